@@ -0,0 +1,316 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* CALIBRATION */
+
+// The maps are interleaved by blocks of LANES pixels: the bias, dark and gain
+// of a block are contiguous so that the kernel reads a single stream and its
+// inner loop is vectorized by the compiler.
+#define LANES 8
+
+typedef struct calib_block {
+    float bias[LANES];
+    float dark[LANES];
+    float gain[LANES];      // inverse flat, 0 for bad pixels
+} calib_block;
+
+// Bad pixel and the good pixels of the same row used to replace it.
+typedef struct bad_pixel {
+    uint32_t x;
+    int32_t left, right;    // -1 if none
+} bad_pixel;
+
+struct tao_common_calib {
+    uint32_t width, height;
+    uint32_t nblocks;       // blocks per row, the last one is padded
+    tao_common_frame_buffer maps;
+    uint32_t* bad_start;    // first bad pixel of each row, height + 1 entries
+    bad_pixel* bad;
+    uint32_t nbad;
+};
+
+tao_status tao_common_calib_create(
+    uint32_t width,
+    uint32_t height,
+    tao_common_calib** calib_ptr)
+{
+    tao_common_calib* calib;
+
+    *calib_ptr = NULL;
+    if (width < 1 || height < 1) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    calib = calloc(1, sizeof(*calib));
+    if (calib == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    calib->width = width;
+    calib->height = height;
+    calib->nblocks = (width + LANES - 1)/LANES;
+    calib->bad_start = calloc(height + 1, sizeof(uint32_t));
+    if (calib->bad_start == NULL) {
+        tao_push_error("calloc", errno);
+        goto error;
+    }
+    if (tao_common_frame_buffer_alloc(
+            &calib->maps, (size_t)calib->nblocks*height*sizeof(calib_block),
+            -1) != TAO_OK) {
+        goto error;
+    }
+    // identity until the maps are set
+    tao_common_calib_set_maps(calib, NULL, NULL, NULL, NULL);
+    *calib_ptr = calib;
+    return TAO_OK;
+
+error:
+    tao_common_calib_destroy(calib);
+    return TAO_ERROR;
+}
+
+// List the bad pixels (zero gain) by row with their nearest good pixels,
+// calib->bad must have room for all of them.
+static void index_bad_pixels(
+    tao_common_calib* calib)
+{
+    const calib_block* blocks = calib->maps.data;
+    uint32_t width = calib->width, height = calib->height;
+    uint32_t n = 0;
+
+    for (uint32_t y = 0; y < height; ++y) {
+        const calib_block* row = blocks + (size_t)y*calib->nblocks;
+        calib->bad_start[y] = n;
+        int32_t left = -1;
+        for (uint32_t x = 0; x < width; ++x) {
+            if (row[x/LANES].gain[x%LANES] != 0) {
+                left = x;
+                continue;
+            }
+            int32_t right = -1;
+            for (uint32_t r = x + 1; r < width; ++r) {
+                if (row[r/LANES].gain[r%LANES] != 0) {
+                    right = r;
+                    break;
+                }
+            }
+            calib->bad[n++] = (bad_pixel){x, left, right};
+        }
+    }
+    calib->bad_start[height] = n;
+    calib->nbad = n;
+}
+
+tao_status tao_common_calib_set_maps(
+    tao_common_calib* calib,
+    const float* bias,
+    const float* dark,
+    const float* flat,
+    const uint8_t* bad)
+{
+    uint32_t width = calib->width, height = calib->height;
+    calib_block* blocks = calib->maps.data;
+    size_t npixels = (size_t)width*height;
+    uint32_t nbad = 0;
+
+    // the list is allocated first so that a failure changes nothing
+    for (size_t i = 0; i < npixels; ++i) {
+        nbad += ((bad != NULL && bad[i] != 0) ||
+                 (flat != NULL && !(flat[i] > 0)));
+    }
+    bad_pixel* list = NULL;
+    if (nbad > 0) {
+        list = malloc(nbad*sizeof(bad_pixel));
+        if (list == NULL) {
+            tao_push_error("malloc", errno);
+            return TAO_ERROR;
+        }
+    }
+    free(calib->bad);
+    calib->bad = list;
+
+    for (uint32_t y = 0; y < height; ++y) {
+        calib_block* row = blocks + (size_t)y*calib->nblocks;
+        for (uint32_t x = 0; x < calib->nblocks*LANES; ++x) {
+            calib_block* b = &row[x/LANES];
+            size_t i = (size_t)y*width + x;
+            int k = x%LANES;
+            if (x >= width) {
+                // padding
+                b->bias[k] = b->dark[k] = b->gain[k] = 0;
+                continue;
+            }
+            float f = (flat != NULL ? flat[i] : 1.0f);
+            int isbad = ((bad != NULL && bad[i] != 0) || !(f > 0));
+            b->bias[k] = (bias != NULL ? bias[i] : 0.0f);
+            b->dark[k] = (dark != NULL ? dark[i] : 0.0f);
+            b->gain[k] = (isbad ? 0.0f : 1.0f/f);
+        }
+    }
+
+    index_bad_pixels(calib);
+    return TAO_OK;
+}
+
+tao_status tao_common_calib_add_bad_pixels(
+    tao_common_calib* calib,
+    const uint32_t* index,
+    uint32_t count)
+{
+    size_t npixels = (size_t)calib->width*calib->height;
+    calib_block* blocks = calib->maps.data;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (index[i] >= npixels) {
+            tao_push_error(__func__, TAO_BAD_VALUE);
+            return TAO_ERROR;
+        }
+    }
+    // room for all, some may already be bad
+    bad_pixel* list = malloc((calib->nbad + count)*sizeof(bad_pixel));
+    if (list == NULL && calib->nbad + count > 0) {
+        tao_push_error("malloc", errno);
+        return TAO_ERROR;
+    }
+    free(calib->bad);
+    calib->bad = list;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t x = index[i]%calib->width, y = index[i]/calib->width;
+        blocks[(size_t)y*calib->nblocks + x/LANES].gain[x%LANES] = 0;
+    }
+    index_bad_pixels(calib);
+    return TAO_OK;
+}
+
+uint32_t tao_common_calib_bad_count(
+    const tao_common_calib* calib)
+{
+    return calib->nbad;
+}
+
+// Calibrate one row, src is a row of pixels of type T.  The kernel is
+// vectorized even at -O2 (GCC 12 and later only vectorize cheap loops there).
+#define CALIBRATE_ROW(T)                                                \
+    static void __attribute__((optimize("tree-vectorize")))             \
+    calibrate_row_##T(                                                  \
+        float* dst, const T* src, const calib_block* blocks,            \
+        uint32_t width, float t)                                        \
+    {                                                                   \
+        uint32_t n = width/LANES;                                       \
+        for (uint32_t j = 0; j < n; ++j) {                              \
+            const calib_block* b = &blocks[j];                          \
+            const T* s = src + j*LANES;                                 \
+            float* d = dst + j*LANES;                                   \
+            for (int k = 0; k < LANES; ++k) {                           \
+                d[k] = ((float)s[k] - b->bias[k] - b->dark[k]*t)*b->gain[k]; \
+            }                                                           \
+        }                                                               \
+        for (uint32_t x = n*LANES; x < width; ++x) {                    \
+            const calib_block* b = &blocks[n];                          \
+            int k = x - n*LANES;                                        \
+            dst[x] = ((float)src[x] - b->bias[k] - b->dark[k]*t)*b->gain[k]; \
+        }                                                               \
+    }
+
+CALIBRATE_ROW(uint8_t)
+CALIBRATE_ROW(uint16_t)
+CALIBRATE_ROW(int16_t)
+CALIBRATE_ROW(float)
+
+typedef struct calib_context {
+    const tao_common_calib* calib;
+    float* dst;
+    const void* src;
+    tao_common_pixel_type type;
+    float exposure;
+} calib_context;
+
+static void calibrate_rows(
+    void* arg,
+    uint32_t y0,
+    uint32_t y1)
+{
+    calib_context* ctx = arg;
+    const tao_common_calib* calib = ctx->calib;
+    uint32_t width = calib->width;
+    for (uint32_t y = y0; y < y1; ++y) {
+        const calib_block* blocks =
+            (const calib_block*)calib->maps.data + (size_t)y*calib->nblocks;
+        float* dst = ctx->dst + (size_t)y*width;
+        size_t offset = (size_t)y*width;
+        switch (ctx->type) {
+        case TAO_COMMON_UINT8:
+            calibrate_row_uint8_t(dst, (const uint8_t*)ctx->src + offset,
+                                  blocks, width, ctx->exposure);
+            break;
+        case TAO_COMMON_UINT16:
+            calibrate_row_uint16_t(dst, (const uint16_t*)ctx->src + offset,
+                                   blocks, width, ctx->exposure);
+            break;
+        case TAO_COMMON_INT16:
+            calibrate_row_int16_t(dst, (const int16_t*)ctx->src + offset,
+                                  blocks, width, ctx->exposure);
+            break;
+        default:
+            calibrate_row_float(dst, (const float*)ctx->src + offset,
+                                blocks, width, ctx->exposure);
+            break;
+        }
+        // the row is still in cache, bad pixels are replaced here
+        for (uint32_t i = calib->bad_start[y]; i < calib->bad_start[y+1]; ++i) {
+            const bad_pixel* p = &calib->bad[i];
+            if (p->left >= 0 && p->right >= 0) {
+                dst[p->x] = 0.5f*(dst[p->left] + dst[p->right]);
+            } else if (p->left >= 0) {
+                dst[p->x] = dst[p->left];
+            } else if (p->right >= 0) {
+                dst[p->x] = dst[p->right];
+            } else {
+                dst[p->x] = 0;
+            }
+        }
+    }
+}
+
+tao_status tao_common_calib_apply(
+    const tao_common_calib* calib,
+    tao_common_pool* pool,
+    float* dst,
+    const void* src,
+    tao_common_pixel_type type,
+    double exposure)
+{
+    if (type != TAO_COMMON_UINT8 && type != TAO_COMMON_UINT16 &&
+        type != TAO_COMMON_INT16 && type != TAO_COMMON_FLOAT32) {
+        tao_push_error(__func__, TAO_BAD_TYPE);
+        return TAO_ERROR;
+    }
+    calib_context ctx = {
+        .calib = calib,
+        .dst = dst,
+        .src = src,
+        .type = type,
+        .exposure = (float)exposure,
+    };
+    // at least a few rows per job
+    tao_common_pool_run_rows(pool, calib->height, 8, calibrate_rows, &ctx);
+    return TAO_OK;
+}
+
+void tao_common_calib_destroy(
+    tao_common_calib* calib)
+{
+    if (calib == NULL) {
+        return;
+    }
+    tao_common_frame_buffer_free(&calib->maps);
+    free(calib->bad_start);
+    free(calib->bad);
+    free(calib);
+}
@@ -0,0 +1,203 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <stdlib.h>
+
+/*---------------------------------------------------------------------------*/
+/* CO-ADDING */
+
+struct tao_common_coadd {
+    uint32_t width, height;
+    tao_common_pixel_type type;         // of the sums
+    uint32_t window;
+    uint32_t count;                     // frames in the current window
+    uint64_t nstacks;
+    tao_common_pool* pool;
+    tao_common_recorder* recorder;      // appends the stacks, may be NULL
+    tao_common_frame_info first;        // first frame of the window
+    tao_common_frame_buffer sums[2];    // accumulated and last stack
+    int current;
+    const tao_common_kernels* kernels;
+};
+
+typedef struct coadd_context {
+    tao_common_coadd* co;
+    const uint16_t* src;
+    void* sum;
+    int store;
+} coadd_context;
+
+static void coadd_rows(
+    void* arg,
+    uint32_t y0,
+    uint32_t y1)
+{
+    coadd_context* ctx = arg;
+    tao_common_coadd* co = ctx->co;
+    size_t offset = (size_t)y0*co->width;
+    size_t n = (size_t)(y1 - y0)*co->width;
+    const tao_common_kernels* k = co->kernels;
+    // the first frame of a window is stored, so the sums are never cleared
+    if (co->type == TAO_COMMON_UINT32) {
+        uint32_t* sum = (uint32_t*)ctx->sum + offset;
+        if (ctx->store) {
+            k->convert_u16_u32(sum, ctx->src + offset, n);
+        } else {
+            k->accumulate_u16_u32(sum, ctx->src + offset, n);
+        }
+    } else {
+        uint64_t* sum = (uint64_t*)ctx->sum + offset;
+        if (ctx->store) {
+            k->convert_u16_u64(sum, ctx->src + offset, n);
+        } else {
+            k->accumulate_u16_u64(sum, ctx->src + offset, n);
+        }
+    }
+}
+
+tao_status tao_common_coadd_create(
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type type,
+    uint32_t window,
+    tao_common_pool* pool,
+    tao_common_stream_writer* writer,
+    tao_common_coadd** co_ptr)
+{
+    tao_common_coadd* co;
+
+    *co_ptr = NULL;
+    if (type != TAO_COMMON_UINT32 && type != TAO_COMMON_UINT64) {
+        tao_push_error(__func__, TAO_BAD_TYPE);
+        return TAO_ERROR;
+    }
+    // 32-bit sums of more than 65537 frames may overflow
+    if (width < 1 || height < 1 || window < 1 ||
+        (type == TAO_COMMON_UINT32 && window > 65537)) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    co = calloc(1, sizeof(*co));
+    if (co == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    co->width = width;
+    co->height = height;
+    co->type = type;
+    co->window = window;
+    co->pool = pool;
+    co->kernels = tao_common_kernels_get();
+    size_t size = (size_t)width*height*tao_common_pixel_size(type);
+    for (int i = 0; i < 2; ++i) {
+        if (tao_common_frame_buffer_alloc(&co->sums[i], size, -1) != TAO_OK) {
+            tao_common_coadd_destroy(co);
+            return TAO_ERROR;
+        }
+    }
+    // a single slot: a stack is written while the next one is accumulated
+    // in the other buffer
+    if (writer != NULL &&
+        tao_common_recorder_create(writer, 1, 0, NULL,
+                                   &co->recorder) != TAO_OK) {
+        tao_common_coadd_destroy(co);
+        return TAO_ERROR;
+    }
+    *co_ptr = co;
+    return TAO_OK;
+}
+
+// Hand out the current sums and switch to the other buffer.  The previous
+// stack, in the other buffer, is written before the sums are queued.
+static tao_status emit(
+    tao_common_coadd* co,
+    const void** stack_ptr)
+{
+    void* sum = co->sums[co->current].data;
+    tao_common_frame_info info = co->first;
+
+    info.id = co->nstacks;
+    co->nstacks += 1;
+    co->count = 0;
+    co->current ^= 1;
+    if (stack_ptr != NULL) {
+        *stack_ptr = sum;
+    }
+    if (co->recorder != NULL) {
+        return tao_common_recorder_submit(co->recorder, sum, &info);
+    }
+    return TAO_OK;
+}
+
+tao_status tao_common_coadd_add(
+    tao_common_coadd* co,
+    const uint16_t* frame,
+    const tao_common_frame_info* info,
+    const void** stack_ptr)
+{
+    if (stack_ptr != NULL) {
+        *stack_ptr = NULL;
+    }
+    if (co->count == 0) {
+        if (info != NULL) {
+            co->first = *info;
+        } else {
+            co->first.host_time = tao_common_monotonic_time();
+            co->first.camera_time = 0;
+        }
+    }
+    coadd_context ctx = {
+        .co = co,
+        .src = frame,
+        .sum = co->sums[co->current].data,
+        .store = (co->count == 0),
+    };
+    tao_common_pool_run_rows(co->pool, co->height, 8, coadd_rows, &ctx);
+    co->count += 1;
+    if (co->count < co->window) {
+        return TAO_OK;
+    }
+    return emit(co, stack_ptr);
+}
+
+tao_status tao_common_coadd_flush(
+    tao_common_coadd* co,
+    const void** stack_ptr,
+    uint32_t* nframes)
+{
+    if (stack_ptr != NULL) {
+        *stack_ptr = NULL;
+    }
+    if (nframes != NULL) {
+        *nframes = co->count;
+    }
+    if (co->count > 0 && emit(co, stack_ptr) != TAO_OK) {
+        return TAO_ERROR;
+    }
+    if (co->recorder != NULL) {
+        return tao_common_recorder_sync(co->recorder);
+    }
+    return TAO_OK;
+}
+
+uint64_t tao_common_coadd_stacks(
+    const tao_common_coadd* co)
+{
+    return co->nstacks;
+}
+
+void tao_common_coadd_destroy(
+    tao_common_coadd* co)
+{
+    if (co == NULL) {
+        return;
+    }
+    // stacks not flushed are still written, a failure is left on the error
+    // stack of the caller
+    tao_common_recorder_close(co->recorder);
+    tao_common_frame_buffer_free(&co->sums[0]);
+    tao_common_frame_buffer_free(&co->sums[1]);
+    free(co);
+}
@@ -0,0 +1,408 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* COMPRESSION */
+
+// Parameters of the Rice coding of 16-bit pixels in FITS (RICE_1).
+#define RICE_BLOCK  32   // pixels per block
+#define RICE_FSBITS  4   // bits of the code of a block
+#define RICE_FSMAX  14   // larger split levels are coded as raw values
+#define RICE_BBITS  16   // bits of a raw value
+
+// Maximum size of a coded tile of `n` pixels: the first value, then for each
+// block its code and at worst raw values (the encoder never does worse).
+static size_t tile_bound(
+    size_t n)
+{
+    size_t nblocks = (n + RICE_BLOCK - 1)/RICE_BLOCK;
+    return 2 + (nblocks*(RICE_FSBITS + RICE_BLOCK*RICE_BBITS) + 7)/8;
+}
+
+static uint32_t count_tiles(
+    uint32_t height,
+    uint32_t tile_rows)
+{
+    return (height + tile_rows - 1)/tile_rows;
+}
+
+size_t tao_common_compress_bound(
+    uint32_t width,
+    uint32_t height,
+    uint32_t tile_rows)
+{
+    if (tile_rows < 1) {
+        tile_rows = TAO_COMMON_COMPRESS_TILE_ROWS;
+    }
+    if (tile_rows > height) {
+        tile_rows = height;
+    }
+    uint32_t ntiles = count_tiles(height, tile_rows);
+    return 4*(size_t)ntiles + ntiles*tile_bound((size_t)width*tile_rows);
+}
+
+typedef struct bit_writer {
+    unsigned char* ptr;
+    uint64_t buf;           // pending bits in the least significant bits
+    int nbits;
+} bit_writer;
+
+// Write the `n` least significant bits of `value`, most significant first
+// (n <= 32).
+static inline void put_bits(
+    bit_writer* bw,
+    uint32_t value,
+    int n)
+{
+    bw->buf = (bw->buf << n) | (value & (uint32_t)((1ull << n) - 1));
+    bw->nbits += n;
+    while (bw->nbits >= 8) {
+        bw->nbits -= 8;
+        *bw->ptr++ = (unsigned char)(bw->buf >> bw->nbits);
+    }
+}
+
+static inline void put_zeros(
+    bit_writer* bw,
+    uint32_t n)
+{
+    while (n > 32) {
+        put_bits(bw, 0, 32);
+        n -= 32;
+    }
+    put_bits(bw, 0, n);
+}
+
+static void flush_bits(
+    bit_writer* bw)
+{
+    if (bw->nbits > 0) {
+        *bw->ptr++ = (unsigned char)(bw->buf << (8 - bw->nbits));
+        bw->nbits = 0;
+    }
+}
+
+// Code `n` pixels with Rice algorithm, `flip` is 0x8000 for unsigned pixels
+// (stored with an offset in FITS) and 0 otherwise.  Yields the number of
+// bytes written.
+static size_t rice_encode(
+    unsigned char* dst,
+    const uint16_t* src,
+    size_t n,
+    uint16_t flip)
+{
+    bit_writer bw = {dst, 0, 0};
+    uint16_t diff[RICE_BLOCK];
+    uint16_t last = src[0];
+
+    put_bits(&bw, last ^ flip, RICE_BBITS);
+    for (size_t i = 0; i < n; i += RICE_BLOCK) {
+        int len = (n - i < RICE_BLOCK ? (int)(n - i) : RICE_BLOCK);
+        uint32_t sum = 0;
+        for (int j = 0; j < len; ++j) {
+            // differences modulo 2^16 mapped to non-negative values
+            uint32_t d = (uint16_t)(src[i + j] - last);
+            diff[j] = (uint16_t)((d & 0x8000) ? ~(d << 1) : (d << 1));
+            sum += diff[j];
+            last = src[i + j];
+        }
+        // split level from the mean as CFITSIO does
+        double dpsum = ((double)sum - (len/2) - 1)/len;
+        if (dpsum < 0) {
+            dpsum = 0;
+        }
+        int fs = 0;
+        for (uint32_t psum = ((uint32_t)dpsum) >> 1; psum > 0; psum >>= 1) {
+            ++fs;
+        }
+        if (fs == 0 && sum == 0) {
+            // low entropy: all differences are zero
+            put_bits(&bw, 0, RICE_FSBITS);
+            continue;
+        }
+        if (fs < RICE_FSMAX) {
+            // keep raw coding for the rare blocks where splitting is worse
+            uint32_t bits = 0;
+            for (int j = 0; j < len; ++j) {
+                bits += (diff[j] >> fs) + 1 + fs;
+            }
+            if (bits > (uint32_t)len*RICE_BBITS) {
+                fs = RICE_FSMAX;
+            }
+        }
+        if (fs >= RICE_FSMAX) {
+            // high entropy: raw differences
+            put_bits(&bw, RICE_FSMAX + 1, RICE_FSBITS);
+            for (int j = 0; j < len; ++j) {
+                put_bits(&bw, diff[j], RICE_BBITS);
+            }
+            continue;
+        }
+        put_bits(&bw, fs + 1, RICE_FSBITS);
+        for (int j = 0; j < len; ++j) {
+            // unary coded high part then the fs low bits
+            put_zeros(&bw, diff[j] >> fs);
+            put_bits(&bw, 1, 1);
+            if (fs > 0) {
+                put_bits(&bw, diff[j], fs);
+            }
+        }
+    }
+    flush_bits(&bw);
+    return bw.ptr - dst;
+}
+
+typedef struct bit_reader {
+    const unsigned char* ptr;
+    const unsigned char* end;
+    uint64_t buf;           // pending bits in the most significant bits
+    int nbits;
+    size_t overrun;         // bytes read past the end
+} bit_reader;
+
+static inline void refill(
+    bit_reader* br)
+{
+    while (br->nbits <= 56) {
+        uint64_t byte;
+        if (br->ptr < br->end) {
+            byte = *br->ptr++;
+        } else {
+            byte = 0;
+            ++br->overrun;
+        }
+        br->buf |= byte << (56 - br->nbits);
+        br->nbits += 8;
+    }
+}
+
+// Read `n` bits (1 <= n <= 32).
+static inline uint32_t get_bits(
+    bit_reader* br,
+    int n)
+{
+    refill(br);
+    uint32_t value = (uint32_t)(br->buf >> (64 - n));
+    br->buf <<= n;
+    br->nbits -= n;
+    return value;
+}
+
+// Count and skip zeros up to the next one (also skipped).  Yields -1 if the
+// data are exhausted.
+static inline long get_unary(
+    bit_reader* br)
+{
+    long zeros = 0;
+    while (1) {
+        refill(br);
+        if (br->buf != 0) {
+            int lz = __builtin_clzll(br->buf);
+            br->buf <<= lz;
+            br->buf <<= 1;
+            br->nbits -= lz + 1;
+            return zeros + lz;
+        }
+        zeros += br->nbits;
+        br->nbits = 0;
+        if (br->overrun > 8) {
+            return -1;
+        }
+    }
+}
+
+// Decode `n` pixels, yields 0 on success and -1 if the data are corrupted.
+static int rice_decode(
+    uint16_t* dst,
+    const unsigned char* src,
+    size_t size,
+    size_t n,
+    uint16_t flip)
+{
+    bit_reader br = {src, src + size, 0, 0, 0};
+    uint16_t last = (uint16_t)(get_bits(&br, RICE_BBITS) ^ flip);
+
+    for (size_t i = 0; i < n; i += RICE_BLOCK) {
+        int len = (n - i < RICE_BLOCK ? (int)(n - i) : RICE_BLOCK);
+        int fs = (int)get_bits(&br, RICE_FSBITS) - 1;
+        if (fs < 0) {
+            for (int j = 0; j < len; ++j) {
+                dst[i + j] = last;
+            }
+            continue;
+        }
+        for (int j = 0; j < len; ++j) {
+            uint32_t diff;
+            if (fs >= RICE_FSMAX) {
+                diff = get_bits(&br, RICE_BBITS);
+            } else {
+                long top = get_unary(&br);
+                if (top < 0) {
+                    return -1;
+                }
+                diff = (uint32_t)top << fs;
+                if (fs > 0) {
+                    diff |= get_bits(&br, fs);
+                }
+            }
+            diff = ((diff & 1) == 0 ? diff >> 1 : ~(diff >> 1));
+            last = (uint16_t)(last + diff);
+            dst[i + j] = last;
+        }
+    }
+    // bits consumed must not exceed the coded size
+    size_t used = (br.ptr - src + br.overrun)*8 - br.nbits;
+    return (used <= size*8 ? 0 : -1);
+}
+
+typedef struct tile_context {
+    unsigned char* coded;       // compressed frame
+    uint16_t* pixels;           // raw frame
+    const uint32_t* offsets;    // offsets of the tiles (decompression)
+    uint32_t* sizes;            // sizes of the tiles
+    uint32_t width;
+    uint32_t height;
+    uint32_t tile_rows;
+    uint32_t ntiles;
+    uint16_t flip;
+    int failed;
+} tile_context;
+
+static void encode_tile(
+    void* arg,
+    int t)
+{
+    tile_context* ctx = arg;
+    uint32_t row = t*ctx->tile_rows;
+    uint32_t nrows = (ctx->height - row < ctx->tile_rows ?
+                      ctx->height - row : ctx->tile_rows);
+    size_t bound = tile_bound((size_t)ctx->width*ctx->tile_rows);
+    // each tile has its own slot, tiles are packed once all are done
+    unsigned char* dst = ctx->coded + 4*(size_t)ctx->ntiles + t*bound;
+    ctx->sizes[t] = (uint32_t)rice_encode(
+        dst, ctx->pixels + (size_t)row*ctx->width,
+        (size_t)nrows*ctx->width, ctx->flip);
+}
+
+static void decode_tile(
+    void* arg,
+    int t)
+{
+    tile_context* ctx = arg;
+    uint32_t row = t*ctx->tile_rows;
+    uint32_t nrows = (ctx->height - row < ctx->tile_rows ?
+                      ctx->height - row : ctx->tile_rows);
+    if (rice_decode(ctx->pixels + (size_t)row*ctx->width,
+                    ctx->coded + ctx->offsets[t], ctx->sizes[t],
+                    (size_t)nrows*ctx->width, ctx->flip) != 0) {
+        __atomic_store_n(&ctx->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int check_parameters(
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t* tile_rows)
+{
+    if (*tile_rows < 1) {
+        *tile_rows = TAO_COMMON_COMPRESS_TILE_ROWS;
+    }
+    if (*tile_rows > height) {
+        *tile_rows = height;
+    }
+    return (width >= 1 && height >= 1 &&
+            (pixel_type == TAO_COMMON_UINT16 || pixel_type == TAO_COMMON_INT16));
+}
+
+size_t tao_common_compress_frame(
+    tao_common_pool* pool,
+    void* dst,
+    const void* src,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t tile_rows)
+{
+    if (!check_parameters(width, height, pixel_type, &tile_rows)) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return 0;
+    }
+    uint32_t ntiles = count_tiles(height, tile_rows);
+    uint32_t sizes[ntiles];
+    tile_context ctx = {
+        .coded = dst,
+        .pixels = (uint16_t*)src,
+        .sizes = sizes,
+        .width = width,
+        .height = height,
+        .tile_rows = tile_rows,
+        .ntiles = ntiles,
+        .flip = (pixel_type == TAO_COMMON_UINT16 ? 0x8000 : 0),
+    };
+    tao_common_pool_run(pool, ntiles, encode_tile, &ctx);
+
+    // table of sizes then packed tiles
+    unsigned char* out = dst;
+    size_t bound = tile_bound((size_t)width*tile_rows);
+    size_t size = 4*(size_t)ntiles;
+    for (uint32_t t = 0; t < ntiles; ++t) {
+        memmove(out + size, out + 4*(size_t)ntiles + t*bound, sizes[t]);
+        size += sizes[t];
+    }
+    memcpy(out, sizes, sizeof(sizes));
+    return size;
+}
+
+tao_status tao_common_decompress_frame(
+    tao_common_pool* pool,
+    void* dst,
+    const void* src,
+    size_t size,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t tile_rows)
+{
+    if (!check_parameters(width, height, pixel_type, &tile_rows)) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    uint32_t ntiles = count_tiles(height, tile_rows);
+    uint32_t sizes[ntiles], offsets[ntiles];
+    size_t offset = 4*(size_t)ntiles;
+    if (size < offset) {
+        goto corrupted;
+    }
+    memcpy(sizes, src, sizeof(sizes));
+    for (uint32_t t = 0; t < ntiles; ++t) {
+        if (sizes[t] > size - offset) {
+            goto corrupted;
+        }
+        offsets[t] = (uint32_t)offset;
+        offset += sizes[t];
+    }
+    tile_context ctx = {
+        .coded = (unsigned char*)src,
+        .pixels = dst,
+        .offsets = offsets,
+        .sizes = sizes,
+        .width = width,
+        .height = height,
+        .tile_rows = tile_rows,
+        .ntiles = ntiles,
+        .flip = (pixel_type == TAO_COMMON_UINT16 ? 0x8000 : 0),
+    };
+    tao_common_pool_run(pool, ntiles, decode_tile, &ctx);
+    if (ctx.failed) {
+        goto corrupted;
+    }
+    return TAO_OK;
+
+corrupted:
+    tao_push_error(__func__, TAO_CORRUPTED);
+    return TAO_ERROR;
+}
@@ -0,0 +1,291 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* DEFECTIVE PIXELS */
+
+// Running statistics are kept as separate arrays (structure of arrays) and
+// all pixels share the number of frames, so the Welford update of a row is a
+// plain loop over contiguous floats.
+struct tao_common_defects {
+    uint32_t width, height;
+    uint32_t nframes;
+    float* mean;
+    float* m2;              // sum of squared deviations from the mean
+};
+
+tao_status tao_common_defects_create(
+    uint32_t width,
+    uint32_t height,
+    tao_common_defects** def_ptr)
+{
+    tao_common_defects* def;
+    size_t npixels = (size_t)width*height;
+
+    *def_ptr = NULL;
+    if (width < 1 || height < 1) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    def = calloc(1, sizeof(*def));
+    if (def == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    def->width = width;
+    def->height = height;
+    def->mean = calloc(npixels, sizeof(float));
+    def->m2 = calloc(npixels, sizeof(float));
+    if (def->mean == NULL || def->m2 == NULL) {
+        tao_push_error("calloc", errno);
+        tao_common_defects_destroy(def);
+        return TAO_ERROR;
+    }
+    *def_ptr = def;
+    return TAO_OK;
+}
+
+void tao_common_defects_reset(
+    tao_common_defects* def)
+{
+    size_t npixels = (size_t)def->width*def->height;
+    def->nframes = 0;
+    memset(def->mean, 0, npixels*sizeof(float));
+    memset(def->m2, 0, npixels*sizeof(float));
+}
+
+uint32_t tao_common_defects_frames(
+    const tao_common_defects* def)
+{
+    return def->nframes;
+}
+
+// Welford update of n pixels of type T, w = 1/nframes.
+#define UPDATE_ROW(T)                                                   \
+    static void __attribute__((optimize("tree-vectorize")))             \
+    update_row_##T(                                                     \
+        float* restrict mean, float* restrict m2, const T* restrict src, \
+        uint32_t n, float w)                                            \
+    {                                                                   \
+        for (uint32_t i = 0; i < n; ++i) {                              \
+            float x = (float)src[i];                                    \
+            float d = x - mean[i];                                      \
+            mean[i] += d*w;                                             \
+            m2[i] += d*(x - mean[i]);                                   \
+        }                                                               \
+    }
+
+UPDATE_ROW(uint8_t)
+UPDATE_ROW(uint16_t)
+UPDATE_ROW(int16_t)
+UPDATE_ROW(float)
+
+typedef struct update_context {
+    tao_common_defects* def;
+    const void* src;
+    tao_common_pixel_type type;
+    float weight;
+} update_context;
+
+static void update_rows(
+    void* arg,
+    uint32_t y0,
+    uint32_t y1)
+{
+    update_context* ctx = arg;
+    tao_common_defects* def = ctx->def;
+    size_t offset = (size_t)y0*def->width;
+    uint32_t n = (y1 - y0)*def->width;
+    float* mean = def->mean + offset;
+    float* m2 = def->m2 + offset;
+    switch (ctx->type) {
+    case TAO_COMMON_UINT8:
+        update_row_uint8_t(mean, m2, (const uint8_t*)ctx->src + offset, n,
+                           ctx->weight);
+        break;
+    case TAO_COMMON_UINT16:
+        update_row_uint16_t(mean, m2, (const uint16_t*)ctx->src + offset, n,
+                            ctx->weight);
+        break;
+    case TAO_COMMON_INT16:
+        update_row_int16_t(mean, m2, (const int16_t*)ctx->src + offset, n,
+                           ctx->weight);
+        break;
+    default:
+        update_row_float(mean, m2, (const float*)ctx->src + offset, n,
+                         ctx->weight);
+        break;
+    }
+}
+
+tao_status tao_common_defects_add(
+    tao_common_defects* def,
+    tao_common_pool* pool,
+    const void* frame,
+    tao_common_pixel_type type)
+{
+    if (type != TAO_COMMON_UINT8 && type != TAO_COMMON_UINT16 &&
+        type != TAO_COMMON_INT16 && type != TAO_COMMON_FLOAT32) {
+        tao_push_error(__func__, TAO_BAD_TYPE);
+        return TAO_ERROR;
+    }
+    def->nframes += 1;
+    update_context ctx = {
+        .def = def,
+        .src = frame,
+        .type = type,
+        .weight = 1.0f/def->nframes,
+    };
+    tao_common_pool_run_rows(pool, def->height, 8, update_rows, &ctx);
+    return TAO_OK;
+}
+
+void tao_common_defect_config_init(
+    tao_common_defect_config* cfg)
+{
+    cfg->hot = 5.0;
+    cfg->cold = 5.0;
+    cfg->stuck = 0.1;
+    cfg->noisy = 3.0;
+}
+
+// Median of n values, the values are reordered.
+static float median(
+    float* val,
+    size_t n)
+{
+    // quickselect of the element of rank n/2
+    ptrdiff_t lo = 0, hi = n - 1, k = n/2;
+    while (lo < hi) {
+        float pivot = val[(lo + hi)/2];
+        ptrdiff_t i = lo, j = hi;
+        while (i <= j) {
+            while (val[i] < pivot) ++i;
+            while (val[j] > pivot) --j;
+            if (i <= j) {
+                float tmp = val[i];
+                val[i++] = val[j];
+                val[j--] = tmp;
+            }
+        }
+        if (k <= j) {
+            hi = j;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+    return val[k];
+}
+
+tao_status tao_common_defects_find(
+    const tao_common_defects* def,
+    const tao_common_defect_config* cfg,
+    uint32_t** list_ptr,
+    uint8_t** kinds_ptr,
+    uint32_t* count_ptr)
+{
+    size_t npixels = (size_t)def->width*def->height;
+    tao_common_defect_config defaultConfig;
+    float* work = NULL;
+    uint32_t* list = NULL;
+    uint8_t* kinds = NULL;
+
+    *list_ptr = NULL;
+    if (kinds_ptr != NULL) {
+        *kinds_ptr = NULL;
+    }
+    *count_ptr = 0;
+    if (def->nframes < 2) {
+        tao_push_error(__func__, TAO_NO_DATA);
+        return TAO_ERROR;
+    }
+    if (cfg == NULL) {
+        tao_common_defect_config_init(&defaultConfig);
+        cfg = &defaultConfig;
+    }
+    work = malloc(npixels*sizeof(float));
+    if (work == NULL) {
+        tao_push_error("malloc", errno);
+        return TAO_ERROR;
+    }
+
+    // robust level and spread of the means, median noise
+    memcpy(work, def->mean, npixels*sizeof(float));
+    float level = median(work, npixels);
+    for (size_t i = 0; i < npixels; ++i) {
+        work[i] = fabsf(def->mean[i] - level);
+    }
+    float spread = 1.4826f*median(work, npixels);
+    float scale = 1.0f/(def->nframes - 1);
+    for (size_t i = 0; i < npixels; ++i) {
+        work[i] = def->m2[i]*scale;
+    }
+    float noise = median(work, npixels);   // median variance
+    // a spread of the means below their statistical error (e.g. a perfectly
+    // flat bias) would flag every pixel off the median
+    float error = sqrtf(noise/def->nframes);
+    if (spread < error) {
+        spread = error;
+    }
+    float hot = level + (float)cfg->hot*spread;
+    float cold = level - (float)cfg->cold*spread;
+    float stuck = (float)(cfg->stuck*cfg->stuck)*noise;
+    float noisy = (float)(cfg->noisy*cfg->noisy)*noise;
+    free(work);
+
+    uint32_t count = 0;
+    for (size_t i = 0; i < npixels; ++i) {
+        float m = def->mean[i], v = def->m2[i]*scale;
+        count += (m > hot || m < cold || v < stuck || v > noisy);
+    }
+    if (count > 0) {
+        list = malloc(count*sizeof(uint32_t));
+        kinds = (kinds_ptr != NULL ? malloc(count) : NULL);
+        if (list == NULL || (kinds_ptr != NULL && kinds == NULL)) {
+            tao_push_error("malloc", errno);
+            free(list);
+            free(kinds);
+            return TAO_ERROR;
+        }
+    }
+    uint32_t n = 0;
+    for (size_t i = 0; i < npixels; ++i) {
+        float m = def->mean[i], v = def->m2[i]*scale;
+        int kind = ((m > hot ? TAO_COMMON_DEFECT_HOT : 0) |
+                    (m < cold || v < stuck ? TAO_COMMON_DEFECT_DEAD : 0) |
+                    (v > noisy ? TAO_COMMON_DEFECT_NOISY : 0));
+        if (kind != 0) {
+            list[n] = i;
+            if (kinds != NULL) {
+                kinds[n] = kind;
+            }
+            ++n;
+        }
+    }
+    *list_ptr = list;
+    if (kinds_ptr != NULL) {
+        *kinds_ptr = kinds;
+    }
+    *count_ptr = count;
+    return TAO_OK;
+}
+
+void tao_common_defects_destroy(
+    tao_common_defects* def)
+{
+    if (def == NULL) {
+        return;
+    }
+    free(def->mean);
+    free(def->m2);
+    free(def);
+}
@@ -0,0 +1,662 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* FITS HEADERS */
+
+#define FITS_BLOCK 2880
+#define FITS_CARDS_PER_BLOCK 36
+#define NSEC_PER_DAY ((int64_t)86400*1000000000)
+
+typedef struct fits_field {
+    int offset;             // offset of the value in the header
+    tao_common_fits_kind kind;
+} fits_field;
+
+struct tao_common_fits_header {
+    tao_common_pixel_type pixel_type;
+    size_t data_size;       // bytes of pixels per frame
+    int ncards;             // cards before END
+    int nfields;
+    fits_field field[TAO_COMMON_FITS_MAX_FIELDS];
+    int64_t day;            // day of `date` (days since the Epoch)
+    char date[11];          // "YYYY-MM-DD" of `day`
+    char cards[TAO_COMMON_FITS_MAX_CARDS + 1][80];  // room for END
+};
+
+// Write the END card and blank the rest of the last block.
+static void fits_end(
+    tao_common_fits_header* hdr)
+{
+    int nblocks = hdr->ncards/FITS_CARDS_PER_BLOCK + 1;
+    memset(hdr->cards[hdr->ncards], ' ',
+           (nblocks*FITS_CARDS_PER_BLOCK - hdr->ncards)*80);
+    memcpy(hdr->cards[hdr->ncards], "END", 3);
+}
+
+// Append a card, the text is truncated or blank-padded to 80 characters.
+static tao_status fits_card(
+    tao_common_fits_header* hdr,
+    const char* fmt,
+    ...)
+{
+    char card[81];
+    va_list args;
+
+    if (hdr->ncards >= TAO_COMMON_FITS_MAX_CARDS) {
+        tao_push_error(__func__, TAO_EXHAUSTED);
+        return TAO_ERROR;
+    }
+    va_start(args, fmt);
+    vsnprintf(card, sizeof(card), fmt, args);
+    va_end(args);
+    size_t len = strlen(card);
+    memset(hdr->cards[hdr->ncards], ' ', 80);
+    memcpy(hdr->cards[hdr->ncards], card, len);
+    hdr->ncards += 1;
+    fits_end(hdr);
+    return TAO_OK;
+}
+
+static int valid_key(
+    const char* key)
+{
+    size_t len = strlen(key);
+    if (len == 0 || len > 8) {
+        return 0;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        char c = key[i];
+        if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '-' || c == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+tao_status tao_common_fits_header_create(
+    tao_common_pixel_type type,
+    int width,
+    int height,
+    int depth,
+    tao_common_fits_header** hdr_ptr)
+{
+    tao_common_fits_header* hdr;
+    const char* bzero = NULL;
+    int bitpix;
+
+    *hdr_ptr = NULL;
+    switch (type) {
+    case TAO_COMMON_UINT8:   bitpix =   8; break;
+    case TAO_COMMON_UINT16:  bitpix =  16; bzero = "32768"; break;
+    case TAO_COMMON_INT16:   bitpix =  16; break;
+    case TAO_COMMON_UINT32:  bitpix =  32; bzero = "2147483648"; break;
+    case TAO_COMMON_INT32:   bitpix =  32; break;
+    case TAO_COMMON_FLOAT32: bitpix = -32; break;
+    case TAO_COMMON_FLOAT64: bitpix = -64; break;
+    case TAO_COMMON_UINT64:  bitpix =  64; bzero = "9223372036854775808"; break;
+    default:
+        tao_push_error(__func__, TAO_BAD_TYPE);
+        return TAO_ERROR;
+    }
+    if (width < 1 || height < 1 || depth < 0) {
+        tao_push_error(__func__, TAO_BAD_SIZE);
+        return TAO_ERROR;
+    }
+    hdr = calloc(1, sizeof(*hdr));
+    if (hdr == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    hdr->pixel_type = type;
+    hdr->data_size = (size_t)width*height*tao_common_pixel_size(type);
+    hdr->day = INT64_MIN;
+    fits_card(hdr, "SIMPLE  = %20s", "T");
+    fits_card(hdr, "BITPIX  = %20d", bitpix);
+    fits_card(hdr, "NAXIS   = %20d", (depth > 0 ? 3 : 2));
+    fits_card(hdr, "NAXIS1  = %20d", width);
+    fits_card(hdr, "NAXIS2  = %20d", height);
+    if (depth > 0) {
+        fits_card(hdr, "NAXIS3  = %20d", depth);
+    }
+    if (bzero != NULL) {
+        fits_card(hdr, "BZERO   = %20s", bzero);
+        fits_card(hdr, "BSCALE  = %20d", 1);
+    }
+    *hdr_ptr = hdr;
+    return TAO_OK;
+}
+
+void tao_common_fits_header_destroy(
+    tao_common_fits_header* hdr)
+{
+    free(hdr);
+}
+
+tao_status tao_common_fits_header_add_int(
+    tao_common_fits_header* hdr,
+    const char* key,
+    long long value,
+    const char* comment)
+{
+    if (!valid_key(key)) {
+        tao_push_error(__func__, TAO_BAD_ARGUMENT);
+        return TAO_ERROR;
+    }
+    return fits_card(hdr, "%-8s= %20lld%s%.47s", key, value,
+                     (comment != NULL ? " / " : ""),
+                     (comment != NULL ? comment : ""));
+}
+
+tao_status tao_common_fits_header_add_real(
+    tao_common_fits_header* hdr,
+    const char* key,
+    double value,
+    const char* comment)
+{
+    if (!valid_key(key)) {
+        tao_push_error(__func__, TAO_BAD_ARGUMENT);
+        return TAO_ERROR;
+    }
+    return fits_card(hdr, "%-8s= %20.12G%s%.47s", key, value,
+                     (comment != NULL ? " / " : ""),
+                     (comment != NULL ? comment : ""));
+}
+
+tao_status tao_common_fits_header_add_string(
+    tao_common_fits_header* hdr,
+    const char* key,
+    const char* value,
+    const char* comment)
+{
+    char str[69];
+    int len = 0;
+
+    if (!valid_key(key)) {
+        tao_push_error(__func__, TAO_BAD_ARGUMENT);
+        return TAO_ERROR;
+    }
+    // quotes are doubled, strings are padded to 8 characters
+    for (const char* s = value; *s != '\0' && len < 66; ++s) {
+        if (*s == '\'') {
+            str[len++] = '\'';
+        }
+        str[len++] = *s;
+    }
+    while (len < 8) {
+        str[len++] = ' ';
+    }
+    str[len] = '\0';
+    return fits_card(hdr, "%-8s= '%s'%s%.40s", key, str,
+                     (comment != NULL ? " / " : ""),
+                     (comment != NULL ? comment : ""));
+}
+
+tao_status tao_common_fits_header_add_comment(
+    tao_common_fits_header* hdr,
+    const char* text)
+{
+    return fits_card(hdr, "COMMENT %.72s", text);
+}
+
+int tao_common_fits_header_add_field(
+    tao_common_fits_header* hdr,
+    const char* key,
+    tao_common_fits_kind kind,
+    const char* comment)
+{
+    const char* blank;
+
+    if (!valid_key(key) ||
+        (kind != TAO_COMMON_FITS_INT && kind != TAO_COMMON_FITS_REAL &&
+         kind != TAO_COMMON_FITS_DATE)) {
+        tao_push_error(__func__, TAO_BAD_ARGUMENT);
+        return -1;
+    }
+    if (hdr->nfields >= TAO_COMMON_FITS_MAX_FIELDS) {
+        tao_push_error(__func__, TAO_EXHAUSTED);
+        return -1;
+    }
+    // the value is rendered as 0 until set
+    if (kind == TAO_COMMON_FITS_DATE) {
+        blank = "'1970-01-01T00:00:00.000000000'";
+    } else {
+        blank = "                   0";
+    }
+    if (fits_card(hdr, "%-8s= %s%s%.40s", key, blank,
+                  (comment != NULL ? " / " : ""),
+                  (comment != NULL ? comment : "")) != TAO_OK) {
+        return -1;
+    }
+    fits_field* field = &hdr->field[hdr->nfields];
+    field->offset = (hdr->ncards - 1)*80 + 10;
+    field->kind = kind;
+    return hdr->nfields++;
+}
+
+// Write the n digits of an unsigned value ending at `end` (exclusive).
+static char* put_digits(
+    char* end,
+    uint64_t value,
+    int n)
+{
+    for (int i = 0; i < n; ++i) {
+        *--end = '0' + value%10;
+        value /= 10;
+    }
+    return end;
+}
+
+// Year, month and day of a number of days since 1970-01-01.
+static void civil_from_days(
+    int64_t days,
+    int64_t* year,
+    int* month,
+    int* day)
+{
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096)/146097;
+    int64_t doe = days - era*146097;
+    int64_t yoe = (doe - doe/1460 + doe/36524 - doe/146096)/365;
+    int64_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+    int64_t mp = (5*doy + 2)/153;
+    *day = (int)(doy - (153*mp + 2)/5 + 1);
+    *month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    *year = yoe + era*400 + (*month <= 2);
+}
+
+void tao_common_fits_header_set_int(
+    tao_common_fits_header* hdr,
+    int field,
+    long long value)
+{
+    if (field < 0 || field >= hdr->nfields) {
+        return;
+    }
+    char* val = (char*)hdr->cards + hdr->field[field].offset;
+    if (hdr->field[field].kind == TAO_COMMON_FITS_REAL) {
+        tao_common_fits_header_set_real(hdr, field, (double)value);
+        return;
+    }
+    if (hdr->field[field].kind != TAO_COMMON_FITS_INT) {
+        return;
+    }
+    // right-justified in 20 columns without snprintf
+    unsigned long long mag = (value < 0 ? 0ULL - (unsigned long long)value
+                              : (unsigned long long)value);
+    char* end = val + 20;
+    do {
+        *--end = '0' + mag%10;
+        mag /= 10;
+    } while (mag != 0 && end > val);
+    if (value < 0 && end > val) {
+        *--end = '-';
+    }
+    memset(val, ' ', end - val);
+}
+
+void tao_common_fits_header_set_real(
+    tao_common_fits_header* hdr,
+    int field,
+    double value)
+{
+    char str[32];
+
+    if (field < 0 || field >= hdr->nfields ||
+        hdr->field[field].kind != TAO_COMMON_FITS_REAL) {
+        return;
+    }
+    snprintf(str, sizeof(str), "%20.12G", value);
+    memcpy((char*)hdr->cards + hdr->field[field].offset, str, 20);
+}
+
+void tao_common_fits_header_set_date(
+    tao_common_fits_header* hdr,
+    int field,
+    int64_t time)
+{
+    if (field < 0 || field >= hdr->nfields ||
+        hdr->field[field].kind != TAO_COMMON_FITS_DATE) {
+        return;
+    }
+    int64_t day = (time >= 0 ? time/NSEC_PER_DAY
+                   : -((-time + NSEC_PER_DAY - 1)/NSEC_PER_DAY));
+    int64_t nsec = time - day*NSEC_PER_DAY;
+    if (day != hdr->day) {
+        // the date is only converted when the day changes
+        int64_t year;
+        int month, mday;
+        civil_from_days(day, &year, &month, &mday);
+        memcpy(hdr->date, "0000-00-00", 11);
+        put_digits(hdr->date + 4, (uint64_t)(year%10000), 4);
+        put_digits(hdr->date + 7, month, 2);
+        put_digits(hdr->date + 10, mday, 2);
+        hdr->day = day;
+    }
+    // 'YYYY-MM-DDThh:mm:ss.nnnnnnnnn'
+    char* val = (char*)hdr->cards + hdr->field[field].offset;
+    int64_t sec = nsec/1000000000;
+    memcpy(val + 1, hdr->date, 10);
+    put_digits(val + 30, nsec%1000000000, 9);
+    put_digits(val + 20, sec%60, 2);
+    put_digits(val + 17, (sec/60)%60, 2);
+    put_digits(val + 14, sec/3600, 2);
+}
+
+const void* tao_common_fits_header_data(
+    const tao_common_fits_header* hdr,
+    size_t* size)
+{
+    *size = (hdr->ncards/FITS_CARDS_PER_BLOCK + 1)*FITS_BLOCK;
+    return hdr->cards;
+}
+
+/*---------------------------------------------------------------------------*/
+/* FITS FILES */
+
+void tao_common_fits_convert(
+    void* dst,
+    const void* src,
+    size_t npixels,
+    tao_common_pixel_type type)
+{
+    switch (type) {
+    case TAO_COMMON_UINT16:
+        for (size_t i = 0; i < npixels; ++i) {
+            uint16_t v = ((const uint16_t*)src)[i] ^ 0x8000;
+            ((uint16_t*)dst)[i] = __builtin_bswap16(v);
+        }
+        break;
+    case TAO_COMMON_INT16:
+        for (size_t i = 0; i < npixels; ++i) {
+            ((uint16_t*)dst)[i] = __builtin_bswap16(((const uint16_t*)src)[i]);
+        }
+        break;
+    case TAO_COMMON_UINT32:
+        for (size_t i = 0; i < npixels; ++i) {
+            uint32_t v = ((const uint32_t*)src)[i] ^ 0x80000000u;
+            ((uint32_t*)dst)[i] = __builtin_bswap32(v);
+        }
+        break;
+    case TAO_COMMON_INT32:
+    case TAO_COMMON_FLOAT32:
+        for (size_t i = 0; i < npixels; ++i) {
+            ((uint32_t*)dst)[i] = __builtin_bswap32(((const uint32_t*)src)[i]);
+        }
+        break;
+    case TAO_COMMON_FLOAT64:
+        for (size_t i = 0; i < npixels; ++i) {
+            ((uint64_t*)dst)[i] = __builtin_bswap64(((const uint64_t*)src)[i]);
+        }
+        break;
+    case TAO_COMMON_UINT64:
+        for (size_t i = 0; i < npixels; ++i) {
+            uint64_t v = ((const uint64_t*)src)[i] ^ 0x8000000000000000u;
+            ((uint64_t*)dst)[i] = __builtin_bswap64(v);
+        }
+        break;
+    default:
+        memcpy(dst, src, npixels*tao_common_pixel_size(type));
+    }
+}
+
+tao_status tao_common_fits_write(
+    const char* path,
+    const tao_common_fits_header* hdr,
+    const void* data,
+    void* work)
+{
+    size_t size;
+    const void* cards = tao_common_fits_header_data(hdr, &size);
+    return tao_common_fits_write_cards(path, hdr, cards, size, data, work);
+}
+
+tao_status tao_common_fits_write_cards(
+    const char* path,
+    const tao_common_fits_header* hdr,
+    const void* cards,
+    size_t size,
+    const void* data,
+    void* work)
+{
+    size_t npixels = hdr->data_size/tao_common_pixel_size(hdr->pixel_type);
+    unsigned char* buf = work;
+
+    if (buf == NULL) {
+        buf = malloc(hdr->data_size);
+        if (buf == NULL) {
+            tao_push_error("malloc", errno);
+            return TAO_ERROR;
+        }
+    }
+    tao_common_fits_convert(buf, data, npixels, hdr->pixel_type);
+
+    tao_status status = TAO_OK;
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        tao_push_error("fopen", errno);
+        status = TAO_ERROR;
+        goto done;
+    }
+    static const char zeros[FITS_BLOCK];
+    size_t pad = (FITS_BLOCK - hdr->data_size%FITS_BLOCK)%FITS_BLOCK;
+    if (fwrite(cards, 1, size, file) != size ||
+        fwrite(buf, 1, hdr->data_size, file) != hdr->data_size ||
+        fwrite(zeros, 1, pad, file) != pad) {
+        tao_push_error("fwrite", errno);
+        status = TAO_ERROR;
+    }
+    if (fclose(file) != 0 && status == TAO_OK) {
+        tao_push_error("fclose", errno);
+        status = TAO_ERROR;
+    }
+
+done:
+    if (work == NULL) {
+        free(buf);
+    }
+    return status;
+}
+
+/*---------------------------------------------------------------------------*/
+/* FITS EXPORT */
+
+// Size of a row of the FRAMES table: id, host and camera times, orientation.
+#define FRAME_ROW_SIZE (3*8 + 4)
+
+static void put_be64(
+    unsigned char* dst,
+    uint64_t value)
+{
+    value = __builtin_bswap64(value);
+    memcpy(dst, &value, 8);
+}
+
+// Append the binary table of the frame metadata of the planes, one row per
+// plane, so that the export keeps the timing of the index.
+static tao_status write_frame_table(
+    FILE* file,
+    const tao_common_stream_reader* reader,
+    uint64_t first,
+    uint64_t count)
+{
+    tao_common_fits_header* tbl = calloc(1, sizeof(*tbl));
+    if (tbl == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    fits_card(tbl, "XTENSION= %s", "'BINTABLE'");
+    fits_card(tbl, "BITPIX  = %20d", 8);
+    fits_card(tbl, "NAXIS   = %20d", 2);
+    fits_card(tbl, "NAXIS1  = %20d", FRAME_ROW_SIZE);
+    fits_card(tbl, "NAXIS2  = %20lld", (long long)count);
+    fits_card(tbl, "PCOUNT  = %20d", 0);
+    fits_card(tbl, "GCOUNT  = %20d", 1);
+    fits_card(tbl, "TFIELDS = %20d", 4);
+    tao_common_fits_header_add_string(tbl, "TTYPE1", "FRAME", "frame id");
+    tao_common_fits_header_add_string(tbl, "TFORM1", "1K", NULL);
+    // unsigned ids, as the pixels of TAO_COMMON_UINT64
+    fits_card(tbl, "TZERO1  = %20s", "9223372036854775808");
+    tao_common_fits_header_add_string(tbl, "TTYPE2", "HOSTTIME",
+                                      "host CLOCK_MONOTONIC time");
+    tao_common_fits_header_add_string(tbl, "TFORM2", "1K", NULL);
+    tao_common_fits_header_add_string(tbl, "TUNIT2", "ns", NULL);
+    tao_common_fits_header_add_string(tbl, "TTYPE3", "CAMTIME",
+                                      "camera time, 0 if unknown");
+    tao_common_fits_header_add_string(tbl, "TFORM3", "1K", NULL);
+    tao_common_fits_header_add_string(tbl, "TUNIT3", "ns", NULL);
+    tao_common_fits_header_add_string(tbl, "TTYPE4", "ORIENT",
+                                      "quarter turns CW + 4 if mirrored");
+    tao_common_fits_header_add_string(tbl, "TFORM4", "1J", NULL);
+    tao_common_fits_header_add_string(tbl, "EXTNAME", "FRAMES", NULL);
+    size_t size;
+    const void* cards = tao_common_fits_header_data(tbl, &size);
+    int ok = (fwrite(cards, 1, size, file) == size);
+    free(tbl);
+    if (!ok) {
+        tao_push_error("fwrite", errno);
+        return TAO_ERROR;
+    }
+
+    // rows in big-endian byte order, padded with zeros to a whole block
+    size_t table_size = count*FRAME_ROW_SIZE;
+    size_t padded = (table_size + FITS_BLOCK - 1)/FITS_BLOCK*FITS_BLOCK;
+    unsigned char* rows = calloc(padded, 1);
+    if (rows == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    for (uint64_t k = 0; k < count; ++k) {
+        const tao_common_stream_record* rec =
+            tao_common_stream_record_get(reader, first + k);
+        unsigned char* row = rows + k*FRAME_ROW_SIZE;
+        put_be64(row, rec->id ^ 0x8000000000000000u);
+        put_be64(row + 8, (uint64_t)rec->host_time);
+        put_be64(row + 16, (uint64_t)rec->camera_time);
+        uint32_t orientation = __builtin_bswap32(rec->orientation);
+        memcpy(row + 24, &orientation, 4);
+    }
+    ok = (fwrite(rows, 1, padded, file) == padded);
+    free(rows);
+    if (!ok) {
+        tao_push_error("fwrite", errno);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+tao_status tao_common_stream_export_fits(
+    const tao_common_stream_reader* reader,
+    const char* path,
+    uint64_t first,
+    uint64_t count)
+{
+    const tao_common_stream_header* hdr = tao_common_stream_get_header(reader);
+    uint64_t nframes = tao_common_stream_count(reader);
+    size_t pixel_size = tao_common_pixel_size(hdr->pixel_type);
+    uint64_t npixels = (uint64_t)hdr->width*hdr->height;
+    tao_common_fits_header* fits = NULL;
+
+    if (count == 0 || first >= nframes || count > nframes - first ||
+        count > INT32_MAX) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    if (tao_common_fits_header_create(hdr->pixel_type, hdr->width,
+                                      hdr->height, (int)count,
+                                      &fits) != TAO_OK) {
+        return TAO_ERROR;
+    }
+    tao_common_frame_info info0 = {0, 0, 0, 0};
+    tao_common_stream_frame(reader, first, &info0);
+    // the metadata of every plane follows in the FRAMES table
+    fits_card(fits, "EXTEND  = %20s", "T");
+    if (hdr->instrument[0] != '\0') {
+        tao_common_fits_header_add_string(fits, "INSTRUME", hdr->instrument,
+                                          NULL);
+    }
+    tao_common_fits_header_add_int(fits, "FRAME0", info0.id,
+                                   "id of the first frame");
+    tao_common_fits_header_add_int(fits, "HOSTT0", info0.host_time,
+                                   "host time of first frame (ns)");
+    if (info0.orientation != TAO_COMMON_ORIENT_NONE) {
+        tao_common_fits_header_add_int(fits, "ORIENT", info0.orientation,
+                                       "quarter turns CW + 4 if mirrored");
+    }
+    if (hdr->comment[0] != '\0') {
+        tao_common_fits_header_add_comment(fits, hdr->comment);
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        tao_push_error("fopen", errno);
+        tao_common_fits_header_destroy(fits);
+        return TAO_ERROR;
+    }
+    size_t size;
+    const void* cards = tao_common_fits_header_data(fits, &size);
+    if (fwrite(cards, 1, size, file) != size) {
+        tao_common_fits_header_destroy(fits);
+        goto write_error;
+    }
+    tao_common_fits_header_destroy(fits);
+
+    // data in big-endian byte order
+    size_t frame_size = npixels*pixel_size;
+    // compressed frames are decoded in the second half of the buffer
+    int compressed = (hdr->compression != TAO_COMMON_COMPRESS_NONE);
+    unsigned char* buf = malloc(compressed ? 2*frame_size : frame_size);
+    if (buf == NULL) {
+        tao_push_error("malloc", errno);
+        fclose(file);
+        return TAO_ERROR;
+    }
+    for (uint64_t k = first; k < first + count; ++k) {
+        const unsigned char* src = tao_common_stream_frame(reader, k, NULL);
+        if (compressed) {
+            if (tao_common_stream_read_frame(reader, k, buf + frame_size,
+                                             NULL, NULL) != TAO_OK) {
+                free(buf);
+                fclose(file);
+                return TAO_ERROR;
+            }
+            src = buf + frame_size;
+        }
+        tao_common_fits_convert(buf, src, npixels, hdr->pixel_type);
+        if (fwrite(buf, 1, frame_size, file) != frame_size) {
+            free(buf);
+            goto write_error;
+        }
+    }
+    free(buf);
+
+    // pad the data to a whole number of blocks
+    size_t rem = (size_t)((count*frame_size)%FITS_BLOCK);
+    if (rem != 0) {
+        static const char zeros[FITS_BLOCK];
+        if (fwrite(zeros, 1, FITS_BLOCK - rem, file) != FITS_BLOCK - rem) {
+            goto write_error;
+        }
+    }
+    if (write_frame_table(file, reader, first, count) != TAO_OK) {
+        fclose(file);
+        return TAO_ERROR;
+    }
+    if (fclose(file) != 0) {
+        tao_push_error("fclose", errno);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+
+write_error:
+    tao_push_error("fwrite", errno);
+    fclose(file);
+    return TAO_ERROR;
+}
@@ -0,0 +1,297 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* PIXEL KERNELS */
+
+// Each kernel is written once as a plain loop and compiled for every
+// instruction set by the KERNELS() macro: the target attribute lets the
+// vectorizer use the wider registers, the table of the best variant
+// supported by the CPU is selected at run time.
+#if defined(__x86_64__) || defined(__i386__)
+#  define ATTR_sse2   __attribute__((optimize("tree-vectorize")))
+#  define ATTR_avx2   __attribute__((optimize("tree-vectorize"),    \
+                                     target("avx2")))
+#  define ATTR_avx512 __attribute__((optimize("tree-vectorize"),    \
+                                     target("avx512f,avx512bw,avx512vl")))
+#else
+#  define ATTR_generic __attribute__((optimize("tree-vectorize")))
+#endif
+
+// Side of the tiles of transposes, a tile of floats fits in L1 cache lines.
+#define TILE 16
+
+// Independent lanes of reductions, enough for 512-bit registers of floats.
+#define LANES 16
+
+#define CONVERT(ISA, name, D, S)                                        \
+    static void ATTR_##ISA name##_##ISA(                                \
+        D* restrict dst, const S* restrict src, size_t n)               \
+    {                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                \
+            dst[i] = src[i];                                            \
+        }                                                               \
+    }
+
+#define ACCUMULATE(ISA, name, D)                                        \
+    static void ATTR_##ISA name##_##ISA(                                \
+        D* restrict sum, const uint16_t* restrict src, size_t n)        \
+    {                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                \
+            sum[i] += src[i];                                           \
+        }                                                               \
+    }
+
+#define TRANSPOSE(ISA, name, T)                                         \
+    static void ATTR_##ISA name##_##ISA(                                \
+        T* restrict dst, const T* restrict src,                         \
+        size_t width, size_t height)                                    \
+    {                                                                   \
+        for (size_t y0 = 0; y0 < height; y0 += TILE) {                  \
+            size_t y1 = (y0 + TILE < height ? y0 + TILE : height);      \
+            for (size_t x0 = 0; x0 < width; x0 += TILE) {               \
+                size_t x1 = (x0 + TILE < width ? x0 + TILE : width);    \
+                for (size_t x = x0; x < x1; ++x) {                      \
+                    for (size_t y = y0; y < y1; ++y) {                  \
+                        dst[x*height + y] = src[y*width + x];           \
+                    }                                                   \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+    }
+
+#define KERNELS(ISA)                                                    \
+    CONVERT(ISA, convert_u8_f32, float, uint8_t)                        \
+    CONVERT(ISA, convert_u16_f32, float, uint16_t)                      \
+    CONVERT(ISA, convert_u16_u32, uint32_t, uint16_t)                   \
+    CONVERT(ISA, convert_u16_u64, uint64_t, uint16_t)                   \
+    ACCUMULATE(ISA, accumulate_u16_u32, uint32_t)                       \
+    ACCUMULATE(ISA, accumulate_u16_u64, uint64_t)                       \
+    TRANSPOSE(ISA, transpose_u16, uint16_t)                             \
+    TRANSPOSE(ISA, transpose_f32, float)                                \
+                                                                        \
+    static void ATTR_##ISA convert_f32_u16_##ISA(                       \
+        uint16_t* restrict dst, const float* restrict src, size_t n)    \
+    {                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                \
+            float v = src[i] + 0.5f;                                    \
+            v = (v > 0.0f ? v : 0.0f);                                  \
+            v = (v < 65535.0f ? v : 65535.0f);                          \
+            dst[i] = (uint16_t)(int32_t)v;                              \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    static void ATTR_##ISA scale_f32_##ISA(                             \
+        float* restrict dst, const float* restrict src, size_t n,       \
+        float a, float b)                                               \
+    {                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                \
+            dst[i] = a*src[i] + b;                                      \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    static void ATTR_##ISA scale_u16_u8_##ISA(                          \
+        uint8_t* restrict dst, const uint16_t* restrict src, size_t n,  \
+        float a, float b)                                               \
+    {                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                \
+            float v = a*src[i] + b;                                     \
+            v = (v > 0.0f ? v : 0.0f);                                  \
+            v = (v < 255.0f ? v : 255.0f);                              \
+            dst[i] = (uint8_t)(int32_t)v;                               \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    static void ATTR_##ISA minmax_u16_##ISA(                            \
+        const uint16_t* restrict src, size_t n,                         \
+        uint16_t* min, uint16_t* max)                                   \
+    {                                                                   \
+        uint16_t lo = UINT16_MAX, hi = 0;                               \
+        for (size_t i = 0; i < n; ++i) {                                \
+            lo = (src[i] < lo ? src[i] : lo);                           \
+            hi = (src[i] > hi ? src[i] : hi);                           \
+        }                                                               \
+        *min = lo;                                                      \
+        *max = hi;                                                      \
+    }                                                                   \
+                                                                        \
+    static void ATTR_##ISA minmax_f32_##ISA(                            \
+        const float* restrict src, size_t n, float* min, float* max)    \
+    {                                                                   \
+        /* per lane selections vectorize, a float reduction does not */ \
+        float lo[LANES], hi[LANES];                                     \
+        for (int k = 0; k < LANES; ++k) {                               \
+            lo[k] = __builtin_inff();                                   \
+            hi[k] = -__builtin_inff();                                  \
+        }                                                               \
+        size_t i = 0;                                                   \
+        for (; i + LANES <= n; i += LANES) {                            \
+            for (int k = 0; k < LANES; ++k) {                           \
+                lo[k] = (src[i+k] < lo[k] ? src[i+k] : lo[k]);          \
+                hi[k] = (src[i+k] > hi[k] ? src[i+k] : hi[k]);          \
+            }                                                           \
+        }                                                               \
+        for (; i < n; ++i) {                                            \
+            lo[0] = (src[i] < lo[0] ? src[i] : lo[0]);                  \
+            hi[0] = (src[i] > hi[0] ? src[i] : hi[0]);                  \
+        }                                                               \
+        for (int k = 1; k < LANES; ++k) {                               \
+            lo[0] = (lo[k] < lo[0] ? lo[k] : lo[0]);                    \
+            hi[0] = (hi[k] > hi[0] ? hi[k] : hi[0]);                    \
+        }                                                               \
+        *min = lo[0];                                                   \
+        *max = hi[0];                                                   \
+    }                                                                   \
+                                                                        \
+    static void ATTR_##ISA histogram_u16_##ISA(                         \
+        uint32_t* restrict bins, const uint16_t* restrict src,          \
+        size_t n, int shift)                                            \
+    {                                                                   \
+        /* consecutive equal pixels do not wait for each other, the */  \
+        /* partial histograms follow the first one */                   \
+        size_t nbins = ((size_t)UINT16_MAX >> shift) + 1;               \
+        uint32_t* part = bins + nbins;                                  \
+        size_t i = 0;                                                   \
+        for (; i + 4 <= n; i += 4) {                                    \
+            bins[src[i] >> shift] += 1;                                 \
+            part[src[i+1] >> shift] += 1;                               \
+            part[nbins + (src[i+2] >> shift)] += 1;                     \
+            part[2*nbins + (src[i+3] >> shift)] += 1;                   \
+        }                                                               \
+        for (; i < n; ++i) {                                            \
+            bins[src[i] >> shift] += 1;                                 \
+        }                                                               \
+        for (size_t j = 0; j < nbins; ++j) {                            \
+            bins[j] += part[j] + part[nbins + j] + part[2*nbins + j];   \
+            part[j] = part[nbins + j] = part[2*nbins + j] = 0;          \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    static void ATTR_##ISA repeat_u32_##ISA(                            \
+        uint32_t* restrict dst, const uint32_t* restrict src,           \
+        size_t n, int factor)                                           \
+    {                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                \
+            for (int k = 0; k < factor; ++k) {                          \
+                dst[i*factor + k] = src[i];                             \
+            }                                                           \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    static void ATTR_##ISA subtract_f32_##ISA(                          \
+        float* restrict dst, const float* restrict a,                   \
+        const float* restrict b, size_t n)                              \
+    {                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                \
+            dst[i] = a[i] - b[i];                                       \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    static void ATTR_##ISA multiply_f32_##ISA(                          \
+        float* restrict dst, const float* restrict a,                   \
+        const float* restrict b, size_t n)                              \
+    {                                                                   \
+        for (size_t i = 0; i < n; ++i) {                                \
+            dst[i] = a[i]*b[i];                                         \
+        }                                                               \
+    }                                                                   \
+                                                                        \
+    static const tao_common_kernels kernels_##ISA = {                   \
+        .isa = #ISA,                                                    \
+        .convert_u8_f32 = convert_u8_f32_##ISA,                         \
+        .convert_u16_f32 = convert_u16_f32_##ISA,                       \
+        .convert_u16_u32 = convert_u16_u32_##ISA,                       \
+        .convert_u16_u64 = convert_u16_u64_##ISA,                       \
+        .convert_f32_u16 = convert_f32_u16_##ISA,                       \
+        .scale_f32 = scale_f32_##ISA,                                   \
+        .scale_u16_u8 = scale_u16_u8_##ISA,                             \
+        .minmax_u16 = minmax_u16_##ISA,                                 \
+        .minmax_f32 = minmax_f32_##ISA,                                 \
+        .histogram_u16 = histogram_u16_##ISA,                           \
+        .repeat_u32 = repeat_u32_##ISA,                                 \
+        .subtract_f32 = subtract_f32_##ISA,                             \
+        .multiply_f32 = multiply_f32_##ISA,                             \
+        .accumulate_u16_u32 = accumulate_u16_u32_##ISA,                 \
+        .accumulate_u16_u64 = accumulate_u16_u64_##ISA,                 \
+        .transpose_u16 = transpose_u16_##ISA,                           \
+        .transpose_f32 = transpose_f32_##ISA,                           \
+    };
+
+#if defined(__x86_64__) || defined(__i386__)
+KERNELS(sse2)
+KERNELS(avx2)
+KERNELS(avx512)
+
+// From the best to the worst
+static const tao_common_kernels* const all_kernels[] = {
+    &kernels_avx512, &kernels_avx2, &kernels_sse2};
+
+static int supported(
+    const tao_common_kernels* k)
+{
+    __builtin_cpu_init();
+    if (k == &kernels_avx512) {
+        return (__builtin_cpu_supports("avx512f") &&
+                __builtin_cpu_supports("avx512bw") &&
+                __builtin_cpu_supports("avx512vl"));
+    }
+    if (k == &kernels_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    return 1;
+}
+#else
+KERNELS(generic)
+
+static const tao_common_kernels* const all_kernels[] = {&kernels_generic};
+
+static int supported(
+    const tao_common_kernels* k)
+{
+    return 1;
+}
+#endif
+
+#define NBR_KERNELS (sizeof(all_kernels)/sizeof(all_kernels[0]))
+
+const tao_common_kernels* tao_common_kernels_select(
+    const char* isa)
+{
+    for (size_t i = 0; i < NBR_KERNELS; ++i) {
+        if (strcmp(all_kernels[i]->isa, isa) == 0) {
+            return (supported(all_kernels[i]) ? all_kernels[i] : NULL);
+        }
+    }
+    return NULL;
+}
+
+static const tao_common_kernels* selected = NULL;
+static pthread_once_t selected_once = PTHREAD_ONCE_INIT;
+
+static void select_kernels(void)
+{
+    // the environment may impose a lower instruction set
+    const char* isa = getenv("TAO_COMMON_ISA");
+    if (isa != NULL) {
+        selected = tao_common_kernels_select(isa);
+        if (selected == NULL) {
+            fprintf(stderr, "TAO_COMMON_ISA=%s is not available\n", isa);
+        }
+    }
+    for (size_t i = 0; selected == NULL && i < NBR_KERNELS; ++i) {
+        if (supported(all_kernels[i])) {
+            selected = all_kernels[i];
+        }
+    }
+}
+
+const tao_common_kernels* tao_common_kernels_get(void)
+{
+    pthread_once(&selected_once, select_kernels);
+    return selected;
+}
@@ -0,0 +1,106 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*---------------------------------------------------------------------------*/
+/* FRAME BUFFERS */
+
+// Memory policy of mbind(), <numaif.h> is part of libnuma which is not
+// needed otherwise.
+#define MPOL_PREFERRED 1
+
+int tao_common_numa_node(
+    int cpu)
+{
+    char path[64];
+
+    if (cpu < 0) {
+        cpu = sched_getcpu();
+        if (cpu < 0) {
+            return -1;
+        }
+    }
+    // the CPU directory has a "nodeN" link to its node
+    for (int node = 0; node < 64; ++node) {
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%d/node%d", cpu, node);
+        if (access(path, F_OK) == 0) {
+            return node;
+        }
+    }
+    return -1;
+}
+
+int tao_common_thread_config_node(
+    const tao_common_thread_config* cfg)
+{
+    return (cfg->ncpus > 0 ? tao_common_numa_node(cfg->cpus[0]) : -1);
+}
+
+tao_status tao_common_frame_buffer_alloc(
+    tao_common_frame_buffer* buf,
+    size_t size,
+    int node)
+{
+    memset(buf, 0, sizeof(*buf));
+    buf->node = -1;
+    if (size == 0) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+
+    // reserved huge pages first, they may have run out
+    size_t huge_size = (size + TAO_COMMON_HUGE_PAGE_SIZE - 1) &
+        ~(size_t)(TAO_COMMON_HUGE_PAGE_SIZE - 1);
+    void* data = mmap(NULL, huge_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data != MAP_FAILED) {
+        buf->mapped = huge_size;
+        buf->huge = 1;
+    } else {
+        size_t page = sysconf(_SC_PAGESIZE);
+        buf->mapped = (size + page - 1) & ~(page - 1);
+        data = mmap(NULL, buf->mapped, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            tao_push_error("mmap", errno);
+            buf->mapped = 0;
+            return TAO_ERROR;
+        }
+        if (buf->mapped >= TAO_COMMON_HUGE_PAGE_SIZE &&
+            madvise(data, buf->mapped, MADV_HUGEPAGE) == 0) {
+            buf->huge = 2;
+        }
+    }
+    buf->data = data;
+    buf->size = size;
+
+    // the policy must be set before the pages are touched
+    if (node >= 0 && node < 8*(int)sizeof(unsigned long)) {
+        unsigned long mask = 1UL << node;
+        if (syscall(SYS_mbind, data, buf->mapped, MPOL_PREFERRED,
+                    &mask, 8*sizeof(mask), 0) == 0) {
+            buf->node = node;
+        }
+    }
+    tao_common_memory_prefault(data, buf->mapped);
+    return TAO_OK;
+}
+
+void tao_common_frame_buffer_free(
+    tao_common_frame_buffer* buf)
+{
+    if (buf->data != NULL) {
+        munmap(buf->data, buf->mapped);
+        memset(buf, 0, sizeof(*buf));
+        buf->node = -1;
+    }
+}
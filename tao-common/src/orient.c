@@ -0,0 +1,195 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* ORIENTATION */
+
+// Side of the tiles, a tile of the source and one of the destination fit in
+// the L1 cache for pixels of up to 8 bytes.
+#define TILE 32
+
+int tao_common_orientation_from_degrees(
+    int degrees,
+    int flip)
+{
+    if (degrees%90 != 0) {
+        return -1;
+    }
+    int turns = ((degrees/90)%4 + 4)%4;
+    return turns | (flip ? TAO_COMMON_ORIENT_FLIP_X : 0);
+}
+
+void tao_common_orient_size(
+    int orientation,
+    uint32_t width,
+    uint32_t height,
+    uint32_t* dst_width,
+    uint32_t* dst_height)
+{
+    int swap = (orientation & 1);
+    *dst_width = (swap ? height : width);
+    *dst_height = (swap ? width : height);
+}
+
+// Position of source pixel (x,y) in the oriented frame.
+static void forward(
+    int orientation,
+    int64_t width,
+    int64_t height,
+    int64_t x,
+    int64_t y,
+    int64_t* xd,
+    int64_t* yd)
+{
+    if (orientation & TAO_COMMON_ORIENT_FLIP_X) {
+        x = width - 1 - x;
+    }
+    for (int k = 0; k < (orientation & 3); ++k) {
+        // a quarter turn clockwise of a width by height frame
+        int64_t t = x;
+        x = height - 1 - y;
+        y = t;
+        t = width;
+        width = height;
+        height = t;
+    }
+    *xd = x;
+    *yd = y;
+}
+
+// The source index of destination pixel (xd,yd) is `origin + xd*step_x +
+// yd*step_y`, each step is a source row or column, forward or backward.
+typedef struct orient_context {
+    void* dst;
+    const void* src;
+    uint32_t dst_width, dst_height;
+    int64_t origin, step_x, step_y;
+    size_t row_size;        // in bytes, for up-down mirrors
+} orient_context;
+
+#define ORIENT_ROWS(T)                                                  \
+    static void __attribute__((optimize("tree-vectorize")))             \
+    orient_rows_##T(                                                    \
+        void* arg,                                                      \
+        uint32_t y0,                                                    \
+        uint32_t y1)                                                    \
+    {                                                                   \
+        orient_context* ctx = arg;                                      \
+        T* dst = ctx->dst;                                              \
+        const T* src = ctx->src;                                        \
+        uint32_t w = ctx->dst_width;                                    \
+        if (ctx->step_x == -1) {                                        \
+            /* reversed rows, read in order */                          \
+            for (uint32_t y = y0; y < y1; ++y) {                        \
+                T* d = dst + (size_t)y*w;                               \
+                const T* s = src + ctx->origin + y*ctx->step_y;         \
+                for (uint32_t x = 0; x < w; ++x) {                      \
+                    d[x] = s[-(int64_t)x];                              \
+                }                                                       \
+            }                                                           \
+            return;                                                     \
+        }                                                               \
+        for (uint32_t ty = y0; ty < y1; ty += TILE) {                   \
+            uint32_t ey = (ty + TILE < y1 ? ty + TILE : y1);            \
+            for (uint32_t tx = 0; tx < w; tx += TILE) {                 \
+                uint32_t ex = (tx + TILE < w ? tx + TILE : w);          \
+                for (uint32_t y = ty; y < ey; ++y) {                    \
+                    T* d = dst + (size_t)y*w;                           \
+                    const T* s = src + ctx->origin + y*ctx->step_y;     \
+                    for (uint32_t x = tx; x < ex; ++x) {                \
+                        d[x] = s[x*ctx->step_x];                        \
+                    }                                                   \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+    }
+
+ORIENT_ROWS(uint8_t)
+ORIENT_ROWS(uint16_t)
+ORIENT_ROWS(uint32_t)
+ORIENT_ROWS(uint64_t)
+
+// Rows are kept or only reversed, no tiles needed.
+static void flip_rows(
+    void* arg,
+    uint32_t y0,
+    uint32_t y1)
+{
+    orient_context* ctx = arg;
+    size_t row_size = ctx->row_size;
+    for (uint32_t y = y0; y < y1; ++y) {
+        memcpy((char*)ctx->dst + y*row_size,
+               (const char*)ctx->src + (ctx->origin + y*ctx->step_y)*row_size,
+               row_size);
+    }
+}
+
+tao_status tao_common_orient(
+    tao_common_pool* pool,
+    void* dst,
+    const void* src,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type type,
+    int orientation)
+{
+    size_t pixel_size = tao_common_pixel_size(type);
+    if (pixel_size == 0) {
+        tao_push_error(__func__, TAO_BAD_TYPE);
+        return TAO_ERROR;
+    }
+    if (orientation < 0 || orientation > 7 || width < 1 || height < 1) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    if (orientation == TAO_COMMON_ORIENT_NONE) {
+        memcpy(dst, src, (size_t)width*height*pixel_size);
+        return TAO_OK;
+    }
+
+    // the inverse of the orientation is the transpose of its matrix
+    int64_t bx, by, ax, ay, cx, cy;
+    forward(orientation, width, height, 0, 0, &bx, &by);
+    forward(orientation, width, height, 1, 0, &ax, &ay);
+    forward(orientation, width, height, 0, 1, &cx, &cy);
+    ax -= bx; ay -= by;     // image of the source x axis
+    cx -= bx; cy -= by;     // image of the source y axis
+    orient_context ctx = {
+        .dst = dst,
+        .src = src,
+        .origin = -(ax*bx + ay*by) - (cx*bx + cy*by)*(int64_t)width,
+        .step_x = ax + cx*(int64_t)width,
+        .step_y = ay + cy*(int64_t)width,
+    };
+    tao_common_orient_size(orientation, width, height,
+                           &ctx.dst_width, &ctx.dst_height);
+
+    // whole tiles per job
+    uint32_t h = ctx.dst_height;
+    if (ctx.step_x == 1) {
+        // up-down mirror: origin and steps in rows
+        ctx.origin /= width;
+        ctx.step_y /= width;
+        ctx.row_size = width*pixel_size;
+        tao_common_pool_run_rows(pool, h, TILE, flip_rows, &ctx);
+        return TAO_OK;
+    }
+    switch (pixel_size) {
+    case 1:
+        tao_common_pool_run_rows(pool, h, TILE, orient_rows_uint8_t, &ctx);
+        break;
+    case 2:
+        tao_common_pool_run_rows(pool, h, TILE, orient_rows_uint16_t, &ctx);
+        break;
+    case 4:
+        tao_common_pool_run_rows(pool, h, TILE, orient_rows_uint32_t, &ctx);
+        break;
+    default:
+        tao_common_pool_run_rows(pool, h, TILE, orient_rows_uint64_t, &ctx);
+        break;
+    }
+    return TAO_OK;
+}
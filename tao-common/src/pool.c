@@ -0,0 +1,228 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <stdlib.h>
+
+/*---------------------------------------------------------------------------*/
+/* THREAD POOL */
+
+struct tao_common_pool {
+    pthread_mutex_t batch_mutex;  // serializes batches
+    pthread_mutex_t mutex;        // protects the fields below
+    pthread_cond_t work;          // a new batch is available
+    pthread_cond_t done;          // a worker has left the batch
+    unsigned generation;          // incremented for each batch
+    int quit;
+    int active;                   // workers executing jobs of the batch
+    int njobs;
+    tao_common_pool_job* job;
+    void* arg;
+    int next;                     // next job index (atomic)
+    int remaining;                // jobs not yet completed (atomic)
+    int nthreads;
+    pthread_t threads[];
+};
+
+// Execute jobs of the current batch until there are none left.
+static void run_jobs(
+    tao_common_pool* pool,
+    tao_common_pool_job* job,
+    void* arg,
+    int njobs)
+{
+    int i;
+    while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) < njobs) {
+        job(arg, i);
+        __atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void* worker(
+    void* ptr)
+{
+    tao_common_pool* pool = ptr;
+    pthread_mutex_lock(&pool->mutex);
+    unsigned seen = pool->generation;
+    while (1) {
+        while (!pool->quit && pool->generation == seen) {
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        }
+        if (pool->quit) {
+            break;
+        }
+        // the batch cannot change while this worker is registered as active
+        seen = pool->generation;
+        tao_common_pool_job* job = pool->job;
+        void* arg = pool->arg;
+        int njobs = pool->njobs;
+        ++pool->active;
+        pthread_mutex_unlock(&pool->mutex);
+        run_jobs(pool, job, arg, njobs);
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->active == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+tao_status tao_common_pool_create(
+    int nthreads,
+    const tao_common_thread_config* cfg,
+    tao_common_pool** pool_ptr)
+{
+    tao_common_pool* pool;
+
+    *pool_ptr = NULL;
+    if (nthreads < 0) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    pool = calloc(1, sizeof(*pool) + nthreads*sizeof(pthread_t));
+    if (pool == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    pthread_mutex_init(&pool->batch_mutex, NULL);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (int i = 0; i < nthreads; ++i) {
+        tao_status status;
+        if (cfg != NULL) {
+            status = tao_common_thread_create(&pool->threads[i], cfg,
+                                              worker, pool);
+        } else {
+            int code = pthread_create(&pool->threads[i], NULL, worker, pool);
+            if (code != 0) {
+                tao_push_error("pthread_create", code);
+            }
+            status = (code == 0 ? TAO_OK : TAO_ERROR);
+        }
+        if (status != TAO_OK) {
+            tao_common_pool_destroy(pool);
+            return TAO_ERROR;
+        }
+        pool->nthreads = i + 1;
+    }
+    *pool_ptr = pool;
+    return TAO_OK;
+}
+
+void tao_common_pool_run(
+    tao_common_pool* pool,
+    int njobs,
+    tao_common_pool_job* job,
+    void* arg)
+{
+    if (njobs <= 0) {
+        return;
+    }
+    if (pool == NULL || pool->nthreads == 0 || njobs == 1) {
+        for (int i = 0; i < njobs; ++i) {
+            job(arg, i);
+        }
+        return;
+    }
+    pthread_mutex_lock(&pool->batch_mutex);
+    pthread_mutex_lock(&pool->mutex);
+    // no worker may still be claiming jobs of a previous batch when `next` is
+    // reset, it would run a job of that batch under the new index
+    while (pool->active > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pool->job = job;
+    pool->arg = arg;
+    pool->njobs = njobs;
+    __atomic_store_n(&pool->next, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pool->remaining, njobs, __ATOMIC_RELAXED);
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_jobs(pool, job, arg, njobs);
+
+    // wait for the jobs taken by the workers
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->active > 0 ||
+           __atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    pthread_mutex_unlock(&pool->batch_mutex);
+}
+
+typedef struct rows_context {
+    tao_common_pool_rows_job* job;
+    void* arg;
+    uint32_t height;
+    uint32_t rows_per_job;
+} rows_context;
+
+static void run_rows(
+    void* arg,
+    int index)
+{
+    rows_context* ctx = arg;
+    uint32_t y0 = index*ctx->rows_per_job;
+    uint32_t y1 = y0 + ctx->rows_per_job;
+    if (y1 > ctx->height) {
+        y1 = ctx->height;
+    }
+    ctx->job(ctx->arg, y0, y1);
+}
+
+void tao_common_pool_run_rows(
+    tao_common_pool* pool,
+    uint32_t height,
+    uint32_t granularity,
+    tao_common_pool_rows_job* job,
+    void* arg)
+{
+    if (height < 1) {
+        return;
+    }
+    if (granularity < 1) {
+        granularity = 1;
+    }
+    // a few jobs per thread for balance
+    uint32_t njobs = 4*tao_common_pool_size(pool);
+    uint32_t rows = (height + njobs - 1)/njobs;
+    rows = ((rows + granularity - 1)/granularity)*granularity;
+    rows_context ctx = {
+        .job = job,
+        .arg = arg,
+        .height = height,
+        .rows_per_job = rows,
+    };
+    tao_common_pool_run(pool, (height + rows - 1)/rows, run_rows, &ctx);
+}
+
+int tao_common_pool_size(
+    const tao_common_pool* pool)
+{
+    return (pool == NULL ? 1 : pool->nthreads + 1);
+}
+
+void tao_common_pool_destroy(
+    tao_common_pool* pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->nthreads; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->batch_mutex);
+    free(pool);
+}
@@ -0,0 +1,181 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+/* REPLAY */
+
+struct tao_common_replay {
+    tao_common_stream_reader* reader;
+    tao_common_replay_mode mode;
+    double rate;
+    int loop;
+    uint64_t index;         // next frame in the stream
+    uint64_t emitted;       // frames emitted since the start of the pass
+    uint64_t pass;          // number of completed passes
+    uint64_t id_span;       // id increment between passes
+    int64_t start;          // CLOCK_MONOTONIC time of the start of the pass
+    int64_t origin;         // time stamp of the first frame of the stream
+    int64_t max_lag;        // worst delay after the due time
+    void* buffer;           // decompressed frame
+};
+
+// Time stamp used for pacing at original timing: host time when recorded,
+// camera time otherwise.
+static int64_t record_time(
+    const tao_common_stream_record* rec)
+{
+    return (rec->host_time != 0 ? rec->host_time : rec->camera_time);
+}
+
+tao_status tao_common_replay_open(
+    const char* path,
+    tao_common_replay_mode mode,
+    double rate,
+    int loop,
+    tao_common_replay** replay_ptr)
+{
+    tao_common_replay* replay;
+
+    *replay_ptr = NULL;
+    if ((mode != TAO_COMMON_REPLAY_ORIGINAL && mode != TAO_COMMON_REPLAY_FAST &&
+         mode != TAO_COMMON_REPLAY_FIXED) ||
+        (mode != TAO_COMMON_REPLAY_FAST && !(rate > 0))) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    replay = calloc(1, sizeof(*replay));
+    if (replay == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    if (tao_common_stream_open(path, &replay->reader) != TAO_OK) {
+        free(replay);
+        return TAO_ERROR;
+    }
+    uint64_t count = tao_common_stream_count(replay->reader);
+    const tao_common_stream_header* hdr =
+        tao_common_stream_get_header(replay->reader);
+    if (count == 0) {
+        fprintf(stderr, "\"%s\" has no frames\n", path);
+        tao_push_error(__func__, TAO_NO_DATA);
+        goto error;
+    }
+    if (hdr->compression != TAO_COMMON_COMPRESS_NONE) {
+        replay->buffer = malloc(hdr->frame_size);
+        if (replay->buffer == NULL) {
+            tao_push_error("malloc", errno);
+            goto error;
+        }
+    }
+    const tao_common_stream_record* first =
+        tao_common_stream_record_get(replay->reader, 0);
+    const tao_common_stream_record* last =
+        tao_common_stream_record_get(replay->reader, count - 1);
+    replay->mode = mode;
+    replay->rate = rate;
+    replay->loop = loop;
+    replay->origin = record_time(first);
+    replay->id_span = last->id - first->id + 1;
+    *replay_ptr = replay;
+    return TAO_OK;
+
+error:
+    tao_common_replay_close(replay);
+    return TAO_ERROR;
+}
+
+tao_status tao_common_replay_next(
+    tao_common_replay* replay,
+    const void** data_ptr,
+    tao_common_frame_info* info)
+{
+    uint64_t count = tao_common_stream_count(replay->reader);
+    const void* data;
+
+    *data_ptr = NULL;
+    if (replay->index >= count) {
+        if (!replay->loop) {
+            return TAO_OK;
+        }
+        replay->index = 0;
+        replay->emitted = 0;
+        replay->pass += 1;
+    }
+
+    // frames are prepared before waiting so that they are emitted on time
+    const tao_common_stream_record* rec =
+        tao_common_stream_record_get(replay->reader, replay->index);
+    if (replay->buffer != NULL) {
+        if (tao_common_stream_read_frame(replay->reader, replay->index,
+                                         replay->buffer, NULL, NULL) != TAO_OK) {
+            return TAO_ERROR;
+        }
+        data = replay->buffer;
+    } else {
+        data = tao_common_stream_frame(replay->reader, replay->index, NULL);
+    }
+
+    int64_t now = tao_common_monotonic_time();
+    if (replay->emitted == 0) {
+        replay->start = now;
+    }
+    if (replay->mode != TAO_COMMON_REPLAY_FAST) {
+        int64_t offset;
+        if (replay->mode == TAO_COMMON_REPLAY_ORIGINAL) {
+            offset = (int64_t)((record_time(rec) - replay->origin)/replay->rate);
+        } else {
+            offset = (int64_t)(replay->emitted*1e9/replay->rate);
+        }
+        int64_t due = replay->start + (offset > 0 ? offset : 0);
+        if (due > now) {
+            struct timespec ts = {due/1000000000, due%1000000000};
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+                                   &ts, NULL) == EINTR)
+                ;
+            now = tao_common_monotonic_time();
+        }
+        if (now - due > replay->max_lag) {
+            replay->max_lag = now - due;
+        }
+    }
+
+    if (info != NULL) {
+        // host time is the emission time as for a live camera
+        info->id = rec->id + replay->pass*replay->id_span;
+        info->host_time = now;
+        info->camera_time = rec->camera_time;
+        info->orientation = rec->orientation;
+    }
+    replay->index += 1;
+    replay->emitted += 1;
+    *data_ptr = data;
+    return TAO_OK;
+}
+
+const tao_common_stream_header* tao_common_replay_get_header(
+    const tao_common_replay* replay)
+{
+    return tao_common_stream_get_header(replay->reader);
+}
+
+int64_t tao_common_replay_max_lag(
+    const tao_common_replay* replay)
+{
+    return replay->max_lag;
+}
+
+void tao_common_replay_close(
+    tao_common_replay* replay)
+{
+    if (replay == NULL) {
+        return;
+    }
+    tao_common_stream_close_reader(replay->reader);
+    free(replay->buffer);
+    free(replay);
+}
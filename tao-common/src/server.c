@@ -0,0 +1,469 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/*---------------------------------------------------------------------------*/
+/* FRAME SERVER */
+
+#define MAX_CLIENTS 32
+
+struct tao_common_server {
+    char* path;
+    int listen_fd;
+    int event_fd;               // wakes the thread up
+    int ring_fd;                // read-only descriptor sent to clients
+    tao_common_shm_reader* reader;
+    pthread_t thread;
+    int quit;
+    int nclients;
+    int clients[MAX_CLIENTS];
+    uint64_t notified;          // latest frame number sent
+};
+
+struct tao_common_client {
+    int fd;
+    tao_common_shm_reader* reader;
+    uint64_t latest;            // latest frame number received
+    int stopped;
+};
+
+static int make_address(
+    const char* path,
+    struct sockaddr_un* addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Send a message, with the descriptor of the ring if `fd` >= 0.
+static int send_message(
+    int sock,
+    uint32_t type,
+    uint64_t number,
+    int fd)
+{
+    tao_common_server_message msg = {type, sizeof(msg), number};
+    struct iovec iov = {&msg, sizeof(msg)};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr mh;
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    if (fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        mh.msg_control = control.buf;
+        mh.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+    // a full socket means a slow client, it gets the next notification
+    if (sendmsg(sock, &mh, MSG_DONTWAIT|MSG_NOSIGNAL) == sizeof(msg) ||
+        errno == EAGAIN) {
+        return 0;
+    }
+    return -1;
+}
+
+static void drop_client(
+    tao_common_server* server,
+    int k)
+{
+    close(server->clients[k]);
+    server->clients[k] = server->clients[server->nclients - 1];
+    __atomic_store_n(&server->nclients, server->nclients - 1,
+                     __ATOMIC_RELAXED);
+}
+
+static uint64_t last_published(
+    const tao_common_server* server)
+{
+    const tao_common_shm_header* hdr = tao_common_shm_get_header(
+        server->reader);
+    return __atomic_load_n(&hdr->published, __ATOMIC_ACQUIRE);
+}
+
+static void* serve(
+    void* arg)
+{
+    tao_common_server* server = arg;
+    struct pollfd fds[2 + MAX_CLIENTS];
+    sigset_t all;
+
+    // signals are for the threads of the application
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+    while (1) {
+        fds[0].fd = server->event_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = server->listen_fd;
+        fds[1].events = POLLIN;
+        int n = server->nclients;
+        for (int k = 0; k < n; ++k) {
+            // clients do not send anything, this detects disconnections
+            fds[2 + k].fd = server->clients[k];
+            fds[2 + k].events = POLLIN;
+        }
+        if (poll(fds, 2 + n, -1) < 0) {
+            continue;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            if (read(server->event_fd, &count, sizeof(count)) < 0) {
+                count = 0;
+            }
+            if (__atomic_load_n(&server->quit, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+        }
+        // clients are dropped from the end, so that polled indices stay valid
+        for (int k = n - 1; k >= 0; --k) {
+            if (fds[2 + k].revents != 0) {
+                char buf[64];
+                ssize_t len = recv(server->clients[k], buf, sizeof(buf),
+                                   MSG_DONTWAIT);
+                if (len == 0 || (len < 0 && errno != EAGAIN)) {
+                    drop_client(server, k);
+                }
+            }
+        }
+        uint64_t number = last_published(server);
+        if (number != server->notified) {
+            server->notified = number;
+            for (int k = server->nclients - 1; k >= 0; --k) {
+                if (send_message(server->clients[k], TAO_COMMON_SERVER_FRAME,
+                                 number, -1) != 0) {
+                    drop_client(server, k);
+                }
+            }
+        }
+        if (fds[1].revents & POLLIN) {
+            int sock = accept4(server->listen_fd, NULL, NULL,
+                               SOCK_CLOEXEC|SOCK_NONBLOCK);
+            if (sock >= 0) {
+                if (server->nclients >= MAX_CLIENTS ||
+                    send_message(sock, TAO_COMMON_SERVER_HELLO,
+                                 last_published(server),
+                                 server->ring_fd) != 0) {
+                    close(sock);
+                } else {
+                    server->clients[server->nclients] = sock;
+                    __atomic_store_n(&server->nclients, server->nclients + 1,
+                                     __ATOMIC_RELAXED);
+                }
+            }
+        }
+    }
+    while (server->nclients > 0) {
+        send_message(server->clients[server->nclients - 1],
+                     TAO_COMMON_SERVER_CLOSED, last_published(server), -1);
+        drop_client(server, server->nclients - 1);
+    }
+    return NULL;
+}
+
+tao_status tao_common_server_create(
+    const char* path,
+    tao_common_shm_writer* writer,
+    tao_common_server** server_ptr)
+{
+    tao_common_server* server;
+    struct sockaddr_un addr;
+    char proc[64];
+
+    *server_ptr = NULL;
+    int ring = tao_common_shm_get_fd(writer);
+    if (ring < 0 || make_address(path, &addr) != 0) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    server = calloc(1, sizeof(*server));
+    if (server == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    server->listen_fd = -1;
+    server->event_fd = -1;
+    server->ring_fd = -1;
+    server->path = strdup(path);
+    if (server->path == NULL) {
+        tao_push_error("strdup", errno);
+        goto error;
+    }
+    // reopening the memfd through /proc gives a descriptor which cannot be
+    // mapped for writing
+    snprintf(proc, sizeof(proc), "/proc/self/fd/%d", ring);
+    server->ring_fd = open(proc, O_RDONLY|O_CLOEXEC);
+    if (server->ring_fd < 0) {
+        tao_push_error("open", errno);
+        goto error;
+    }
+    if (tao_common_shm_attach(server->ring_fd, &server->reader) != TAO_OK) {
+        goto error;
+    }
+    server->event_fd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+    if (server->event_fd < 0) {
+        tao_push_error("eventfd", errno);
+        goto error;
+    }
+    server->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0) {
+        tao_push_error("socket", errno);
+        goto error;
+    }
+    if (bind(server->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (errno != EADDRINUSE) {
+            tao_push_error("bind", errno);
+            goto error;
+        }
+        // the socket file of a server which no longer runs refuses
+        // connections
+        int probe = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+        int alive = (probe >= 0 &&
+                     connect(probe, (struct sockaddr*)&addr,
+                             sizeof(addr)) == 0);
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (alive) {
+            tao_push_error(__func__, TAO_ALREADY_IN_USE);
+            goto error;
+        }
+        unlink(path);
+        if (bind(server->listen_fd, (struct sockaddr*)&addr,
+                 sizeof(addr)) != 0) {
+            tao_push_error("bind", errno);
+            goto error;
+        }
+    }
+    if (listen(server->listen_fd, 8) != 0) {
+        tao_push_error("listen", errno);
+        unlink(path);
+        goto error;
+    }
+    server->notified = last_published(server);
+    if (pthread_create(&server->thread, NULL, serve, server) != 0) {
+        tao_push_error("pthread_create", errno);
+        unlink(path);
+        goto error;
+    }
+    *server_ptr = server;
+    return TAO_OK;
+
+error:
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+    }
+    if (server->event_fd >= 0) {
+        close(server->event_fd);
+    }
+    if (server->ring_fd >= 0) {
+        close(server->ring_fd);
+    }
+    tao_common_shm_close_reader(server->reader);
+    free(server->path);
+    free(server);
+    return TAO_ERROR;
+}
+
+void tao_common_server_notify(
+    tao_common_server* server)
+{
+    uint64_t one = 1;
+    // the counter cannot overflow, the thread resets it
+    if (write(server->event_fd, &one, sizeof(one)) < 0) {
+        return;
+    }
+}
+
+int tao_common_server_clients(
+    tao_common_server* server)
+{
+    return __atomic_load_n(&server->nclients, __ATOMIC_RELAXED);
+}
+
+void tao_common_server_destroy(
+    tao_common_server* server)
+{
+    if (server == NULL) {
+        return;
+    }
+    __atomic_store_n(&server->quit, 1, __ATOMIC_RELEASE);
+    tao_common_server_notify(server);
+    pthread_join(server->thread, NULL);
+    close(server->listen_fd);
+    unlink(server->path);
+    close(server->event_fd);
+    close(server->ring_fd);
+    tao_common_shm_close_reader(server->reader);
+    free(server->path);
+    free(server);
+}
+
+tao_status tao_common_client_connect(
+    const char* path,
+    tao_common_client** client_ptr)
+{
+    tao_common_client* client;
+    struct sockaddr_un addr;
+    tao_common_server_message msg;
+    struct iovec iov = {&msg, sizeof(msg)};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct msghdr mh;
+    int ring = -1;
+
+    *client_ptr = NULL;
+    if (make_address(path, &addr) != 0) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    client = calloc(1, sizeof(*client));
+    if (client == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    client->fd = socket(AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+    if (client->fd < 0) {
+        tao_push_error("socket", errno);
+        free(client);
+        return TAO_ERROR;
+    }
+    if (connect(client->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        tao_push_error("connect", errno);
+        goto error;
+    }
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control.buf;
+    mh.msg_controllen = sizeof(control.buf);
+    ssize_t len = recvmsg(client->fd, &mh, MSG_CMSG_CLOEXEC);
+    if (len < 0) {
+        tao_push_error("recvmsg", errno);
+        goto error;
+    }
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&mh);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+        cmsg->cmsg_type == SCM_RIGHTS) {
+        memcpy(&ring, CMSG_DATA(cmsg), sizeof(int));
+    }
+    if (len != sizeof(msg) || msg.type != TAO_COMMON_SERVER_HELLO ||
+        ring < 0) {
+        tao_push_error(__func__, TAO_BAD_MAGIC);
+        goto error;
+    }
+    tao_status status = tao_common_shm_attach(ring, &client->reader);
+    close(ring);
+    if (status != TAO_OK) {
+        goto error;
+    }
+    client->latest = msg.number;
+    *client_ptr = client;
+    return TAO_OK;
+
+error:
+    if (ring >= 0) {
+        close(ring);
+    }
+    close(client->fd);
+    free(client);
+    return TAO_ERROR;
+}
+
+tao_common_shm_reader* tao_common_client_get_reader(
+    tao_common_client* client)
+{
+    return client->reader;
+}
+
+// Read the pending messages.
+static void receive(
+    tao_common_client* client)
+{
+    tao_common_server_message msg;
+
+    while (!client->stopped) {
+        ssize_t len = recv(client->fd, &msg, sizeof(msg), MSG_DONTWAIT);
+        if (len < 0 && errno == EAGAIN) {
+            return;
+        }
+        if (len != sizeof(msg) || msg.type == TAO_COMMON_SERVER_CLOSED) {
+            client->stopped = 1;
+        }
+        if (len == sizeof(msg) && msg.number > client->latest) {
+            client->latest = msg.number;
+        }
+    }
+}
+
+tao_status tao_common_client_wait(
+    tao_common_client* client,
+    uint64_t count,
+    double timeout,
+    uint64_t* published)
+{
+    int64_t deadline = tao_common_monotonic_time() + (int64_t)(timeout*1e9);
+    struct pollfd pfd = {client->fd, POLLIN, 0};
+
+    while (1) {
+        receive(client);
+        if (client->latest > count) {
+            *published = client->latest;
+            return TAO_OK;
+        }
+        int64_t left = deadline - tao_common_monotonic_time();
+        if (left <= 0 || client->stopped) {
+            *published = count;
+            return TAO_OK;
+        }
+        if (poll(&pfd, 1, (int)((left + 999999)/1000000)) < 0 &&
+            errno != EINTR) {
+            tao_push_error("poll", errno);
+            return TAO_ERROR;
+        }
+    }
+}
+
+int tao_common_client_stopped(
+    const tao_common_client* client)
+{
+    return client->stopped;
+}
+
+void tao_common_client_close(
+    tao_common_client* client)
+{
+    if (client == NULL) {
+        return;
+    }
+    close(client->fd);
+    tao_common_shm_close_reader(client->reader);
+    free(client);
+}
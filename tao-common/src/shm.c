@@ -0,0 +1,477 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*---------------------------------------------------------------------------*/
+/* SHARED FRAMES */
+
+// Slots start with this header, the pixels follow on a cache line.
+typedef struct shm_slot {
+    tao_common_seqlock lock;
+    uint32_t reserved;
+    uint64_t number;        // of the frame in the slot, 1 for the first one
+    tao_common_frame_info info;
+} shm_slot;
+
+#define SLOT_HEADER_SIZE 64
+
+struct tao_common_shm_writer {
+    char* name;             // NULL for an anonymous ring
+    int fd;                 // of an anonymous ring, -1 otherwise
+    unsigned char* data;
+    size_t size;
+    tao_common_shm_header* header;
+};
+
+struct tao_common_shm_reader {
+    const unsigned char* data;
+    size_t size;
+    const tao_common_shm_header* header;
+};
+
+static inline shm_slot* get_slot(
+    const unsigned char* data,
+    const tao_common_shm_header* hdr,
+    uint64_t number)
+{
+    return (shm_slot*)(data + hdr->header_size +
+                       ((number - 1)%hdr->nslots)*hdr->slot_stride);
+}
+
+// Whether an existing object belongs to a running acquisition.
+static int in_use(
+    const char* name)
+{
+    tao_common_shm_header hdr;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    int used = (pread(fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+                memcmp(hdr.magic, TAO_COMMON_SHM_MAGIC, 8) == 0 &&
+                hdr.closed == 0 &&
+                (kill(hdr.writer_pid, 0) == 0 || errno == EPERM));
+    close(fd);
+    return used;
+}
+
+// Size the object of `fd`, map it and fill its header.
+static tao_status map_writer(
+    tao_common_shm_writer* writer,
+    int fd,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t nslots)
+{
+    uint64_t frame_size = (uint64_t)width*height*
+        tao_common_pixel_size(pixel_type);
+    uint64_t stride = ((SLOT_HEADER_SIZE + frame_size + 4095)/4096)*4096;
+    writer->size = TAO_COMMON_SHM_HEADER_SIZE + nslots*stride;
+    if (ftruncate(fd, writer->size) != 0) {
+        tao_push_error("ftruncate", errno);
+        return TAO_ERROR;
+    }
+    writer->data = mmap(NULL, writer->size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+    if (writer->data == MAP_FAILED) {
+        tao_push_error("mmap", errno);
+        writer->data = NULL;
+        return TAO_ERROR;
+    }
+    // no page fault when publishing
+    tao_common_memory_prefault(writer->data, writer->size);
+
+    tao_common_shm_header* hdr = (tao_common_shm_header*)writer->data;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    memcpy(hdr->magic, TAO_COMMON_SHM_MAGIC, 8);
+    hdr->version = TAO_COMMON_SHM_VERSION;
+    hdr->header_size = TAO_COMMON_SHM_HEADER_SIZE;
+    hdr->width = width;
+    hdr->height = height;
+    hdr->pixel_type = pixel_type;
+    hdr->nslots = nslots;
+    hdr->frame_size = frame_size;
+    hdr->slot_stride = stride;
+    hdr->creation_time = ts.tv_sec*(int64_t)1000000000 + ts.tv_nsec;
+    hdr->writer_pid = getpid();
+    writer->header = hdr;
+    return TAO_OK;
+}
+
+static tao_status check_geometry(
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t nslots)
+{
+    if (tao_common_pixel_size(pixel_type) == 0) {
+        tao_push_error(__func__, TAO_BAD_TYPE);
+        return TAO_ERROR;
+    }
+    if (width < 1 || height < 1 || nslots < 2) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+tao_status tao_common_shm_create(
+    const char* name,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t nslots,
+    tao_common_shm_writer** writer_ptr)
+{
+    tao_common_shm_writer* writer;
+
+    *writer_ptr = NULL;
+    if (check_geometry(width, height, pixel_type, nslots) != TAO_OK) {
+        return TAO_ERROR;
+    }
+    if (in_use(name)) {
+        tao_push_error(__func__, TAO_ALREADY_IN_USE);
+        return TAO_ERROR;
+    }
+    // readers of a stale object keep it, a new one is created
+    shm_unlink(name);
+    writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    writer->fd = -1;
+    writer->name = strdup(name);
+    if (writer->name == NULL) {
+        tao_push_error("strdup", errno);
+        free(writer);
+        return TAO_ERROR;
+    }
+    int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0644);
+    if (fd < 0) {
+        tao_push_error("shm_open", errno);
+        goto error;
+    }
+    tao_status status = map_writer(writer, fd, width, height, pixel_type,
+                                   nslots);
+    close(fd);
+    if (status != TAO_OK) {
+        shm_unlink(name);
+        goto error;
+    }
+    *writer_ptr = writer;
+    return TAO_OK;
+
+error:
+    free(writer->name);
+    free(writer);
+    return TAO_ERROR;
+}
+
+tao_status tao_common_shm_create_anonymous(
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t nslots,
+    tao_common_shm_writer** writer_ptr)
+{
+    tao_common_shm_writer* writer;
+
+    *writer_ptr = NULL;
+    if (check_geometry(width, height, pixel_type, nslots) != TAO_OK) {
+        return TAO_ERROR;
+    }
+    writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    writer->fd = memfd_create("tao-frames", MFD_CLOEXEC|MFD_ALLOW_SEALING);
+    if (writer->fd < 0) {
+        tao_push_error("memfd_create", errno);
+        free(writer);
+        return TAO_ERROR;
+    }
+    if (map_writer(writer, writer->fd, width, height, pixel_type,
+                   nslots) != TAO_OK) {
+        close(writer->fd);
+        free(writer);
+        return TAO_ERROR;
+    }
+    // readers may hold the descriptor, but cannot resize the ring under the
+    // acquisition (which would raise SIGBUS)
+    if (fcntl(writer->fd, F_ADD_SEALS,
+              F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_SEAL) != 0) {
+        tao_push_error("fcntl", errno);
+        tao_common_shm_close(writer);
+        return TAO_ERROR;
+    }
+    *writer_ptr = writer;
+    return TAO_OK;
+}
+
+int tao_common_shm_get_fd(
+    const tao_common_shm_writer* writer)
+{
+    return writer->fd;
+}
+
+void* tao_common_shm_begin(
+    tao_common_shm_writer* writer)
+{
+    tao_common_shm_header* hdr = writer->header;
+    shm_slot* slot = get_slot(writer->data, hdr, hdr->published + 1);
+    tao_common_seqlock_write_begin(&slot->lock);
+    return (unsigned char*)slot + SLOT_HEADER_SIZE;
+}
+
+void tao_common_shm_end(
+    tao_common_shm_writer* writer,
+    const tao_common_frame_info* info)
+{
+    tao_common_shm_header* hdr = writer->header;
+    uint64_t number = hdr->published + 1;
+    shm_slot* slot = get_slot(writer->data, hdr, number);
+    slot->number = number;
+    if (info != NULL) {
+        slot->info = *info;
+    } else {
+        memset(&slot->info, 0, sizeof(slot->info));
+        slot->info.id = number - 1;
+    }
+    tao_common_seqlock_write_end(&slot->lock);
+    hdr->heartbeat = tao_common_monotonic_time();
+    __atomic_store_n(&hdr->published, number, __ATOMIC_RELEASE);
+}
+
+void tao_common_shm_publish(
+    tao_common_shm_writer* writer,
+    const void* data,
+    const tao_common_frame_info* info)
+{
+    void* dst = tao_common_shm_begin(writer);
+    memcpy(dst, data, writer->header->frame_size);
+    tao_common_shm_end(writer, info);
+}
+
+void tao_common_shm_close(
+    tao_common_shm_writer* writer)
+{
+    if (writer == NULL) {
+        return;
+    }
+    __atomic_store_n(&writer->header->closed, 1, __ATOMIC_RELEASE);
+    munmap(writer->data, writer->size);
+    if (writer->name != NULL) {
+        shm_unlink(writer->name);
+    } else {
+        close(writer->fd);
+    }
+    free(writer->name);
+    free(writer);
+}
+
+tao_status tao_common_shm_attach(
+    int fd,
+    tao_common_shm_reader** reader_ptr)
+{
+    tao_common_shm_reader* reader;
+    tao_common_shm_header hdr;
+    struct stat st;
+
+    *reader_ptr = NULL;
+    if (fstat(fd, &st) != 0) {
+        tao_push_error("fstat", errno);
+        return TAO_ERROR;
+    }
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        memcmp(hdr.magic, TAO_COMMON_SHM_MAGIC, 8) != 0) {
+        tao_push_error(__func__, TAO_BAD_MAGIC);
+        return TAO_ERROR;
+    }
+    if (hdr.version != TAO_COMMON_SHM_VERSION || hdr.nslots < 1 ||
+        hdr.slot_stride < SLOT_HEADER_SIZE + hdr.frame_size ||
+        (uint64_t)st.st_size < hdr.header_size + hdr.nslots*hdr.slot_stride) {
+        tao_push_error(__func__, TAO_CORRUPTED);
+        return TAO_ERROR;
+    }
+    reader = calloc(1, sizeof(*reader));
+    if (reader == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    // read-only, a reader cannot disturb the acquisition
+    reader->size = st.st_size;
+    reader->data = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (reader->data == MAP_FAILED) {
+        tao_push_error("mmap", errno);
+        free(reader);
+        return TAO_ERROR;
+    }
+    reader->header = (const tao_common_shm_header*)reader->data;
+    *reader_ptr = reader;
+    return TAO_OK;
+}
+
+tao_status tao_common_shm_open(
+    const char* name,
+    tao_common_shm_reader** reader_ptr)
+{
+    *reader_ptr = NULL;
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        tao_push_error("shm_open", errno);
+        return TAO_ERROR;
+    }
+    tao_status status = tao_common_shm_attach(fd, reader_ptr);
+    close(fd);
+    return status;
+}
+
+const tao_common_shm_header* tao_common_shm_get_header(
+    const tao_common_shm_reader* reader)
+{
+    return reader->header;
+}
+
+int tao_common_shm_stopped(
+    const tao_common_shm_reader* reader)
+{
+    const tao_common_shm_header* hdr = reader->header;
+    return (__atomic_load_n(&hdr->closed, __ATOMIC_ACQUIRE) != 0 ||
+            (kill(hdr->writer_pid, 0) != 0 && errno == ESRCH));
+}
+
+tao_status tao_common_shm_wait(
+    tao_common_shm_reader* reader,
+    uint64_t count,
+    double timeout,
+    uint64_t* published)
+{
+    const tao_common_shm_header* hdr = reader->header;
+    int64_t deadline = tao_common_monotonic_time() + (int64_t)(timeout*1e9);
+    // a fraction of a frame period of fast cameras
+    struct timespec nap = {0, 200000};
+
+    while (1) {
+        uint64_t n = __atomic_load_n(&hdr->published, __ATOMIC_ACQUIRE);
+        if (n > count) {
+            *published = n;
+            return TAO_OK;
+        }
+        if (tao_common_monotonic_time() >= deadline ||
+            tao_common_shm_stopped(reader)) {
+            *published = count;
+            return TAO_OK;
+        }
+        nanosleep(&nap, NULL);
+    }
+}
+
+tao_status tao_common_shm_read(
+    tao_common_shm_reader* reader,
+    void* dst,
+    tao_common_frame_info* info,
+    uint64_t* number)
+{
+    const tao_common_shm_header* hdr = reader->header;
+
+    // give up if the acquisition overwrites the slots faster than they are
+    // copied
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        uint64_t n = __atomic_load_n(&hdr->published, __ATOMIC_ACQUIRE);
+        if (n == 0) {
+            *number = 0;
+            return TAO_OK;
+        }
+        // the latest slot, or the previous ones if an acquisition which
+        // died while writing left it locked
+        for (uint64_t k = n; k > 0 && k + hdr->nslots > n; --k) {
+            const shm_slot* slot = get_slot(reader->data, hdr, k);
+            unsigned seq = __atomic_load_n(&slot->lock.seq, __ATOMIC_ACQUIRE);
+            if ((seq & 1) != 0) {
+                continue;
+            }
+            uint64_t found = slot->number;
+            tao_common_frame_info tmp = slot->info;
+            memcpy(dst, (const unsigned char*)slot + SLOT_HEADER_SIZE,
+                   hdr->frame_size);
+            if (tao_common_seqlock_read_retry(&slot->lock, seq) ||
+                found != k) {
+                break;
+            }
+            if (info != NULL) {
+                *info = tmp;
+            }
+            *number = found;
+            return TAO_OK;
+        }
+    }
+    tao_push_error(__func__, TAO_EXHAUSTED);
+    return TAO_ERROR;
+}
+
+tao_status tao_common_shm_peek(
+    tao_common_shm_reader* reader,
+    tao_common_shm_view* view)
+{
+    const tao_common_shm_header* hdr = reader->header;
+
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        uint64_t n = __atomic_load_n(&hdr->published, __ATOMIC_ACQUIRE);
+        if (n == 0) {
+            view->data = NULL;
+            view->number = 0;
+            return TAO_OK;
+        }
+        const shm_slot* slot = get_slot(reader->data, hdr, n);
+        unsigned seq = __atomic_load_n(&slot->lock.seq, __ATOMIC_ACQUIRE);
+        if ((seq & 1) != 0) {
+            continue;
+        }
+        uint64_t found = slot->number;
+        tao_common_frame_info info = slot->info;
+        if (tao_common_seqlock_read_retry(&slot->lock, seq) || found != n) {
+            continue;
+        }
+        view->data = (const unsigned char*)slot + SLOT_HEADER_SIZE;
+        view->info = info;
+        view->number = n;
+        view->seq = seq;
+        return TAO_OK;
+    }
+    tao_push_error(__func__, TAO_EXHAUSTED);
+    return TAO_ERROR;
+}
+
+int tao_common_shm_intact(
+    const tao_common_shm_reader* reader,
+    const tao_common_shm_view* view)
+{
+    const shm_slot* slot = get_slot(reader->data, reader->header,
+                                    view->number);
+    return (view->number > 0 &&
+            !tao_common_seqlock_read_retry(&slot->lock, view->seq));
+}
+
+void tao_common_shm_close_reader(
+    tao_common_shm_reader* reader)
+{
+    if (reader == NULL) {
+        return;
+    }
+    munmap((void*)reader->data, reader->size);
+    free(reader);
+}
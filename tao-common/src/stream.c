@@ -0,0 +1,750 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*---------------------------------------------------------------------------*/
+/* PIXELS AND FRAMES */
+
+size_t tao_common_pixel_size(
+    tao_common_pixel_type type)
+{
+    switch (type) {
+    case TAO_COMMON_UINT8:   return 1;
+    case TAO_COMMON_UINT16:  return 2;
+    case TAO_COMMON_INT16:   return 2;
+    case TAO_COMMON_UINT32:  return 4;
+    case TAO_COMMON_INT32:   return 4;
+    case TAO_COMMON_FLOAT32: return 4;
+    case TAO_COMMON_FLOAT64: return 8;
+    case TAO_COMMON_UINT64:  return 8;
+    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* FRAME STREAMS */
+
+struct tao_common_stream_writer {
+    int fd;
+    int index_fd;
+    uint64_t offset;        // offset of the next payload
+    tao_common_pool* pool;  // threads compressing the tiles
+    unsigned char* buffer;  // compressed frame
+    tao_common_stream_header header;
+};
+
+struct tao_common_stream_reader {
+    int fd;
+    int index_fd;
+    const unsigned char* data;
+    size_t data_size;
+    const tao_common_stream_record* records;
+    size_t index_size;
+    uint64_t count;
+    tao_common_stream_header header;
+};
+
+// Name of the index file of a stream, to be freed by the caller.
+static char* index_path(
+    const char* path)
+{
+    size_t len = strlen(path);
+    char* str = malloc(len + 5);
+    if (str == NULL) {
+        tao_push_error("malloc", errno);
+        return NULL;
+    }
+    memcpy(str, path, len);
+    memcpy(str + len, ".idx", 5);
+    return str;
+}
+
+static tao_status write_all(
+    int fd,
+    const void* data,
+    size_t size,
+    off_t offset)
+{
+    const char* ptr = data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, ptr, size, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tao_push_error("pwrite", errno);
+            return TAO_ERROR;
+        }
+        ptr += n;
+        size -= n;
+        offset += n;
+    }
+    return TAO_OK;
+}
+
+static void copy_string(
+    char* dst,
+    size_t size,
+    const char* src)
+{
+    if (src != NULL) {
+        strncpy(dst, src, size - 1);
+    }
+}
+
+// Layout of raw frames: page aligned payloads unless frames are tiny.
+static void raw_layout(
+    tao_common_stream_header* hdr)
+{
+    hdr->alignment = (hdr->frame_size >= 4096 ? 4096 : 64);
+    hdr->frame_stride = ((hdr->frame_size + hdr->alignment - 1)/
+                         hdr->alignment)*hdr->alignment;
+}
+
+tao_status tao_common_stream_create(
+    const char* path,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    const char* instrument,
+    const char* comment,
+    tao_common_stream_writer** writer_ptr)
+{
+    tao_common_stream_writer* writer = NULL;
+    char* idx = NULL;
+    size_t pixel_size = tao_common_pixel_size(pixel_type);
+    struct timespec now;
+
+    *writer_ptr = NULL;
+    if (width < 1 || height < 1 || pixel_size == 0) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    writer = calloc(1, sizeof(*writer));
+    if (writer == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    writer->fd = -1;
+    writer->index_fd = -1;
+
+    tao_common_stream_header* hdr = &writer->header;
+    memcpy(hdr->magic, TAO_COMMON_STREAM_MAGIC, sizeof(hdr->magic));
+    hdr->version = TAO_COMMON_STREAM_VERSION;
+    hdr->header_size = TAO_COMMON_STREAM_HEADER_SIZE;
+    hdr->width = width;
+    hdr->height = height;
+    hdr->pixel_type = pixel_type;
+    hdr->frame_size = (uint64_t)width*height*pixel_size;
+    raw_layout(hdr);
+    clock_gettime(CLOCK_REALTIME, &now);
+    hdr->creation_time = (int64_t)now.tv_sec*1000000000 + now.tv_nsec;
+    copy_string(hdr->instrument, sizeof(hdr->instrument), instrument);
+    copy_string(hdr->comment, sizeof(hdr->comment), comment);
+    writer->offset = hdr->header_size;
+
+    writer->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        tao_push_error("open", errno);
+        goto error;
+    }
+    idx = index_path(path);
+    if (idx == NULL) {
+        goto error;
+    }
+    writer->index_fd = open(idx, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (writer->index_fd < 0) {
+        tao_push_error("open", errno);
+        goto error;
+    }
+    free(idx);
+    idx = NULL;
+
+    // the header is written now so that readers can open a stream in progress
+    unsigned char block[TAO_COMMON_STREAM_HEADER_SIZE];
+    memset(block, 0, sizeof(block));
+    memcpy(block, hdr, sizeof(*hdr));
+    if (write_all(writer->fd, block, sizeof(block), 0) != TAO_OK) {
+        goto error;
+    }
+    *writer_ptr = writer;
+    return TAO_OK;
+
+error:
+    free(idx);
+    if (writer->index_fd >= 0) {
+        close(writer->index_fd);
+    }
+    if (writer->fd >= 0) {
+        close(writer->fd);
+    }
+    free(writer);
+    return TAO_ERROR;
+}
+
+tao_status tao_common_stream_set_compression(
+    tao_common_stream_writer* writer,
+    uint32_t compression,
+    uint32_t tile_rows,
+    tao_common_pool* pool)
+{
+    tao_common_stream_header* hdr = &writer->header;
+
+    if (hdr->nframes > 0 ||
+        (compression != TAO_COMMON_COMPRESS_NONE &&
+         compression != TAO_COMMON_COMPRESS_RICE) ||
+        (compression == TAO_COMMON_COMPRESS_RICE &&
+         hdr->pixel_type != TAO_COMMON_UINT16 &&
+         hdr->pixel_type != TAO_COMMON_INT16)) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    free(writer->buffer);
+    writer->buffer = NULL;
+    writer->pool = pool;
+    hdr->compression = compression;
+    if (compression == TAO_COMMON_COMPRESS_NONE) {
+        hdr->tile_rows = 0;
+        raw_layout(hdr);
+    } else {
+        if (tile_rows < 1) {
+            tile_rows = TAO_COMMON_COMPRESS_TILE_ROWS;
+        }
+        hdr->tile_rows = (tile_rows < hdr->height ? tile_rows : hdr->height);
+        hdr->alignment = 8;
+        hdr->frame_stride = 0;
+        writer->buffer = malloc(tao_common_compress_bound(
+                                    hdr->width, hdr->height, hdr->tile_rows));
+        if (writer->buffer == NULL) {
+            tao_push_error("malloc", errno);
+            return TAO_ERROR;
+        }
+    }
+    // rewrite the header for readers of a stream in progress
+    return write_all(writer->fd, hdr, sizeof(*hdr), 0);
+}
+
+tao_status tao_common_stream_append(
+    tao_common_stream_writer* writer,
+    const void* data,
+    const tao_common_frame_info* info)
+{
+    tao_common_stream_header* hdr = &writer->header;
+    tao_common_stream_record rec;
+    uint64_t size = hdr->frame_size;
+
+    if (hdr->compression == TAO_COMMON_COMPRESS_RICE) {
+        size = tao_common_compress_frame(writer->pool, writer->buffer, data,
+                                         hdr->width, hdr->height,
+                                         hdr->pixel_type, hdr->tile_rows);
+        if (size == 0) {
+            return TAO_ERROR;
+        }
+        data = writer->buffer;
+    }
+    if (write_all(writer->fd, data, size, writer->offset) != TAO_OK) {
+        return TAO_ERROR;
+    }
+    // the record is written after the payload, a reader never sees a record
+    // of a frame that is not yet in the stream file
+    memset(&rec, 0, sizeof(rec));
+    rec.id = (info != NULL ? info->id : hdr->nframes);
+    rec.host_time = (info != NULL ? info->host_time : 0);
+    rec.camera_time = (info != NULL ? info->camera_time : 0);
+    rec.orientation = (info != NULL ? info->orientation : 0);
+    rec.offset = writer->offset;
+    rec.size = size;
+    rec.flags = hdr->compression;
+    if (write_all(writer->index_fd, &rec, sizeof(rec),
+                  hdr->nframes*sizeof(rec)) != TAO_OK) {
+        return TAO_ERROR;
+    }
+    writer->offset += ((size + hdr->alignment - 1)/
+                       hdr->alignment)*hdr->alignment;
+    hdr->nframes += 1;
+    return TAO_OK;
+}
+
+uint64_t tao_common_stream_written(
+    const tao_common_stream_writer* writer)
+{
+    return writer->header.nframes;
+}
+
+tao_status tao_common_stream_close(
+    tao_common_stream_writer* writer)
+{
+    tao_status status = TAO_OK;
+    if (writer == NULL) {
+        return TAO_OK;
+    }
+    // whole last stride so that every payload can be mapped
+    if (ftruncate(writer->fd, writer->offset) != 0) {
+        tao_push_error("ftruncate", errno);
+        status = TAO_ERROR;
+    }
+    if (write_all(writer->fd, &writer->header, sizeof(writer->header),
+                  0) != TAO_OK) {
+        status = TAO_ERROR;
+    }
+    if (close(writer->index_fd) != 0) {
+        tao_push_error("close", errno);
+        status = TAO_ERROR;
+    }
+    if (close(writer->fd) != 0) {
+        tao_push_error("close", errno);
+        status = TAO_ERROR;
+    }
+    free(writer->buffer);
+    free(writer);
+    return status;
+}
+
+// Unmap and map again the files with their current size.
+static tao_status map_reader(
+    tao_common_stream_reader* reader)
+{
+    struct stat st;
+
+    if (reader->data != NULL) {
+        munmap((void*)reader->data, reader->data_size);
+        reader->data = NULL;
+    }
+    if (reader->records != NULL) {
+        munmap((void*)reader->records, reader->index_size);
+        reader->records = NULL;
+    }
+    reader->count = 0;
+    if (fstat(reader->fd, &st) != 0) {
+        tao_push_error("fstat", errno);
+        return TAO_ERROR;
+    }
+    reader->data_size = st.st_size;
+    reader->data = mmap(NULL, reader->data_size, PROT_READ, MAP_SHARED,
+                        reader->fd, 0);
+    if (reader->data == MAP_FAILED) {
+        reader->data = NULL;
+        tao_push_error("mmap", errno);
+        return TAO_ERROR;
+    }
+    if (fstat(reader->index_fd, &st) != 0) {
+        tao_push_error("fstat", errno);
+        return TAO_ERROR;
+    }
+    reader->index_size = st.st_size - st.st_size%sizeof(tao_common_stream_record);
+    if (reader->index_size > 0) {
+        reader->records = mmap(NULL, reader->index_size, PROT_READ, MAP_SHARED,
+                               reader->index_fd, 0);
+        if (reader->records == MAP_FAILED) {
+            reader->records = NULL;
+            tao_push_error("mmap", errno);
+            return TAO_ERROR;
+        }
+    }
+    // only keep frames whose payload is entirely mapped
+    uint64_t count = reader->index_size/sizeof(tao_common_stream_record);
+    while (count > 0) {
+        const tao_common_stream_record* rec = &reader->records[count - 1];
+        if (rec->offset + rec->size <= reader->data_size) {
+            break;
+        }
+        --count;
+    }
+    reader->count = count;
+    return TAO_OK;
+}
+
+tao_status tao_common_stream_open(
+    const char* path,
+    tao_common_stream_reader** reader_ptr)
+{
+    tao_common_stream_reader* reader;
+    char* idx = NULL;
+
+    *reader_ptr = NULL;
+    reader = calloc(1, sizeof(*reader));
+    if (reader == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    reader->index_fd = -1;
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        tao_push_error("open", errno);
+        goto error;
+    }
+    if (pread(reader->fd, &reader->header, sizeof(reader->header), 0)
+        != sizeof(reader->header) ||
+        memcmp(reader->header.magic, TAO_COMMON_STREAM_MAGIC,
+               sizeof(reader->header.magic)) != 0 ||
+        reader->header.version != TAO_COMMON_STREAM_VERSION) {
+        fprintf(stderr, "\"%s\" is not a TAO frame stream\n", path);
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        goto error;
+    }
+    idx = index_path(path);
+    if (idx == NULL) {
+        goto error;
+    }
+    reader->index_fd = open(idx, O_RDONLY);
+    if (reader->index_fd < 0) {
+        tao_push_error("open", errno);
+        goto error;
+    }
+    free(idx);
+    idx = NULL;
+    if (map_reader(reader) != TAO_OK) {
+        goto error;
+    }
+    *reader_ptr = reader;
+    return TAO_OK;
+
+error:
+    free(idx);
+    tao_common_stream_close_reader(reader);
+    return TAO_ERROR;
+}
+
+tao_status tao_common_stream_refresh(
+    tao_common_stream_reader* reader)
+{
+    return map_reader(reader);
+}
+
+const tao_common_stream_header* tao_common_stream_get_header(
+    const tao_common_stream_reader* reader)
+{
+    return &reader->header;
+}
+
+uint64_t tao_common_stream_count(
+    const tao_common_stream_reader* reader)
+{
+    return reader->count;
+}
+
+const tao_common_stream_record* tao_common_stream_record_get(
+    const tao_common_stream_reader* reader,
+    uint64_t index)
+{
+    return (index < reader->count ? &reader->records[index] : NULL);
+}
+
+const void* tao_common_stream_frame(
+    const tao_common_stream_reader* reader,
+    uint64_t index,
+    tao_common_frame_info* info)
+{
+    if (index >= reader->count) {
+        return NULL;
+    }
+    const tao_common_stream_record* rec = &reader->records[index];
+    if (info != NULL) {
+        info->id = rec->id;
+        info->host_time = rec->host_time;
+        info->camera_time = rec->camera_time;
+        info->orientation = rec->orientation;
+    }
+    return reader->data + rec->offset;
+}
+
+tao_status tao_common_stream_read_frame(
+    const tao_common_stream_reader* reader,
+    uint64_t index,
+    void* dst,
+    tao_common_frame_info* info,
+    tao_common_pool* pool)
+{
+    const tao_common_stream_header* hdr = &reader->header;
+    const void* src = tao_common_stream_frame(reader, index, info);
+    if (src == NULL) {
+        tao_push_error(__func__, TAO_OUT_OF_RANGE);
+        return TAO_ERROR;
+    }
+    const tao_common_stream_record* rec = &reader->records[index];
+    switch (rec->flags) {
+    case TAO_COMMON_COMPRESS_NONE:
+        if (rec->size != hdr->frame_size) {
+            break;
+        }
+        memcpy(dst, src, hdr->frame_size);
+        return TAO_OK;
+    case TAO_COMMON_COMPRESS_RICE:
+        return tao_common_decompress_frame(pool, dst, src, rec->size,
+                                           hdr->width, hdr->height,
+                                           hdr->pixel_type, hdr->tile_rows);
+    }
+    tao_push_error(__func__, TAO_CORRUPTED);
+    return TAO_ERROR;
+}
+
+void tao_common_stream_close_reader(
+    tao_common_stream_reader* reader)
+{
+    if (reader == NULL) {
+        return;
+    }
+    if (reader->data != NULL) {
+        munmap((void*)reader->data, reader->data_size);
+    }
+    if (reader->records != NULL) {
+        munmap((void*)reader->records, reader->index_size);
+    }
+    if (reader->index_fd >= 0) {
+        close(reader->index_fd);
+    }
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+    free(reader);
+}
+
+/*---------------------------------------------------------------------------*/
+/* FRAME RECORDERS */
+
+typedef struct recorder_slot {
+    const void* data;               // pixels to append
+    tao_common_frame_info info;
+    int has_info;
+} recorder_slot;
+
+struct tao_common_recorder {
+    tao_common_stream_writer* writer;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t queued;          // a frame is queued or the thread must quit
+    pthread_cond_t written;         // a slot has been released
+    unsigned nslots;
+    unsigned head;                  // next slot to write (recorder thread)
+    unsigned tail;                  // next slot to fill (producer)
+    int quit;
+    int failed;
+    uint64_t dropped;
+    size_t frame_size;
+    tao_common_frame_buffer copies; // pixels of the pushed frames
+    recorder_slot* slots;
+};
+
+static void* record(
+    void* arg)
+{
+    tao_common_recorder* rec = arg;
+
+    pthread_mutex_lock(&rec->mutex);
+    while (1) {
+        while (rec->head == rec->tail && !rec->quit) {
+            pthread_cond_wait(&rec->queued, &rec->mutex);
+        }
+        if (rec->head == rec->tail) {
+            break;
+        }
+        // the slot belongs to this thread until `head` moves past it
+        const recorder_slot* slot = &rec->slots[rec->head%rec->nslots];
+        int failed = rec->failed;
+        pthread_mutex_unlock(&rec->mutex);
+        if (!failed && tao_common_stream_append(
+                rec->writer, slot->data,
+                (slot->has_info ? &slot->info : NULL)) != TAO_OK) {
+            // nobody else can see the errors of this thread
+            tao_report_errors();
+            failed = 1;
+        }
+        pthread_mutex_lock(&rec->mutex);
+        rec->failed = failed;
+        rec->head += 1;
+        pthread_cond_broadcast(&rec->written);
+    }
+    pthread_mutex_unlock(&rec->mutex);
+    return NULL;
+}
+
+tao_status tao_common_recorder_create(
+    tao_common_stream_writer* writer,
+    int nslots,
+    int copy,
+    const tao_common_thread_config* cfg,
+    tao_common_recorder** rec_ptr)
+{
+    tao_common_recorder* rec;
+
+    *rec_ptr = NULL;
+    if (writer == NULL || nslots < 1) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    rec = calloc(1, sizeof(*rec));
+    if (rec == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    rec->writer = writer;
+    rec->nslots = nslots;
+    rec->frame_size = writer->header.frame_size;
+    rec->slots = calloc(nslots, sizeof(recorder_slot));
+    if (rec->slots == NULL) {
+        tao_push_error("calloc", errno);
+        free(rec);
+        return TAO_ERROR;
+    }
+    if (copy && tao_common_frame_buffer_alloc(&rec->copies,
+                                              (size_t)nslots*rec->frame_size,
+                                              -1) != TAO_OK) {
+        free(rec->slots);
+        free(rec);
+        return TAO_ERROR;
+    }
+    pthread_mutex_init(&rec->mutex, NULL);
+    pthread_cond_init(&rec->queued, NULL);
+    pthread_cond_init(&rec->written, NULL);
+    tao_status status;
+    if (cfg != NULL) {
+        status = tao_common_thread_create(&rec->thread, cfg, record, rec);
+    } else {
+        int code = pthread_create(&rec->thread, NULL, record, rec);
+        if (code != 0) {
+            tao_push_error("pthread_create", code);
+        }
+        status = (code == 0 ? TAO_OK : TAO_ERROR);
+    }
+    if (status != TAO_OK) {
+        pthread_cond_destroy(&rec->written);
+        pthread_cond_destroy(&rec->queued);
+        pthread_mutex_destroy(&rec->mutex);
+        tao_common_frame_buffer_free(&rec->copies);
+        free(rec->slots);
+        free(rec);
+        return TAO_ERROR;
+    }
+    *rec_ptr = rec;
+    return TAO_OK;
+}
+
+// Fill the next free slot and hand it to the recorder thread.  The caller
+// has checked that there is one; only the producer moves `tail`.
+static void enqueue(
+    tao_common_recorder* rec,
+    const void* data,
+    const tao_common_frame_info* info)
+{
+    recorder_slot* slot = &rec->slots[rec->tail%rec->nslots];
+    slot->data = data;
+    slot->has_info = (info != NULL);
+    if (info != NULL) {
+        slot->info = *info;
+    }
+    pthread_mutex_lock(&rec->mutex);
+    rec->tail += 1;
+    pthread_cond_signal(&rec->queued);
+    pthread_mutex_unlock(&rec->mutex);
+}
+
+// Status of the appended frames, `failed` is read under the lock.
+static tao_status check_failure(
+    int failed)
+{
+    if (failed) {
+        // the cause has been reported by the recorder thread
+        tao_push_error("tao_common_stream_append", TAO_CANT_TRACK_ERROR);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+tao_status tao_common_recorder_push(
+    tao_common_recorder* rec,
+    const void* data,
+    const tao_common_frame_info* info)
+{
+    if (rec->copies.data == NULL) {
+        tao_push_error(__func__, TAO_UNSUPPORTED);
+        return TAO_ERROR;
+    }
+    pthread_mutex_lock(&rec->mutex);
+    int full = (rec->tail - rec->head >= rec->nslots);
+    if (full) {
+        rec->dropped += 1;
+    }
+    int failed = rec->failed;
+    pthread_mutex_unlock(&rec->mutex);
+    if (check_failure(failed) != TAO_OK) {
+        return TAO_ERROR;
+    }
+    if (!full) {
+        // the slot is free, the copy is made without holding the lock
+        void* copy = (char*)rec->copies.data +
+            (size_t)(rec->tail%rec->nslots)*rec->frame_size;
+        memcpy(copy, data, rec->frame_size);
+        enqueue(rec, copy, info);
+    }
+    return TAO_OK;
+}
+
+tao_status tao_common_recorder_submit(
+    tao_common_recorder* rec,
+    const void* data,
+    const tao_common_frame_info* info)
+{
+    pthread_mutex_lock(&rec->mutex);
+    while (rec->tail - rec->head >= rec->nslots) {
+        pthread_cond_wait(&rec->written, &rec->mutex);
+    }
+    int failed = rec->failed;
+    pthread_mutex_unlock(&rec->mutex);
+    if (check_failure(failed) != TAO_OK) {
+        return TAO_ERROR;
+    }
+    enqueue(rec, data, info);
+    return TAO_OK;
+}
+
+tao_status tao_common_recorder_sync(
+    tao_common_recorder* rec)
+{
+    pthread_mutex_lock(&rec->mutex);
+    while (rec->head != rec->tail) {
+        pthread_cond_wait(&rec->written, &rec->mutex);
+    }
+    int failed = rec->failed;
+    pthread_mutex_unlock(&rec->mutex);
+    return check_failure(failed);
+}
+
+uint64_t tao_common_recorder_dropped(
+    tao_common_recorder* rec)
+{
+    pthread_mutex_lock(&rec->mutex);
+    uint64_t dropped = rec->dropped;
+    pthread_mutex_unlock(&rec->mutex);
+    return dropped;
+}
+
+tao_status tao_common_recorder_close(
+    tao_common_recorder* rec)
+{
+    if (rec == NULL) {
+        return TAO_OK;
+    }
+    pthread_mutex_lock(&rec->mutex);
+    rec->quit = 1;
+    pthread_cond_signal(&rec->queued);
+    pthread_mutex_unlock(&rec->mutex);
+    pthread_join(rec->thread, NULL);
+    tao_status status = check_failure(rec->failed);
+    pthread_cond_destroy(&rec->written);
+    pthread_cond_destroy(&rec->queued);
+    pthread_mutex_destroy(&rec->mutex);
+    tao_common_frame_buffer_free(&rec->copies);
+    free(rec->slots);
+    free(rec);
+    return status;
+}
@@ -0,0 +1,248 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* DISPLAY STRETCH */
+
+#define NBR_VALUES 65536
+
+struct tao_common_stretch {
+    tao_common_stretch_config cfg;
+    const tao_common_kernels* kernels;
+    double lo, hi;          // limits of the table
+    int valid;              // the limits have been set
+    uint16_t max;           // top of the highest non-empty bin
+    uint32_t* bins;
+    uint32_t* table;
+};
+
+void tao_common_stretch_config_init(
+    tao_common_stretch_config* cfg)
+{
+    cfg->mode = TAO_COMMON_STRETCH_LINEAR;
+    cfg->low = 0.5;
+    cfg->high = 99.5;
+    cfg->tolerance = 0.01;
+    cfg->shift = 4;
+    cfg->levels = 256;
+    cfg->multiplier = 1;
+}
+
+int tao_common_stretch_mode_parse(
+    const char* name)
+{
+    static const char* names[] = {"linear", "log", "sqrt", "asinh"};
+    for (int i = 0; i < 4; ++i) {
+        if (strcmp(name, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Display value of a normalized level in [0,1], the curves are those of
+// SAOImage DS9.
+static double curve(
+    tao_common_stretch_mode mode,
+    double t)
+{
+    switch (mode) {
+    case TAO_COMMON_STRETCH_LOG:
+        return log(1000.0*t + 1.0)/log(1000.0);
+    case TAO_COMMON_STRETCH_SQRT:
+        return sqrt(t);
+    case TAO_COMMON_STRETCH_ASINH:
+        return asinh(10.0*t)/asinh(10.0);
+    default:
+        return t;
+    }
+}
+
+static void build_table(
+    tao_common_stretch* stretch)
+{
+    const tao_common_stretch_config* cfg = &stretch->cfg;
+    double scale = 1.0/(stretch->hi - stretch->lo);
+    double top = cfg->levels - 1;
+
+    // the curve is only evaluated between the limits
+    double first = ceil(stretch->lo), last = floor(stretch->hi);
+    uint32_t v0 = (first > 0 ? (first < NBR_VALUES ? first : NBR_VALUES) : 0);
+    uint32_t v1 = (last >= 0 ? (last < NBR_VALUES ? last + 1 : NBR_VALUES) : 0);
+    uint32_t max = (uint32_t)top*cfg->multiplier;
+    for (uint32_t v = 0; v < v0; ++v) {
+        stretch->table[v] = 0;
+    }
+    for (uint32_t v = v0; v < v1; ++v) {
+        double t = (v - stretch->lo)*scale;
+        uint32_t level = (uint32_t)(curve(cfg->mode, t)*top + 0.5);
+        stretch->table[v] = level*cfg->multiplier;
+    }
+    for (uint32_t v = (v1 > v0 ? v1 : v0); v < NBR_VALUES; ++v) {
+        stretch->table[v] = max;
+    }
+}
+
+tao_status tao_common_stretch_create(
+    const tao_common_stretch_config* cfg,
+    tao_common_stretch** stretch_ptr)
+{
+    tao_common_stretch* stretch;
+
+    *stretch_ptr = NULL;
+    if (cfg->mode < TAO_COMMON_STRETCH_LINEAR ||
+        cfg->mode > TAO_COMMON_STRETCH_ASINH ||
+        !(cfg->low >= 0 && cfg->low < cfg->high && cfg->high <= 100) ||
+        !(cfg->tolerance >= 0) || cfg->shift < 0 || cfg->shift > 15 ||
+        cfg->levels < 2 || cfg->multiplier < 1 ||
+        (uint64_t)(cfg->levels - 1)*cfg->multiplier > UINT32_MAX) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    stretch = calloc(1, sizeof(*stretch));
+    if (stretch == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    stretch->cfg = *cfg;
+    stretch->kernels = tao_common_kernels_get();
+    // room for the partial histograms of the kernel, which stay zero
+    stretch->bins = calloc(4*(NBR_VALUES >> cfg->shift), sizeof(uint32_t));
+    stretch->table = malloc(NBR_VALUES*sizeof(uint32_t));
+    if (stretch->bins == NULL || stretch->table == NULL) {
+        tao_push_error("calloc", errno);
+        tao_common_stretch_destroy(stretch);
+        return TAO_ERROR;
+    }
+    // full range until the first frame
+    stretch->lo = 0;
+    stretch->hi = NBR_VALUES - 1;
+    build_table(stretch);
+    *stretch_ptr = stretch;
+    return TAO_OK;
+}
+
+// Value below which are `count` pixels, interpolated within its bin.
+static double percentile(
+    const uint32_t* bins,
+    size_t nbins,
+    int shift,
+    double count)
+{
+    double sum = 0;
+    for (size_t b = 0; b < nbins; ++b) {
+        if (bins[b] > 0 && sum + bins[b] >= count) {
+            double frac = (count - sum)/bins[b];
+            return ((double)b + frac)*(1 << shift);
+        }
+        sum += bins[b];
+    }
+    return (double)(nbins << shift);
+}
+
+tao_status tao_common_stretch_update(
+    tao_common_stretch* stretch,
+    const uint16_t* frame,
+    size_t n,
+    int* rebuilt)
+{
+    const tao_common_stretch_config* cfg = &stretch->cfg;
+    size_t nbins = NBR_VALUES >> cfg->shift;
+
+    if (rebuilt != NULL) {
+        *rebuilt = 0;
+    }
+    if (n < 1) {
+        tao_push_error(__func__, TAO_BAD_SIZE);
+        return TAO_ERROR;
+    }
+    memset(stretch->bins, 0, nbins*sizeof(uint32_t));
+    stretch->kernels->histogram_u16(stretch->bins, frame, n, cfg->shift);
+    size_t top = nbins - 1;
+    while (top > 0 && stretch->bins[top] == 0) {
+        --top;
+    }
+    stretch->max = ((top + 1) << cfg->shift) - 1;
+    double lo = percentile(stretch->bins, nbins, cfg->shift, cfg->low*n/100);
+    double hi = percentile(stretch->bins, nbins, cfg->shift, cfg->high*n/100);
+    if (hi < lo + 1) {
+        // flat frame
+        hi = lo + 1;
+    }
+    double tol = cfg->tolerance*(stretch->hi - stretch->lo);
+    if (stretch->valid && fabs(lo - stretch->lo) <= tol &&
+        fabs(hi - stretch->hi) <= tol) {
+        return TAO_OK;
+    }
+    stretch->lo = lo;
+    stretch->hi = hi;
+    stretch->valid = 1;
+    build_table(stretch);
+    if (rebuilt != NULL) {
+        *rebuilt = 1;
+    }
+    return TAO_OK;
+}
+
+void tao_common_stretch_set_limits(
+    tao_common_stretch* stretch,
+    double lo,
+    double hi)
+{
+    stretch->lo = lo;
+    stretch->hi = (hi >= lo + 1 ? hi : lo + 1);
+    stretch->valid = 1;
+    build_table(stretch);
+}
+
+void tao_common_stretch_get_limits(
+    const tao_common_stretch* stretch,
+    double* lo,
+    double* hi)
+{
+    *lo = stretch->lo;
+    *hi = stretch->hi;
+}
+
+uint16_t tao_common_stretch_get_max(
+    const tao_common_stretch* stretch)
+{
+    return stretch->max;
+}
+
+void tao_common_stretch_set_mode(
+    tao_common_stretch* stretch,
+    tao_common_stretch_mode mode)
+{
+    stretch->cfg.mode = mode;
+    build_table(stretch);
+}
+
+void __attribute__((optimize("tree-vectorize"))) tao_common_stretch_apply(
+    const tao_common_stretch* stretch,
+    uint32_t* restrict dst,
+    const uint16_t* restrict src,
+    size_t n)
+{
+    const uint32_t* table = stretch->table;
+    for (size_t i = 0; i < n; ++i) {
+        dst[i] = table[src[i]];
+    }
+}
+
+void tao_common_stretch_destroy(
+    tao_common_stretch* stretch)
+{
+    if (stretch == NULL) {
+        return;
+    }
+    free(stretch->bins);
+    free(stretch->table);
+    free(stretch);
+}
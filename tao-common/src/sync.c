@@ -0,0 +1,418 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <errno.h>
+#include <math.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+/* CLOCKS */
+
+int64_t tao_common_monotonic_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+int64_t tao_common_realtime_offset(void)
+{
+    struct timespec t0, t1, rt;
+    int64_t best = 0, width = INT64_MAX;
+
+    // keep the realtime reading most tightly bracketed by monotonic ones
+    for (int i = 0; i < 5; ++i) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        clock_gettime(CLOCK_REALTIME, &rt);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        int64_t m0 = (int64_t)t0.tv_sec*1000000000 + t0.tv_nsec;
+        int64_t m1 = (int64_t)t1.tv_sec*1000000000 + t1.tv_nsec;
+        if (m1 - m0 < width) {
+            width = m1 - m0;
+            best = (int64_t)rt.tv_sec*1000000000 + rt.tv_nsec - (m0 + m1)/2;
+        }
+    }
+    return best;
+}
+
+void tao_common_clock_map_init(
+    tao_common_clock_map* map)
+{
+    memset(map, 0, sizeof(*map));
+    map->slope = 1.0;
+}
+
+// Median of n values, the values are reordered.
+static double median(
+    double* val,
+    int n)
+{
+    // quickselect of the element of rank n/2
+    int lo = 0, hi = n - 1, k = n/2;
+    while (lo < hi) {
+        double pivot = val[(lo + hi)/2];
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (val[i] < pivot) ++i;
+            while (val[j] > pivot) --j;
+            if (i <= j) {
+                double tmp = val[i];
+                val[i++] = val[j];
+                val[j--] = tmp;
+            }
+        }
+        if (k <= j) {
+            hi = j;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+    return val[k];
+}
+
+// Least squares fit of the samples whose residual is in [lo,hi] (all samples
+// if res is NULL).  Returns the number of samples used.
+static int fit(
+    tao_common_clock_map* map,
+    const double* res,
+    double lo,
+    double hi,
+    double* slope,
+    double* offset)
+{
+    int n = 0;
+    double xm = 0, ym = 0;
+    for (int i = 0; i < map->count; ++i) {
+        if (res != NULL && (res[i] < lo || res[i] > hi)) {
+            continue;
+        }
+        xm += map->camera[i];
+        ym += map->host[i];
+        ++n;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    xm /= n;
+    ym /= n;
+    double sxx = 0, sxy = 0;
+    for (int i = 0; i < map->count; ++i) {
+        if (res != NULL && (res[i] < lo || res[i] > hi)) {
+            continue;
+        }
+        double dx = map->camera[i] - xm;
+        sxx += dx*dx;
+        sxy += dx*(map->host[i] - ym);
+    }
+    // assume synchronous clocks until the samples span some time
+    *slope = (sxx > 0 && n >= 8 ? sxy/sxx : 1.0);
+    *offset = ym - *slope*xm;
+    return n;
+}
+
+void tao_common_clock_map_update(
+    tao_common_clock_map* map,
+    int64_t camera_time,
+    int64_t host_time)
+{
+    double res[TAO_COMMON_CLOCK_MAP_SAMPLES], tmp[TAO_COMMON_CLOCK_MAP_SAMPLES];
+    double slope, offset;
+
+    if (map->count == 0) {
+        map->camera_ref = camera_time;
+        map->host_ref = host_time;
+    }
+    map->camera[map->next] = (double)(camera_time - map->camera_ref);
+    map->host[map->next] = (double)(host_time - map->host_ref);
+    map->next = (map->next + 1)%TAO_COMMON_CLOCK_MAP_SAMPLES;
+    if (map->count < TAO_COMMON_CLOCK_MAP_SAMPLES) {
+        map->count += 1;
+    }
+
+    // first fit on all samples
+    int n = map->count;
+    fit(map, NULL, 0, 0, &slope, &offset);
+    for (int i = 0; i < n; ++i) {
+        res[i] = map->host[i] - (offset + slope*map->camera[i]);
+        tmp[i] = res[i];
+    }
+
+    // reject the samples delayed (or early) by more than 3 sigma, sigma being
+    // estimated from the median absolute deviation of the residuals
+    double med = median(tmp, n);
+    for (int i = 0; i < n; ++i) {
+        tmp[i] = fabs(res[i] - med);
+    }
+    double sigma = 1.4826*median(tmp, n);
+    int used = n;
+    if (sigma > 0) {
+        used = fit(map, res, med - 3*sigma, med + 3*sigma, &slope, &offset);
+        if (used == 0) {
+            fit(map, NULL, 0, 0, &slope, &offset);
+            used = n;
+        }
+    }
+
+    // shift the line to the earliest arrivals (lower envelope) so that the
+    // mapped times do not include the variable part of the latency
+    double lowest = 0;
+    int first = 1;
+    for (int i = 0; i < n; ++i) {
+        double r = map->host[i] - (offset + slope*map->camera[i]);
+        if (sigma > 0 && fabs(res[i] - med) > 3*sigma) {
+            continue;
+        }
+        if (first || r < lowest) {
+            lowest = r;
+            first = 0;
+        }
+    }
+    map->slope = slope;
+    map->offset = offset + lowest;
+    map->jitter = sigma;
+    map->rejected = n - used;
+}
+
+int64_t tao_common_clock_map_to_host(
+    const tao_common_clock_map* map,
+    int64_t camera_time)
+{
+    double dt = (double)(camera_time - map->camera_ref);
+    return map->host_ref + (int64_t)(map->offset + map->slope*dt);
+}
+
+double tao_common_clock_map_drift(
+    const tao_common_clock_map* map)
+{
+    return (map->slope - 1.0)*1e6;
+}
+
+/*---------------------------------------------------------------------------*/
+/* FRAME MERGING */
+
+// Single producer, single consumer queue.
+typedef struct merger_queue {
+    tao_common_frame_info* items;
+    unsigned head;          // next item to read (consumer)
+    unsigned tail;          // next item to write (producer)
+    uint64_t lost;
+} merger_queue;
+
+struct tao_common_merger {
+    unsigned mask;          // capacity - 1, capacity is a power of 2
+    int64_t tolerance;
+    int64_t max_wait;
+    sem_t sem;              // posted for every queued frame, a wake-up hint
+    merger_queue queue[2];
+};
+
+tao_status tao_common_merger_create(
+    int capacity,
+    int64_t tolerance,
+    int64_t max_wait,
+    tao_common_merger** merger_ptr)
+{
+    tao_common_merger* merger;
+    unsigned size = 2;
+
+    *merger_ptr = NULL;
+    if (capacity < 1 || tolerance < 0 || max_wait < 0) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    while (size < (unsigned)capacity) {
+        size *= 2;
+    }
+    merger = calloc(1, sizeof(*merger));
+    if (merger == NULL) {
+        tao_push_error("calloc", errno);
+        return TAO_ERROR;
+    }
+    for (int i = 0; i < 2; ++i) {
+        merger->queue[i].items = calloc(size, sizeof(tao_common_frame_info));
+        if (merger->queue[i].items == NULL) {
+            tao_push_error("calloc", errno);
+            free(merger->queue[0].items);
+            free(merger);
+            return TAO_ERROR;
+        }
+    }
+    merger->mask = size - 1;
+    merger->tolerance = tolerance;
+    merger->max_wait = max_wait;
+    sem_init(&merger->sem, 0, 0);
+    *merger_ptr = merger;
+    return TAO_OK;
+}
+
+void tao_common_merger_destroy(
+    tao_common_merger* merger)
+{
+    if (merger != NULL) {
+        sem_destroy(&merger->sem);
+        free(merger->queue[0].items);
+        free(merger->queue[1].items);
+        free(merger);
+    }
+}
+
+tao_status tao_common_merger_push(
+    tao_common_merger* merger,
+    int source,
+    const tao_common_frame_info* info)
+{
+    if (source < 0 || source > 1) {
+        tao_push_error(__func__, TAO_BAD_VALUE);
+        return TAO_ERROR;
+    }
+    merger_queue* q = &merger->queue[source];
+    unsigned tail = q->tail;
+    if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) > merger->mask) {
+        __atomic_add_fetch(&q->lost, 1, __ATOMIC_RELAXED);
+        return TAO_OK;
+    }
+    q->items[tail & merger->mask] = *info;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    sem_post(&merger->sem);
+    return TAO_OK;
+}
+
+uint64_t tao_common_merger_lost(
+    const tao_common_merger* merger,
+    int source)
+{
+    return __atomic_load_n(&merger->queue[source & 1].lost, __ATOMIC_RELAXED);
+}
+
+// Number of queued frames of a source and address of the k-th one.
+static unsigned queued(
+    tao_common_merger* merger,
+    int source)
+{
+    merger_queue* q = &merger->queue[source];
+    return __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) - q->head;
+}
+
+static const tao_common_frame_info* peek(
+    tao_common_merger* merger,
+    int source,
+    unsigned k)
+{
+    merger_queue* q = &merger->queue[source];
+    return &q->items[(q->head + k) & merger->mask];
+}
+
+static void take(
+    tao_common_merger* merger,
+    int source,
+    tao_common_merged* result)
+{
+    merger_queue* q = &merger->queue[source];
+    result->mask |= (1 << source);
+    result->frame[source] = q->items[q->head & merger->mask];
+    __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+}
+
+static int64_t distance(
+    const tao_common_frame_info* a,
+    const tao_common_frame_info* b)
+{
+    int64_t d = a->host_time - b->host_time;
+    return (d < 0 ? -d : d);
+}
+
+// Try to produce a result with the queued frames.  `*wake` is set to the
+// time when a waiting frame has to be given alone.
+static int merge(
+    tao_common_merger* merger,
+    tao_common_merged* result,
+    int64_t now,
+    int64_t* wake)
+{
+    unsigned n[2] = {queued(merger, 0), queued(merger, 1)};
+    *wake = INT64_MAX;
+    result->mask = 0;
+    if (n[0] > 0 && n[1] > 0) {
+        const tao_common_frame_info* f[2] = {peek(merger, 0, 0),
+                                             peek(merger, 1, 0)};
+        int64_t d = distance(f[0], f[1]);
+        if (d > merger->tolerance) {
+            // the older frame cannot be paired with any later frame
+            take(merger, (f[0]->host_time < f[1]->host_time ? 0 : 1), result);
+            return 1;
+        }
+        // the next frame of a source may be a better match
+        int ready = 1;
+        for (int s = 0; s < 2; ++s) {
+            if (f[s]->host_time >= f[1 - s]->host_time) {
+                continue;
+            }
+            if (n[s] > 1) {
+                if (distance(peek(merger, s, 1), f[1 - s]) < d) {
+                    take(merger, s, result);
+                    return 1;
+                }
+            } else {
+                ready = 0;
+            }
+        }
+        if (ready || now >= f[0]->host_time + merger->max_wait ||
+            now >= f[1]->host_time + merger->max_wait) {
+            take(merger, 0, result);
+            take(merger, 1, result);
+            return 1;
+        }
+    }
+    // frames without partner for too long are given alone
+    for (int s = 0; s < 2; ++s) {
+        if (n[s] > 0) {
+            int64_t limit = peek(merger, s, 0)->host_time + merger->max_wait;
+            if (now >= limit) {
+                take(merger, s, result);
+                return 1;
+            }
+            if (limit < *wake) {
+                *wake = limit;
+            }
+        }
+    }
+    return 0;
+}
+
+int tao_common_merger_pop(
+    tao_common_merger* merger,
+    tao_common_merged* result,
+    double timeout)
+{
+    int64_t deadline = tao_common_monotonic_time() + (int64_t)(timeout*1e9);
+    while (1) {
+        // the semaphore only wakes the consumer up, posts of the frames about
+        // to be examined are consumed so that it does not grow without bound
+        // (a frame pushed after this point posts again)
+        while (sem_trywait(&merger->sem) == 0) {
+        }
+        int64_t now = tao_common_monotonic_time();
+        int64_t wake;
+        if (merge(merger, result, now, &wake)) {
+            return 1;
+        }
+        if (now >= deadline) {
+            return 0;
+        }
+        if (wake > deadline) {
+            wake = deadline;
+        }
+        struct timespec ts = {wake/1000000000, wake%1000000000};
+        if (sem_clockwait(&merger->sem, CLOCK_MONOTONIC, &ts) != 0 &&
+            errno != ETIMEDOUT && errno != EINTR) {
+            tao_push_error("sem_clockwait", errno);
+            return 0;
+        }
+    }
+}
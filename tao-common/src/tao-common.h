@@ -0,0 +1,1713 @@
+#ifndef TAO_COMMON_H_
+#define TAO_COMMON_H_ 1
+
+#include <tao.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*---------------------------------------------------------------------------*/
+/* THREADS */
+
+/* Maximum number of CPUs that can be listed in a thread configuration. */
+#define TAO_COMMON_THREAD_MAX_CPUS 256
+
+/**
+ * Real-time configuration of an acquisition or processing thread.
+ *
+ * A configuration is initialized by tao_common_thread_config_init() which
+ * leaves the scheduling of the thread untouched.  Fields are then set by the
+ * caller before the configuration is applied.
+ */
+typedef struct tao_common_thread_config {
+    const char* name;     /**< Thread name (at most 15 characters), or NULL */
+    int ncpus;            /**< Number of CPUs in `cpus`, 0 to keep affinity */
+    int cpus[TAO_COMMON_THREAD_MAX_CPUS]; /**< CPUs the thread may run on */
+    int priority;         /**< SCHED_FIFO priority, 0 for SCHED_OTHER */
+    int nice;             /**< Nice value for SCHED_OTHER, 0 to keep it */
+    int lock_memory;      /**< Lock all process pages with mlockall() */
+    size_t stack_prefault;/**< Number of stack bytes to touch, 0 for none */
+} tao_common_thread_config;
+
+/**
+ * Initialize a thread configuration.
+ *
+ * The configuration is set so that applying it does nothing.
+ */
+extern void tao_common_thread_config_init(
+    tao_common_thread_config* cfg);
+
+/**
+ * Parse a list of CPUs.
+ *
+ * This function stores in the thread configuration the CPUs given by a
+ * list like "2,4-7" (the syntax of `taskset -c`).
+ */
+extern tao_status tao_common_thread_config_parse_cpus(
+    tao_common_thread_config* cfg,
+    const char* list);
+
+/**
+ * Apply a configuration to the calling thread.
+ *
+ * All requested settings are attempted even though some fail (typically
+ * SCHED_FIFO or mlockall() without the needed privileges).  TAO_ERROR is
+ * returned if any of them failed, tao_common_thread_report() can then be
+ * called to see what has been achieved.
+ */
+extern tao_status tao_common_thread_apply(
+    const tao_common_thread_config* cfg);
+
+/**
+ * Create a configured thread.
+ *
+ * The new thread applies the configuration, reports the achieved settings
+ * on the standard error output, then calls `func(arg)`.  Failing to apply
+ * the configuration is not fatal: the thread still runs with whatever
+ * settings could be achieved.  The configuration is copied so the caller
+ * does not need to keep it.
+ */
+extern tao_status tao_common_thread_create(
+    pthread_t* thread_ptr,
+    const tao_common_thread_config* cfg,
+    void* (*func)(void*),
+    void* arg);
+
+/**
+ * Report the scheduling of the calling thread.
+ *
+ * The effective CPU affinity, scheduling policy, priority and nice value of
+ * the calling thread and the amount of locked memory of the process are
+ * printed.
+ */
+extern void tao_common_thread_report(
+    FILE* output,
+    const char* name);
+
+/**
+ * Lock the pages of the process in memory.
+ *
+ * Current and future pages are locked with mlockall() so that they never
+ * cause page faults once touched.
+ */
+extern tao_status tao_common_memory_lock(void);
+
+/**
+ * Prefault a buffer.
+ *
+ * Every page of the buffer is written so that it is mapped (and locked if
+ * tao_common_memory_lock() has been called) before real-time use.  The
+ * contents of the buffer is zero-filled.
+ */
+extern void tao_common_memory_prefault(
+    void* data,
+    size_t size);
+
+/**
+ * Pool of worker threads.
+ *
+ * A pool runs batches of independent jobs: tao_common_pool_run() calls a
+ * job function for every job index, in parallel on the workers and on the
+ * calling thread, and returns when all jobs are done.
+ */
+typedef struct tao_common_pool tao_common_pool;
+
+typedef void tao_common_pool_job(
+    void* arg,
+    int index);
+
+/**
+ * Create a pool of worker threads.
+ *
+ * The `nthreads` workers are created with configuration `cfg` (may be NULL).
+ * As the caller of tao_common_pool_run() also executes jobs, a pool with
+ * `nthreads = 0` is valid and runs everything in the calling thread.
+ */
+extern tao_status tao_common_pool_create(
+    int nthreads,
+    const tao_common_thread_config* cfg,
+    tao_common_pool** pool_ptr);
+
+/**
+ * Run a batch of jobs.
+ *
+ * `job(arg, i)` is called once for each `i` in `0` to `njobs - 1`.  Batches
+ * are serialized if several threads use the same pool.
+ */
+extern void tao_common_pool_run(
+    tao_common_pool* pool,
+    int njobs,
+    tao_common_pool_job* job,
+    void* arg);
+
+typedef void tao_common_pool_rows_job(
+    void* arg,
+    uint32_t y0,
+    uint32_t y1);
+
+/**
+ * Run a batch of jobs on the rows of an image.
+ *
+ * The `height` rows are split in a few blocks per thread, `job(arg, y0, y1)`
+ * processes rows `y0` to `y1 - 1`.  Blocks have a multiple of `granularity`
+ * rows (except the last one), e.g. to keep a few rows or whole tiles per job.
+ */
+extern void tao_common_pool_run_rows(
+    tao_common_pool* pool,
+    uint32_t height,
+    uint32_t granularity,
+    tao_common_pool_rows_job* job,
+    void* arg);
+
+/**
+ * Get the number of threads running jobs, including the caller.
+ */
+extern int tao_common_pool_size(
+    const tao_common_pool* pool);
+
+extern void tao_common_pool_destroy(
+    tao_common_pool* pool);
+
+/*---------------------------------------------------------------------------*/
+/* FRAME BUFFERS */
+
+/* Size of the huge pages used for frame buffers. */
+#define TAO_COMMON_HUGE_PAGE_SIZE (2*1024*1024)
+
+/**
+ * Frame buffer.
+ *
+ * Frame buffers are mapped directly from the kernel so that they can be
+ * backed by huge pages and placed on a given NUMA node.  `huge` is 1 if the
+ * buffer uses reserved huge pages (see `/proc/sys/vm/nr_hugepages`), 2 if
+ * transparent huge pages have been requested instead, 0 for normal pages.
+ */
+typedef struct tao_common_frame_buffer {
+    void* data;           /**< Address of the buffer (page aligned) */
+    size_t size;          /**< Requested size in bytes */
+    size_t mapped;        /**< Size of the mapping in bytes */
+    int huge;             /**< Kind of pages backing the buffer */
+    int node;             /**< NUMA node of the buffer, -1 if not bound */
+} tao_common_frame_buffer;
+
+/**
+ * Get the NUMA node of a CPU.
+ *
+ * The node of the CPU running the caller is given if `cpu` is negative.
+ * The result is -1 if it cannot be determined (no NUMA support).
+ */
+extern int tao_common_numa_node(
+    int cpu);
+
+/**
+ * Get the NUMA node where a configured thread will run.
+ *
+ * The node of the first CPU of the configuration is given, or -1 if the
+ * configuration does not set the CPU affinity.
+ */
+extern int tao_common_thread_config_node(
+    const tao_common_thread_config* cfg);
+
+/**
+ * Allocate a frame buffer.
+ *
+ * Huge pages are used when there are enough reserved ones, page aligned
+ * memory otherwise.  If `node` is not negative, the pages are allocated on
+ * this NUMA node; otherwise they are allocated on the node of the thread
+ * which prefaults them, so a buffer should be allocated by the thread that
+ * uses it.  In all cases the buffer is zero-filled and every page is
+ * faulted in before the function returns.
+ */
+extern tao_status tao_common_frame_buffer_alloc(
+    tao_common_frame_buffer* buf,
+    size_t size,
+    int node);
+
+/**
+ * Release a frame buffer.
+ *
+ * Nothing is done for a buffer which has not been allocated or has already
+ * been released.
+ */
+extern void tao_common_frame_buffer_free(
+    tao_common_frame_buffer* buf);
+
+/*---------------------------------------------------------------------------*/
+/* SEQUENCE LOCKS */
+
+/**
+ * Sequence lock.
+ *
+ * A sequence lock protects data written by a single thread and read by any
+ * number of threads without ever blocking the writer: readers copy the data
+ * and retry if the writer has modified it meanwhile.  The sequence number is
+ * odd while the data is being written.  A zero-filled structure is a valid
+ * unlocked sequence lock.
+ */
+typedef struct tao_common_seqlock {
+    unsigned seq;
+} tao_common_seqlock;
+
+static inline void tao_common_seqlock_write_begin(
+    tao_common_seqlock* lock)
+{
+    __atomic_store_n(&lock->seq, lock->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void tao_common_seqlock_write_end(
+    tao_common_seqlock* lock)
+{
+    __atomic_store_n(&lock->seq, lock->seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline unsigned tao_common_seqlock_read_begin(
+    const tao_common_seqlock* lock)
+{
+    unsigned seq;
+    while (((seq = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE)) & 1) != 0) {
+        __builtin_ia32_pause();
+    }
+    return seq;
+}
+
+static inline int tao_common_seqlock_read_retry(
+    const tao_common_seqlock* lock,
+    unsigned seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&lock->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/**
+ * Copy data protected by a sequence lock.
+ *
+ * The `size` bytes at `src` are copied to `dst` until a consistent copy is
+ * obtained.  Yields the sequence number of the copy.
+ */
+static inline unsigned tao_common_seqlock_read(
+    const tao_common_seqlock* lock,
+    void* dst,
+    const volatile void* src,
+    size_t size)
+{
+    unsigned seq;
+    do {
+        seq = tao_common_seqlock_read_begin(lock);
+        __builtin_memcpy(dst, (const void*)src, size);
+    } while (tao_common_seqlock_read_retry(lock, seq));
+    return seq;
+}
+
+/*---------------------------------------------------------------------------*/
+/* PIXELS AND FRAMES */
+
+/**
+ * Pixel types of frames.
+ */
+typedef enum tao_common_pixel_type {
+    TAO_COMMON_UINT8   = 1,
+    TAO_COMMON_UINT16  = 2,
+    TAO_COMMON_INT16   = 3,
+    TAO_COMMON_UINT32  = 4,
+    TAO_COMMON_INT32   = 5,
+    TAO_COMMON_FLOAT32 = 6,
+    TAO_COMMON_FLOAT64 = 7,
+    TAO_COMMON_UINT64  = 8,
+} tao_common_pixel_type;
+
+/**
+ * Get the size of a pixel type in bytes, 0 if the type is invalid.
+ */
+extern size_t tao_common_pixel_size(
+    tao_common_pixel_type type);
+
+/**
+ * Metadata of a frame.
+ */
+typedef struct tao_common_frame_info {
+    uint64_t id;          /**< Frame number given by the acquisition */
+    int64_t host_time;    /**< Host CLOCK_MONOTONIC time stamp (ns) */
+    int64_t camera_time;  /**< Camera time stamp (ns), 0 if unknown */
+    uint32_t orientation; /**< Applied on the host, see tao_common_orient() */
+} tao_common_frame_info;
+
+/*---------------------------------------------------------------------------*/
+/* PIXEL KERNELS */
+
+/*
+ * Vectorized loops over `n` contiguous pixels.  Every kernel is compiled for
+ * SSE2, AVX2 and AVX-512 (on x86) and the table of the best instruction set
+ * of the CPU is chosen at run time, so a single binary uses the widest
+ * registers of each host.  Unless stated otherwise, the destination must not
+ * overlap the sources.
+ */
+typedef struct tao_common_kernels {
+    const char* isa;    /**< "avx512", "avx2", "sse2" or "generic" */
+    void (*convert_u8_f32)(float* dst, const uint8_t* src, size_t n);
+    void (*convert_u16_f32)(float* dst, const uint16_t* src, size_t n);
+    void (*convert_u16_u32)(uint32_t* dst, const uint16_t* src, size_t n);
+    void (*convert_u16_u64)(uint64_t* dst, const uint16_t* src, size_t n);
+    /** Rounded to the nearest integer and saturated. */
+    void (*convert_f32_u16)(uint16_t* dst, const float* src, size_t n);
+    /** `dst = a*src + b`, `dst` may be `src`. */
+    void (*scale_f32)(float* dst, const float* src, size_t n,
+                      float a, float b);
+    /** `dst = a*src + b` saturated to 0-255 (e.g. for display). */
+    void (*scale_u16_u8)(uint8_t* dst, const uint16_t* src, size_t n,
+                         float a, float b);
+    void (*minmax_u16)(const uint16_t* src, size_t n,
+                       uint16_t* min, uint16_t* max);
+    /** NaN are ignored, +inf and -inf if there are only NaN. */
+    void (*minmax_f32)(const float* src, size_t n, float* min, float* max);
+    /** Add to `65536 >> shift` bins the pixels divided by `2^shift`.
+        `bins` has room for 4 times as many counts, the last 3/4 are
+        scratch which must be zero and are left zero. */
+    void (*histogram_u16)(uint32_t* bins, const uint16_t* src, size_t n,
+                          int shift);
+    /** Each pixel repeated `factor` times: `dst[i*factor + k] = src[i]`
+        (e.g. to enlarge a row for display). */
+    void (*repeat_u32)(uint32_t* dst, const uint32_t* src, size_t n,
+                       int factor);
+    void (*subtract_f32)(float* dst, const float* a, const float* b,
+                         size_t n);
+    void (*multiply_f32)(float* dst, const float* a, const float* b,
+                         size_t n);
+    /** `sum += src`, widening. */
+    void (*accumulate_u16_u32)(uint32_t* sum, const uint16_t* src, size_t n);
+    void (*accumulate_u16_u64)(uint64_t* sum, const uint16_t* src, size_t n);
+    /** `dst` (`height` by `width`) is the transpose of `src`. */
+    void (*transpose_u16)(uint16_t* dst, const uint16_t* src,
+                          size_t width, size_t height);
+    void (*transpose_f32)(float* dst, const float* src,
+                          size_t width, size_t height);
+} tao_common_kernels;
+
+/**
+ * Get the kernels of the best instruction set of the CPU.
+ *
+ * The choice is made at the first call.  The environment variable
+ * `TAO_COMMON_ISA` may name a lower instruction set, e.g. to compare hosts.
+ */
+extern const tao_common_kernels* tao_common_kernels_get(void);
+
+/**
+ * Get the kernels of a given instruction set.
+ *
+ * The result is NULL if the instruction set is unknown or not supported by
+ * the CPU.
+ */
+extern const tao_common_kernels* tao_common_kernels_select(
+    const char* isa);
+
+/*---------------------------------------------------------------------------*/
+/* ORIENTATION */
+
+/*
+ * Orientations are a number of quarter turns clockwise (bits 0 and 1)
+ * applied after an optional left-right mirror (bit 2), so the 8 rotations
+ * and flips of a frame are the values 0 to 7.  A frame is oriented once on
+ * the host, when it is acquired, and its orientation is kept in its
+ * metadata instead of having every consumer rotate it.
+ */
+typedef enum tao_common_orientation {
+    TAO_COMMON_ORIENT_NONE      = 0,
+    TAO_COMMON_ORIENT_ROTATE90  = 1,
+    TAO_COMMON_ORIENT_ROTATE180 = 2,
+    TAO_COMMON_ORIENT_ROTATE270 = 3,
+    TAO_COMMON_ORIENT_FLIP_X    = 4, /**< Left-right mirror */
+    TAO_COMMON_ORIENT_FLIP_Y    = 6, /**< Up-down mirror */
+} tao_common_orientation;
+
+/**
+ * Get the orientation for a clockwise rotation by `degrees` (a multiple of
+ * 90, possibly negative) after a left-right mirror if `flip` is nonzero.
+ *
+ * The result is -1 if `degrees` is not a multiple of 90.
+ */
+extern int tao_common_orientation_from_degrees(
+    int degrees,
+    int flip);
+
+/**
+ * Get the size of an oriented frame of `width` by `height` pixels, the
+ * dimensions are swapped by odd numbers of quarter turns.
+ */
+extern void tao_common_orient_size(
+    int orientation,
+    uint32_t width,
+    uint32_t height,
+    uint32_t* dst_width,
+    uint32_t* dst_height);
+
+/**
+ * Orient a frame.
+ *
+ * `src` has `width` by `height` pixels of any type, `dst` must have room for
+ * the same number of pixels and must not overlap `src`.  Rotations by odd
+ * numbers of quarter turns are transposes done by square tiles that fit in
+ * the L1 cache; bands of tiles are shared between the threads of `pool`
+ * which may be NULL.
+ */
+extern tao_status tao_common_orient(
+    tao_common_pool* pool,
+    void* dst,
+    const void* src,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type type,
+    int orientation);
+
+/*---------------------------------------------------------------------------*/
+/* DISPLAY STRETCH */
+
+/*
+ * Auto-contrast of 16-bit frames for display.  The limits are percentiles of
+ * the histogram of each frame and a table of 65536 display values is built
+ * again only when they move, so displaying a frame costs one lookup per
+ * pixel.  Display values are `level*multiplier` with `levels` levels: for
+ * instance 1024 levels and a multiplier of 0x100401 give gray pixels of
+ * Cairo RGB30 surfaces.
+ */
+typedef enum tao_common_stretch_mode {
+    TAO_COMMON_STRETCH_LINEAR = 0,
+    TAO_COMMON_STRETCH_LOG    = 1,
+    TAO_COMMON_STRETCH_SQRT   = 2,
+    TAO_COMMON_STRETCH_ASINH  = 3,
+} tao_common_stretch_mode;
+
+typedef struct tao_common_stretch_config {
+    tao_common_stretch_mode mode;
+    double low, high;       /**< Percentiles of the limits, in percent */
+    double tolerance;       /**< Move of the limits, relative to their
+                                 range, before the table is rebuilt */
+    int shift;              /**< Histogram bins of 2^shift values */
+    uint32_t levels;        /**< Number of display levels */
+    uint32_t multiplier;    /**< Display value of level 1 */
+} tao_common_stretch_config;
+
+typedef struct tao_common_stretch tao_common_stretch;
+
+/**
+ * Default stretch: linear between the 0.5 and 99.5 percentiles, limits
+ * moving by more than 1% of their range, bins of 16 values, 256 levels and
+ * a multiplier of 1.
+ */
+extern void tao_common_stretch_config_init(
+    tao_common_stretch_config* cfg);
+
+/**
+ * Get the stretch mode named "linear", "log", "sqrt" or "asinh", -1 if the
+ * name is unknown.
+ */
+extern int tao_common_stretch_mode_parse(
+    const char* name);
+
+extern tao_status tao_common_stretch_create(
+    const tao_common_stretch_config* cfg,
+    tao_common_stretch** stretch_ptr);
+
+/**
+ * Update the limits from a frame of `n` pixels.
+ *
+ * The table is rebuilt if the limits moved by more than the tolerance;
+ * `rebuilt` (if not NULL) is set to 1 when it is.  The limits within a bin
+ * are interpolated from its count.
+ */
+extern tao_status tao_common_stretch_update(
+    tao_common_stretch* stretch,
+    const uint16_t* frame,
+    size_t n,
+    int* rebuilt);
+
+/**
+ * Use fixed limits instead (until the next update), for instance to
+ * freeze the contrast.
+ */
+extern void tao_common_stretch_set_limits(
+    tao_common_stretch* stretch,
+    double lo,
+    double hi);
+
+extern void tao_common_stretch_get_limits(
+    const tao_common_stretch* stretch,
+    double* lo,
+    double* hi);
+
+/**
+ * Maximum of the last updated frame, to the bin: the top of the highest
+ * non-empty bin (exact with a shift of 0).
+ */
+extern uint16_t tao_common_stretch_get_max(
+    const tao_common_stretch* stretch);
+
+/**
+ * Change the stretch mode, the table is rebuilt.
+ */
+extern void tao_common_stretch_set_mode(
+    tao_common_stretch* stretch,
+    tao_common_stretch_mode mode);
+
+/**
+ * Map `n` pixels to display values with the current table.
+ */
+extern void tao_common_stretch_apply(
+    const tao_common_stretch* stretch,
+    uint32_t* dst,
+    const uint16_t* src,
+    size_t n);
+
+extern void tao_common_stretch_destroy(
+    tao_common_stretch* stretch);
+
+/*---------------------------------------------------------------------------*/
+/* CALIBRATION */
+
+/*
+ * A calibrator applies `(raw - bias - dark*exposure)/flat` and replaces bad
+ * pixels by the mean of the nearest good pixels of the same row, in a single
+ * pass over the frame.  The maps are stored interleaved by blocks of pixels
+ * so that the kernel reads one stream of calibration data and rows are split
+ * between the threads of a pool.
+ */
+typedef struct tao_common_calib tao_common_calib;
+
+/**
+ * Create a calibrator for frames of `width` by `height` pixels.
+ *
+ * The calibrator does nothing until its maps are set.
+ */
+extern tao_status tao_common_calib_create(
+    uint32_t width,
+    uint32_t height,
+    tao_common_calib** calib_ptr);
+
+/**
+ * Set the calibration maps.
+ *
+ * `bias`, `dark` (per second of exposure) and `flat` have one value per
+ * pixel, any of them may be NULL (0 for the bias and the dark, 1 for the
+ * flat).  Pixels for which `bad` is nonzero or the flat is not positive are
+ * bad pixels.  Must not be called during tao_common_calib_apply().
+ */
+extern tao_status tao_common_calib_set_maps(
+    tao_common_calib* calib,
+    const float* bias,
+    const float* dark,
+    const float* flat,
+    const uint8_t* bad);
+
+/**
+ * Mark more pixels as bad.
+ *
+ * `index` lists `count` pixel indices (`x + width*y`), typically found by
+ * tao_common_defects_find().  The other maps are unchanged.
+ */
+extern tao_status tao_common_calib_add_bad_pixels(
+    tao_common_calib* calib,
+    const uint32_t* index,
+    uint32_t count);
+
+/**
+ * Get the number of bad pixels.
+ */
+extern uint32_t tao_common_calib_bad_count(
+    const tao_common_calib* calib);
+
+/**
+ * Calibrate a frame.
+ *
+ * `src` has pixels of type TAO_COMMON_UINT8, TAO_COMMON_UINT16,
+ * TAO_COMMON_INT16 or TAO_COMMON_FLOAT32, `exposure` is in seconds and
+ * `pool` may be NULL to calibrate in the calling thread.
+ */
+extern tao_status tao_common_calib_apply(
+    const tao_common_calib* calib,
+    tao_common_pool* pool,
+    float* dst,
+    const void* src,
+    tao_common_pixel_type type,
+    double exposure);
+
+extern void tao_common_calib_destroy(
+    tao_common_calib* calib);
+
+/*---------------------------------------------------------------------------*/
+/* DEFECTIVE PIXELS */
+
+/*
+ * Bad pixels are found from a sequence of bias or dark frames.  The mean and
+ * variance of each pixel are updated frame by frame (Welford's algorithm on
+ * separate arrays, rows split between the threads of a pool), then pixels are
+ * compared with the median over the detector: hot and cold pixels by their
+ * mean (in units of the robust spread of the means), stuck and noisy pixels
+ * by their noise (relative to the median noise).
+ */
+typedef struct tao_common_defects tao_common_defects;
+
+/* Kinds of defective pixels (bits). */
+#define TAO_COMMON_DEFECT_HOT   1  /* mean too high */
+#define TAO_COMMON_DEFECT_DEAD  2  /* mean too low or no noise */
+#define TAO_COMMON_DEFECT_NOISY 4  /* noise too high */
+
+/**
+ * Thresholds of defective pixels.
+ */
+typedef struct tao_common_defect_config {
+    double hot;     /**< Mean above the median by more than hot spreads */
+    double cold;    /**< Mean below the median by more than cold spreads */
+    double stuck;   /**< Noise below stuck times the median noise */
+    double noisy;   /**< Noise above noisy times the median noise */
+} tao_common_defect_config;
+
+/**
+ * Set the default thresholds (5, 5, 0.1 and 3).
+ */
+extern void tao_common_defect_config_init(
+    tao_common_defect_config* cfg);
+
+extern tao_status tao_common_defects_create(
+    uint32_t width,
+    uint32_t height,
+    tao_common_defects** def_ptr);
+
+/**
+ * Add a frame to the statistics.
+ *
+ * The pixel types are those of tao_common_calib_apply(), `pool` may be NULL.
+ */
+extern tao_status tao_common_defects_add(
+    tao_common_defects* def,
+    tao_common_pool* pool,
+    const void* frame,
+    tao_common_pixel_type type);
+
+/**
+ * Get the number of frames added since the creation or the last reset.
+ */
+extern uint32_t tao_common_defects_frames(
+    const tao_common_defects* def);
+
+/**
+ * Find the defective pixels.
+ *
+ * At least 2 frames are needed.  `cfg` may be NULL for the default
+ * thresholds.  On return, `*list_ptr` is the increasing list of the
+ * `*count_ptr` indices (`x + width*y`) of defective pixels and `*kinds_ptr`
+ * (if not NULL) their kinds; both are to be freed by the caller.
+ */
+extern tao_status tao_common_defects_find(
+    const tao_common_defects* def,
+    const tao_common_defect_config* cfg,
+    uint32_t** list_ptr,
+    uint8_t** kinds_ptr,
+    uint32_t* count_ptr);
+
+/**
+ * Forget all frames.
+ */
+extern void tao_common_defects_reset(
+    tao_common_defects* def);
+
+extern void tao_common_defects_destroy(
+    tao_common_defects* def);
+
+/*---------------------------------------------------------------------------*/
+/* FITS FILES */
+
+/*
+ * A FITS header template is rendered once with the cards that do not change
+ * between frames (pixel type, size, instrument, settings).  Cards whose value
+ * changes for every frame are declared as fields: they are rendered with a
+ * fixed width so that setting their value only patches a few bytes of the
+ * header in place.  Writing a frame is then a copy of the header block(s)
+ * followed by the pixels.
+ */
+
+/* Maximum number of cards of a header (4 FITS blocks, END excluded). */
+#define TAO_COMMON_FITS_MAX_CARDS 143
+
+/* Maximum number of fields of a header. */
+#define TAO_COMMON_FITS_MAX_FIELDS 16
+
+/* Maximum size in bytes of a rendered header. */
+#define TAO_COMMON_FITS_MAX_HEADER_SIZE ((TAO_COMMON_FITS_MAX_CARDS + 1)*80)
+
+typedef struct tao_common_fits_header tao_common_fits_header;
+
+/**
+ * Kinds of per-frame values.
+ *
+ * Integers and reals use 20 columns, dates are given in ns since the Epoch
+ * and rendered as 'YYYY-MM-DDThh:mm:ss.nnnnnnnnn' (UTC).
+ */
+typedef enum tao_common_fits_kind {
+    TAO_COMMON_FITS_INT  = 1,
+    TAO_COMMON_FITS_REAL = 2,
+    TAO_COMMON_FITS_DATE = 3,
+} tao_common_fits_kind;
+
+/**
+ * Create a header template for frames of a given pixel type and size.
+ *
+ * The mandatory cards are rendered, `depth` is the number of frames of a 3-D
+ * array or 0 for a single frame.  Unsigned integer pixels are stored with the
+ * usual BZERO offset.
+ */
+extern tao_status tao_common_fits_header_create(
+    tao_common_pixel_type type,
+    int width,
+    int height,
+    int depth,
+    tao_common_fits_header** hdr_ptr);
+
+extern void tao_common_fits_header_destroy(
+    tao_common_fits_header* hdr);
+
+/**
+ * Add static cards.
+ *
+ * Keys have at most 8 characters (upper case letters, digits, `-` and `_`),
+ * the comment may be NULL.
+ */
+extern tao_status tao_common_fits_header_add_int(
+    tao_common_fits_header* hdr,
+    const char* key,
+    long long value,
+    const char* comment);
+
+extern tao_status tao_common_fits_header_add_real(
+    tao_common_fits_header* hdr,
+    const char* key,
+    double value,
+    const char* comment);
+
+extern tao_status tao_common_fits_header_add_string(
+    tao_common_fits_header* hdr,
+    const char* key,
+    const char* value,
+    const char* comment);
+
+extern tao_status tao_common_fits_header_add_comment(
+    tao_common_fits_header* hdr,
+    const char* text);
+
+/**
+ * Add a per-frame card.
+ *
+ * The result is the field number to give to the setters, -1 on error.
+ */
+extern int tao_common_fits_header_add_field(
+    tao_common_fits_header* hdr,
+    const char* key,
+    tao_common_fits_kind kind,
+    const char* comment);
+
+/**
+ * Set the value of a field.
+ *
+ * These functions only patch the header in place.  Integers and dates are
+ * formatted without the C library, the calendar date is only recomputed when
+ * the day changes.  Calls for an invalid field or a field of another kind are
+ * ignored.
+ */
+extern void tao_common_fits_header_set_int(
+    tao_common_fits_header* hdr,
+    int field,
+    long long value);
+
+extern void tao_common_fits_header_set_real(
+    tao_common_fits_header* hdr,
+    int field,
+    double value);
+
+extern void tao_common_fits_header_set_date(
+    tao_common_fits_header* hdr,
+    int field,
+    int64_t time);
+
+/**
+ * Get the rendered header (whole FITS blocks, END card included).
+ */
+extern const void* tao_common_fits_header_data(
+    const tao_common_fits_header* hdr,
+    size_t* size);
+
+/**
+ * Convert pixels to FITS (big-endian, BZERO offset for unsigned integers).
+ */
+extern void tao_common_fits_convert(
+    void* dst,
+    const void* src,
+    size_t npixels,
+    tao_common_pixel_type type);
+
+/**
+ * Write a FITS file with a header and the pixels of a frame.
+ *
+ * `work` is a buffer of the size of a frame used for the conversion of the
+ * pixels, it is allocated for the call if NULL.  The header must not be
+ * modified by another thread during the call.
+ */
+extern tao_status tao_common_fits_write(
+    const char* path,
+    const tao_common_fits_header* hdr,
+    const void* data,
+    void* work);
+
+/**
+ * Write a FITS file with a copy of a rendered header.
+ *
+ * Same as tao_common_fits_write() with the `size` bytes of `cards` copied
+ * from tao_common_fits_header_data() instead of the header itself, which can
+ * then be patched for another frame while the file is written.
+ */
+extern tao_status tao_common_fits_write_cards(
+    const char* path,
+    const tao_common_fits_header* hdr,
+    const void* cards,
+    size_t size,
+    const void* data,
+    void* work);
+
+/*---------------------------------------------------------------------------*/
+/* COMPRESSION */
+
+/*
+ * Lossless compression of 16-bit frames.  A frame is split in tiles of whole
+ * rows that are coded independently (and in parallel if a pool of threads is
+ * given) with the Rice algorithm of FITS tile compression (RICE_1 with blocks
+ * of 32 pixels): a tile can be decoded by CFITSIO as a tile of 16-bit pixels
+ * (with BZERO = 32768 for unsigned pixels).
+ *
+ * A compressed frame starts with the byte size of each tile coded as 32-bit
+ * unsigned integers followed by the tiles.
+ */
+
+#define TAO_COMMON_COMPRESS_NONE 0
+#define TAO_COMMON_COMPRESS_RICE 1
+
+/* Default number of rows per tile. */
+#define TAO_COMMON_COMPRESS_TILE_ROWS 16
+
+/**
+ * Get the maximum size of a compressed frame.
+ */
+extern size_t tao_common_compress_bound(
+    uint32_t width,
+    uint32_t height,
+    uint32_t tile_rows);
+
+/**
+ * Compress a frame of 16-bit pixels.
+ *
+ * `pixel_type` is TAO_COMMON_UINT16 or TAO_COMMON_INT16.  The output buffer
+ * must have at least tao_common_compress_bound() bytes.  `pool` may be NULL
+ * to compress in the calling thread.  Yields the size of the compressed
+ * frame, 0 on error.
+ */
+extern size_t tao_common_compress_frame(
+    tao_common_pool* pool,
+    void* dst,
+    const void* src,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t tile_rows);
+
+/**
+ * Decompress a frame of 16-bit pixels.
+ *
+ * The parameters are the same as for the compression.  Corrupted data are
+ * detected and reported as an error.
+ */
+extern tao_status tao_common_decompress_frame(
+    tao_common_pool* pool,
+    void* dst,
+    const void* src,
+    size_t size,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t tile_rows);
+
+/*---------------------------------------------------------------------------*/
+/* FRAME STREAMS */
+
+/*
+ * A frame stream is an append-only file of frames of identical size and type
+ * with a sidecar index.  The stream file starts with a header of
+ * `header_size` bytes followed by the frame payloads, each starting on a
+ * multiple of `alignment`.  The index file (stream name with ".idx"
+ * appended) has one fixed-size record per frame with its metadata and the
+ * offset of its payload, so any frame is located in O(1).  Both files use the
+ * native byte order of the host.
+ *
+ * Frames of compressed streams have variable sizes: `frame_stride` is then 0
+ * and the payloads are aligned on 8 bytes.
+ */
+
+#define TAO_COMMON_STREAM_MAGIC "TAOSTRM1"
+#define TAO_COMMON_STREAM_VERSION 1
+#define TAO_COMMON_STREAM_HEADER_SIZE 4096
+
+typedef struct tao_common_stream_header {
+    char magic[8];          /**< TAO_COMMON_STREAM_MAGIC */
+    uint32_t version;       /**< TAO_COMMON_STREAM_VERSION */
+    uint32_t header_size;   /**< Offset of the first frame */
+    uint32_t width;         /**< Frame width in pixels */
+    uint32_t height;        /**< Frame height in pixels */
+    uint32_t pixel_type;    /**< See tao_common_pixel_type */
+    uint32_t alignment;     /**< Alignment of frame payloads in bytes */
+    uint64_t frame_size;    /**< Size of a raw frame in bytes */
+    uint64_t frame_stride;  /**< Distance between raw frames in bytes */
+    uint64_t nframes;       /**< Number of frames (set when closed) */
+    int64_t creation_time;  /**< CLOCK_REALTIME of creation (ns) */
+    uint32_t compression;   /**< TAO_COMMON_COMPRESS_... */
+    uint32_t tile_rows;     /**< Rows per compressed tile */
+    char instrument[64];    /**< Name of the instrument */
+    char comment[256];      /**< Free text */
+} tao_common_stream_header;
+
+typedef struct tao_common_stream_record {
+    uint64_t id;            /**< Frame number */
+    int64_t host_time;      /**< Host time stamp (ns) */
+    int64_t camera_time;    /**< Camera time stamp (ns) */
+    uint64_t offset;        /**< Offset of the payload in the stream file */
+    uint64_t size;          /**< Size of the payload in bytes */
+    uint32_t flags;         /**< Encoding of the payload */
+    uint32_t orientation;   /**< Orientation of the frame, 0 if none */
+} tao_common_stream_record;
+
+typedef struct tao_common_stream_writer tao_common_stream_writer;
+typedef struct tao_common_stream_reader tao_common_stream_reader;
+
+/**
+ * Create a frame stream.
+ *
+ * Existing files are overwritten.  `instrument` and `comment` may be NULL.
+ */
+extern tao_status tao_common_stream_create(
+    const char* path,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    const char* instrument,
+    const char* comment,
+    tao_common_stream_writer** writer_ptr);
+
+/**
+ * Compress the frames of a stream.
+ *
+ * Must be called before the first frame is appended.  Only streams of 16-bit
+ * pixels can be compressed.  `tile_rows` is the number of rows per tile (0
+ * for the default).  The tiles of a frame are compressed by the threads of
+ * `pool` if not NULL, the pool must remain valid until the stream is closed.
+ */
+extern tao_status tao_common_stream_set_compression(
+    tao_common_stream_writer* writer,
+    uint32_t compression,
+    uint32_t tile_rows,
+    tao_common_pool* pool);
+
+/**
+ * Append a frame to a stream.
+ *
+ * The frame is `width*height` contiguous pixels of the stream type.
+ */
+extern tao_status tao_common_stream_append(
+    tao_common_stream_writer* writer,
+    const void* data,
+    const tao_common_frame_info* info);
+
+/**
+ * Get the number of frames written so far.
+ */
+extern uint64_t tao_common_stream_written(
+    const tao_common_stream_writer* writer);
+
+/**
+ * Flush buffered index records and close a stream.
+ */
+extern tao_status tao_common_stream_close(
+    tao_common_stream_writer* writer);
+
+/**
+ * Open a frame stream for reading.
+ *
+ * The stream and its index are memory mapped read-only.  A stream that is
+ * still being written can be opened, see tao_common_stream_refresh().
+ */
+extern tao_status tao_common_stream_open(
+    const char* path,
+    tao_common_stream_reader** reader_ptr);
+
+/**
+ * Map the frames appended since the stream was opened or last refreshed.
+ */
+extern tao_status tao_common_stream_refresh(
+    tao_common_stream_reader* reader);
+
+extern const tao_common_stream_header* tao_common_stream_get_header(
+    const tao_common_stream_reader* reader);
+
+extern uint64_t tao_common_stream_count(
+    const tao_common_stream_reader* reader);
+
+/**
+ * Get a frame.
+ *
+ * Yields the address of the payload of the `index`-th frame (NULL if out of
+ * range) and stores its metadata in `info` if not NULL.  The address remains
+ * valid until the reader is refreshed or closed.  The payload is compressed
+ * if the stream is, see tao_common_stream_read_frame().
+ */
+extern const void* tao_common_stream_frame(
+    const tao_common_stream_reader* reader,
+    uint64_t index,
+    tao_common_frame_info* info);
+
+/**
+ * Copy a frame.
+ *
+ * The pixels of the `index`-th frame are decompressed if needed and stored
+ * in `dst` which has room for a raw frame.  `pool` may be NULL.
+ */
+extern tao_status tao_common_stream_read_frame(
+    const tao_common_stream_reader* reader,
+    uint64_t index,
+    void* dst,
+    tao_common_frame_info* info,
+    tao_common_pool* pool);
+
+extern const tao_common_stream_record* tao_common_stream_record_get(
+    const tao_common_stream_reader* reader,
+    uint64_t index);
+
+extern void tao_common_stream_close_reader(
+    tao_common_stream_reader* reader);
+
+/**
+ * Export frames of a stream into a FITS cube.
+ *
+ * Frames `first` to `first + count - 1` are written as a 3-D primary array.
+ * Unsigned integer pixels are stored with the usual BZERO offset.  A binary
+ * table extension named FRAMES follows with one row per plane: FRAME (id),
+ * HOSTTIME and CAMTIME (ns) and ORIENT.
+ */
+extern tao_status tao_common_stream_export_fits(
+    const tao_common_stream_reader* reader,
+    const char* path,
+    uint64_t first,
+    uint64_t count);
+
+/*---------------------------------------------------------------------------*/
+/* FRAME RECORDERS */
+
+/*
+ * A recorder appends frames to a stream in a thread of its own, so that the
+ * thread acquiring the frames never waits for the disk.  Queued frames wait
+ * in a ring of slots: tao_common_recorder_push() copies the pixels and never
+ * blocks (the frame is dropped if all slots are busy), while
+ * tao_common_recorder_submit() queues the address of pixels that the caller
+ * leaves untouched until tao_common_recorder_sync() returns.  Frames must be
+ * queued by a single thread.
+ */
+typedef struct tao_common_recorder tao_common_recorder;
+
+/**
+ * Create a recorder.
+ *
+ * Frames are appended to `writer` which must not be used by anyone else
+ * until the recorder is closed.  At most `nslots` frames wait to be written.
+ * Room for `nslots` copies is only reserved if `copy` is true, otherwise
+ * frames can only be submitted.  The recorder thread is created with
+ * configuration `cfg` (may be NULL).
+ */
+extern tao_status tao_common_recorder_create(
+    tao_common_stream_writer* writer,
+    int nslots,
+    int copy,
+    const tao_common_thread_config* cfg,
+    tao_common_recorder** rec_ptr);
+
+/**
+ * Queue a copy of a frame.
+ *
+ * The frame has the layout required by tao_common_stream_append(), `info`
+ * may be NULL.  TAO_ERROR is returned if a previous frame could not be
+ * written (the cause has been reported by the recorder thread); a frame
+ * dropped because all slots are busy is only counted.
+ */
+extern tao_status tao_common_recorder_push(
+    tao_common_recorder* rec,
+    const void* data,
+    const tao_common_frame_info* info);
+
+/**
+ * Queue a frame without copying it.
+ *
+ * Waits for a free slot if needed.  The pixels must remain unchanged until
+ * tao_common_recorder_sync() or tao_common_recorder_close() returns.
+ */
+extern tao_status tao_common_recorder_submit(
+    tao_common_recorder* rec,
+    const void* data,
+    const tao_common_frame_info* info);
+
+/**
+ * Wait until all queued frames have been written.
+ */
+extern tao_status tao_common_recorder_sync(
+    tao_common_recorder* rec);
+
+/**
+ * Get the number of frames dropped by tao_common_recorder_push().
+ */
+extern uint64_t tao_common_recorder_dropped(
+    tao_common_recorder* rec);
+
+/**
+ * Write the queued frames and stop a recorder.
+ *
+ * The stream is left open.  TAO_ERROR is returned if any frame could not be
+ * written.
+ */
+extern tao_status tao_common_recorder_close(
+    tao_common_recorder* rec);
+
+/*---------------------------------------------------------------------------*/
+/* CO-ADDING */
+
+/*
+ * A co-adder sums windows of consecutive 16-bit frames into 32-bit or 64-bit
+ * pixels (rows split between the threads of a pool) and emits each complete
+ * stack, to a frame stream if one is given.  The sums are double-buffered: a
+ * stack remains valid while the next window is accumulated, and is appended
+ * to the stream by a recorder thread meanwhile.
+ */
+typedef struct tao_common_coadd tao_common_coadd;
+
+/**
+ * Create a co-adder.
+ *
+ * `type` is TAO_COMMON_UINT32 (at most 65537 frames per window) or
+ * TAO_COMMON_UINT64.  `pool` may be NULL to add in the calling thread.  If
+ * `writer` is not NULL, stacks are appended to it (it must have the size and
+ * type of the sums, and must not be used by anyone else until the co-adder
+ * is destroyed); stacks are numbered from 0 and have the time stamps of
+ * their first frame.
+ */
+extern tao_status tao_common_coadd_create(
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type type,
+    uint32_t window,
+    tao_common_pool* pool,
+    tao_common_stream_writer* writer,
+    tao_common_coadd** co_ptr);
+
+/**
+ * Add a frame.
+ *
+ * `info` may be NULL.  When the frame completes a window, `*stack_ptr` (if
+ * `stack_ptr` is not NULL) is set to the sums, which remain valid until the
+ * next window is complete; it is set to NULL otherwise.
+ */
+extern tao_status tao_common_coadd_add(
+    tao_common_coadd* co,
+    const uint16_t* frame,
+    const tao_common_frame_info* info,
+    const void** stack_ptr);
+
+/**
+ * Emit the incomplete window, if any, and wait until the stacks are written.
+ *
+ * `*nframes` is the number of frames of the emitted stack (0 if none).
+ */
+extern tao_status tao_common_coadd_flush(
+    tao_common_coadd* co,
+    const void** stack_ptr,
+    uint32_t* nframes);
+
+/**
+ * Get the number of stacks emitted so far.
+ */
+extern uint64_t tao_common_coadd_stacks(
+    const tao_common_coadd* co);
+
+extern void tao_common_coadd_destroy(
+    tao_common_coadd* co);
+
+/*---------------------------------------------------------------------------*/
+/* SHARED FRAMES */
+
+/*
+ * The last frames of an acquisition published in a POSIX shared memory
+ * object (see shm_overview(7)) for other processes.  The acquisition writes
+ * a ring of `nslots` frames and never waits for anyone; readers map the
+ * object read-only, copy the latest complete frame and retry if it was
+ * overwritten meanwhile (each slot is protected by a sequence lock), so
+ * starting, stopping or killing a reader cannot affect the acquisition.
+ */
+
+#define TAO_COMMON_SHM_MAGIC "TAOSHM01"
+#define TAO_COMMON_SHM_VERSION 1
+#define TAO_COMMON_SHM_HEADER_SIZE 4096
+
+typedef struct tao_common_shm_header {
+    char magic[8];          /**< TAO_COMMON_SHM_MAGIC */
+    uint32_t version;       /**< TAO_COMMON_SHM_VERSION */
+    uint32_t header_size;   /**< Offset of the first slot */
+    uint32_t width;         /**< Frame width in pixels */
+    uint32_t height;        /**< Frame height in pixels */
+    uint32_t pixel_type;    /**< See tao_common_pixel_type */
+    uint32_t nslots;        /**< Number of frames in the ring */
+    uint64_t frame_size;    /**< Size of a frame in bytes */
+    uint64_t slot_stride;   /**< Distance between slots in bytes */
+    int64_t creation_time;  /**< CLOCK_REALTIME of creation (ns) */
+    int32_t writer_pid;     /**< Process of the acquisition */
+    uint32_t closed;        /**< Nonzero once the acquisition has stopped */
+    uint64_t published;     /**< Number of frames published so far */
+    int64_t heartbeat;      /**< CLOCK_MONOTONIC of the last frame (ns) */
+} tao_common_shm_header;
+
+typedef struct tao_common_shm_writer tao_common_shm_writer;
+typedef struct tao_common_shm_reader tao_common_shm_reader;
+
+/**
+ * Create the shared memory object `name` (e.g. "/tao-nuvu").
+ *
+ * A stale object left by a process which no longer runs is replaced; the
+ * error is TAO_ALREADY_IN_USE if the object belongs to a running
+ * acquisition.  The ring is prefaulted.
+ */
+extern tao_status tao_common_shm_create(
+    const char* name,
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t nslots,
+    tao_common_shm_writer** writer_ptr);
+
+/**
+ * Create an anonymous ring (see memfd_create(2)) to be shared by passing its
+ * descriptor, e.g. by a frame server.
+ *
+ * The size of the ring is sealed, so processes given its descriptor cannot
+ * truncate it under the acquisition.
+ */
+extern tao_status tao_common_shm_create_anonymous(
+    uint32_t width,
+    uint32_t height,
+    tao_common_pixel_type pixel_type,
+    uint32_t nslots,
+    tao_common_shm_writer** writer_ptr);
+
+/**
+ * Get the descriptor of an anonymous ring, -1 for a named one.
+ */
+extern int tao_common_shm_get_fd(
+    const tao_common_shm_writer* writer);
+
+/**
+ * Get the slot where the next frame is to be written.
+ *
+ * The frame is written directly in shared memory (for instance by
+ * tao_common_orient()) and published by tao_common_shm_end().
+ */
+extern void* tao_common_shm_begin(
+    tao_common_shm_writer* writer);
+
+extern void tao_common_shm_end(
+    tao_common_shm_writer* writer,
+    const tao_common_frame_info* info);
+
+/**
+ * Copy and publish a frame.
+ */
+extern void tao_common_shm_publish(
+    tao_common_shm_writer* writer,
+    const void* data,
+    const tao_common_frame_info* info);
+
+/**
+ * Mark the acquisition as stopped and remove the name, readers keep their
+ * mapping until they close it.
+ */
+extern void tao_common_shm_close(
+    tao_common_shm_writer* writer);
+
+extern tao_status tao_common_shm_open(
+    const char* name,
+    tao_common_shm_reader** reader_ptr);
+
+/**
+ * Map the ring of descriptor `fd` read-only, the descriptor may be closed
+ * afterwards.
+ */
+extern tao_status tao_common_shm_attach(
+    int fd,
+    tao_common_shm_reader** reader_ptr);
+
+extern const tao_common_shm_header* tao_common_shm_get_header(
+    const tao_common_shm_reader* reader);
+
+/**
+ * Wait for more than `count` frames to have been published.
+ *
+ * The number of published frames is stored in `published`, it is `count`
+ * after `timeout` seconds or if the acquisition has stopped.  The reader
+ * polls the shared counter, the acquisition is never signaled.
+ */
+extern tao_status tao_common_shm_wait(
+    tao_common_shm_reader* reader,
+    uint64_t count,
+    double timeout,
+    uint64_t* published);
+
+/**
+ * Copy the latest complete frame.
+ *
+ * The pixels are stored in `dst` and the metadata in `info` (if not NULL).
+ * The number of the frame (the number of frames published when it was) is
+ * stored in `number`, 0 if none has been published yet.
+ */
+extern tao_status tao_common_shm_read(
+    tao_common_shm_reader* reader,
+    void* dst,
+    tao_common_frame_info* info,
+    uint64_t* number);
+
+/**
+ * A frame used in place, without copy.
+ */
+typedef struct tao_common_shm_view {
+    const void* data;               /**< Pixels in shared memory */
+    tao_common_frame_info info;     /**< Metadata of the frame */
+    uint64_t number;                /**< Number of the frame, 0 if none */
+    unsigned seq;                   /**< Version of the slot */
+} tao_common_shm_view;
+
+/**
+ * Get the latest complete frame without copying it.
+ *
+ * The pixels stay in the ring and may be overwritten at any time: results
+ * computed from them are only valid if tao_common_shm_intact() is true
+ * afterwards.  `view->number` is 0 if no frame has been published yet.
+ */
+extern tao_status tao_common_shm_peek(
+    tao_common_shm_reader* reader,
+    tao_common_shm_view* view);
+
+/**
+ * Check that the frame of a view has not been overwritten since
+ * tao_common_shm_peek().
+ */
+extern int tao_common_shm_intact(
+    const tao_common_shm_reader* reader,
+    const tao_common_shm_view* view);
+
+/**
+ * Check whether the acquisition has stopped or its process is gone.
+ */
+extern int tao_common_shm_stopped(
+    const tao_common_shm_reader* reader);
+
+extern void tao_common_shm_close_reader(
+    tao_common_shm_reader* reader);
+
+/*---------------------------------------------------------------------------*/
+/* FRAME SERVER */
+
+/*
+ * A frame server lets local processes which do not link TAO get the frames
+ * of an anonymous ring (see tao_common_shm_create_anonymous()).  Clients
+ * connect to a Unix domain socket of type SOCK_SEQPACKET and receive a
+ * TAO_COMMON_SERVER_HELLO message carrying a read-only descriptor of the
+ * ring (SCM_RIGHTS ancillary data), which they map with mmap(2); the layout
+ * is given by tao_common_shm_header.  A TAO_COMMON_SERVER_FRAME message is
+ * then sent when frames are published and TAO_COMMON_SERVER_CLOSED when the
+ * server stops.  Pixels never go through the socket.
+ *
+ * Notifications are sent by a thread of the server: the acquisition only
+ * wakes it up (one write(2) to an eventfd) whatever the number of clients.
+ * Messages are not queued for slow clients, the number of the next one is
+ * that of the latest frame.
+ */
+
+#define TAO_COMMON_SERVER_HELLO  1
+#define TAO_COMMON_SERVER_FRAME  2
+#define TAO_COMMON_SERVER_CLOSED 3
+
+typedef struct tao_common_server_message {
+    uint32_t type;          /**< TAO_COMMON_SERVER_HELLO, ... */
+    uint32_t size;          /**< Size of the message in bytes */
+    uint64_t number;        /**< Number of the latest published frame */
+} tao_common_server_message;
+
+typedef struct tao_common_server tao_common_server;
+typedef struct tao_common_client tao_common_client;
+
+/**
+ * Serve the frames of `writer` on the socket `path`.
+ *
+ * The writer must be anonymous and outlive the server.  A socket file left
+ * by a server which no longer runs is replaced; the error is
+ * TAO_ALREADY_IN_USE if another server listens on `path`.
+ */
+extern tao_status tao_common_server_create(
+    const char* path,
+    tao_common_shm_writer* writer,
+    tao_common_server** server_ptr);
+
+/**
+ * Notify the clients that a frame has been published, to be called after
+ * tao_common_shm_end().  Never blocks.
+ */
+extern void tao_common_server_notify(
+    tao_common_server* server);
+
+/**
+ * Get the number of connected clients.
+ */
+extern int tao_common_server_clients(
+    tao_common_server* server);
+
+/**
+ * Tell the clients that the acquisition stops, disconnect them and remove
+ * the socket file.
+ */
+extern void tao_common_server_destroy(
+    tao_common_server* server);
+
+/**
+ * Connect to a frame server and map its ring.
+ */
+extern tao_status tao_common_client_connect(
+    const char* path,
+    tao_common_client** client_ptr);
+
+extern tao_common_shm_reader* tao_common_client_get_reader(
+    tao_common_client* client);
+
+/**
+ * Wait for a notification of a frame after number `count`.
+ *
+ * The number of published frames is stored in `published`, it is `count`
+ * after `timeout` seconds or if the server has stopped.
+ */
+extern tao_status tao_common_client_wait(
+    tao_common_client* client,
+    uint64_t count,
+    double timeout,
+    uint64_t* published);
+
+/**
+ * Check whether the server has stopped or closed the connection.
+ */
+extern int tao_common_client_stopped(
+    const tao_common_client* client);
+
+extern void tao_common_client_close(
+    tao_common_client* client);
+
+/*---------------------------------------------------------------------------*/
+/* REPLAY */
+
+/*
+ * A replay emits the frames of a recorded stream as a camera would, to run
+ * processing stages on real data without a camera.
+ */
+
+typedef enum tao_common_replay_mode {
+    TAO_COMMON_REPLAY_ORIGINAL = 0, /**< Original time stamps (rate = speed) */
+    TAO_COMMON_REPLAY_FAST,         /**< As fast as possible (rate ignored) */
+    TAO_COMMON_REPLAY_FIXED,        /**< Fixed frame rate (rate in Hz) */
+} tao_common_replay_mode;
+
+typedef struct tao_common_replay tao_common_replay;
+
+/**
+ * Open a stream for replay.
+ *
+ * The stream is memory mapped.  `rate` is the speed factor for original
+ * timing (1 for real time) and the number of frames per second for fixed
+ * rate.  If `loop` is true, the stream is replayed endlessly.
+ */
+extern tao_status tao_common_replay_open(
+    const char* path,
+    tao_common_replay_mode mode,
+    double rate,
+    int loop,
+    tao_common_replay** replay_ptr);
+
+/**
+ * Wait for the next frame.
+ *
+ * The function returns when the frame is due and stores its address in
+ * `*data_ptr` (NULL at the end of a stream which is not looping).  The frame
+ * is valid until the next call.  In `info`, the host time is the emission
+ * time, the camera time is the recorded one and the frame numbers keep
+ * increasing when the stream loops.  A frame is emitted late rather than
+ * skipped when processing is slower than the pacing.
+ */
+extern tao_status tao_common_replay_next(
+    tao_common_replay* replay,
+    const void** data_ptr,
+    tao_common_frame_info* info);
+
+extern const tao_common_stream_header* tao_common_replay_get_header(
+    const tao_common_replay* replay);
+
+/**
+ * Get the worst delay (in ns) of the emitted frames after their due time.
+ */
+extern int64_t tao_common_replay_max_lag(
+    const tao_common_replay* replay);
+
+extern void tao_common_replay_close(
+    tao_common_replay* replay);
+
+/*---------------------------------------------------------------------------*/
+/* CLOCKS */
+
+/* Number of samples used to estimate the relation between two clocks. */
+#define TAO_COMMON_CLOCK_MAP_SAMPLES 256
+
+/**
+ * Mapping of a camera clock to the host CLOCK_MONOTONIC clock.
+ *
+ * The relation `host = host_ref + offset + slope*(camera - camera_ref)` is
+ * fitted on the last pairs of time stamps (camera time of a frame, host time
+ * when it was received).  The slope gives the drift of the camera clock.
+ *
+ * Host times include the latency of the readout and transfer plus delays of
+ * the receiving thread.  The fit is made robust by rejecting the samples
+ * whose residual is more than 3 sigma away from the median (sigma being
+ * estimated from the median absolute deviation), then the fitted line is
+ * moved to the lower envelope of the remaining samples: mapped times are
+ * those of the fastest arrivals, `host_time - mapped_time` is the extra
+ * latency of a frame.
+ */
+typedef struct tao_common_clock_map {
+    int count;              /**< Number of samples in the window */
+    int next;               /**< Index of the next sample */
+    int64_t camera_ref;     /**< Camera time of the first sample (ns) */
+    int64_t host_ref;       /**< Host time of the first sample (ns) */
+    double offset;          /**< Fitted offset (ns) */
+    double slope;           /**< Fitted slope */
+    double jitter;          /**< Robust standard deviation of arrivals (ns) */
+    int rejected;           /**< Samples rejected by the last fit */
+    double camera[TAO_COMMON_CLOCK_MAP_SAMPLES]; /**< Camera times - ref */
+    double host[TAO_COMMON_CLOCK_MAP_SAMPLES];   /**< Host times - ref */
+} tao_common_clock_map;
+
+extern void tao_common_clock_map_init(
+    tao_common_clock_map* map);
+
+/**
+ * Add a pair of time stamps (in ns) and update the fit.
+ */
+extern void tao_common_clock_map_update(
+    tao_common_clock_map* map,
+    int64_t camera_time,
+    int64_t host_time);
+
+/**
+ * Map a camera time to the host clock (both in ns).
+ */
+extern int64_t tao_common_clock_map_to_host(
+    const tao_common_clock_map* map,
+    int64_t camera_time);
+
+/**
+ * Get the drift of the camera clock relative to the host clock in parts per
+ * million.
+ */
+extern double tao_common_clock_map_drift(
+    const tao_common_clock_map* map);
+
+/**
+ * Get the current host CLOCK_MONOTONIC time in ns.
+ */
+extern int64_t tao_common_monotonic_time(void);
+
+/**
+ * Get the offset of CLOCK_REALTIME relative to CLOCK_MONOTONIC in ns.
+ *
+ * Adding the offset to a monotonic time gives the time since the Epoch.  The
+ * offset changes when the system clock is adjusted, so it has to be sampled
+ * again from time to time.
+ */
+extern int64_t tao_common_realtime_offset(void);
+
+/*---------------------------------------------------------------------------*/
+/* FRAME MERGING */
+
+/*
+ * A merger pairs the frames of two cameras whose host times (see
+ * tao_common_clock_map) differ by less than a tolerance.  Each camera thread
+ * pushes the metadata of its frames in its own lock-free queue so that the
+ * cameras never wait for each other nor for the merger.
+ */
+
+typedef struct tao_common_merger tao_common_merger;
+
+/**
+ * Result of a merge, `mask` has bit `i` set if `frame[i]` is valid.  When a
+ * single bit is set, the frame could not be paired.
+ */
+typedef struct tao_common_merged {
+    int mask;
+    tao_common_frame_info frame[2];
+} tao_common_merged;
+
+/**
+ * Create a frame merger.
+ *
+ * `capacity` is the number of frames that can be queued for each camera,
+ * `tolerance` is the largest difference of times of paired frames and a
+ * frame waiting more than `max_wait` for a partner is given alone (both in
+ * ns).
+ */
+extern tao_status tao_common_merger_create(
+    int capacity,
+    int64_t tolerance,
+    int64_t max_wait,
+    tao_common_merger** merger_ptr);
+
+/**
+ * Queue a frame of camera `source` (0 or 1).
+ *
+ * Only one thread may push frames of a given source.  The `host_time` of
+ * `info` is the time used for pairing.  This function never blocks: the
+ * frame is counted as lost if the queue is full.
+ */
+extern tao_status tao_common_merger_push(
+    tao_common_merger* merger,
+    int source,
+    const tao_common_frame_info* info);
+
+/**
+ * Get the next merged frames.
+ *
+ * Waits at most `timeout` seconds.  Yields 1 if `result` has been filled, 0
+ * on timeout.  Only one thread may call this function.
+ */
+extern int tao_common_merger_pop(
+    tao_common_merger* merger,
+    tao_common_merged* result,
+    double timeout);
+
+/**
+ * Get the number of frames of a source lost because its queue was full.
+ */
+extern uint64_t tao_common_merger_lost(
+    const tao_common_merger* merger,
+    int source);
+
+extern void tao_common_merger_destroy(
+    tao_common_merger* merger);
+
+#endif /* TAO_COMMON_H_ */
@@ -0,0 +1,1331 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "tao-common.h"
+
+#define WIDTH 128
+#define HEIGHT 96
+#define NFRAMES 50
+
+static void fatal_error()
+{
+    fprintf(stderr, "Some fatal error has been encountered...\n");
+    if (tao_any_errors()) {
+        tao_report_errors();
+    }
+    exit(EXIT_FAILURE);
+}
+
+static void check(
+    int cond,
+    const char* what)
+{
+    if (!cond) {
+        fprintf(stderr, "FAILED: %s\n", what);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Frame buffers: whatever pages back them, buffers are page aligned, zero
+// filled and writable.
+static void test_frame_buffer(void)
+{
+    const size_t sizes[] = {1, 4096, 3*1024*1024 + 5};
+    for (int i = 0; i < 3; ++i) {
+        tao_common_frame_buffer buf;
+        int node = tao_common_numa_node(-1);
+        if (tao_common_frame_buffer_alloc(&buf, sizes[i], node) != TAO_OK) {
+            fatal_error();
+        }
+        check(((uintptr_t)buf.data & 4095) == 0, "frame buffer alignment");
+        check(buf.mapped >= sizes[i], "frame buffer size");
+        const unsigned char* bytes = buf.data;
+        for (size_t j = 0; j < buf.mapped; j += 4096) {
+            check(bytes[j] == 0, "frame buffer contents");
+        }
+        memset(buf.data, 0xff, sizes[i]);
+        tao_common_frame_buffer_free(&buf);
+        check(buf.data == NULL, "frame buffer release");
+        tao_common_frame_buffer_free(&buf);
+    }
+    printf("frame buffers: ok\n");
+}
+
+// Pool of threads: many tiny batches back to back, every job of every batch
+// runs exactly once, none of them leaks into the next batch.
+typedef struct pool_ctx {
+    int counts[8];
+} pool_ctx;
+
+static void pool_job(
+    void* arg,
+    int index)
+{
+    pool_ctx* ctx = arg;
+    __atomic_fetch_add(&ctx->counts[index], 1, __ATOMIC_RELAXED);
+}
+
+static void pool_rows(
+    void* arg,
+    uint32_t y0,
+    uint32_t y1)
+{
+    int* rows = arg;
+    for (uint32_t y = y0; y < y1; ++y) {
+        // blocks start on a multiple of the granularity
+        __atomic_fetch_add(&rows[y], (y0%8 == 0 ? 1 : 100), __ATOMIC_RELAXED);
+    }
+}
+
+static void test_pool(void)
+{
+    tao_common_pool* pool;
+    if (tao_common_pool_create(3, NULL, &pool) != TAO_OK) {
+        fatal_error();
+    }
+    pool_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    for (int batch = 0; batch < 100000; ++batch) {
+        int njobs = 2 + batch%7;
+        tao_common_pool_run(pool, njobs, pool_job, &ctx);
+        for (int i = 0; i < 8; ++i) {
+            int count = __atomic_load_n(&ctx.counts[i], __ATOMIC_RELAXED);
+            check(count == (i < njobs), "pool jobs run once per batch");
+            ctx.counts[i] = 0;
+        }
+    }
+    static int rows[1001];
+    tao_common_pool_run_rows(pool, 1001, 8, pool_rows, rows);
+    for (int y = 0; y < 1001; ++y) {
+        check(rows[y] == 1, "pool rows run once");
+    }
+    tao_common_pool_destroy(pool);
+    printf("pool: ok\n");
+}
+
+// Frame streams: write frames, read them back at random, export to FITS.
+static void test_stream(
+    const char* dir)
+{
+    char path[256], fits[256];
+    uint16_t frame[WIDTH*HEIGHT];
+    tao_common_stream_writer* writer = NULL;
+    tao_common_stream_reader* reader = NULL;
+
+    snprintf(path, sizeof(path), "%s/test-01.tfs", dir);
+    snprintf(fits, sizeof(fits), "%s/test-01.fits", dir);
+    if (tao_common_stream_create(path, WIDTH, HEIGHT, TAO_COMMON_UINT16,
+                                 "test", NULL, &writer) != TAO_OK) {
+        fatal_error();
+    }
+    for (int k = 0; k < NFRAMES; ++k) {
+        tao_common_frame_info info = {100 + k, 1000*k, 0, k%8};
+        for (int i = 0; i < WIDTH*HEIGHT; ++i) {
+            frame[i] = (uint16_t)(k*WIDTH*HEIGHT + i);
+        }
+        if (tao_common_stream_append(writer, frame, &info) != TAO_OK) {
+            fatal_error();
+        }
+    }
+    if (tao_common_stream_close(writer) != TAO_OK) {
+        fatal_error();
+    }
+
+    if (tao_common_stream_open(path, &reader) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_stream_count(reader) == NFRAMES, "stream count");
+    for (int k = NFRAMES - 1; k >= 0; k -= 7) {
+        tao_common_frame_info info;
+        const uint16_t* data = tao_common_stream_frame(reader, k, &info);
+        check(data != NULL && info.id == 100 + k && info.host_time == 1000*k &&
+              info.orientation == k%8, "stream frame metadata");
+        check(((uintptr_t)data % 64) == 0, "stream frame alignment");
+        check(data[0] == (uint16_t)(k*WIDTH*HEIGHT) &&
+              data[WIDTH*HEIGHT - 1] == (uint16_t)(k*WIDTH*HEIGHT + WIDTH*HEIGHT - 1),
+              "stream frame contents");
+    }
+    check(tao_common_stream_frame(reader, NFRAMES, NULL) == NULL,
+          "stream out of range");
+    if (tao_common_stream_export_fits(reader, fits, 10, 5) != TAO_OK) {
+        fatal_error();
+    }
+    FILE* file = fopen(fits, "rb");
+    check(file != NULL, "FITS file");
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    long table = 2880*(1 + (5*WIDTH*HEIGHT*2 + 2879)/2880);
+    check(size == table + 2*2880, "FITS size");
+    // the FRAMES table keeps the metadata of each plane (big-endian)
+    char card[20];
+    unsigned char row[28];
+    fseek(file, table, SEEK_SET);
+    check(fread(card, 1, 20, file) == 20 &&
+          memcmp(card, "XTENSION= 'BINTABLE'", 20) == 0, "FITS table");
+    fseek(file, table + 2880 + 28, SEEK_SET);
+    check(fread(row, 1, 28, file) == 28, "FITS table row");
+    uint64_t id = 0, host = 0;
+    for (int i = 0; i < 8; ++i) {
+        id = (id << 8) | row[i];
+        host = (host << 8) | row[8 + i];
+    }
+    check((id ^ 0x8000000000000000u) == 111 && host == 11000 &&
+          row[27] == 11%8, "FITS frame metadata");
+    fclose(file);
+    tao_common_stream_close_reader(reader);
+    unlink(fits);
+    unlink(path);
+    strcat(path, ".idx");
+    unlink(path);
+    printf("frame streams: ok\n");
+}
+
+// Frame recorders: pushed frames are copies, submitted frames are written
+// from the caller's memory, all of them in order.
+static void test_recorder(
+    const char* dir)
+{
+    char path[256];
+    static uint16_t frames[2][WIDTH*HEIGHT];
+    tao_common_stream_writer* writer = NULL;
+    tao_common_stream_reader* reader = NULL;
+    tao_common_recorder* rec = NULL;
+
+    snprintf(path, sizeof(path), "%s/test-rec.tfs", dir);
+    if (tao_common_stream_create(path, WIDTH, HEIGHT, TAO_COMMON_UINT16,
+                                 "test", NULL, &writer) != TAO_OK ||
+        tao_common_recorder_create(writer, NFRAMES, 1, NULL, &rec) != TAO_OK) {
+        fatal_error();
+    }
+    for (int k = 0; k < 2*NFRAMES; ++k) {
+        tao_common_frame_info info = {k, 1000*k, 0, 0};
+        // the first half reuses one buffer, the second half alternates
+        // between two buffers, each one refilled once its frame is written
+        uint16_t* frame = frames[k < NFRAMES ? 0 : k & 1];
+        if (k >= NFRAMES && tao_common_recorder_sync(rec) != TAO_OK) {
+            fatal_error();
+        }
+        for (int i = 0; i < WIDTH*HEIGHT; ++i) {
+            frame[i] = (uint16_t)(k + i);
+        }
+        tao_status status;
+        if (k < NFRAMES) {
+            status = tao_common_recorder_push(rec, frame, &info);
+            memset(frame, 0, sizeof(frames[0]));
+        } else {
+            status = tao_common_recorder_submit(rec, frame, &info);
+        }
+        if (status != TAO_OK) {
+            fatal_error();
+        }
+    }
+    check(tao_common_recorder_dropped(rec) == 0, "recorder drops");
+    if (tao_common_recorder_close(rec) != TAO_OK ||
+        tao_common_stream_close(writer) != TAO_OK ||
+        tao_common_stream_open(path, &reader) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_stream_count(reader) == 2*NFRAMES, "recorder count");
+    for (int k = 0; k < 2*NFRAMES; ++k) {
+        tao_common_frame_info info;
+        const uint16_t* data = tao_common_stream_frame(reader, k, &info);
+        check(data != NULL && info.id == k && info.host_time == 1000*k,
+              "recorder metadata");
+        check(data[0] == (uint16_t)k &&
+              data[WIDTH*HEIGHT - 1] == (uint16_t)(k + WIDTH*HEIGHT - 1),
+              "recorder contents");
+    }
+    tao_common_stream_close_reader(reader);
+    unlink(path);
+    strcat(path, ".idx");
+    unlink(path);
+    printf("frame recorders: ok\n");
+}
+
+// FITS header templates: fields are patched in place and written frames are
+// valid FITS files.
+static void test_fits(
+    const char* dir)
+{
+    tao_common_fits_header* hdr = NULL;
+    char path[256];
+    uint16_t data[WIDTH*HEIGHT];
+    size_t size;
+
+    if (tao_common_fits_header_create(TAO_COMMON_UINT16, WIDTH, HEIGHT, 0,
+                                      &hdr) != TAO_OK ||
+        tao_common_fits_header_add_string(hdr, "INSTRUME", "Nuvu's", NULL)
+        != TAO_OK ||
+        tao_common_fits_header_add_real(hdr, "EXPTIME", 2.5, "msec")
+        != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_fits_header_add_int(hdr, "lower", 1, NULL) == TAO_ERROR,
+          "FITS key check");
+    tao_discard_errors();
+    int frame = tao_common_fits_header_add_field(hdr, "FRAMENUM",
+                                                 TAO_COMMON_FITS_INT, NULL);
+    int temp = tao_common_fits_header_add_field(hdr, "DETTEMP",
+                                                TAO_COMMON_FITS_REAL, "Celsius");
+    int date = tao_common_fits_header_add_field(hdr, "DATE-OBS",
+                                                TAO_COMMON_FITS_DATE, NULL);
+    check(frame >= 0 && temp >= 0 && date >= 0, "FITS fields");
+
+    const char* cards = tao_common_fits_header_data(hdr, &size);
+    check(size == 2880, "FITS header size");
+    check(memcmp(cards + 7*80, "INSTRUME= 'Nuvu''s '", 20) == 0,
+          "FITS string card");
+    tao_common_fits_header_set_int(hdr, frame, -1234567);
+    check(strncmp(cards + 9*80, "FRAMENUM=             -1234567 ", 31) == 0,
+          "FITS integer field");
+    tao_common_fits_header_set_real(hdr, temp, -60.25);
+    check(strncmp(cards + 10*80, "DETTEMP =               -60.25 / Celsius", 40)
+          == 0, "FITS real field");
+    // 2024-02-29T23:59:59.123456789 then across midnight
+    int64_t t = (int64_t)1709251199*1000000000 + 123456789;
+    tao_common_fits_header_set_date(hdr, date, t);
+    check(strncmp(cards + 11*80, "DATE-OBS= '2024-02-29T23:59:59.123456789'", 41)
+          == 0, "FITS date field");
+    tao_common_fits_header_set_date(hdr, date, t + 1000000000);
+    check(strncmp(cards + 11*80, "DATE-OBS= '2024-03-01T00:00:00.123456789'", 41)
+          == 0, "FITS date at midnight");
+    tao_common_fits_header_set_date(hdr, date, -1);
+    check(strncmp(cards + 11*80, "DATE-OBS= '1969-12-31T23:59:59.999999999'", 41)
+          == 0, "FITS date before 1970");
+    check(strncmp(cards + 12*80, "END     ", 8) == 0, "FITS END card");
+
+    for (int i = 0; i < WIDTH*HEIGHT; ++i) {
+        data[i] = i;
+    }
+    snprintf(path, sizeof(path), "%s/test-01-frame.fits", dir);
+    if (tao_common_fits_write(path, hdr, data, NULL) != TAO_OK) {
+        fatal_error();
+    }
+    FILE* file = fopen(path, "rb");
+    check(file != NULL, "FITS file");
+    unsigned char bytes[2884];
+    check(fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes), "FITS read");
+    fseek(file, 0, SEEK_END);
+    long fsize = ftell(file);
+    fclose(file);
+    unlink(path);
+    check(memcmp(bytes, cards, 2880) == 0, "FITS written header");
+    // pixel 1 is 1 - 32768 in big-endian order
+    check(bytes[2882] == 0x80 && bytes[2883] == 0x01, "FITS pixels");
+    check(fsize == 2880*(1 + (WIDTH*HEIGHT*2 + 2879)/2880), "FITS padding");
+
+    // a copy of the header is written while the template is patched again
+    char copy[TAO_COMMON_FITS_MAX_HEADER_SIZE];
+    memcpy(copy, cards, size);
+    tao_common_fits_header_set_int(hdr, frame, 42);
+    if (tao_common_fits_write_cards(path, hdr, copy, size, data,
+                                    NULL) != TAO_OK) {
+        fatal_error();
+    }
+    file = fopen(path, "rb");
+    check(file != NULL && fread(bytes, 1, sizeof(bytes), file) == sizeof(bytes),
+          "FITS copy read");
+    fclose(file);
+    unlink(path);
+    check(memcmp(bytes, copy, 2880) == 0 && memcmp(bytes, cards, 2880) != 0,
+          "FITS written copy");
+    tao_common_fits_header_destroy(hdr);
+    printf("FITS headers: ok\n");
+}
+
+// Pseudo-random EMCCD-like frame: bias, gradient, noise, a few hot pixels
+// and saturated or full-range values.
+static void make_frame(
+    uint16_t* frame,
+    int width,
+    int height,
+    unsigned seed)
+{
+    for (int i = 0; i < width*height; ++i) {
+        seed = seed*1103515245u + 12345u;
+        int noise = (int)((seed >> 16) & 63) - 32;
+        frame[i] = (uint16_t)(1000 + (i%width)/4 + noise);
+        if ((seed >> 8)%997 == 0) {
+            frame[i] = ((seed >> 4) & 1 ? 65535 : (uint16_t)(seed >> 7));
+        }
+    }
+    frame[0] = 0;
+    frame[width*height - 1] = 65535;
+}
+
+// Compression: round trip for several tile sizes, with and without threads.
+static void test_compress(
+    const char* dir)
+{
+    const int sizes[][2] = {{WIDTH, HEIGHT}, {37, 23}, {1, 5}, {100, 1}};
+    const uint32_t tiles[] = {0, 1, 7, 1000};
+    tao_common_pool* pool = NULL;
+    uint16_t frame[WIDTH*HEIGHT], back[WIDTH*HEIGHT];
+    size_t bound = 2*tao_common_compress_bound(WIDTH, HEIGHT, 1);
+    unsigned char* coded = malloc(bound);
+
+    if (coded == NULL || tao_common_pool_create(3, NULL, &pool) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_pool_size(pool) == 4, "pool size");
+    for (int s = 0; s < 4; ++s) {
+        int width = sizes[s][0], height = sizes[s][1];
+        for (int t = 0; t < 4; ++t) {
+            for (int p = 0; p < 2; ++p) {
+                tao_common_pixel_type type = (p == 0 ? TAO_COMMON_UINT16
+                                              : TAO_COMMON_INT16);
+                tao_common_pool* use = (t%2 == 0 ? pool : NULL);
+                make_frame(frame, width, height, 17*s + t);
+                check(tao_common_compress_bound(width, height, tiles[t])
+                      <= bound, "compression bound");
+                size_t size = tao_common_compress_frame(
+                    use, coded, frame, width, height, type, tiles[t]);
+                check(size > 0, "compressed size");
+                memset(back, 0xa5, sizeof(back));
+                if (tao_common_decompress_frame(use, back, coded, size,
+                                                width, height, type,
+                                                tiles[t]) != TAO_OK) {
+                    fatal_error();
+                }
+                check(memcmp(frame, back, 2*width*height) == 0,
+                      "compression round trip");
+                check(tao_common_decompress_frame(
+                          use, back, coded, size - 1 - size/2, width, height,
+                          type, tiles[t]) != TAO_OK, "truncated data");
+                tao_discard_errors();
+            }
+        }
+    }
+
+    // constant frames take a few bits per block
+    for (int i = 0; i < WIDTH*HEIGHT; ++i) {
+        frame[i] = 1234;
+    }
+    size_t size = tao_common_compress_frame(pool, coded, frame, WIDTH, HEIGHT,
+                                            TAO_COMMON_UINT16, 0);
+    check(size < WIDTH*HEIGHT/8, "constant frame");
+
+    // compressed stream
+    char path[256];
+    tao_common_stream_writer* writer = NULL;
+    tao_common_stream_reader* reader = NULL;
+    snprintf(path, sizeof(path), "%s/test-01-rice.tfs", dir);
+    if (tao_common_stream_create(path, WIDTH, HEIGHT, TAO_COMMON_UINT16,
+                                 "test", NULL, &writer) != TAO_OK ||
+        tao_common_stream_set_compression(writer, TAO_COMMON_COMPRESS_RICE,
+                                          0, pool) != TAO_OK) {
+        fatal_error();
+    }
+    for (int k = 0; k < NFRAMES; ++k) {
+        tao_common_frame_info info = {k, 0, 0};
+        make_frame(frame, WIDTH, HEIGHT, k);
+        if (tao_common_stream_append(writer, frame, &info) != TAO_OK) {
+            fatal_error();
+        }
+    }
+    if (tao_common_stream_close(writer) != TAO_OK ||
+        tao_common_stream_open(path, &reader) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_stream_get_header(reader)->compression ==
+          TAO_COMMON_COMPRESS_RICE, "compressed stream header");
+    uint64_t total = 0;
+    for (int k = 0; k < NFRAMES; ++k) {
+        make_frame(frame, WIDTH, HEIGHT, k);
+        if (tao_common_stream_read_frame(reader, k, back, NULL,
+                                         (k%2 ? pool : NULL)) != TAO_OK) {
+            fatal_error();
+        }
+        check(memcmp(frame, back, sizeof(frame)) == 0,
+              "compressed stream contents");
+        total += tao_common_stream_record_get(reader, k)->size;
+    }
+    tao_common_stream_close_reader(reader);
+    unlink(path);
+    strcat(path, ".idx");
+    unlink(path);
+    tao_common_pool_destroy(pool);
+    free(coded);
+    printf("compression: ok (ratio %.2f)\n",
+           (double)NFRAMES*sizeof(frame)/total);
+}
+
+static int64_t elapsed_ns(
+    const struct timespec* t0)
+{
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (int64_t)(t1.tv_sec - t0->tv_sec)*1000000000 +
+        (t1.tv_nsec - t0->tv_nsec);
+}
+
+// Replay: pacing modes and looping.
+static void test_replay(
+    const char* dir)
+{
+    char path[256];
+    uint16_t frame[WIDTH*HEIGHT];
+    tao_common_stream_writer* writer = NULL;
+    tao_common_replay* replay = NULL;
+    const int nframes = 10;
+    const int64_t period = 10000000; // 10 ms between recorded frames
+
+    snprintf(path, sizeof(path), "%s/test-01-replay.tfs", dir);
+    if (tao_common_stream_create(path, WIDTH, HEIGHT, TAO_COMMON_UINT16,
+                                 "test", NULL, &writer) != TAO_OK) {
+        fatal_error();
+    }
+    for (int k = 0; k < nframes; ++k) {
+        tao_common_frame_info info = {k, 5000000000 + k*period, k, k%8};
+        frame[0] = k;
+        if (tao_common_stream_append(writer, frame, &info) != TAO_OK) {
+            fatal_error();
+        }
+    }
+    if (tao_common_stream_close(writer) != TAO_OK) {
+        fatal_error();
+    }
+
+    const tao_common_replay_mode modes[] = {
+        TAO_COMMON_REPLAY_ORIGINAL, TAO_COMMON_REPLAY_FIXED,
+        TAO_COMMON_REPLAY_FAST};
+    const double rates[] = {2.0, 200.0, 0.0};
+    for (int m = 0; m < 3; ++m) {
+        struct timespec t0;
+        const void* data;
+        tao_common_frame_info info;
+        int n = 0;
+        if (tao_common_replay_open(path, modes[m], rates[m], 0,
+                                   &replay) != TAO_OK) {
+            fatal_error();
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        while (1) {
+            if (tao_common_replay_next(replay, &data, &info) != TAO_OK) {
+                fatal_error();
+            }
+            if (data == NULL) {
+                break;
+            }
+            check(((const uint16_t*)data)[0] == n && info.id == n &&
+                  info.camera_time == n && info.orientation == n%8,
+                  "replay frame");
+            ++n;
+        }
+        int64_t dt = elapsed_ns(&t0);
+        check(n == nframes, "replay count");
+        if (m < 2) {
+            // 9 intervals of 5 ms in both paced modes
+            check(dt >= 9*period/2, "replay pacing");
+        }
+        tao_common_replay_close(replay);
+    }
+
+    // looping keeps frame numbers increasing
+    if (tao_common_replay_open(path, TAO_COMMON_REPLAY_FAST, 0, 1,
+                               &replay) != TAO_OK) {
+        fatal_error();
+    }
+    for (int n = 0; n < 3*nframes; ++n) {
+        const void* data;
+        tao_common_frame_info info;
+        if (tao_common_replay_next(replay, &data, &info) != TAO_OK) {
+            fatal_error();
+        }
+        check(data != NULL && info.id == n &&
+              ((const uint16_t*)data)[0] == n%nframes, "replay loop");
+    }
+    tao_common_replay_close(replay);
+    unlink(path);
+    strcat(path, ".idx");
+    unlink(path);
+    printf("replay: ok\n");
+}
+
+typedef struct producer {
+    tao_common_merger* merger;
+    int source;
+    int nframes;
+} producer;
+
+static void* produce(
+    void* arg)
+{
+    producer* p = arg;
+    int64_t t0 = tao_common_monotonic_time() - 1000000000;
+    for (int k = 0; k < p->nframes; ++k) {
+        tao_common_frame_info info = {k, t0 + k*(p->source + 1)*1000, 0};
+        tao_common_merger_push(p->merger, p->source, &info);
+    }
+    return NULL;
+}
+
+// Clock mapping and frame merging.
+static void test_sync(void)
+{
+    tao_common_clock_map map;
+    tao_common_merger* merger = NULL;
+    tao_common_merged out;
+
+    // camera clock running 50 ppm fast with 20 us of arrival jitter and one
+    // frame in 50 delayed by 5 ms
+    tao_common_clock_map_init(&map);
+    unsigned seed = 1;
+    for (int k = 0; k < 1000; ++k) {
+        int64_t host = 1000000000000 + (int64_t)k*10000000;
+        int64_t camera = 7 + (int64_t)((host - 1000000000000)*(1 + 50e-6));
+        seed = seed*1103515245u + 12345u;
+        int64_t delay = 100000 + (seed >> 16)%20000 + (k%50 == 49 ? 5000000 : 0);
+        tao_common_clock_map_update(&map, camera, host + delay);
+    }
+    check(fabs(tao_common_clock_map_drift(&map) + 50) < 1, "clock drift");
+    check(map.rejected >= 4, "clock outliers");
+    check(map.jitter > 3000 && map.jitter < 12000, "clock jitter");
+    // mapped times are those of the fastest arrivals
+    int64_t camera = 7 + (int64_t)(10000000000*(1 + 50e-6));
+    int64_t err = tao_common_clock_map_to_host(&map, camera) -
+        (1000000000000 + 10000000000 + 100000);
+    check(err > -2000 && err < 2000, "clock mapping");
+    struct timespec ts;
+    int64_t mono = tao_common_monotonic_time();
+    clock_gettime(CLOCK_REALTIME, &ts);
+    err = (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec -
+        (mono + tao_common_realtime_offset());
+    check(err > -1000000 && err < 1000000, "realtime offset");
+
+    // 1 kHz and 100 Hz streams, the second one 0.3 ms late
+    int64_t t0 = tao_common_monotonic_time() - 1000000000;
+    if (tao_common_merger_create(256, 500000, 1000000, &merger) != TAO_OK) {
+        fatal_error();
+    }
+    for (int k = 0; k < 200; ++k) {
+        tao_common_frame_info info = {k, t0 + k*1000000, 0};
+        tao_common_merger_push(merger, 0, &info);
+        if (k%10 == 0) {
+            info.id = k/10;
+            info.host_time += 300000;
+            tao_common_merger_push(merger, 1, &info);
+        }
+    }
+    int pairs = 0, singles = 0;
+    while (tao_common_merger_pop(merger, &out, 0.01)) {
+        if (out.mask == 3) {
+            check(out.frame[0].id == 10*out.frame[1].id, "merged pair");
+            ++pairs;
+        } else {
+            check(out.mask == 1, "merged single");
+            ++singles;
+        }
+    }
+    check(pairs == 20 && singles == 180, "merged counts");
+    tao_common_merger_destroy(merger);
+
+    // full queues lose frames
+    if (tao_common_merger_create(16, 0, 0, &merger) != TAO_OK) {
+        fatal_error();
+    }
+    for (int k = 0; k < 20; ++k) {
+        tao_common_frame_info info = {k, t0 + k, 0};
+        tao_common_merger_push(merger, 1, &info);
+    }
+    check(tao_common_merger_lost(merger, 1) == 4, "merger lost frames");
+    tao_common_merger_destroy(merger);
+
+    // concurrent producers: every frame comes out exactly once
+    const int nframes = 20000;
+    if (tao_common_merger_create(64, 500, 100000, &merger) != TAO_OK) {
+        fatal_error();
+    }
+    producer p[2] = {{merger, 0, nframes}, {merger, 1, nframes}};
+    pthread_t threads[2];
+    for (int i = 0; i < 2; ++i) {
+        pthread_create(&threads[i], NULL, produce, &p[i]);
+    }
+    int64_t next[2] = {0, 0}, count[2] = {0, 0};
+    while (tao_common_merger_pop(merger, &out, 0.2)) {
+        for (int s = 0; s < 2; ++s) {
+            if (out.mask & (1 << s)) {
+                check((int64_t)out.frame[s].id >= next[s], "merger order");
+                next[s] = out.frame[s].id + 1;
+                ++count[s];
+            }
+        }
+    }
+    for (int i = 0; i < 2; ++i) {
+        pthread_join(threads[i], NULL);
+        check(count[i] + tao_common_merger_lost(merger, i) == nframes,
+              "merger completeness");
+    }
+    tao_common_merger_destroy(merger);
+    printf("synchronization: ok\n");
+}
+
+// Calibration: compare the fused kernel with a direct computation, bad
+// pixels included.
+static void test_calib(void)
+{
+    const int sizes[][2] = {{WIDTH, HEIGHT}, {37, 23}, {1, 5}};
+    static float bias[WIDTH*HEIGHT], dark[WIDTH*HEIGHT], flat[WIDTH*HEIGHT];
+    static float out[WIDTH*HEIGHT], ref[WIDTH*HEIGHT];
+    static uint16_t raw[WIDTH*HEIGHT];
+    static uint8_t bad[WIDTH*HEIGHT];
+    tao_common_pool* pool = NULL;
+
+    if (tao_common_pool_create(2, NULL, &pool) != TAO_OK) {
+        fatal_error();
+    }
+    for (int s = 0; s < 3; ++s) {
+        int width = sizes[s][0], height = sizes[s][1], n = width*height;
+        tao_common_calib* calib;
+        if (tao_common_calib_create(width, height, &calib) != TAO_OK) {
+            fatal_error();
+        }
+        srand(s + 1);
+        uint32_t nbad = 0;
+        for (int i = 0; i < n; ++i) {
+            bias[i] = 100 + rand()%20;
+            dark[i] = 0.5f*(rand()%10);
+            flat[i] = 0.8f + 0.4f*rand()/RAND_MAX;
+            bad[i] = (rand()%17 == 0);
+            if (rand()%53 == 0) {
+                flat[i] = 0;
+            }
+            nbad += (bad[i] || flat[i] == 0);
+            raw[i] = 120 + rand()%4000;
+        }
+        // identity before the maps are set
+        if (tao_common_calib_apply(calib, pool, out, raw, TAO_COMMON_UINT16,
+                                   1.0) != TAO_OK) {
+            fatal_error();
+        }
+        for (int i = 0; i < n; ++i) {
+            check(out[i] == raw[i], "calibration identity");
+        }
+        if (tao_common_calib_set_maps(calib, bias, dark, flat, bad) != TAO_OK) {
+            fatal_error();
+        }
+        check(tao_common_calib_bad_count(calib) == nbad, "bad pixel count");
+
+        const double t = 2.5;
+        for (int y = 0; y < height; ++y) {
+            const int o = y*width;
+            for (int x = 0; x < width; ++x) {
+                ref[o + x] = (raw[o + x] - bias[o + x] - dark[o + x]*t)
+                    /flat[o + x];
+            }
+            for (int x = 0; x < width; ++x) {
+                if (!bad[o + x] && flat[o + x] > 0) {
+                    continue;
+                }
+                int l = x - 1, r = x + 1;
+                while (l >= 0 && (bad[o + l] || !(flat[o + l] > 0))) --l;
+                while (r < width && (bad[o + r] || !(flat[o + r] > 0))) ++r;
+                float vl = (l >= 0 ? (raw[o + l] - bias[o + l] -
+                                      dark[o + l]*t)/flat[o + l] : 0);
+                float vr = (r < width ? (raw[o + r] - bias[o + r] -
+                                         dark[o + r]*t)/flat[o + r] : 0);
+                ref[o + x] = (l >= 0 && r < width ? 0.5f*(vl + vr) :
+                              l >= 0 ? vl : vr);
+            }
+        }
+        for (int p = 0; p < 2; ++p) {
+            memset(out, 0, sizeof(out));
+            if (tao_common_calib_apply(calib, (p ? pool : NULL), out, raw,
+                                       TAO_COMMON_UINT16, t) != TAO_OK) {
+                fatal_error();
+            }
+            for (int i = 0; i < n; ++i) {
+                check(fabsf(out[i] - ref[i]) <= 1e-3f*(1 + fabsf(ref[i])),
+                      "calibrated pixel");
+            }
+        }
+        tao_common_calib_destroy(calib);
+    }
+    tao_common_pool_destroy(pool);
+    printf("calibration: ok\n");
+}
+
+// Defective pixels: plant hot, dead, cold and noisy pixels in noisy bias
+// frames and find them.
+static void test_defects(void)
+{
+    const int width = 61, height = 47, nframes = 50;
+    const uint32_t planted[] = {5, 300, 1234, 2866};
+    const uint8_t kinds[] = {TAO_COMMON_DEFECT_HOT, TAO_COMMON_DEFECT_DEAD,
+                             TAO_COMMON_DEFECT_DEAD, TAO_COMMON_DEFECT_NOISY};
+    static uint16_t frame[61*47];
+    tao_common_defects* def;
+    tao_common_calib* calib;
+    tao_common_pool* pool;
+    uint32_t* list;
+    uint8_t* found;
+    uint32_t count;
+
+    if (tao_common_pool_create(2, NULL, &pool) != TAO_OK ||
+        tao_common_defects_create(width, height, &def) != TAO_OK) {
+        fatal_error();
+    }
+    srand(7);
+    for (int f = 0; f < nframes; ++f) {
+        for (int i = 0; i < width*height; ++i) {
+            // fixed pattern and approximately Gaussian noise
+            int noise = rand()%7 + rand()%7 + rand()%7 + rand()%7 - 12;
+            frame[i] = 1000 + (i%5) + noise;
+        }
+        frame[planted[0]] += 200;
+        frame[planted[1]] = 1002;
+        frame[planted[2]] -= 300;
+        frame[planted[3]] += 20*(rand()%7 - 3);
+        if (tao_common_defects_add(def, (f%2 ? pool : NULL), frame,
+                                   TAO_COMMON_UINT16) != TAO_OK) {
+            fatal_error();
+        }
+    }
+    check(tao_common_defects_frames(def) == nframes, "defect frames");
+    if (tao_common_defects_find(def, NULL, &list, &found, &count) != TAO_OK) {
+        fatal_error();
+    }
+    check(count == 4, "number of defective pixels");
+    for (uint32_t i = 0; i < count; ++i) {
+        check(list[i] == planted[i] && (found[i] & kinds[i]) != 0,
+              "defective pixel");
+    }
+
+    // the list goes directly to the calibration
+    if (tao_common_calib_create(width, height, &calib) != TAO_OK ||
+        tao_common_calib_add_bad_pixels(calib, list, count) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_calib_bad_count(calib) == count, "calibration bad pixels");
+    tao_common_calib_destroy(calib);
+    free(list);
+    free(found);
+
+    tao_common_defects_reset(def);
+    check(tao_common_defects_find(def, NULL, &list, NULL, &count) != TAO_OK,
+          "defects without frames");
+    tao_discard_errors();
+    tao_common_defects_destroy(def);
+    tao_common_pool_destroy(pool);
+    printf("defective pixels: ok\n");
+}
+
+// Co-adding: windows of frames are summed exactly in 32 and 64 bits and the
+// stacks are recorded.
+static void test_coadd(
+    const char* dir)
+{
+    const int window = 3, nframes = 7;
+    static uint16_t frames[7][WIDTH*HEIGHT];
+    tao_common_stream_writer* writer = NULL;
+    tao_common_stream_reader* reader = NULL;
+    tao_common_pool* pool = NULL;
+    char path[256];
+
+    for (int k = 0; k < nframes; ++k) {
+        for (int i = 0; i < WIDTH*HEIGHT; ++i) {
+            frames[k][i] = 65535 - (uint16_t)(13*k + i);
+        }
+    }
+    snprintf(path, sizeof(path), "%s/coadd.tfs", dir);
+    if (tao_common_pool_create(2, NULL, &pool) != TAO_OK ||
+        tao_common_stream_create(path, WIDTH, HEIGHT, TAO_COMMON_UINT32,
+                                 "test", NULL, &writer) != TAO_OK) {
+        fatal_error();
+    }
+    for (int t = 0; t < 2; ++t) {
+        tao_common_pixel_type type = (t == 0 ? TAO_COMMON_UINT32
+                                      : TAO_COMMON_UINT64);
+        tao_common_coadd* co;
+        if (tao_common_coadd_create(WIDTH, HEIGHT, type, window,
+                                    (t == 0 ? pool : NULL),
+                                    (t == 0 ? writer : NULL), &co) != TAO_OK) {
+            fatal_error();
+        }
+        const void* stack;
+        uint32_t count;
+        for (int k = 0; k <= nframes; ++k) {
+            if (k < nframes) {
+                tao_common_frame_info info = {k, 1000*k, 0};
+                if (tao_common_coadd_add(co, frames[k], &info,
+                                         &stack) != TAO_OK) {
+                    fatal_error();
+                }
+                count = (stack != NULL ? window : 0);
+            } else if (tao_common_coadd_flush(co, &stack, &count) != TAO_OK) {
+                fatal_error();
+            }
+            check((stack != NULL) == ((k + 1)%window == 0 || k == nframes),
+                  "co-added stack");
+            if (stack == NULL) {
+                continue;
+            }
+            int first = k + 1 - count - (k == nframes);
+            for (int i = 0; i < WIDTH*HEIGHT; ++i) {
+                uint64_t sum = 0;
+                for (int j = first; j < first + (int)count; ++j) {
+                    sum += frames[j][i];
+                }
+                uint64_t val = (type == TAO_COMMON_UINT32 ?
+                                ((const uint32_t*)stack)[i] :
+                                ((const uint64_t*)stack)[i]);
+                check(val == sum, "co-added pixel");
+            }
+        }
+        check(tao_common_coadd_stacks(co) == 3, "number of stacks");
+        tao_common_coadd_destroy(co);
+    }
+    if (tao_common_stream_close(writer) != TAO_OK ||
+        tao_common_stream_open(path, &reader) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_stream_count(reader) == 3, "recorded stacks");
+    tao_common_frame_info info;
+    const uint32_t* data = tao_common_stream_frame(reader, 1, &info);
+    check(data != NULL && info.id == 1 && info.host_time == 3000 &&
+          data[5] == (uint32_t)frames[3][5] + frames[4][5] + frames[5][5],
+          "recorded stack");
+    tao_common_stream_close_reader(reader);
+    tao_common_pool_destroy(pool);
+    unlink(path);
+    strcat(path, ".idx");
+    unlink(path);
+    printf("co-adding: ok\n");
+}
+
+// Pixel kernels: every instruction set supported by the CPU gives the
+// results of plain loops, for sizes which are not multiples of the vectors.
+static void test_kernels(void)
+{
+    const char* isas[] = {"sse2", "avx2", "avx512", "generic"};
+    const size_t w = 37, h = 29, n = 37*29;
+    static uint16_t u16[37*29], t16[37*29], r16[37*29];
+    static uint8_t u8[37*29], r8[37*29];
+    static float f[37*29], g[37*29], out[37*29], tf[37*29];
+    static uint32_t u32[37*29], bins[4*4096], big[3*37*29];
+    static uint64_t u64[37*29];
+    int nisas = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        u16[i] = (uint16_t)(i*2654435761u >> 7);
+        u8[i] = (uint8_t)(i*31);
+        f[i] = (float)i - 300.25f;
+        g[i] = 0.5f + (i%7);
+    }
+    f[17] = NAN;
+    const tao_common_kernels* best = tao_common_kernels_get();
+    check(best != NULL && tao_common_kernels_select(best->isa) == best,
+          "selected kernels");
+    check(tao_common_kernels_select("none") == NULL, "unknown kernels");
+    for (int j = 0; j < 4; ++j) {
+        const tao_common_kernels* k = tao_common_kernels_select(isas[j]);
+        if (k == NULL) {
+            continue;
+        }
+        ++nisas;
+        k->convert_u8_f32(out, u8, n);
+        for (size_t i = 0; i < n; ++i) check(out[i] == u8[i], "u8 to f32");
+        k->convert_u16_f32(out, u16, n);
+        for (size_t i = 0; i < n; ++i) check(out[i] == u16[i], "u16 to f32");
+        k->convert_u16_u32(u32, u16, n);
+        k->accumulate_u16_u32(u32, u16, n);
+        for (size_t i = 0; i < n; ++i) check(u32[i] == 2u*u16[i], "u32 sum");
+        k->convert_u16_u64(u64, u16, n);
+        k->accumulate_u16_u64(u64, u16, n);
+        for (size_t i = 0; i < n; ++i) check(u64[i] == 2u*u16[i], "u64 sum");
+        k->scale_f32(out, g, n, 3.0f, -1.0f);
+        for (size_t i = 0; i < n; ++i) check(out[i] == 3*g[i] - 1, "scale");
+        k->convert_f32_u16(r16, out, n);
+        for (size_t i = 0; i < n; ++i) {
+            check(r16[i] == (out[i] < 0 ? 0 : (uint16_t)(out[i] + 0.5f)),
+                  "f32 to u16");
+        }
+        k->scale_u16_u8(r8, u16, n, 1.0f/64, -100.0f);
+        for (size_t i = 0; i < n; ++i) {
+            float v = u16[i]/64.0f - 100;
+            check(r8[i] == (v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v),
+                  "u16 to u8");
+        }
+        uint16_t lo16, hi16;
+        float lo, hi;
+        k->minmax_u16(u16, n, &lo16, &hi16);
+        k->minmax_f32(f, n, &lo, &hi);
+        uint16_t rlo16 = 65535, rhi16 = 0;
+        for (size_t i = 0; i < n; ++i) {
+            rlo16 = (u16[i] < rlo16 ? u16[i] : rlo16);
+            rhi16 = (u16[i] > rhi16 ? u16[i] : rhi16);
+        }
+        check(lo16 == rlo16 && hi16 == rhi16, "u16 min/max");
+        check(lo == f[0] && hi == f[n-1], "f32 min/max");
+        memset(bins, 0, sizeof(bins));
+        k->histogram_u16(bins, u16, n, 4);
+        uint32_t total = 0;
+        for (int b = 0; b < 4096; ++b) total += bins[b];
+        check(total == n && bins[u16[5] >> 4] > 0, "histogram");
+        for (int b = 4096; b < 4*4096; ++b) check(bins[b] == 0, "scratch");
+        k->convert_u16_u32(u32, u16, n);
+        k->repeat_u32(big, u32, n, 3);
+        for (size_t i = 0; i < 3*n; ++i) check(big[i] == u16[i/3], "repeat");
+        k->subtract_f32(out, g, f, n);
+        for (size_t i = 18; i < n; ++i) check(out[i] == g[i] - f[i], "subtract");
+        k->multiply_f32(out, g, g, n);
+        for (size_t i = 0; i < n; ++i) check(out[i] == g[i]*g[i], "multiply");
+        k->transpose_u16(t16, u16, w, h);
+        k->transpose_f32(tf, g, w, h);
+        for (size_t y = 0; y < h; ++y) {
+            for (size_t x = 0; x < w; ++x) {
+                check(t16[x*h + y] == u16[y*w + x] &&
+                      tf[x*h + y] == g[y*w + x], "transpose");
+            }
+        }
+    }
+    check(nisas >= 1, "available kernels");
+    printf("pixel kernels: ok (%s)\n", best->isa);
+}
+
+// Orientation: the 8 rotations and flips of frames larger than a tile with
+// pixels of every size, split between threads.
+static void test_orient(void)
+{
+    const tao_common_pixel_type types[] = {
+        TAO_COMMON_UINT8, TAO_COMMON_UINT16, TAO_COMMON_FLOAT32,
+        TAO_COMMON_FLOAT64};
+    const uint32_t w = 70, h = 45;
+    static uint64_t src[70*45], dst[70*45], tmp[70*45];
+    tao_common_pool* pool = NULL;
+
+    if (tao_common_pool_create(3, NULL, &pool) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_orientation_from_degrees(-90, 0) ==
+          TAO_COMMON_ORIENT_ROTATE270 &&
+          tao_common_orientation_from_degrees(540, 1) ==
+          TAO_COMMON_ORIENT_FLIP_Y &&
+          tao_common_orientation_from_degrees(45, 0) == -1,
+          "orientation from degrees");
+    for (int t = 0; t < 4; ++t) {
+        size_t size = tao_common_pixel_size(types[t]);
+        for (size_t i = 0; i < w*h; ++i) {
+            // distinct values for any pixel size
+            memcpy((char*)src + i*size, &(uint64_t){i*0x10001}, size);
+        }
+        for (int o = 0; o < 8; ++o) {
+            uint32_t dw, dh;
+            tao_common_orient_size(o, w, h, &dw, &dh);
+            check(dw*dh == w*h && (dw == h) == (o & 1), "oriented size");
+            if (tao_common_orient(pool, dst, src, w, h, types[t],
+                                  o) != TAO_OK) {
+                fatal_error();
+            }
+            for (uint32_t yd = 0; yd < dh; ++yd) {
+                for (uint32_t xd = 0; xd < dw; ++xd) {
+                    // source pixel by the definition of each orientation
+                    uint32_t xs[8] = {xd, yd, w-1-xd, w-1-yd,
+                                      w-1-xd, w-1-yd, xd, yd};
+                    uint32_t ys[8] = {yd, h-1-xd, h-1-yd, xd,
+                                      yd, h-1-xd, h-1-yd, xd};
+                    check(memcmp((char*)dst + ((size_t)yd*dw + xd)*size,
+                                 (char*)src + ((size_t)ys[o]*w + xs[o])*size,
+                                 size) == 0, "oriented pixel");
+                }
+            }
+        }
+        // two quarter turns are a half turn
+        tao_common_orient(NULL, tmp, src, w, h, types[t],
+                          TAO_COMMON_ORIENT_ROTATE90);
+        tao_common_orient(NULL, dst, tmp, h, w, types[t],
+                          TAO_COMMON_ORIENT_ROTATE90);
+        tao_common_orient(pool, tmp, src, w, h, types[t],
+                          TAO_COMMON_ORIENT_ROTATE180);
+        check(memcmp(dst, tmp, w*h*size) == 0, "composed rotations");
+    }
+    check(tao_common_orient(NULL, dst, src, w, h, TAO_COMMON_UINT16,
+                            8) == TAO_ERROR, "invalid orientation");
+    tao_discard_errors();
+    tao_common_pool_destroy(pool);
+    printf("orientation: ok\n");
+}
+
+// Display stretch: percentiles of a known distribution, table rebuilt only
+// when the limits move, monotonic curves.
+static void test_stretch(void)
+{
+    static uint16_t frame[100*100];
+    static uint32_t out[100*100];
+    tao_common_stretch_config cfg;
+    tao_common_stretch* stretch = NULL;
+    double lo, hi;
+    int rebuilt;
+
+    check(tao_common_stretch_mode_parse("asinh") == TAO_COMMON_STRETCH_ASINH &&
+          tao_common_stretch_mode_parse("gamma") == -1, "stretch modes");
+    tao_common_stretch_config_init(&cfg);
+    cfg.levels = 1024;
+    cfg.multiplier = 0x100401;  // gray RGB30
+    if (tao_common_stretch_create(&cfg, &stretch) != TAO_OK) {
+        fatal_error();
+    }
+    // uniform from 1000 to 10999, a few hot pixels
+    for (int i = 0; i < 100*100; ++i) {
+        frame[i] = 1000 + i;
+    }
+    frame[0] = frame[1] = 65535;
+    if (tao_common_stretch_update(stretch, frame, 100*100,
+                                  &rebuilt) != TAO_OK) {
+        fatal_error();
+    }
+    tao_common_stretch_get_limits(stretch, &lo, &hi);
+    check(rebuilt && fabs(lo - 1050) < 20 && fabs(hi - 10950) < 20,
+          "stretch limits");
+    check(tao_common_stretch_get_max(stretch) == 65535, "stretch max");
+    tao_common_stretch_apply(stretch, out, frame, 100*100);
+    check(out[2] == 0 && out[0] == 1023*0x100401u &&
+          out[5000]%0x100401u == 0 && out[5000]/0x100401u - 511 <= 1,
+          "stretch linear");
+    // a small change keeps the table
+    frame[5000] = 0;
+    tao_common_stretch_update(stretch, frame, 100*100, &rebuilt);
+    check(!rebuilt, "stretch table kept");
+    for (int i = 0; i < 100*100; ++i) {
+        frame[i] = 1000 + i/2;
+    }
+    tao_common_stretch_update(stretch, frame, 100*100, &rebuilt);
+    check(rebuilt, "stretch table rebuilt");
+    check(tao_common_stretch_get_max(stretch) == (5999 | 15), "stretch max");
+    for (int mode = TAO_COMMON_STRETCH_LOG; mode <= TAO_COMMON_STRETCH_ASINH;
+         ++mode) {
+        tao_common_stretch_set_mode(stretch, mode);
+        tao_common_stretch_apply(stretch, out, frame, 100*100);
+        for (int i = 1; i < 100*100; ++i) {
+            check(out[i] >= out[i-1], "stretch monotonic");
+        }
+        // faint levels are brightened
+        check(out[3000] > 512*0x100401u, "stretch curve");
+    }
+    tao_common_stretch_destroy(stretch);
+    cfg.levels = 0;
+    check(tao_common_stretch_create(&cfg, &stretch) == TAO_ERROR,
+          "stretch invalid levels");
+    tao_discard_errors();
+    printf("display stretch: ok\n");
+}
+
+// Shared frames: a reader copying frames while they are published at full
+// speed only gets whole frames, in order.
+typedef struct shm_test {
+    tao_common_shm_writer* writer;
+    int nframes;
+} shm_test;
+
+static void* shm_publisher(
+    void* arg)
+{
+    shm_test* t = arg;
+    static uint32_t frame[64*48];
+    for (int k = 1; k <= t->nframes; ++k) {
+        // every pixel of the k-th frame is k
+        uint32_t* dst = tao_common_shm_begin(t->writer);
+        for (int i = 0; i < 64*48; ++i) {
+            dst[i] = k;
+        }
+        tao_common_shm_end(t->writer, NULL);
+    }
+    frame[0] = 0;
+    tao_common_shm_publish(t->writer, frame, NULL);
+    return NULL;
+}
+
+static void test_shm(void)
+{
+    char name[64];
+    static uint32_t frame[64*48];
+    tao_common_shm_writer* writer = NULL;
+    tao_common_shm_writer* other = NULL;
+    tao_common_shm_reader* reader = NULL;
+    tao_common_frame_info info;
+    uint64_t number, published;
+
+    snprintf(name, sizeof(name), "/tao-common-test-%d", (int)getpid());
+    if (tao_common_shm_create(name, 64, 48, TAO_COMMON_UINT32, 4,
+                              &writer) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_shm_create(name, 64, 48, TAO_COMMON_UINT32, 4,
+                                &other) == TAO_ERROR, "shared frames in use");
+    tao_discard_errors();
+    if (tao_common_shm_open(name, &reader) != TAO_OK) {
+        fatal_error();
+    }
+    const tao_common_shm_header* hdr = tao_common_shm_get_header(reader);
+    check(hdr->width == 64 && hdr->height == 48 && hdr->nslots == 4 &&
+          hdr->pixel_type == TAO_COMMON_UINT32, "shared frames header");
+    if (tao_common_shm_read(reader, frame, NULL, &number) != TAO_OK) {
+        fatal_error();
+    }
+    check(number == 0, "no shared frame yet");
+    tao_common_shm_wait(reader, 0, 0.01, &published);
+    check(published == 0, "shared frames timeout");
+
+    for (int i = 0; i < 64*48; ++i) {
+        frame[i] = i;
+    }
+    for (int k = 0; k < 6; ++k) {
+        tao_common_frame_info in = {10 + k, 100*k, 0, 0};
+        frame[0] = k;
+        tao_common_shm_publish(writer, frame, &in);
+    }
+    tao_common_shm_wait(reader, 0, 1.0, &published);
+    check(published == 6, "shared frames published");
+    memset(frame, 0, sizeof(frame));
+    if (tao_common_shm_read(reader, frame, &info, &number) != TAO_OK) {
+        fatal_error();
+    }
+    check(number == 6 && info.id == 15 && frame[0] == 5 &&
+          frame[64*48 - 1] == 64*48 - 1, "latest shared frame");
+
+    // concurrent copies
+    shm_test t = {writer, 20000};
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, shm_publisher, &t) != 0) {
+        fatal_error();
+    }
+    uint64_t last = number, reads = 0;
+    while (1) {
+        if (tao_common_shm_read(reader, frame, &info, &number) != TAO_OK) {
+            fatal_error();
+        }
+        if (number <= 6) {
+            // not yet a frame of the thread
+            continue;
+        }
+        if (frame[0] == 0) {
+            break;
+        }
+        for (int i = 1; i < 64*48; ++i) {
+            check(frame[i] == frame[0], "torn shared frame");
+        }
+        check(number >= last && frame[0] == number - 6,
+              "shared frame order");
+        last = number;
+        ++reads;
+    }
+    pthread_join(thread, NULL);
+    check(!tao_common_shm_stopped(reader), "shared frames running");
+    tao_common_shm_close(writer);
+    check(tao_common_shm_stopped(reader), "shared frames stopped");
+    tao_common_shm_close_reader(reader);
+    check(tao_common_shm_open(name, &reader) == TAO_ERROR,
+          "shared frames removed");
+    tao_discard_errors();
+    printf("shared frames: ok (%lu reads)\n", (unsigned long)reads);
+}
+
+static void test_server(
+    const char* dir)
+{
+    char path[256];
+    static uint16_t frame[32*16];
+    tao_common_shm_writer* writer = NULL;
+    tao_common_shm_writer* named = NULL;
+    tao_common_server* server = NULL;
+    tao_common_server* other = NULL;
+    tao_common_client* client = NULL;
+    tao_common_shm_view view;
+    uint64_t published;
+
+    snprintf(path, sizeof(path), "%s/tao_common_test-%d.sock", dir,
+             (int)getpid());
+    if (tao_common_shm_create_anonymous(32, 16, TAO_COMMON_UINT16, 4,
+                                        &writer) != TAO_OK) {
+        fatal_error();
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "/tao-common-test-%d", (int)getpid());
+    if (tao_common_shm_create(name, 32, 16, TAO_COMMON_UINT16, 4,
+                              &named) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_server_create(path, named, &server) == TAO_ERROR,
+          "frame server of a named ring");
+    tao_discard_errors();
+    tao_common_shm_close(named);
+    if (tao_common_server_create(path, writer, &server) != TAO_OK) {
+        fatal_error();
+    }
+    check(tao_common_server_create(path, writer, &other) == TAO_ERROR,
+          "frame server in use");
+    tao_discard_errors();
+    if (tao_common_client_connect(path, &client) != TAO_OK) {
+        fatal_error();
+    }
+    tao_common_shm_reader* reader = tao_common_client_get_reader(client);
+    const tao_common_shm_header* hdr = tao_common_shm_get_header(reader);
+    check(hdr->width == 32 && hdr->height == 16 && hdr->nslots == 4,
+          "frame server ring");
+    for (int k = 0; k < 100 && tao_common_server_clients(server) < 1; ++k) {
+        usleep(1000);
+    }
+    check(tao_common_server_clients(server) == 1, "frame server clients");
+
+    // frames in place
+    for (int i = 0; i < 32*16; ++i) {
+        frame[i] = 7;
+    }
+    tao_common_shm_publish(writer, frame, NULL);
+    tao_common_server_notify(server);
+    tao_common_client_wait(client, 0, 1.0, &published);
+    check(published == 1, "frame notified");
+    if (tao_common_shm_peek(reader, &view) != TAO_OK) {
+        fatal_error();
+    }
+    const uint16_t* pixels = view.data;
+    check(view.number == 1 && pixels[0] == 7 && pixels[32*16 - 1] == 7,
+          "frame in place");
+    check(tao_common_shm_intact(reader, &view), "frame intact");
+    for (int k = 0; k < 4; ++k) {
+        tao_common_shm_publish(writer, frame, NULL);
+        tao_common_server_notify(server);
+    }
+    check(!tao_common_shm_intact(reader, &view), "frame overwritten");
+    tao_common_client_wait(client, 1, 1.0, &published);
+    check(published > 1, "frames notified");
+    check(tao_common_client_wait(client, 5, 0.01, &published) == TAO_OK &&
+          published == 5, "frame server timeout");
+
+    tao_common_server_destroy(server);
+    tao_common_client_wait(client, 5, 1.0, &published);
+    check(published == 5 && tao_common_client_stopped(client),
+          "frame server stopped");
+    tao_common_client_close(client);
+    check(tao_common_client_connect(path, &client) == TAO_ERROR,
+          "frame server removed");
+    tao_discard_errors();
+    tao_common_shm_close(writer);
+    printf("frame server: ok\n");
+}
+
+int main(
+    int argc,
+    char* argv[])
+{
+    const char* dir = (argc > 1 ? argv[1] : ".");
+    test_frame_buffer();
+    test_pool();
+    test_stream(dir);
+    test_recorder(dir);
+    test_fits(dir);
+    test_compress(dir);
+    test_replay(dir);
+    test_sync();
+    test_calib();
+    test_defects();
+    test_coadd(dir);
+    test_kernels();
+    test_orient();
+    test_stretch();
+    test_shm();
+    test_server(dir);
+    return EXIT_SUCCESS;
+}
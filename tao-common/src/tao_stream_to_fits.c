@@ -0,0 +1,50 @@
+// Export frames of a TAO frame stream into a FITS cube
+// syntax: tao_stream_to_fits stream.tfs output.fits [first [count]]
+
+#include <stdlib.h>
+#include "tao-common.h"
+
+static void fatal_error()
+{
+    fprintf(stderr, "Some fatal error has been encountered...\n");
+    if (tao_any_errors()) {
+        tao_report_errors();
+    }
+    exit(EXIT_FAILURE);
+}
+
+int main(
+    int argc,
+    char* argv[])
+{
+    tao_common_stream_reader* reader = NULL;
+    unsigned long long first = 0, count = 0;
+
+    if (argc < 3 || argc > 5) {
+        fprintf(stderr, "syntax: %s stream output.fits [first [count]]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (tao_common_stream_open(argv[1], &reader) != TAO_OK) {
+        fatal_error();
+    }
+    uint64_t nframes = tao_common_stream_count(reader);
+    if (argc > 3 && sscanf(argv[3], "%llu", &first) != 1) {
+        fprintf(stderr, "first frame should be an integer\n");
+        return EXIT_FAILURE;
+    }
+    count = (first < nframes ? nframes - first : 0);
+    if (argc > 4 && sscanf(argv[4], "%llu", &count) != 1) {
+        fprintf(stderr, "number of frames should be an integer\n");
+        return EXIT_FAILURE;
+    }
+    const tao_common_stream_header* hdr = tao_common_stream_get_header(reader);
+    printf("%s: %llu frame(s) of %ux%u pixels\n", argv[1],
+           (unsigned long long)nframes, hdr->width, hdr->height);
+    if (tao_common_stream_export_fits(reader, argv[2], first, count) != TAO_OK) {
+        fatal_error();
+    }
+    printf("%llu frame(s) written to %s\n", count, argv[2]);
+    tao_common_stream_close_reader(reader);
+    return EXIT_SUCCESS;
+}
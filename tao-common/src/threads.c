@@ -0,0 +1,263 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "tao-common.h"
+#include <alloca.h>
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*---------------------------------------------------------------------------*/
+/* THREADS */
+
+void tao_common_thread_config_init(
+    tao_common_thread_config* cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+}
+
+tao_status tao_common_thread_config_parse_cpus(
+    tao_common_thread_config* cfg,
+    const char* list)
+{
+    const char* str = list;
+    char* end;
+    int ncpus = 0;
+
+    while (*str != '\0') {
+        long first = strtol(str, &end, 10);
+        if (end == str || first < 0) {
+            goto error;
+        }
+        long last = first;
+        str = end;
+        if (*str == '-') {
+            ++str;
+            last = strtol(str, &end, 10);
+            if (end == str || last < first) {
+                goto error;
+            }
+            str = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            if (ncpus >= TAO_COMMON_THREAD_MAX_CPUS) {
+                goto error;
+            }
+            cfg->cpus[ncpus++] = (int)cpu;
+        }
+        if (*str == ',') {
+            ++str;
+        } else if (*str != '\0') {
+            goto error;
+        }
+    }
+    cfg->ncpus = ncpus;
+    return TAO_OK;
+error:
+    fprintf(stderr, "invalid CPU list \"%s\"\n", list);
+    tao_push_error(__func__, TAO_BAD_VALUE);
+    return TAO_ERROR;
+}
+
+// Touch the stack of the calling thread so that it does not page fault
+// later.  Not inlined to have the array allocated on a fresh frame.
+static void __attribute__((noinline)) prefault_stack(
+    size_t size)
+{
+    volatile unsigned char* buf = alloca(size);
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < size; i += page) {
+        buf[i] = 0;
+    }
+}
+
+tao_status tao_common_thread_apply(
+    const tao_common_thread_config* cfg)
+{
+    tao_status status = TAO_OK;
+    pthread_t self = pthread_self();
+    int code;
+
+    if (cfg->name != NULL) {
+        code = pthread_setname_np(self, cfg->name);
+        if (code != 0) {
+            tao_push_error("pthread_setname_np", code);
+            status = TAO_ERROR;
+        }
+    }
+    if (cfg->ncpus > 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (int i = 0; i < cfg->ncpus; ++i) {
+            if (cfg->cpus[i] >= 0 && cfg->cpus[i] < CPU_SETSIZE) {
+                CPU_SET(cfg->cpus[i], &cpuset);
+            }
+        }
+        code = pthread_setaffinity_np(self, sizeof(cpuset), &cpuset);
+        if (code != 0) {
+            tao_push_error("pthread_setaffinity_np", code);
+            status = TAO_ERROR;
+        }
+    }
+    if (cfg->priority > 0) {
+        struct sched_param param;
+        int pmin = sched_get_priority_min(SCHED_FIFO);
+        int pmax = sched_get_priority_max(SCHED_FIFO);
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = cfg->priority;
+        if (param.sched_priority < pmin) {
+            param.sched_priority = pmin;
+        }
+        if (param.sched_priority > pmax) {
+            param.sched_priority = pmax;
+        }
+        code = pthread_setschedparam(self, SCHED_FIFO, &param);
+        if (code != 0) {
+            tao_push_error("pthread_setschedparam", code);
+            status = TAO_ERROR;
+        }
+    }
+    if (cfg->priority <= 0 && cfg->nice != 0) {
+        // On Linux, the nice value is a per-thread attribute.
+        if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), cfg->nice) != 0) {
+            tao_push_error("setpriority", errno);
+            status = TAO_ERROR;
+        }
+    }
+    if (cfg->lock_memory) {
+        if (tao_common_memory_lock() != TAO_OK) {
+            status = TAO_ERROR;
+        }
+    }
+    if (cfg->stack_prefault > 0) {
+        prefault_stack(cfg->stack_prefault);
+    }
+    return status;
+}
+
+typedef struct thread_context {
+    tao_common_thread_config cfg;
+    void* (*func)(void*);
+    void* arg;
+} thread_context;
+
+static void* thread_start(
+    void* data)
+{
+    thread_context ctx = *(thread_context*)data;
+    free(data);
+
+    const char* name = (ctx.cfg.name != NULL ? ctx.cfg.name : "thread");
+    if (tao_common_thread_apply(&ctx.cfg) != TAO_OK) {
+        fprintf(stderr, "%s: thread configuration only partially applied\n",
+                name);
+        if (tao_any_errors()) {
+            tao_report_errors();
+        }
+    }
+    tao_common_thread_report(stderr, name);
+    return ctx.func(ctx.arg);
+}
+
+tao_status tao_common_thread_create(
+    pthread_t* thread_ptr,
+    const tao_common_thread_config* cfg,
+    void* (*func)(void*),
+    void* arg)
+{
+    thread_context* ctx = malloc(sizeof(*ctx));
+    if (ctx == NULL) {
+        tao_push_error("malloc", errno);
+        return TAO_ERROR;
+    }
+    ctx->cfg = *cfg;
+    ctx->func = func;
+    ctx->arg = arg;
+    int code = pthread_create(thread_ptr, NULL, thread_start, ctx);
+    if (code != 0) {
+        tao_push_error("pthread_create", code);
+        free(ctx);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+// Yield the amount of locked memory of the process in kB, -1 if unknown.
+static long locked_memory(void)
+{
+    char line[128];
+    long value = -1;
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "VmLck: %ld", &value) == 1) {
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+void tao_common_thread_report(
+    FILE* output,
+    const char* name)
+{
+    pthread_t self = pthread_self();
+    cpu_set_t cpuset;
+    struct sched_param param;
+    int policy;
+    char cpus[512];
+    size_t len = 0;
+
+    cpus[0] = '\0';
+    if (pthread_getaffinity_np(self, sizeof(cpuset), &cpuset) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE && len < sizeof(cpus) - 8; ++cpu) {
+            if (CPU_ISSET(cpu, &cpuset)) {
+                len += snprintf(cpus + len, sizeof(cpus) - len,
+                                (len > 0 ? ",%d" : "%d"), cpu);
+            }
+        }
+    } else {
+        strcpy(cpus, "?");
+    }
+    if (pthread_getschedparam(self, &policy, &param) != 0) {
+        policy = -1;
+        param.sched_priority = 0;
+    }
+    errno = 0;
+    int nice = getpriority(PRIO_PROCESS, syscall(SYS_gettid));
+    fprintf(output, "%s: cpus = %s, policy = %s, priority = %d, nice = %d, "
+            "locked memory = %ld kB\n", name, cpus,
+            (policy == SCHED_FIFO ? "SCHED_FIFO" :
+             policy == SCHED_RR ? "SCHED_RR" :
+             policy == SCHED_OTHER ? "SCHED_OTHER" : "unknown"),
+            param.sched_priority, (errno == 0 ? nice : 0), locked_memory());
+}
+
+/*---------------------------------------------------------------------------*/
+/* MEMORY */
+
+tao_status tao_common_memory_lock(void)
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        tao_push_error("mlockall", errno);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+void tao_common_memory_prefault(
+    void* data,
+    size_t size)
+{
+    if (data != NULL && size > 0) {
+        memset(data, 0, size);
+    }
+}
@@ -1,4 +1,7 @@
 #include "tao-spinnaker.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 
 /*---------------------------------------------------------------------------*/
 /* ERRORS */
@@ -337,7 +340,143 @@ tao_status tao_spinnaker_camera_release(
 /*---------------------------------------------------------------------------*/
 /* ACQUISITION */
 
+tao_status tao_spinnaker_camera_begin_acquisition(
+    spinCamera camera)
+{
+    spinError err = spinCameraBeginAcquisition(camera);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinCameraBeginAcquisition", err);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_camera_end_acquisition(
+    spinCamera camera)
+{
+    spinError err = spinCameraEndAcquisition(camera);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinCameraEndAcquisition", err);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_camera_get_next_image(
+    spinCamera camera,
+    uint64_t timeout,
+    spinImage* image_ptr)
+{
+    spinError err = spinCameraGetNextImageEx(camera, timeout, image_ptr);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinCameraGetNextImageEx", err);
+        *image_ptr = NULL;
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
 
+tao_status tao_spinnaker_image_release(
+    spinImage image)
+{
+    spinError err = spinImageRelease(image);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageRelease", err);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_image_get_info(
+    spinImage image,
+    tao_spinnaker_image_info* info)
+{
+    bool8_t incomplete = False;
+    spinError err;
+
+    memset(info, 0, sizeof(*info));
+    err = spinImageIsIncomplete(image, &incomplete);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageIsIncomplete", err);
+        return TAO_ERROR;
+    }
+    info->incomplete = (incomplete != False);
+    err = spinImageGetWidth(image, &info->width);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageGetWidth", err);
+        return TAO_ERROR;
+    }
+    err = spinImageGetHeight(image, &info->height);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageGetHeight", err);
+        return TAO_ERROR;
+    }
+    err = spinImageGetStride(image, &info->stride);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageGetStride", err);
+        return TAO_ERROR;
+    }
+    err = spinImageGetBitsPerPixel(image, &info->bits_per_pixel);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageGetBitsPerPixel", err);
+        return TAO_ERROR;
+    }
+    err = spinImageGetFrameID(image, &info->frame_id);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageGetFrameID", err);
+        return TAO_ERROR;
+    }
+    err = spinImageGetTimeStamp(image, &info->timestamp);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageGetTimeStamp", err);
+        return TAO_ERROR;
+    }
+    err = spinImageGetData(image, &info->data);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinImageGetData", err);
+        return TAO_ERROR;
+    }
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_image_convert(
+    const tao_spinnaker_image_info* info,
+    tao_common_pixel_type type,
+    void* dst,
+    size_t size)
+{
+    const tao_common_kernels* k = tao_common_kernels_get();
+    size_t width = info->width, height = info->height;
+    size_t bits = info->bits_per_pixel;
+
+    if ((bits != 8 && bits != 16) ||
+        (type != TAO_COMMON_UINT16 && type != TAO_COMMON_UINT32 &&
+         type != TAO_COMMON_FLOAT32) ||
+        (bits == 8 && type != TAO_COMMON_FLOAT32)) {
+        tao_push_error(__func__, TAO_BAD_TYPE);
+        return TAO_ERROR;
+    }
+    size_t row_size = width*tao_common_pixel_size(type);
+    if (size < height*row_size || info->stride < width*bits/8) {
+        tao_push_error(__func__, TAO_BAD_SIZE);
+        return TAO_ERROR;
+    }
+    // row by row as the stride may be larger than a row
+    for (size_t y = 0; y < height; ++y) {
+        const void* src = (const char*)info->data + y*info->stride;
+        void* row = (char*)dst + y*row_size;
+        if (bits == 8) {
+            k->convert_u8_f32(row, src, width);
+        } else if (type == TAO_COMMON_FLOAT32) {
+            k->convert_u16_f32(row, src, width);
+        } else if (type == TAO_COMMON_UINT32) {
+            k->convert_u16_u32(row, src, width);
+        } else {
+            memcpy(row, src, row_size);
+        }
+    }
+    return TAO_OK;
+}
 
 /*---------------------------------------------------------------------------*/
 /* NODES */
@@ -527,3 +666,570 @@ tao_status tao_spinnaker_enumeration_set_int(
   return status;
 
 }
+
+/*---------------------------------------------------------------------------*/
+/* NODE CACHE */
+
+// Types of the typed accessors.
+enum {
+    NODE_FLOAT = 1,
+    NODE_INTEGER,
+    NODE_BOOLEAN,
+    NODE_STRING,
+    NODE_COMMAND,
+    NODE_ENUMERATION
+};
+
+typedef struct node_entry {
+    char* name;
+    spinNodeHandle node;
+    int type;
+    int stale;                  // access and limits to be read again
+    int available;
+    int readable;
+    int writable;
+    double fmin, fmax;          // of float nodes
+    int64_t imin, imax, inc;    // of integer nodes
+    int nsymbols;               // entries of enumerations, by symbol
+    char** symbols;
+    int64_t* values;
+} node_entry;
+
+struct tao_spinnaker_node_cache {
+    spinNodeMapHandle node_map;
+    int nentries;
+    int capacity;
+    node_entry** entries;
+    long calls;                 // to the SDK
+};
+
+// Nodes whose access or limits depend on the value of another one, according
+// to the SFNC (e.g. the maximum of OffsetX is WidthMax - Width); "*" stands
+// for all nodes.
+static const char* const dependencies[][7] = {
+    {"Width", "OffsetX", "AcquisitionFrameRate", NULL},
+    {"Height", "OffsetY", "AcquisitionFrameRate", "ExposureTime", NULL},
+    {"OffsetX", "Width", NULL},
+    {"OffsetY", "Height", NULL},
+    {"BinningHorizontal", "Width", "WidthMax", "OffsetX", NULL},
+    {"BinningVertical", "Height", "HeightMax", "OffsetY",
+     "AcquisitionFrameRate", NULL},
+    {"DecimationHorizontal", "Width", "WidthMax", "OffsetX", NULL},
+    {"DecimationVertical", "Height", "HeightMax", "OffsetY",
+     "AcquisitionFrameRate", NULL},
+    {"PixelFormat", "Width", "OffsetX", "AcquisitionFrameRate",
+     "ExposureTime", NULL},
+    {"AdcBitDepth", "AcquisitionFrameRate", "ExposureTime", NULL},
+    {"ExposureAuto", "ExposureTime", NULL},
+    {"ExposureMode", "ExposureTime", NULL},
+    {"ExposureTime", "AcquisitionFrameRate", NULL},
+    {"AcquisitionFrameRateEnable", "AcquisitionFrameRate", "ExposureTime",
+     NULL},
+    {"AcquisitionFrameRate", "ExposureTime", NULL},
+    {"GainAuto", "Gain", NULL},
+    {"TriggerMode", "AcquisitionFrameRate", "ExposureTime", NULL},
+    {"TriggerSelector", "TriggerMode", "TriggerSource", "TriggerActivation",
+     NULL},
+    {"AcquisitionStart", "*", NULL},
+    {"AcquisitionStop", "*", NULL},
+};
+
+#define NBR_DEPENDENCIES (sizeof(dependencies)/sizeof(dependencies[0]))
+
+tao_status tao_spinnaker_node_cache_create(
+    spinNodeMapHandle node_map,
+    tao_spinnaker_node_cache** cache_ptr)
+{
+    tao_spinnaker_node_cache* cache = calloc(1, sizeof(*cache));
+    if (cache == NULL) {
+        tao_push_error("calloc", errno);
+        *cache_ptr = NULL;
+        return TAO_ERROR;
+    }
+    cache->node_map = node_map;
+    *cache_ptr = cache;
+    return TAO_OK;
+}
+
+static void free_entry(
+    node_entry* entry)
+{
+    for (int i = 0; i < entry->nsymbols; ++i) {
+        free(entry->symbols[i]);
+    }
+    free(entry->symbols);
+    free(entry->values);
+    free(entry->name);
+    free(entry);
+}
+
+void tao_spinnaker_node_cache_destroy(
+    tao_spinnaker_node_cache* cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+    for (int i = 0; i < cache->nentries; ++i) {
+        free_entry(cache->entries[i]);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+void tao_spinnaker_node_cache_invalidate(
+    tao_spinnaker_node_cache* cache,
+    const char* name)
+{
+    for (int i = 0; i < cache->nentries; ++i) {
+        if (name == NULL || strcmp(cache->entries[i]->name, name) == 0) {
+            cache->entries[i]->stale = 1;
+        }
+    }
+}
+
+long tao_spinnaker_node_cache_calls(
+    const tao_spinnaker_node_cache* cache)
+{
+    return cache->calls;
+}
+
+// Invalidate the nodes depending on a node which has been changed.
+static void changed(
+    tao_spinnaker_node_cache* cache,
+    const char* name)
+{
+    for (size_t i = 0; i < NBR_DEPENDENCIES; ++i) {
+        if (strcmp(dependencies[i][0], name) != 0) {
+            continue;
+        }
+        for (int j = 1; dependencies[i][j] != NULL; ++j) {
+            const char* dep = dependencies[i][j];
+            tao_spinnaker_node_cache_invalidate(
+                cache, (strcmp(dep, "*") == 0 ? NULL : dep));
+        }
+    }
+}
+
+// Read the access mode and the limits of a node.
+static tao_status refresh(
+    tao_spinnaker_node_cache* cache,
+    node_entry* entry)
+{
+    bool8_t flag = False;
+    spinError err;
+
+    entry->readable = 0;
+    entry->writable = 0;
+    cache->calls += 1;
+    err = spinNodeIsAvailable(entry->node, &flag);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        tao_spinnaker_error_push("spinNodeIsAvailable", err);
+        return TAO_ERROR;
+    }
+    entry->available = (flag != False);
+    if (entry->available) {
+        cache->calls += 2;
+        err = spinNodeIsReadable(entry->node, &flag);
+        if (err != SPINNAKER_ERR_SUCCESS) {
+            tao_spinnaker_error_push("spinNodeIsReadable", err);
+            return TAO_ERROR;
+        }
+        entry->readable = (flag != False);
+        err = spinNodeIsWritable(entry->node, &flag);
+        if (err != SPINNAKER_ERR_SUCCESS) {
+            tao_spinnaker_error_push("spinNodeIsWritable", err);
+            return TAO_ERROR;
+        }
+        entry->writable = (flag != False);
+    }
+    if (entry->readable && entry->type == NODE_FLOAT) {
+        cache->calls += 2;
+        err = spinFloatGetMin(entry->node, &entry->fmin);
+        if (err != SPINNAKER_ERR_SUCCESS) {
+            tao_spinnaker_error_push("spinFloatGetMin", err);
+            return TAO_ERROR;
+        }
+        err = spinFloatGetMax(entry->node, &entry->fmax);
+        if (err != SPINNAKER_ERR_SUCCESS) {
+            tao_spinnaker_error_push("spinFloatGetMax", err);
+            return TAO_ERROR;
+        }
+    } else if (entry->readable && entry->type == NODE_INTEGER) {
+        cache->calls += 3;
+        err = spinIntegerGetMin(entry->node, &entry->imin);
+        if (err != SPINNAKER_ERR_SUCCESS) {
+            tao_spinnaker_error_push("spinIntegerGetMin", err);
+            return TAO_ERROR;
+        }
+        err = spinIntegerGetMax(entry->node, &entry->imax);
+        if (err != SPINNAKER_ERR_SUCCESS) {
+            tao_spinnaker_error_push("spinIntegerGetMax", err);
+            return TAO_ERROR;
+        }
+        err = spinIntegerGetInc(entry->node, &entry->inc);
+        if (err != SPINNAKER_ERR_SUCCESS) {
+            tao_spinnaker_error_push("spinIntegerGetInc", err);
+            return TAO_ERROR;
+        }
+    }
+    entry->stale = 0;
+    return TAO_OK;
+}
+
+// Find a node of the cache, resolving it the first time, and make sure its
+// access and limits are up to date.
+static node_entry* get_entry(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int type)
+{
+    node_entry* entry = NULL;
+
+    for (int i = 0; i < cache->nentries; ++i) {
+        if (strcmp(cache->entries[i]->name, name) == 0) {
+            entry = cache->entries[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        if (cache->nentries >= cache->capacity) {
+            int capacity = (cache->capacity > 0 ? 2*cache->capacity : 16);
+            node_entry** entries = realloc(cache->entries,
+                                           capacity*sizeof(node_entry*));
+            if (entries == NULL) {
+                tao_push_error("realloc", errno);
+                return NULL;
+            }
+            cache->entries = entries;
+            cache->capacity = capacity;
+        }
+        entry = calloc(1, sizeof(*entry));
+        if (entry == NULL || (entry->name = strdup(name)) == NULL) {
+            tao_push_error("calloc", errno);
+            free(entry);
+            return NULL;
+        }
+        cache->calls += 1;
+        spinError err = spinNodeMapGetNode(cache->node_map, name,
+                                           &entry->node);
+        if (err != SPINNAKER_ERR_SUCCESS || entry->node == NULL) {
+            tao_spinnaker_error_push("spinNodeMapGetNode", err);
+            tao_push_error(__func__, TAO_NOT_FOUND);
+            free_entry(entry);
+            return NULL;
+        }
+        entry->type = type;
+        entry->stale = 1;
+        cache->entries[cache->nentries++] = entry;
+    }
+    if (entry->type != type) {
+        tao_push_error(__func__, TAO_BAD_TYPE);
+        return NULL;
+    }
+    if (entry->stale && refresh(cache, entry) != TAO_OK) {
+        return NULL;
+    }
+    if (!entry->available) {
+        tao_push_error(__func__, TAO_NOT_FOUND);
+        return NULL;
+    }
+    return entry;
+}
+
+static node_entry* get_readable(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int type)
+{
+    node_entry* entry = get_entry(cache, name, type);
+    if (entry != NULL && !entry->readable) {
+        tao_push_error(__func__, TAO_NOT_READY);
+        return NULL;
+    }
+    return entry;
+}
+
+static node_entry* get_writable(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int type)
+{
+    node_entry* entry = get_entry(cache, name, type);
+    if (entry != NULL && !entry->writable) {
+        tao_push_error(__func__, TAO_NOT_READY);
+        return NULL;
+    }
+    return entry;
+}
+
+// Report a failed call, the access mode may have changed behind the cache.
+static tao_status failed(
+    node_entry* entry,
+    const char* func,
+    spinError err)
+{
+    tao_spinnaker_error_push(func, err);
+    entry->stale = 1;
+    return TAO_ERROR;
+}
+
+tao_status tao_spinnaker_get_float(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    double* value)
+{
+    node_entry* entry = get_readable(cache, name, NODE_FLOAT);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    cache->calls += 1;
+    spinError err = spinFloatGetValue(entry->node, value);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinFloatGetValue", err);
+    }
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_get_float_range(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    double* min,
+    double* max)
+{
+    node_entry* entry = get_readable(cache, name, NODE_FLOAT);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    *min = entry->fmin;
+    *max = entry->fmax;
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_set_float(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    double value)
+{
+    node_entry* entry = get_writable(cache, name, NODE_FLOAT);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    if (entry->readable && (value < entry->fmin || value > entry->fmax)) {
+        tao_push_error(__func__, TAO_OUT_OF_RANGE);
+        return TAO_ERROR;
+    }
+    cache->calls += 1;
+    spinError err = spinFloatSetValue(entry->node, value);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinFloatSetValue", err);
+    }
+    changed(cache, name);
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_get_int(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int64_t* value)
+{
+    node_entry* entry = get_readable(cache, name, NODE_INTEGER);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    cache->calls += 1;
+    spinError err = spinIntegerGetValue(entry->node, value);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinIntegerGetValue", err);
+    }
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_get_int_range(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int64_t* min,
+    int64_t* max,
+    int64_t* inc)
+{
+    node_entry* entry = get_readable(cache, name, NODE_INTEGER);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    *min = entry->imin;
+    *max = entry->imax;
+    *inc = entry->inc;
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_set_int(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int64_t value)
+{
+    node_entry* entry = get_writable(cache, name, NODE_INTEGER);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    if (entry->readable) {
+        if (value < entry->imin || value > entry->imax) {
+            tao_push_error(__func__, TAO_OUT_OF_RANGE);
+            return TAO_ERROR;
+        }
+        if (entry->inc > 1 && (value - entry->imin)%entry->inc != 0) {
+            tao_push_error(__func__, TAO_BAD_VALUE);
+            return TAO_ERROR;
+        }
+    }
+    cache->calls += 1;
+    spinError err = spinIntegerSetValue(entry->node, value);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinIntegerSetValue", err);
+    }
+    changed(cache, name);
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_get_bool(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int* value)
+{
+    bool8_t flag = False;
+    node_entry* entry = get_readable(cache, name, NODE_BOOLEAN);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    cache->calls += 1;
+    spinError err = spinBooleanGetValue(entry->node, &flag);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinBooleanGetValue", err);
+    }
+    *value = (flag != False);
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_set_bool(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int value)
+{
+    node_entry* entry = get_writable(cache, name, NODE_BOOLEAN);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    cache->calls += 1;
+    spinError err = spinBooleanSetValue(entry->node, value ? True : False);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinBooleanSetValue", err);
+    }
+    changed(cache, name);
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_get_string(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    char* buffer,
+    size_t size)
+{
+    node_entry* entry = get_readable(cache, name, NODE_STRING);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    cache->calls += 1;
+    spinError err = spinStringGetValue(entry->node, buffer, &size);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinStringGetValue", err);
+    }
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_set_string(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    const char* value)
+{
+    node_entry* entry = get_writable(cache, name, NODE_STRING);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    cache->calls += 1;
+    spinError err = spinStringSetValue(entry->node, value);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinStringSetValue", err);
+    }
+    changed(cache, name);
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_execute(
+    tao_spinnaker_node_cache* cache,
+    const char* name)
+{
+    node_entry* entry = get_writable(cache, name, NODE_COMMAND);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    cache->calls += 1;
+    spinError err = spinCommandExecute(entry->node);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinCommandExecute", err);
+    }
+    changed(cache, name);
+    return TAO_OK;
+}
+
+tao_status tao_spinnaker_set_enum(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    const char* symbol)
+{
+    node_entry* entry = get_writable(cache, name, NODE_ENUMERATION);
+    if (entry == NULL) {
+        return TAO_ERROR;
+    }
+    int k = 0;
+    while (k < entry->nsymbols && strcmp(entry->symbols[k], symbol) != 0) {
+        ++k;
+    }
+    if (k == entry->nsymbols) {
+        // the value of an entry does not change, it is resolved once
+        spinNodeHandle node = NULL;
+        int64_t value = 0;
+        cache->calls += 2;
+        spinError err = spinEnumerationGetEntryByName(entry->node, symbol,
+                                                      &node);
+        if (err != SPINNAKER_ERR_SUCCESS || node == NULL) {
+            tao_spinnaker_error_push("spinEnumerationGetEntryByName", err);
+            tao_push_error(__func__, TAO_BAD_VALUE);
+            return TAO_ERROR;
+        }
+        err = spinEnumerationEntryGetIntValue(node, &value);
+        if (err != SPINNAKER_ERR_SUCCESS) {
+            tao_spinnaker_error_push("spinEnumerationEntryGetIntValue", err);
+            return TAO_ERROR;
+        }
+        char** symbols = realloc(entry->symbols, (k + 1)*sizeof(char*));
+        if (symbols != NULL) {
+            entry->symbols = symbols;
+        }
+        int64_t* values = realloc(entry->values, (k + 1)*sizeof(int64_t));
+        if (values != NULL) {
+            entry->values = values;
+        }
+        if (symbols == NULL || values == NULL ||
+            (entry->symbols[k] = strdup(symbol)) == NULL) {
+            tao_push_error("realloc", errno);
+            return TAO_ERROR;
+        }
+        entry->values[k] = value;
+        entry->nsymbols = k + 1;
+    }
+    cache->calls += 1;
+    spinError err = spinEnumerationSetIntValue(entry->node, entry->values[k]);
+    if (err != SPINNAKER_ERR_SUCCESS) {
+        return failed(entry, "spinEnumerationSetIntValue", err);
+    }
+    changed(cache, name);
+    return TAO_OK;
+}
@@ -4,6 +4,7 @@
 
 #include <tao.h>
 #include <SpinnakerC.h>
+#include "tao-common.h"
 
 /*---------------------------------------------------------------------------*/
 /* ERRORS */
@@ -169,7 +170,72 @@ extern tao_status tao_spinnaker_camera_release(
 /*---------------------------------------------------------------------------*/
 /* Acquisition */
 
-// extern tao_status tao_spinnaker_
+/**
+ * Start the acquisition of an initialized camera.
+ */
+extern tao_status tao_spinnaker_camera_begin_acquisition(
+    spinCamera camera);
+
+/**
+ * Stop the acquisition of a camera.
+ */
+extern tao_status tao_spinnaker_camera_end_acquisition(
+    spinCamera camera);
+
+/**
+ * Wait for the next image of a camera.
+ *
+ * This function waits at most `timeout` milliseconds for an image.  The
+ * caller is responsible of calling tao_spinnaker_image_release() to give the
+ * image buffer back to the acquisition.
+ */
+extern tao_status tao_spinnaker_camera_get_next_image(
+    spinCamera camera,
+    uint64_t timeout,
+    spinImage* image_ptr);
+
+/**
+ * Release an image obtained by tao_spinnaker_camera_get_next_image().
+ */
+extern tao_status tao_spinnaker_image_release(
+    spinImage image);
+
+/**
+ * Description of an acquired image.
+ */
+typedef struct tao_spinnaker_image_info {
+    size_t width;           /**< Width in pixels */
+    size_t height;          /**< Height in pixels */
+    size_t stride;          /**< Bytes per row */
+    size_t bits_per_pixel;  /**< Bits per pixel */
+    uint64_t frame_id;      /**< Frame number given by the camera */
+    uint64_t timestamp;     /**< Camera time stamp (ns) */
+    int incomplete;         /**< Image is incomplete */
+    void* data;             /**< Address of the first pixel */
+} tao_spinnaker_image_info;
+
+/**
+ * Get the description of an image.
+ *
+ * The data remains valid until the image is released.
+ */
+extern tao_status tao_spinnaker_image_get_info(
+    spinImage image,
+    tao_spinnaker_image_info* info);
+
+/**
+ * Convert the pixels of an image.
+ *
+ * The 8-bit or 16-bit monochrome pixels described by `info` are converted
+ * to `type` (TAO_COMMON_UINT16, TAO_COMMON_UINT32 or TAO_COMMON_FLOAT32) in
+ * `dst` which has `size` bytes, rows are contiguous in `dst`.  The
+ * conversion uses the pixel kernels of the CPU (see tao_common_kernels_get()).
+ */
+extern tao_status tao_spinnaker_image_convert(
+    const tao_spinnaker_image_info* info,
+    tao_common_pixel_type type,
+    void* dst,
+    size_t size);
 
 
 
@@ -224,5 +290,121 @@ extern tao_status tao_spinnaker_enumeration_set_int(
     spinNodeHandle nodeEnumeration,
     long value);
 
+/*---------------------------------------------------------------------------*/
+/* NODE CACHE */
+
+/*
+ * A node cache resolves each node of a node map by name once and keeps its
+ * access mode and limits (minimum, maximum and increment), so that setting
+ * or reading a feature is one call of the SDK.  The entries of the nodes
+ * whose access or limits depend on a changed node (e.g. the maximum of
+ * OffsetX when Width is set, of ExposureTime when AcquisitionFrameRate is
+ * set, see the SFNC) are refreshed when used next.  A cache is owned by the
+ * thread which configures the camera.
+ *
+ * Errors are TAO_NOT_FOUND for a missing or unavailable node, TAO_NOT_READY
+ * if it cannot be read or written now, TAO_OUT_OF_RANGE for values out of
+ * its limits and TAO_BAD_TYPE if the node is used with another type.
+ */
+typedef struct tao_spinnaker_node_cache tao_spinnaker_node_cache;
+
+extern tao_status tao_spinnaker_node_cache_create(
+    spinNodeMapHandle node_map,
+    tao_spinnaker_node_cache** cache_ptr);
+
+extern void tao_spinnaker_node_cache_destroy(
+    tao_spinnaker_node_cache* cache);
+
+/**
+ * Refresh the access mode and limits of node `name`, of all nodes if `name`
+ * is NULL (e.g. after tao_spinnaker_camera_begin_acquisition() which locks
+ * the ROI and pixel format).
+ */
+extern void tao_spinnaker_node_cache_invalidate(
+    tao_spinnaker_node_cache* cache,
+    const char* name);
+
+/**
+ * Get the number of calls of the SDK made by the cache so far.
+ */
+extern long tao_spinnaker_node_cache_calls(
+    const tao_spinnaker_node_cache* cache);
+
+extern tao_status tao_spinnaker_get_float(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    double* value);
+
+extern tao_status tao_spinnaker_get_float_range(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    double* min,
+    double* max);
+
+extern tao_status tao_spinnaker_set_float(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    double value);
+
+extern tao_status tao_spinnaker_get_int(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int64_t* value);
+
+extern tao_status tao_spinnaker_get_int_range(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int64_t* min,
+    int64_t* max,
+    int64_t* inc);
+
+/**
+ * Set an integer node, the value must be in range and a multiple of the
+ * increment from the minimum (TAO_BAD_VALUE otherwise).
+ */
+extern tao_status tao_spinnaker_set_int(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int64_t value);
+
+extern tao_status tao_spinnaker_get_bool(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int* value);
+
+extern tao_status tao_spinnaker_set_bool(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    int value);
+
+/**
+ * Get the value of a string node in `buffer` of `size` bytes.
+ */
+extern tao_status tao_spinnaker_get_string(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    char* buffer,
+    size_t size);
+
+extern tao_status tao_spinnaker_set_string(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    const char* value);
+
+/**
+ * Execute a command node (e.g. "TimestampLatch").
+ */
+extern tao_status tao_spinnaker_execute(
+    tao_spinnaker_node_cache* cache,
+    const char* name);
+
+/**
+ * Set an enumeration node by the symbol of an entry (e.g. "PixelFormat" to
+ * "Mono16"), the value of each entry is resolved once.
+ */
+extern tao_status tao_spinnaker_set_enum(
+    tao_spinnaker_node_cache* cache,
+    const char* name,
+    const char* symbol);
 
 #endif /* TAO_SPINNAKER_H_ */
@@ -175,6 +175,26 @@ int main(
 
     printf("Acquisition mode is set to Continuos..\n");
 
+    // same settings through the node cache, a second setting is one call
+    tao_spinnaker_node_cache* nodes = NULL;
+    double minExposure, maxExposure, exposure;
+    if(tao_spinnaker_node_cache_create(cameraNodeMap, &nodes) != TAO_OK ||
+       tao_spinnaker_set_enum(nodes, "AcquisitionMode", "Continuous") != TAO_OK ||
+       tao_spinnaker_set_enum(nodes, "ExposureAuto", "Off") != TAO_OK ||
+       tao_spinnaker_get_float_range(nodes, "ExposureTime", &minExposure,
+                                     &maxExposure) != TAO_OK ||
+       tao_spinnaker_get_float(nodes, "ExposureTime", &exposure) != TAO_OK){
+      fatal_error();
+    }
+    long calls = tao_spinnaker_node_cache_calls(nodes);
+    if(tao_spinnaker_set_float(nodes, "ExposureTime", exposure) != TAO_OK){
+      fatal_error();
+    }
+    printf("Exposure time %g usec in [%g,%g] set in %ld call(s)\n", exposure,
+           minExposure, maxExposure,
+           tao_spinnaker_node_cache_calls(nodes) - calls);
+    tao_spinnaker_node_cache_destroy(nodes);
+
       /* --------------------- Take images ----------------------------*/
 
 
@@ -1,18 +1,18 @@
 // acquisition_with_display.c
+// viewer of the frames published by nuvu_daemon, it maps the shared memory
+// read-only and can be started, stopped or killed without disturbing the
+// acquisition
 // options
-// 1. -e [exposuretime in msec]
-// 2. -g [analog gain value]
-// 4. -go [analog gain offset]
-// 3. -gem [em gain value]
-// 5. -t [target temperature]
-// 6. -r [degree to rotate]
-// 7. -w [waiting time in msec]
+// 1. -shm [name of the shared memory, default /tao-nuvu]
+// 2. -stretch [linear|log|sqrt|asinh auto-contrast]
+// 3. -clip [percent of pixels clipped at each end by the auto-contrast]
+// 4. -socket [Unix socket of nuvu_daemon -socket, instead of -shm]
 
 // -----------------------------------------
 
 #include "tao_nuvu.h"
+#include "tao-common.h"
 #include <gtk/gtk.h>
-#include <math.h>
 #include <malloc.h>
 #include <time.h>
 
@@ -34,26 +34,29 @@ typedef struct imageBuffer{
 } imageBuffer;
 
 // global
-NcCam	cam = NULL;
 imageBuffer buff;
-int isRotate =  FALSE;
-int degree = 0;
-double fps = 0;
+tao_common_frame_buffer displayBuffer;		// memory of buff.data
+tao_common_stretch* stretch = NULL;		// 16-bit to RGB30 lookup table
+int autoContrast = 0;							// follow the percentiles of each frame
 int satVal = 0;
-static int hasRun = 0;
+const char* shmName = "/tao-nuvu";
+tao_common_shm_reader* shm = NULL;		// frames of the acquisition
+const char* socketPath = NULL;
+tao_common_client* client = NULL;			// connection to nuvu_daemon -socket
 
 // Man page
 void man(){
 	printf(
 "______ start_nuvu program ______ \n\
-syntax: -[option] [numeric value] \n\
-1. -e [exposuretime in msec] \n\
-2. -g [analog gain value] \n\
-4. -go [analog gain offset] \n\
-3. -gem [em gain value] (not done yet)\n\
-5. -t [target temperature] \n\
-6. -r [degree to rotate] \n\
-7. -w [waiting time in msec] \n\
+syntax: -[option] [value] \n\
+1. -shm [name of the shared memory, default /tao-nuvu] \n\
+2. -stretch [linear|log|sqrt|asinh auto-contrast] \n\
+3. -clip [percent of pixels clipped at each end by the auto-contrast, \n\
+    default is 0.5] \n\
+4. -socket [Unix socket of nuvu_daemon -socket, instead of -shm] \n\
+\n\
+The frames are acquired by nuvu_daemon which must be running, camera \n\
+settings are options of nuvu_daemon. \n\
 \n");
 
 }
@@ -69,322 +72,165 @@ static void fatal_error()
     exit(EXIT_FAILURE);
 }
 
-// nearest pixel image scaling
+// nearest pixel image scaling, each row is enlarged once then copied
 void makeBigger(unsigned char* img, unsigned char* simage, int scale)
 {
-
-    uint32_t row = 0, col = 0;
-    int swidth = WIDTH * scale;
-    int sheight = HEIGHT * scale;
-
-    for (row = 0; row < sheight; row++) {
-        for (col = 0;col < swidth; col++) {
-            int round_row = (int) floor(row/scale);
-            int round_col = (int) floor(col/scale);
-
-            memcpy(simage + (row*sheight + col)*BYTES_PER_PIXEL,
-                    img + (round_row*HEIGHT + round_col)*BYTES_PER_PIXEL, BYTES_PER_PIXEL);
+    const tao_common_kernels* k = tao_common_kernels_get();
+    size_t srow = (size_t)WIDTH*scale*BYTES_PER_PIXEL;
+
+    for (int row = 0; row < HEIGHT; row++) {
+        unsigned char* dst = simage + row*scale*srow;
+        k->repeat_u32((uint32_t*) dst,
+                      (const uint32_t*) (img + row*WIDTH*BYTES_PER_PIXEL),
+                      WIDTH, scale);
+        for (int i = 1; i < scale; i++) {
+            memcpy(dst + i*srow, dst, srow);
         }
     }
 
 }
 
-// scale 16 bbp to 10 bbp
-// 16-bit to 10-bit rgb
-unsigned int rgb_mapping(uint16_t gray_val){
-  double uint10size = pow(2,10);
-  double uint16size = pow(2,16);
-  unsigned int gray10bit = (unsigned int) floor(gray_val/uint16size*uint10size);
-  unsigned int blue = gray10bit;
-  unsigned int green = gray10bit << 10;
-  unsigned int red = gray10bit << 20;
-  unsigned int ref =  red | green | blue;
-  return ref;
-
-}
-
-void rgb_image(uint16_t * img_data, unsigned char* new_image, int* maxVal)
+// 16-bit to 10-bit rgb, one lookup per pixel: the table of the stretch is
+// the full range when there is no auto-contrast, the percentiles otherwise
+void display_image(uint16_t* img_data, unsigned char* new_image, int* maxVal)
 {
-	uint16_t val;
-  unsigned int pixelpack;
-  memset(new_image , 0 , WIDTH*HEIGHT*BYTES_PER_PIXEL);
-	*maxVal = 0;
-  for(int row = 0; row < HEIGHT; row++){
-    for(int col = 0; col< WIDTH; col++){
-			val  = *(img_data+row*HEIGHT + col);
-
-			if ((int)val > *maxVal){
-				*maxVal = val;
-			}
-
-      pixelpack = rgb_mapping(val);
-      memcpy(new_image + (row*HEIGHT + col)*BYTES_PER_PIXEL, &pixelpack, 4) ;
-
-    }
-
-  }
-
+	uint16_t lo, hi;
+	if (autoContrast){
+		// the maximum comes with the histogram of the percentiles
+		if (tao_common_stretch_update(stretch, img_data, WIDTH*HEIGHT, NULL) != TAO_OK){
+			fatal_error();
+		}
+		*maxVal = tao_common_stretch_get_max(stretch);
+	}
+	else {
+		tao_common_kernels_get()->minmax_u16(img_data, WIDTH*HEIGHT, &lo, &hi);
+		*maxVal = hi;
+	}
+	tao_common_stretch_apply(stretch, (uint32_t*) new_image, img_data, WIDTH*HEIGHT);
 }
 
 
-/*------ Camera operations ------- */
-tao_status initialize(NcCam* cam, int argc, char* argv[]){
-   int i;
-	 int array_index = 0;
-	 char* param[argc];
-	 char* val[argc];
-
-	 if (argc > 1){
-		 // read input arguments
-		 for(i = 1; i < argc; i += 2)
-		 {
-			 param[array_index] = argv[i];
-		 	 val[array_index] = argv[i+1];
-			 array_index += 1 ;
-		 }
-	 }
-
-	 //em gain array
-	 //emGainOp =
-
-	 // List of parameters
-	 	double readoutTime,
-				   waitingTime,
-					 exposureTime,
-					 temperature;
-		int 	 analogGain,
-					 analogOffset;
-
+/*------ Viewer ------- */
+tao_status initialize(int argc, char* argv[]){
+	tao_common_stretch_config stretchConfig;
+	int stretchMode = -1;
 
-	 // do generic initialization
-  tao_status st = TAO_OK;			//We initialize an error flag variable
-
-
-  printf("Open camera...\n" );
-  st = cam_open(NC_AUTO_UNIT, NC_AUTO_CHANNEL, 4, cam);
-  if( st != TAO_OK){
-     fatal_error();
-  }
-
-  st = set_readout_mode(*cam, 1);
-  if( st != TAO_OK){
-     fatal_error();
-  }
-
-  st = get_readout_time(*cam, &readoutTime);
-  if( st != TAO_OK){
-     fatal_error();
-  }
-	printf("Estimated readout time = %lf msec\n", readoutTime);
+	// gray levels of the RGB30 surface
+	tao_common_stretch_config_init(&stretchConfig);
+	stretchConfig.levels = 1024;
+	stretchConfig.multiplier = (1 << 20) | (1 << 10) | 1;
 
-	/* =====assign defaults values to parameters ======== */
-	exposureTime = readoutTime;
-	waitingTime = 0.1 * exposureTime;
-	temperature = -60.0;
-
-	int	error = NC_SUCCESS;
-
-	int	analogGainMin, analogGainMax;
-	error = ncCamGetAnalogGainRange(*cam, &analogGainMin, &analogGainMax);
-	if (error) {return error;}
-	analogGain = (analogGainMin + analogGainMax) / 2;
-
-	int	analogOffsetMin, analogOffsetMax;
-	error = ncCamGetAnalogOffsetRange(*cam, &analogOffsetMin, &analogOffsetMax);
-	if (error) {return error;}
-	analogOffset = (analogOffsetMin + analogOffsetMax) / 2;
-
-	//#======== iterate over the list of options ================#/
-
-	char* op;
-
-	for(int j =0; j < (argc-1)/2; j++ ){
-		 op = param[j];
-
-		 // exposure time
-		if(strcmp(op, "-e") == 0){
-			if (sscanf (val[j], "%lf", &exposureTime) != 1){
-				printf("exposure time should be a floating point number\n");
-			  fatal_error();
-			}
-		}
-		// analog gain
-		else if (strcmp(op, "-g") == 0){
-			if (sscanf (val[j], "%d", &analogGain) != 1){
-				printf("analog gain should be an integer\n");
-				fatal_error();
-			}
+	for(int i = 1; i + 1 < argc; i += 2){
+		const char* op = argv[i];
+		const char* val = argv[i+1];
+		if (strcmp(op, "-shm") == 0){
+			shmName = val;
 		}
-		// em gain: TODO
-		else if (strcmp(op, "-gem") == 0){
-			// int emGain = (int) val[j];
-			// st = set_em_gain(*cam, emGainOp,emGainInput);
-			// if( st != TAO_OK){
-			// 	 fatal_error();
-			// }
+		else if (strcmp(op, "-socket") == 0){
+			socketPath = val;
 		}
-		// analog gain offset
-		else if (strcmp(op, "-go") == 0){
-			if (sscanf (val[j], "%d", &analogGain) != 1){
-				printf("analog offset should be an integer\n");
+		else if (strcmp(op, "-stretch") == 0){
+			stretchMode = tao_common_stretch_mode_parse(val);
+			if (stretchMode < 0){
+				printf("stretch should be linear, log, sqrt or asinh\n");
 				fatal_error();
 			}
 		}
-		else if (strcmp(op, "-t") == 0){
-			if (sscanf (val[j], "%lf", &temperature) != 1){
-				printf("temperature should be a floating point number\n");
+		else if (strcmp(op, "-clip") == 0){
+			double clip;
+			if (sscanf (val, "%lf", &clip) != 1 || clip < 0 || clip >= 50){
+				printf("clip should be a percentage below 50\n");
 				fatal_error();
 			}
-
+			stretchConfig.low = clip;
+			stretchConfig.high = 100 - clip;
 		}
-		else if (strcmp(op, "-r") == 0){
-			isRotate = TRUE;
-			if (sscanf (val[j], "%d", &degree) != 1){
-				printf("degree should be an interger\n");
-				fatal_error();
-			}
-			if(degree%90 != 0){
-				printf("Degree must be 90-degree interger\n");
-				return 0;
-			}
-			else
-			printf("Image will be rotated %d CW\n", degree);
-		}
-		else if (strcmp(op, "-w") == 0){
-			if (sscanf (val[j], "%lf", &waitingTime) != 1){
-				printf("waiting time should be a floating point number\n");
-				fatal_error();
-			}
+		else {
+			printf("unknown option %s, camera settings are options of nuvu_daemon\n", op);
+			fatal_error();
 		}
-
-
-	} // end option loop
-
-	// # =============== setter functions ============== #//
-	st = set_exposure_time(*cam, exposureTime);
-	if( st != TAO_OK){
-		 fatal_error();
-	}
-	printf("exposure time is set to %f msec\n", exposureTime);
-
-	st = set_waiting_time(*cam, waitingTime);
-	if( st != TAO_OK){
-		 fatal_error();
 	}
-	printf("waiting time is set to %f msec\n", waitingTime);
 
-	st = set_analog_gain(*cam, analogGain);
-	if( st != TAO_OK){
-		 fatal_error();
+	if (stretchMode >= 0){
+		stretchConfig.mode = stretchMode;
+		autoContrast = 1;
 	}
-	printf("analog gain is set to %d\n", analogGain);
-
-	st = set_analog_gain(*cam, analogOffset);
-	if( st != TAO_OK){
-		 fatal_error();
+	if (tao_common_stretch_create(&stretchConfig, &stretch) != TAO_OK){
+		fatal_error();
 	}
-	printf("analog offset is set to %d\n", analogOffset);
-
-	st = set_temperature(*cam, temperature);
-	if( st != TAO_OK){
-		 fatal_error();
+	if (!autoContrast){
+		tao_common_stretch_set_limits(stretch, 0, UINT16_MAX);
 	}
-	printf("temperature is set to %f\n", temperature);
 
-	// set reasonable timeout
-  st = set_timeout(*cam ,  (int)(readoutTime + exposureTime) + 1000);
-  if( st != TAO_OK){
-     fatal_error();
+	if (socketPath != NULL){
+		if (tao_common_client_connect(socketPath, &client) != TAO_OK){
+			printf("No frames on \"%s\", is nuvu_daemon running?\n", socketPath);
+			fatal_error();
+		}
+		shm = tao_common_client_get_reader(client);
 	}
-	// set image size
-	set_ROI(*cam, WIDTH, HEIGHT);
-
-  printf("initialization is complete.\n" );
-
-  return st;
-
-}
-
-// acquisition
-// grab NcImage (unsigned short *)
-// downsample
-// update the pointer to the 8 bpp image
-// No rounding up to 4-byte integer (strid === width)
-tao_status acquisition(NcCam cam, unsigned char	*image_handle){
-  tao_status  st = TAO_OK;
-	NcImage* _image_handle; // 1-D array pointer 16 bpp
-
-  // start acquisition
-  st = cam_take_image(cam);
-  if (st != TAO_OK) {
-    fatal_error();
-  }
-	// wait image: blocking style Ok for separate thread
-	// FIXME: bad practice
-	int isacquiring = 1;
-	while (isacquiring){
-		ncCamIsAcquiring(cam, &isacquiring);
+	else if (tao_common_shm_open(shmName, &shm) != TAO_OK){
+		printf("No frames in \"%s\", is nuvu_daemon running?\n", shmName);
+		fatal_error();
 	}
-
-	// read image
-	st = read_uint16_image(cam, &_image_handle)  ;
-	if(st != TAO_OK){
+	const tao_common_shm_header* hdr = tao_common_shm_get_header(shm);
+	if (hdr->width != WIDTH || hdr->height != HEIGHT ||
+			hdr->pixel_type != TAO_COMMON_UINT16){
+		printf("Published frames must be %dx%d 16-bit images\n", WIDTH, HEIGHT);
 		fatal_error();
 	}
-
-	rgb_image((uint16_t*) _image_handle, image_handle, &satVal);
-
-  return st;
-
-}
-
-// camera status update routines
-gboolean temperature_update(gpointer user_data){
-
-		double detector_temp = 0.0;
-		detector_temperature(cam, &detector_temp);
-		printf("Temperature = %ld \n", (long)detector_temp );
-		return TRUE;
-
+	printf("Displaying \"%s\"...\n", socketPath != NULL ? socketPath : shmName);
+	return TAO_OK;
 }
 
 // saturation check
 gboolean saturation_check(gpointer user_data){
-	int maxVal = (int) pow(2,16);
-	satVal == maxVal ? printf("Image is saturated!\n"):0;
+	// to the histogram bin with -stretch
+	satVal == UINT16_MAX ? printf("Image is saturated!\n"):0;
 	return TRUE;
 
 }
-// frame rate print update (not working)
-gboolean fps_update(gpointer user_data)
-{
-	double fps = 0.0;
-	get_framerate(cam, &fps);
-	printf("Frame rate = %lf \n", fps );
-	return TRUE;
 
-}
 // --- worker functions --- //
-// createImage camera
-// acquisition routine
-void* createImage(void* arg)
+// copy the latest published frame, scale it and hand it to the GTK thread;
+// frames published while this thread is busy are skipped
+void* viewImage(void* arg)
 {
-	// pointer to the final data which will be stored in the buffer
-	unsigned char* img_data = (unsigned char *) malloc(buff.stride* HEIGHT);
-	unsigned char* final_image_array = (unsigned char*) malloc(buff.stride*HEIGHT*SCALE_FACTOR*SCALE_FACTOR);
-  // open shutter
-	tao_status st = TAO_OK;
-  enum ShutterMode mode = OPEN;
-  st = set_shuttermode(cam, mode);
-  if (st != TAO_OK) {
-    fatal_error();
-  }
-	while (1){
+	tao_common_frame_buffer rawBuffer, imgBuffer, finalBuffer;
+	if (tao_common_frame_buffer_alloc(&rawBuffer, WIDTH*HEIGHT*sizeof(uint16_t),
+																		-1) != TAO_OK ||
+			tao_common_frame_buffer_alloc(&imgBuffer, buff.stride* HEIGHT,
+																		-1) != TAO_OK ||
+			tao_common_frame_buffer_alloc(&finalBuffer,
+																		buff.stride*HEIGHT*SCALE_FACTOR*SCALE_FACTOR,
+																		-1) != TAO_OK){
+		fatal_error();
+	}
+	uint16_t* raw = (uint16_t*) rawBuffer.data;
+	unsigned char* img_data = (unsigned char *) imgBuffer.data;
+	unsigned char* final_image_array = (unsigned char*) finalBuffer.data;
+	uint64_t last = 0, published;
 
-		st = acquisition(cam, img_data);
-		if (st != TAO_OK) {
-	    fatal_error();
-	  }
+	while (1){
+		// notified by the server, or polling the shared memory
+		tao_status st = (client != NULL ?
+										 tao_common_client_wait(client, last, 1.0, &published) :
+										 tao_common_shm_wait(shm, last, 1.0, &published));
+		if (st != TAO_OK){
+			fatal_error();
+		}
+		if (published == last){
+			if (client != NULL ? tao_common_client_stopped(client) :
+					tao_common_shm_stopped(shm)){
+				printf("The acquisition has stopped.\n");
+				break;
+			}
+			continue;
+		}
+		if (tao_common_shm_read(shm, raw, NULL, &last) != TAO_OK){
+			fatal_error();
+		}
+		display_image(raw, img_data, &satVal);
 		// scale image
 		makeBigger(img_data, final_image_array, SCALE_FACTOR);
 
@@ -392,27 +238,14 @@ void* createImage(void* arg)
 		memcpy((void *) buff.data, (void*) final_image_array,
 					buff.stride * HEIGHT *SCALE_FACTOR *SCALE_FACTOR);
 		pthread_mutex_unlock(&(buff.mutexBuffer));
-
-	  // pthread_cond_signal(&(buff.waitdata));
 	}
 
-	// --- Finalizer --- //
-	printf("Finishing...\n");
-	// close shutter
-  st = set_shuttermode(cam, CLOSE);
-  if (st != TAO_OK) {
-    fatal_error();
-  }
-
-	st = cam_close(cam);
-  if(st != TAO_OK){
-    fatal_error();
-  }
-
+	tao_common_frame_buffer_free(&finalBuffer);
+	tao_common_frame_buffer_free(&imgBuffer);
+	tao_common_frame_buffer_free(&rawBuffer);
 	return NULL;
 }
 
-
 // ------- Callbacks --------
 // redraw callback (idel)
 gboolean redraw(gpointer user_data){
@@ -423,16 +256,6 @@ gboolean redraw(gpointer user_data){
 
 // draw callback
 gboolean draw_callback(GtkWidget*widget,cairo_t* cr, gpointer arg){
-	// start camera image acquisition in a seperate thread
-	if (hasRun == 0){
-    pthread_t imageThread;
-    // spawn image generating thread
-    if(pthread_create(&imageThread, NULL, createImage, NULL) != 0){
-      printf("Failed to create a GTK routine..\n");
-    }
-		 hasRun = 1;
-
-  }
 	 //create cairo surface
 	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB30,
 																												SCALE_FACTOR*WIDTH,
@@ -452,16 +275,11 @@ gboolean draw_callback(GtkWidget*widget,cairo_t* cr, gpointer arg){
   pthread_mutex_unlock(&(buff.mutexBuffer));
   // pthread_cond_signal(&(buff.waitdata));
 
-	// rotate the image
-  static int offsetx_rotate = (W_WIDTH)/2 ;
-  static int offsety_rotate = (W_HEIGHT)/2 ;
+	// center the image, it is already oriented
+  static int offsetx_center = (W_WIDTH)/2 ;
+  static int offsety_center = (W_HEIGHT)/2 ;
 
-  cairo_translate (cr, offsetx_rotate,offsety_rotate);
-  double radian = degree/180.0 * M_PI;
-
-	if (isRotate == TRUE) {
-    cairo_rotate(cr, radian);
-  }
+  cairo_translate (cr, offsetx_center,offsety_center);
 	cairo_translate (cr, -SCALE_FACTOR*WIDTH/2,-SCALE_FACTOR*HEIGHT/2);
 
   cairo_set_source_surface (cr, surface, 0,0);
@@ -475,11 +293,7 @@ gboolean draw_callback(GtkWidget*widget,cairo_t* cr, gpointer arg){
 // quit callback
 gboolean quit_callback(gpointer arg)
 {
-		// clean camera
-	enum ShutterMode mode = CLOSE;
-	set_shuttermode(cam,mode);
-	cam_abort(cam);
-	cam_close(cam);
+	// the acquisition is not ours, only the mapping is released at exit
   gtk_main_quit();
 	return FALSE;
 }
@@ -495,19 +309,27 @@ int main(int argc, char* argv[]) {
 			printf("Wrong argument. use --help to see the manual\n");
 			return 0;
 		}
-		else {
-			*argv = NULL;
-		}
 	}
 
- 	initialize(&cam, argc, argv);
+ 	initialize(argc, argv);
 
 	gtk_init (&argc, &argv);
   // initialize global struct
   buff.stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB30, WIDTH);
-  buff.data = (unsigned char*) calloc(buff.stride*HEIGHT*SCALE_FACTOR*SCALE_FACTOR,
-		 																	sizeof(unsigned char));
-  // pthread_cond_init(&(buff. waitdata), NULL);
+  if (tao_common_frame_buffer_alloc(&displayBuffer,
+                                    buff.stride*HEIGHT*SCALE_FACTOR*SCALE_FACTOR,
+                                    -1) != TAO_OK){
+    fatal_error();
+  }
+  buff.data = (unsigned char*) displayBuffer.data;
+  pthread_mutex_init(&(buff.mutexBuffer), NULL);
+
+  // frames are read from the start, not from the first draw
+  pthread_t imageThread;
+  if(pthread_create(&imageThread, NULL, viewImage, NULL) != 0){
+    fatal_error();
+  }
+  pthread_detach(imageThread);
 
   // GTK initialization
   GtkWidget *area = gtk_drawing_area_new();
@@ -531,13 +353,17 @@ int main(int argc, char* argv[]) {
   gtk_widget_show_all(window);
 	// add callbacks
 	gdk_threads_add_idle(redraw, area);
-	gdk_threads_add_timeout_seconds(5, temperature_update,cam);
-	gdk_threads_add_timeout_seconds(2, saturation_check,cam);
+	gdk_threads_add_timeout_seconds(2, saturation_check,NULL);
 
 	gtk_main();
 
-
-  return EXIT_SUCCESS;
+	if (client != NULL){
+		tao_common_client_close(client);
+	}
+	else {
+		tao_common_shm_close_reader(shm);
+	}
+	tao_common_stretch_destroy(stretch);
 
   return EXIT_SUCCESS;
 }
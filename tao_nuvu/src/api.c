@@ -1,6 +1,7 @@
 #include "tao_nuvu.h"
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 
 /*-------------------------------------------------------------------------*/
 /* ERROR */
@@ -95,9 +96,21 @@ tao_status set_timeout(NcCam cam,
 /*-------------------------------------------------------------------------*/
 /* EM gain */
 
+// Default EM gain operation: the requested value clamped to [emMin, emMax]
+static int em_gain_clamp(int* nums)
+{
+  int emGain = nums[2];
+  if (emGain < nums[0])
+    emGain = nums[0];
+  if (emGain > nums[1])
+    emGain = nums[1];
+  return emGain;
+}
+
 // change EM gain
 /*
 *   function pointer to opeartion on the emMax and emMin
+*   (NULL to use emGainInput clamped to the allowed range)
 */
 tao_status set_em_gain(  NcCam camera,
                           int (*emGainOp)(int* num),
@@ -111,8 +124,10 @@ tao_status set_em_gain(  NcCam camera,
 	enum Ampli	ampliType;
 
 	int emGainMin, emGainMax;
-  int* emGainArray = malloc(3*sizeof(int));  // array holds 3 integers
+  int emGainArray[3];  // array holds 3 integers
   *(emGainArray+2) =  emGainInput;
+  if (emGainOp == NULL)
+    emGainOp = em_gain_clamp;
 	error = ncCamGetReadoutMode(camera, 1, &ampliType, 0, 0, 0);
 	if (error) {
 
@@ -191,7 +206,6 @@ tao_status set_em_gain(  NcCam camera,
     }
 	}
 
-  free(emGainArray);
 	return TAO_OK;
 
 }
@@ -343,6 +357,17 @@ tao_status set_temperature(NcCam camera, double	ccdTargetTemp) {
 
 /*---------------------------------------------------------------------------*/
 /* Status*/
+tao_status get_nbr_dropped_images(NcCam cam, int* nbrDropped)
+{
+  int err = NC_SUCCESS;
+  err =  ncCamGetNbrDroppedImages(cam, nbrDropped);
+  if(err){
+    error_push(__func__, err);
+    return TAO_ERROR;
+  }
+
+  return TAO_OK;
+}
 
 /*-------------------------- Helper Function -------------------------------*/
 // Param availability
@@ -421,17 +446,134 @@ tao_status read_uint16_image(NcCam cam,
   return TAO_OK;
 }
 
-tao_status read_uint32_image(NcCam cam, uint32_t* image)
+// Read and return the camera time stamp (msec) of the image
+tao_status read_timed_image(NcCam cam,
+                              NcImage** image_ptrptr,
+                              double* imageTime)
 {
-	int err = NC_SUCCESS;
-  err =  ncCamReadUInt32(cam, image);
+  int err = NC_SUCCESS;
+  err =  ncCamReadTimed(cam, image_ptrptr, imageTime);
   if(err){
     error_push(__func__, err);
     return TAO_ERROR;
   }
 
   return TAO_OK;
+}
 
+// Reset the camera timer used by read_timed_image
+tao_status reset_timer(NcCam cam, double timeOffset)
+{
+  int err = NC_SUCCESS;
+  err =  ncCamResetTimer(cam, timeOffset);
+  if(err){
+    error_push(__func__, err);
+    return TAO_ERROR;
+  }
+
+  return TAO_OK;
+}
+
+// Pixel types of converted images
+static int read_type(tao_common_pixel_type type)
+{
+  return (type == TAO_COMMON_UINT16 || type == TAO_COMMON_UINT32 ||
+          type == TAO_COMMON_FLOAT32);
+}
+
+size_t image_size(NcCam cam, tao_common_pixel_type type)
+{
+  int width, height;
+  int err = ncCamGetSize(cam, &width, &height);
+  if (err) {
+    error_push("ncCamGetSize", err);
+    return 0;
+  }
+  return (size_t)width*height*tao_common_pixel_size(type);
+}
+
+// Read the next image and convert it in place of the caller, the driver
+// buffer is only valid until the next read.  The size of the image comes
+// from the configuration cache, the driver is not queried for every frame.
+tao_status read_converted_image(NcCam cam, const nuvu_config_cache* cache,
+                                tao_common_pixel_type type,
+                                void* image, size_t size)
+{
+  NcImage* raw;
+  size_t n, needed;
+
+  if (!read_type(type)) {
+    tao_push_error(__func__, TAO_BAD_TYPE);
+    return TAO_ERROR;
+  }
+  needed = config_image_size(cache, type);
+  if (needed == 0) {
+    tao_push_error(__func__, TAO_NOT_READY);
+    return TAO_ERROR;
+  }
+  // a size taken before a change of the ROI would read past the driver buffer
+  if (image == NULL || size != needed) {
+    tao_push_error(__func__, TAO_BAD_SIZE);
+    return TAO_ERROR;
+  }
+  int err = ncCamRead(cam, &raw);
+  if (err) {
+    error_push("ncCamRead", err);
+    return TAO_ERROR;
+  }
+  // widened by the kernels of the instruction set of the CPU
+  n = needed/tao_common_pixel_size(type);
+  switch (type) {
+  case TAO_COMMON_UINT32:
+    tao_common_kernels_get()->convert_u16_u32(image, raw, n);
+    break;
+  case TAO_COMMON_FLOAT32:
+    tao_common_kernels_get()->convert_u16_f32(image, raw, n);
+    break;
+  default:
+    memcpy(image, raw, needed);
+    break;
+  }
+  return TAO_OK;
+}
+
+tao_status read_uint32_image(NcCam cam, const nuvu_config_cache* cache,
+                             uint32_t* image, size_t size)
+{
+  return read_converted_image(cam, cache, TAO_COMMON_UINT32, image, size);
+}
+
+tao_status read_float_image(NcCam cam, const nuvu_config_cache* cache,
+                            float* image, size_t size)
+{
+  return read_converted_image(cam, cache, TAO_COMMON_FLOAT32, image, size);
+}
+
+// The buffer is only reallocated when the size of the images changes, so it
+// can be reused for all the images of an acquisition.
+tao_status read_image_buffer(NcCam cam, const nuvu_config_cache* cache,
+                             tao_common_pixel_type type,
+                             tao_common_frame_buffer* buf)
+{
+  size_t needed;
+
+  if (!read_type(type)) {
+    tao_push_error(__func__, TAO_BAD_TYPE);
+    return TAO_ERROR;
+  }
+  needed = config_image_size(cache, type);
+  if (needed == 0) {
+    tao_push_error(__func__, TAO_NOT_READY);
+    return TAO_ERROR;
+  }
+  if (buf->data == NULL || buf->size != needed) {
+    int node = buf->node;
+    tao_common_frame_buffer_free(buf);
+    if (tao_common_frame_buffer_alloc(buf, needed, node) != TAO_OK) {
+      return TAO_ERROR;
+    }
+  }
+  return read_converted_image(cam, cache, type, buf->data, buf->size);
 }
 
 //apply ROI
@@ -0,0 +1,339 @@
+#include "tao_nuvu.h"
+#include <errno.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* Background bias refresh */
+
+// Number of bias estimates: the published one, one still used by a slow
+// reader and one being computed
+#define NBR_ESTIMATES 3
+
+// Burst state of the streaming thread
+enum { BIAS_STREAMING = 0, BIAS_CLOSING, BIAS_BURST, BIAS_OPENING };
+
+typedef struct bias_estimate {
+  float* data;              // width*(height + overscanLines) pixels
+  double overscan;          // mean level of the overscan rows
+  int refs;                 // readers using the estimate
+} bias_estimate;
+
+struct nuvu_bias {
+  int width, height;        // image size without the overscan rows
+  size_t npixels;           // pixels of a raw frame (overscan included)
+  nuvu_bias_config cfg;
+  // streaming thread only
+  int state;
+  int count;                // frames received in the current state
+  int64_t nextBurst;        // CLOCK_MONOTONIC time of the next burst
+  uint16_t* burst;          // frames of the current burst
+  // shared with the update thread
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int burstReady;           // a complete burst waits for the update thread
+  int running;
+  long generation;          // number of estimates published
+  int current;              // published estimate, -1 until the first burst
+  bias_estimate est[NBR_ESTIMATES];
+  pthread_t thread;
+};
+
+// Mean level of the overscan rows of a frame
+static double overscan_level(const nuvu_bias* bias, const float* bf,
+                             const NcImage* raw)
+{
+  size_t start = (size_t)bias->width*bias->height;
+  double sum = 0;
+
+  if (bias->cfg.overscanLines <= 0) {
+    return 0;
+  }
+  if (bf != NULL) {
+    for (size_t i = start; i < bias->npixels; ++i) sum += bf[i];
+  } else {
+    for (size_t i = start; i < bias->npixels; ++i) sum += raw[i];
+  }
+  return sum/(bias->npixels - start);
+}
+
+// Blend a burst into a free estimate and publish it
+static void update_estimate(nuvu_bias* bias)
+{
+  int target = -1;
+
+  pthread_mutex_lock(&bias->mutex);
+  for (int k = 0; k < NBR_ESTIMATES; ++k) {
+    if (k != bias->current && bias->est[k].refs == 0) {
+      target = k;
+      break;
+    }
+  }
+  int current = bias->current;
+  pthread_mutex_unlock(&bias->mutex);
+  if (target < 0) {
+    // all estimates in use, this burst is lost
+    return;
+  }
+
+  // the published estimate is never written, only this thread publishes
+  float* dst = bias->est[target].data;
+  const float* cur = (current >= 0 ? bias->est[current].data : NULL);
+  int n = bias->cfg.burstFrames;
+  float w = (cur != NULL ? bias->cfg.weight : 1.0f);
+  for (size_t i = 0; i < bias->npixels; ++i) {
+    uint32_t sum = 0;
+    for (int j = 0; j < n; ++j) {
+      sum += bias->burst[j*bias->npixels + i];
+    }
+    float mean = (float)sum/n;
+    dst[i] = (cur != NULL ? (1 - w)*cur[i] + w*mean : mean);
+  }
+  bias->est[target].overscan = overscan_level(bias, dst, NULL);
+
+  pthread_mutex_lock(&bias->mutex);
+  bias->current = target;
+  bias->generation += 1;
+  pthread_mutex_unlock(&bias->mutex);
+}
+
+static void* bias_loop(void* arg)
+{
+  nuvu_bias* bias = arg;
+
+  pthread_mutex_lock(&bias->mutex);
+  while (1) {
+    while (bias->running && !bias->burstReady) {
+      pthread_cond_wait(&bias->cond, &bias->mutex);
+    }
+    if (!bias->running) {
+      break;
+    }
+    pthread_mutex_unlock(&bias->mutex);
+    update_estimate(bias);
+    pthread_mutex_lock(&bias->mutex);
+    bias->burstReady = 0;
+  }
+  pthread_mutex_unlock(&bias->mutex);
+  return NULL;
+}
+
+void bias_config_init(nuvu_bias_config* cfg)
+{
+  cfg->burstFrames = 10;
+  cfg->burstPeriod = 300.0;
+  cfg->weight = 0.25;
+  cfg->settleFrames = 2;
+  cfg->overscanLines = 0;
+}
+
+tao_status bias_create(int width, int height, const nuvu_bias_config* cfg,
+                       nuvu_bias** bias_ptr)
+{
+  tao_common_thread_config threadConfig;
+  nuvu_bias* bias;
+
+  *bias_ptr = NULL;
+  if (width < 1 || height < 1 || cfg->burstFrames < 1 ||
+      cfg->burstFrames > 65536 || !(cfg->burstPeriod >= 0) ||
+      !(cfg->weight > 0 && cfg->weight <= 1) || cfg->settleFrames < 0 ||
+      cfg->overscanLines < 0) {
+    tao_push_error(__func__, TAO_BAD_VALUE);
+    return TAO_ERROR;
+  }
+  bias = calloc(1, sizeof(nuvu_bias));
+  if (bias == NULL) {
+    tao_push_error(__func__, errno);
+    return TAO_ERROR;
+  }
+  bias->width = width;
+  bias->height = height;
+  bias->npixels = (size_t)width*(height + cfg->overscanLines);
+  bias->cfg = *cfg;
+  bias->current = -1;
+  bias->nextBurst = tao_common_monotonic_time();   // first burst right away
+  bias->burst = malloc(cfg->burstFrames*bias->npixels*sizeof(uint16_t));
+  for (int k = 0; k < NBR_ESTIMATES; ++k) {
+    bias->est[k].data = malloc(bias->npixels*sizeof(float));
+  }
+  if (bias->burst == NULL || bias->est[0].data == NULL ||
+      bias->est[1].data == NULL || bias->est[2].data == NULL) {
+    tao_push_error(__func__, errno);
+    goto error;
+  }
+  pthread_mutex_init(&bias->mutex, NULL);
+  pthread_cond_init(&bias->cond, NULL);
+  bias->running = 1;
+
+  // low priority, the estimate is not urgent
+  tao_common_thread_config_init(&threadConfig);
+  threadConfig.name = "nuvu-bias";
+  threadConfig.nice = 10;
+  if (tao_common_thread_create(&bias->thread, &threadConfig, bias_loop,
+                               bias) != TAO_OK) {
+    pthread_cond_destroy(&bias->cond);
+    pthread_mutex_destroy(&bias->mutex);
+    goto error;
+  }
+  *bias_ptr = bias;
+  return TAO_OK;
+
+error:
+  for (int k = 0; k < NBR_ESTIMATES; ++k) {
+    free(bias->est[k].data);
+  }
+  free(bias->burst);
+  free(bias);
+  return TAO_ERROR;
+}
+
+void bias_destroy(nuvu_bias* bias)
+{
+  if (bias == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&bias->mutex);
+  bias->running = 0;
+  pthread_cond_signal(&bias->cond);
+  pthread_mutex_unlock(&bias->mutex);
+  pthread_join(bias->thread, NULL);
+  pthread_cond_destroy(&bias->cond);
+  pthread_mutex_destroy(&bias->mutex);
+  for (int k = 0; k < NBR_ESTIMATES; ++k) {
+    free(bias->est[k].data);
+  }
+  free(bias->burst);
+  free(bias);
+}
+
+tao_status bias_feed(nuvu_bias* bias, NcCam cam, const NcImage* image,
+                     int* isData)
+{
+  *isData = 0;
+  switch (bias->state) {
+  case BIAS_STREAMING:
+    if (tao_common_monotonic_time() < bias->nextBurst) {
+      *isData = 1;
+      return TAO_OK;
+    }
+    // the previous burst is still being processed: wait for the next frame
+    pthread_mutex_lock(&bias->mutex);
+    int busy = bias->burstReady;
+    pthread_mutex_unlock(&bias->mutex);
+    if (busy) {
+      *isData = 1;
+      return TAO_OK;
+    }
+    // this frame was exposed with the shutter open
+    *isData = 1;
+    if (set_shuttermode(cam, CLOSE) != TAO_OK) {
+      return TAO_ERROR;
+    }
+    bias->state = BIAS_CLOSING;
+    bias->count = 0;
+    return TAO_OK;
+
+  case BIAS_CLOSING:
+    // frames exposed while the shutter was moving
+    if (++bias->count <= bias->cfg.settleFrames) {
+      return TAO_OK;
+    }
+    bias->state = BIAS_BURST;
+    bias->count = 0;
+    // fall through
+
+  case BIAS_BURST:
+    memcpy(bias->burst + bias->count*bias->npixels, image,
+           bias->npixels*sizeof(uint16_t));
+    if (++bias->count < bias->cfg.burstFrames) {
+      return TAO_OK;
+    }
+    if (set_shuttermode(cam, OPEN) != TAO_OK) {
+      return TAO_ERROR;
+    }
+    pthread_mutex_lock(&bias->mutex);
+    bias->burstReady = 1;
+    pthread_cond_signal(&bias->cond);
+    pthread_mutex_unlock(&bias->mutex);
+    bias->state = BIAS_OPENING;
+    bias->count = 0;
+    return TAO_OK;
+
+  case BIAS_OPENING:
+    if (++bias->count <= bias->cfg.settleFrames) {
+      return TAO_OK;
+    }
+    bias->state = BIAS_STREAMING;
+    bias->nextBurst = (bias->cfg.burstPeriod > 0 ?
+                       tao_common_monotonic_time() +
+                       (int64_t)(bias->cfg.burstPeriod*1e9) : INT64_MAX);
+    *isData = 1;
+    return TAO_OK;
+  }
+  return TAO_OK;
+}
+
+long bias_generation(nuvu_bias* bias)
+{
+  pthread_mutex_lock(&bias->mutex);
+  long generation = bias->generation;
+  pthread_mutex_unlock(&bias->mutex);
+  return generation;
+}
+
+// Reference the published estimate, NULL if there is none yet
+static bias_estimate* bias_acquire(nuvu_bias* bias)
+{
+  bias_estimate* est = NULL;
+  pthread_mutex_lock(&bias->mutex);
+  if (bias->current >= 0) {
+    est = &bias->est[bias->current];
+    est->refs += 1;
+  }
+  pthread_mutex_unlock(&bias->mutex);
+  if (est == NULL) {
+    tao_push_error("bias_acquire", TAO_NOT_READY);
+  }
+  return est;
+}
+
+static void bias_release(nuvu_bias* bias, bias_estimate* est)
+{
+  pthread_mutex_lock(&bias->mutex);
+  est->refs -= 1;
+  pthread_mutex_unlock(&bias->mutex);
+}
+
+tao_status bias_correct(nuvu_bias* bias, const NcImage* raw, float* out)
+{
+  bias_estimate* est = bias_acquire(bias);
+  if (est == NULL) {
+    return TAO_ERROR;
+  }
+  // drift of the bias level since the estimate, from the overscan rows
+  float drift = (float)(overscan_level(bias, NULL, raw) - est->overscan);
+  const float* bf = est->data;
+  size_t n = (size_t)bias->width*bias->height;
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = (float)raw[i] - bf[i] - drift;
+  }
+  bias_release(bias, est);
+  return TAO_OK;
+}
+
+tao_status bias_count_photons(nuvu_bias* bias, const NcImage* raw,
+                              float threshold, uint16_t* counts)
+{
+  bias_estimate* est = bias_acquire(bias);
+  if (est == NULL) {
+    return TAO_ERROR;
+  }
+  float level = threshold + (float)(overscan_level(bias, NULL, raw) -
+                                    est->overscan);
+  const float* bf = est->data;
+  size_t n = (size_t)bias->width*bias->height;
+  for (size_t i = 0; i < n; ++i) {
+    counts[i] += ((float)raw[i] - bf[i] > level);
+  }
+  bias_release(bias, est);
+  return TAO_OK;
+}
@@ -0,0 +1,396 @@
+#include "tao_nuvu.h"
+#include <math.h>
+
+/*---------------------------------------------------------------------------*/
+/* Batch configuration */
+
+#define NC_CHECK(call, name)                    \
+  do {                                          \
+    int _err = (call);                          \
+    if (_err != NC_SUCCESS) {                   \
+      error_push(name, _err);                   \
+      return TAO_ERROR;                         \
+    }                                           \
+  } while (0)
+
+void config_init(nuvu_config* cfg)
+{
+  memset(cfg, 0, sizeof(nuvu_config));
+  cfg->binX = 1;
+  cfg->binY = 1;
+}
+
+// Ranges that depend on the readout mode
+static tao_status load_mode_ranges(NcCam cam, nuvu_config_cache* cache)
+{
+  enum Ampli ampliType;
+  int readoutMode;
+
+  NC_CHECK(ncCamGetCurrentReadoutMode(cam, &readoutMode, &ampliType, 0, 0, 0),
+           "ncCamGetCurrentReadoutMode");
+  cache->current.readoutMode = readoutMode;
+  NC_CHECK(ncCamGetAnalogGainRange(cam, &cache->analogGainMin, &cache->analogGainMax),
+           "ncCamGetAnalogGainRange");
+  NC_CHECK(ncCamGetAnalogOffsetRange(cam, &cache->analogOffsetMin, &cache->analogOffsetMax),
+           "ncCamGetAnalogOffsetRange");
+  NC_CHECK(ncCamGetReadoutTime(cam, &cache->readoutTime), "ncCamGetReadoutTime");
+
+  cache->emGainKind = NUVU_EM_GAIN_NONE;
+  if (ampliType == EM) {
+    if (ncCamParamAvailable(cam, CALIBRATED_EM_GAIN, 0) == NC_SUCCESS) {
+      cache->emGainKind = NUVU_EM_GAIN_CALIBRATED;
+      NC_CHECK(ncCamGetCalibratedEmGainRange(cam, &cache->emGainMin, &cache->emGainMax),
+               "ncCamGetCalibratedEmGainRange");
+    } else if (ncCamParamAvailable(cam, RAW_EM_GAIN, 0) == NC_SUCCESS) {
+      cache->emGainKind = NUVU_EM_GAIN_RAW;
+      NC_CHECK(ncCamGetRawEmGainRange(cam, &cache->emGainMin, &cache->emGainMax),
+               "ncCamGetRawEmGainRange");
+    }
+  }
+  return TAO_OK;
+}
+
+tao_status config_load_cache(NcCam cam, nuvu_config_cache* cache)
+{
+  memset(cache, 0, sizeof(nuvu_config_cache));
+  NC_CHECK(ncCamGetNbrReadoutModes(cam, &cache->nbrReadoutModes),
+           "ncCamGetNbrReadoutModes");
+  NC_CHECK(ncCamGetMaxSize(cam, &cache->maxWidth, &cache->maxHeight),
+           "ncCamGetMaxSize");
+  NC_CHECK(ncCamGetTargetDetectorTempRange(cam, &cache->tempMin, &cache->tempMax),
+           "ncCamGetTargetDetectorTempRange");
+  if (ncCamGetCalibratedEmGainTempRange(cam, &cache->emTempMin,
+                                        &cache->emTempMax) != NC_SUCCESS) {
+    cache->emTempMin = cache->tempMin;
+    cache->emTempMax = cache->tempMax;
+  }
+  // supported binnings (powers of 2 up to 16)
+  cache->binXMask = cache->binYMask = 1 << 1;
+  for (int i = 2; i <= 16; i *= 2) {
+    if (ncCamParamAvailable(cam, BINNING_X, i) == NC_SUCCESS)
+      cache->binXMask |= 1 << i;
+    if (ncCamParamAvailable(cam, BINNING_Y, i) == NC_SUCCESS)
+      cache->binYMask |= 1 << i;
+  }
+  if (load_mode_ranges(cam, cache) != TAO_OK) {
+    return TAO_ERROR;
+  }
+  // what the camera currently uses
+  nuvu_config* cur = &cache->current;
+  ncCamGetExposureTime(cam, 0, &cur->exposureTime);
+  ncCamGetWaitingTime(cam, 0, &cur->waitingTime);
+  ncCamGetAnalogGain(cam, 0, &cur->analogGain);
+  ncCamGetAnalogOffset(cam, 0, &cur->analogOffset);
+  ncCamGetTargetDetectorTemp(cam, 0, &cur->targetTemp);
+  ncCamGetBinningMode(cam, &cur->binX, &cur->binY);
+  ncCamGetMRoiSize(cam, 0, &cur->roiWidth, &cur->roiHeight);
+  if (cache->emGainKind == NUVU_EM_GAIN_CALIBRATED)
+    ncCamGetCalibratedEmGain(cam, 0, &cur->emGain);
+  else if (cache->emGainKind == NUVU_EM_GAIN_RAW)
+    ncCamGetRawEmGain(cam, 0, &cur->emGain);
+  ncCamGetTimeout(cam, &cur->timeout);
+  cur->readoutTime = cache->readoutTime;
+  cur->mask = NUVU_CONFIG_ALL;
+  cache->loaded = 1;
+  return TAO_OK;
+}
+
+// Check a configuration against the cached ranges, mode-dependent ranges are
+// only checked when modeRanges is set.  Yields the number of errors.
+static int validate(const nuvu_config* cfg, const nuvu_config_cache* cache,
+                    int modeRanges, FILE* report)
+{
+  int nerr = 0;
+#define BAD(...) do { if (report) fprintf(report, "  invalid " __VA_ARGS__); nerr++; } while (0)
+  unsigned m = cfg->mask;
+  if ((m & NUVU_CONFIG_READOUT_MODE) &&
+      (cfg->readoutMode < 1 || cfg->readoutMode > cache->nbrReadoutModes))
+    BAD("readout mode %d (1..%d)\n", cfg->readoutMode, cache->nbrReadoutModes);
+  if ((m & NUVU_CONFIG_EXPOSURE_TIME) && !(cfg->exposureTime >= 0))
+    BAD("exposure time %g msec\n", cfg->exposureTime);
+  if ((m & NUVU_CONFIG_WAITING_TIME) && !(cfg->waitingTime >= 0))
+    BAD("waiting time %g msec\n", cfg->waitingTime);
+  if ((m & NUVU_CONFIG_TARGET_TEMP) &&
+      (cfg->targetTemp < cache->tempMin || cfg->targetTemp > cache->tempMax))
+    BAD("target temperature %g (%g..%g)\n", cfg->targetTemp, cache->tempMin,
+        cache->tempMax);
+  if ((m & NUVU_CONFIG_BINNING) &&
+      (cfg->binX < 1 || cfg->binX > 16 || !(cache->binXMask & (1 << cfg->binX)) ||
+       cfg->binY < 1 || cfg->binY > 16 || !(cache->binYMask & (1 << cfg->binY))))
+    BAD("binning %dx%d\n", cfg->binX, cfg->binY);
+  if ((m & NUVU_CONFIG_ROI) &&
+      (cfg->roiWidth < 1 || cfg->roiWidth > cache->maxWidth ||
+       cfg->roiHeight < 1 || cfg->roiHeight > cache->maxHeight))
+    BAD("ROI %dx%d (max %dx%d)\n", cfg->roiWidth, cfg->roiHeight,
+        cache->maxWidth, cache->maxHeight);
+  if (modeRanges) {
+    if ((m & NUVU_CONFIG_ANALOG_GAIN) &&
+        (cfg->analogGain < cache->analogGainMin || cfg->analogGain > cache->analogGainMax))
+      BAD("analog gain %d (%d..%d)\n", cfg->analogGain, cache->analogGainMin,
+          cache->analogGainMax);
+    if ((m & NUVU_CONFIG_ANALOG_OFFSET) &&
+        (cfg->analogOffset < cache->analogOffsetMin || cfg->analogOffset > cache->analogOffsetMax))
+      BAD("analog offset %d (%d..%d)\n", cfg->analogOffset, cache->analogOffsetMin,
+          cache->analogOffsetMax);
+    if ((m & NUVU_CONFIG_EM_GAIN) &&
+        (cache->emGainKind == NUVU_EM_GAIN_NONE ||
+         cfg->emGain < cache->emGainMin || cfg->emGain > cache->emGainMax))
+      BAD("EM gain %d (%d..%d)\n", cfg->emGain, cache->emGainMin,
+          cache->emGainMax);
+  }
+#undef BAD
+  return nerr;
+}
+
+// Is a field requested with a value different from the current one?
+#define CHANGED(bit, field) \
+  ((cfg->mask & (bit)) && (!(cur->mask & (bit)) || cfg->field != cur->field))
+
+unsigned config_changes(const nuvu_config* cfg, const nuvu_config_cache* cache)
+{
+  const nuvu_config* cur = &cache->current;
+  unsigned changes = 0;
+  if (CHANGED(NUVU_CONFIG_READOUT_MODE, readoutMode))
+    changes |= NUVU_CONFIG_READOUT_MODE;
+  if (CHANGED(NUVU_CONFIG_EXPOSURE_TIME, exposureTime))
+    changes |= NUVU_CONFIG_EXPOSURE_TIME;
+  if (CHANGED(NUVU_CONFIG_WAITING_TIME, waitingTime))
+    changes |= NUVU_CONFIG_WAITING_TIME;
+  if (CHANGED(NUVU_CONFIG_ANALOG_GAIN, analogGain))
+    changes |= NUVU_CONFIG_ANALOG_GAIN;
+  if (CHANGED(NUVU_CONFIG_ANALOG_OFFSET, analogOffset))
+    changes |= NUVU_CONFIG_ANALOG_OFFSET;
+  if (CHANGED(NUVU_CONFIG_EM_GAIN, emGain))
+    changes |= NUVU_CONFIG_EM_GAIN;
+  if (CHANGED(NUVU_CONFIG_TARGET_TEMP, targetTemp))
+    changes |= NUVU_CONFIG_TARGET_TEMP;
+  if (CHANGED(NUVU_CONFIG_ROI, roiWidth) || CHANGED(NUVU_CONFIG_ROI, roiHeight))
+    changes |= NUVU_CONFIG_ROI;
+  if (CHANGED(NUVU_CONFIG_BINNING, binX) || CHANGED(NUVU_CONFIG_BINNING, binY))
+    changes |= NUVU_CONFIG_BINNING;
+  return changes;
+}
+
+size_t config_image_size(const nuvu_config_cache* cache,
+                         tao_common_pixel_type type)
+{
+  const nuvu_config* cur = &cache->current;
+  unsigned geometry = NUVU_CONFIG_ROI | NUVU_CONFIG_BINNING;
+  if (!cache->loaded || (cur->mask & geometry) != geometry ||
+      cur->binX < 1 || cur->binY < 1) {
+    return 0;
+  }
+  // the ROI is given in unbinned pixels
+  return (size_t)(cur->roiWidth/cur->binX)*(cur->roiHeight/cur->binY)*
+    tao_common_pixel_size(type);
+}
+
+static const char* fieldNames[] = {
+  "readout mode", "exposure time", "waiting time", "analog gain",
+  "analog offset", "EM gain", "target temperature", "ROI", "binning"
+};
+
+// Change a setting of the camera, on failure its value is no longer known
+// and the remaining fields are not applied
+#define SET(bit, call, name)                    \
+  do {                                          \
+    int _err = (call);                          \
+    if (_err != NC_SUCCESS) {                   \
+      error_push(name, _err);                   \
+      cur->mask &= ~(unsigned)(bit);            \
+      goto failed;                              \
+    }                                           \
+  } while (0)
+
+tao_status config_apply(NcCam cam, nuvu_config_cache* cache,
+                        nuvu_config* cfg, FILE* report)
+{
+  nuvu_config* cur = &cache->current;
+  int nchanged = 0;
+
+  cfg->applied = 0;
+  if (!cache->loaded && config_load_cache(cam, cache) != TAO_OK) {
+    return TAO_ERROR;
+  }
+  if (report)
+    fprintf(report, "Camera configuration:\n");
+
+  // 1. everything that does not depend on the readout mode
+  if (validate(cfg, cache, 0, report) > 0) {
+    tao_push_error(__func__, TAO_BAD_VALUE);
+    return TAO_ERROR;
+  }
+  // the slots of a running dispatcher have the size of the current ROI
+  if (cache->dispatchers > 0 &&
+      (config_changes(cfg, cache) & (NUVU_CONFIG_ROI | NUVU_CONFIG_BINNING))) {
+    if (report)
+      fprintf(report, "  ROI and binning are fixed while a dispatcher runs\n");
+    tao_push_error(__func__, TAO_ALREADY_IN_USE);
+    return TAO_ERROR;
+  }
+
+  // 2. readout mode first since it changes the other ranges
+  int previousMode = cur->readoutMode;
+  if (CHANGED(NUVU_CONFIG_READOUT_MODE, readoutMode)) {
+    cache->version++;
+    SET(NUVU_CONFIG_READOUT_MODE, ncCamSetReadoutMode(cam, cfg->readoutMode),
+        "ncCamSetReadoutMode");
+    if (load_mode_ranges(cam, cache) != TAO_OK) {
+      cur->mask &= ~(unsigned)NUVU_CONFIG_READOUT_MODE;
+      goto failed;
+    }
+    nchanged++;
+  }
+  if (validate(cfg, cache, 1, report) > 0) {
+    // leave the camera as it was
+    if (cur->readoutMode != previousMode) {
+      ncCamSetReadoutMode(cam, previousMode);
+      load_mode_ranges(cam, cache);
+    }
+    tao_push_error(__func__, TAO_BAD_VALUE);
+    return TAO_ERROR;
+  }
+
+  // 3. geometry, which changes the readout time
+  int geometry = 0;
+  if (CHANGED(NUVU_CONFIG_BINNING, binX) || CHANGED(NUVU_CONFIG_BINNING, binY)) {
+    cache->version++;
+    SET(NUVU_CONFIG_BINNING, ncCamSetBinningMode(cam, cfg->binX, cfg->binY),
+        "ncCamSetBinningMode");
+    cur->binX = cfg->binX;
+    cur->binY = cfg->binY;
+    geometry = 1;
+  }
+  if (CHANGED(NUVU_CONFIG_ROI, roiWidth) || CHANGED(NUVU_CONFIG_ROI, roiHeight)) {
+    // centered ROI as set_ROI()
+    int offsetX = (cache->maxWidth - cfg->roiWidth)/2;
+    int offsetY = (cache->maxHeight - cfg->roiHeight)/2;
+    cache->version++;
+    SET(NUVU_CONFIG_ROI, ncCamSetMRoiSize(cam, 0, cfg->roiWidth, cfg->roiHeight),
+        "ncCamSetMRoiSize");
+    SET(NUVU_CONFIG_ROI, ncCamSetMRoiPosition(cam, 0, offsetX, offsetY),
+        "ncCamSetMRoiPosition");
+    SET(NUVU_CONFIG_ROI, ncCamMRoiApply(cam), "ncCamMRoiApply");
+    cur->roiWidth = cfg->roiWidth;
+    cur->roiHeight = cfg->roiHeight;
+    geometry = 1;
+  }
+  if (geometry) {
+    int err = ncCamGetReadoutTime(cam, &cache->readoutTime);
+    if (err != NC_SUCCESS) {
+      error_push("ncCamGetReadoutTime", err);
+      goto failed;
+    }
+    nchanged++;
+  }
+
+  // 4. timing
+  if (CHANGED(NUVU_CONFIG_EXPOSURE_TIME, exposureTime)) {
+    cache->version++;
+    SET(NUVU_CONFIG_EXPOSURE_TIME, ncCamSetExposureTime(cam, cfg->exposureTime),
+        "ncCamSetExposureTime");
+    cur->exposureTime = cfg->exposureTime;
+    nchanged++;
+  }
+  if (CHANGED(NUVU_CONFIG_WAITING_TIME, waitingTime)) {
+    cache->version++;
+    SET(NUVU_CONFIG_WAITING_TIME, ncCamSetWaitingTime(cam, cfg->waitingTime),
+        "ncCamSetWaitingTime");
+    cur->waitingTime = cfg->waitingTime;
+    nchanged++;
+  }
+  // timeout consistent with the frame duration
+  int timeout = (int)ceil(cache->readoutTime + cur->exposureTime +
+                          cur->waitingTime) + 1000;
+  if (timeout != cur->timeout) {
+    int err = ncCamSetTimeout(cam, timeout);
+    if (err != NC_SUCCESS) {
+      error_push("ncCamSetTimeout", err);
+      goto failed;
+    }
+    cur->timeout = timeout;
+  }
+
+  // 5. gains, offset and temperature
+  if (CHANGED(NUVU_CONFIG_ANALOG_GAIN, analogGain)) {
+    cache->version++;
+    SET(NUVU_CONFIG_ANALOG_GAIN, ncCamSetAnalogGain(cam, cfg->analogGain),
+        "ncCamSetAnalogGain");
+    cur->analogGain = cfg->analogGain;
+    nchanged++;
+  }
+  if (CHANGED(NUVU_CONFIG_ANALOG_OFFSET, analogOffset)) {
+    cache->version++;
+    SET(NUVU_CONFIG_ANALOG_OFFSET, ncCamSetAnalogOffset(cam, cfg->analogOffset),
+        "ncCamSetAnalogOffset");
+    cur->analogOffset = cfg->analogOffset;
+    nchanged++;
+  }
+  if (CHANGED(NUVU_CONFIG_EM_GAIN, emGain)) {
+    cache->version++;
+    if (cache->emGainKind == NUVU_EM_GAIN_CALIBRATED)
+      SET(NUVU_CONFIG_EM_GAIN, ncCamSetCalibratedEmGain(cam, cfg->emGain),
+          "ncCamSetCalibratedEmGain");
+    else
+      SET(NUVU_CONFIG_EM_GAIN, ncCamSetRawEmGain(cam, cfg->emGain),
+          "ncCamSetRawEmGain");
+    cur->emGain = cfg->emGain;
+    nchanged++;
+  }
+  if (CHANGED(NUVU_CONFIG_TARGET_TEMP, targetTemp)) {
+    cache->version++;
+    SET(NUVU_CONFIG_TARGET_TEMP, ncCamSetTargetDetectorTemp(cam, cfg->targetTemp),
+        "ncCamSetTargetDetectorTemp");
+    cur->targetTemp = cfg->targetTemp;
+    nchanged++;
+  }
+  cur->readoutTime = cache->readoutTime;
+
+  // give back what the camera uses
+  cfg->applied = cfg->mask;
+  cfg->readoutTime = cache->readoutTime;
+  cfg->timeout = cur->timeout;
+
+  if (report) {
+    fprintf(report, "  readout mode       %d\n", cur->readoutMode);
+    fprintf(report, "  ROI                %dx%d, binning %dx%d\n",
+            cur->roiWidth, cur->roiHeight, cur->binX, cur->binY);
+    fprintf(report, "  readout time       %f msec\n", cache->readoutTime);
+    fprintf(report, "  exposure time      %f msec\n", cur->exposureTime);
+    fprintf(report, "  waiting time       %f msec\n", cur->waitingTime);
+    fprintf(report, "  timeout            %d msec\n", cur->timeout);
+    fprintf(report, "  analog gain        %d\n", cur->analogGain);
+    fprintf(report, "  analog offset      %d\n", cur->analogOffset);
+    if (cache->emGainKind != NUVU_EM_GAIN_NONE)
+      fprintf(report, "  EM gain            %d (%s)\n", cur->emGain,
+              (cache->emGainKind == NUVU_EM_GAIN_CALIBRATED ? "calibrated" : "raw"));
+    fprintf(report, "  target temperature %f\n", cur->targetTemp);
+    if (cache->emGainKind == NUVU_EM_GAIN_CALIBRATED &&
+        (cur->targetTemp < cache->emTempMin || cur->targetTemp > cache->emTempMax))
+      fprintf(report, "  WARNING: EM gain calibration is only valid for %g..%g\n",
+              cache->emTempMin, cache->emTempMax);
+    fprintf(report, "  %d setting(s) changed\n", nchanged);
+  }
+  return TAO_OK;
+
+ failed:
+  // the fields set before the error are kept, the caller is told which ones
+  // the camera uses (the cache follows the camera in any case)
+  cur->readoutTime = cache->readoutTime;
+  cfg->applied = cfg->mask & ~config_changes(cfg, cache);
+  cfg->readoutTime = cache->readoutTime;
+  cfg->timeout = cur->timeout;
+  if (report) {
+    const char* sep = "";
+    fprintf(report, "  FAILED, requested settings in effect: ");
+    for (int i = 0; i < 9; i++) {
+      if (cfg->applied & (1u << i)) {
+        fprintf(report, "%s%s", sep, fieldNames[i]);
+        sep = ", ";
+      }
+    }
+    fprintf(report, "%s\n  %d setting(s) changed\n",
+            (*sep ? "" : "none"), nchanged);
+  }
+  return TAO_ERROR;
+}
@@ -0,0 +1,283 @@
+#include "tao_nuvu.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+/* Callback dispatcher */
+
+struct nuvu_dispatcher {
+  NcCam cam;
+  nuvu_config_cache* cache;       // geometry locked while running, may be NULL
+  nuvu_frame_handler* handler;
+  nuvu_clock clock;               // only used by image_callback
+  void* handlerData;
+  size_t frameSize;               // bytes per frame
+  int nbrSlots;
+  nuvu_frame* slots;
+  tao_common_frame_buffer memory; // pixels of all slots
+  pthread_mutex_t mutex;          // protects the fields below
+  pthread_cond_t work;            // a frame has been queued
+  pthread_cond_t done;            // a frame has been handled or dropped
+  int* freeSlots;                 // stack of free slots
+  int nbrFree;
+  int* ready;                     // FIFO of frames to handle
+  int readyHead, nbrReady;
+  int quit;
+  int eventSet;                   // image_callback registered
+  nuvu_dispatcher_stats stats;
+  int nbrStarted;                 // gives the workers their index
+  int nbrWorkers;
+  pthread_t workers[];
+};
+
+// Driver callback: claim the frame and queue it, the workers do the rest.
+static void image_callback(void* arg)
+{
+  nuvu_dispatcher* disp = arg;
+  NcImage* image;
+  double cameraTime;
+  nuvu_frame_time time;
+  int64_t hostTime = tao_common_monotonic_time();
+
+  // dropped frames are also used for the clock fit
+  int err = ncCamReadTimed(disp->cam, &image, &cameraTime);
+  if (err == NC_SUCCESS) {
+    cam_clock_update(&disp->clock, cameraTime, hostTime, &time);
+  }
+  pthread_mutex_lock(&disp->mutex);
+  if (err != NC_SUCCESS) {
+    disp->stats.readErrors += 1;
+    pthread_mutex_unlock(&disp->mutex);
+    return;
+  }
+  long number = disp->stats.received++;
+  if (disp->nbrFree == 0) {
+    // all slots are in use by the workers, never wait for them
+    disp->stats.dropped += 1;
+    pthread_cond_broadcast(&disp->done);
+    pthread_mutex_unlock(&disp->mutex);
+    return;
+  }
+  int slot = disp->freeSlots[--disp->nbrFree];
+  pthread_mutex_unlock(&disp->mutex);
+
+  // the driver reuses its buffer, copy the pixels before returning
+  nuvu_frame* frame = &disp->slots[slot];
+  memcpy(frame->data, image, disp->frameSize);
+  frame->number = number;
+  frame->time = time;
+
+  pthread_mutex_lock(&disp->mutex);
+  disp->ready[(disp->readyHead + disp->nbrReady) % disp->nbrSlots] = slot;
+  disp->nbrReady += 1;
+  pthread_cond_signal(&disp->work);
+  pthread_mutex_unlock(&disp->mutex);
+}
+
+static void* dispatcher_worker(void* arg)
+{
+  nuvu_dispatcher* disp = arg;
+
+  pthread_mutex_lock(&disp->mutex);
+  int worker = disp->nbrStarted++;
+  while (1) {
+    while (!disp->quit && disp->nbrReady == 0) {
+      pthread_cond_wait(&disp->work, &disp->mutex);
+    }
+    // queued frames are handled before quitting
+    if (disp->nbrReady == 0) {
+      break;
+    }
+    int slot = disp->ready[disp->readyHead];
+    disp->readyHead = (disp->readyHead + 1) % disp->nbrSlots;
+    disp->nbrReady -= 1;
+    pthread_mutex_unlock(&disp->mutex);
+
+    disp->slots[slot].worker = worker;
+    tao_status st = disp->handler(disp->cam, &disp->slots[slot],
+                                  disp->handlerData);
+    if (st != TAO_OK && tao_any_errors()) {
+      tao_report_errors();
+    }
+
+    pthread_mutex_lock(&disp->mutex);
+    disp->stats.handled += 1;
+    disp->stats.failed += (st != TAO_OK);
+    disp->freeSlots[disp->nbrFree++] = slot;
+    pthread_cond_broadcast(&disp->done);
+  }
+  pthread_mutex_unlock(&disp->mutex);
+  return NULL;
+}
+
+tao_status dispatcher_start(NcCam cam, nuvu_config_cache* cache,
+                            int nbrSlots, int nbrWorkers,
+                            const tao_common_thread_config* cfg,
+                            nuvu_frame_handler* handler, void* data,
+                            nuvu_dispatcher** disp_ptr)
+{
+  tao_common_thread_config defaultConfig;
+  pthread_condattr_t attr;
+  nuvu_dispatcher* disp;
+  int width, height, err;
+
+  *disp_ptr = NULL;
+  if (nbrSlots < 1 || nbrWorkers < 1 || handler == NULL) {
+    tao_push_error(__func__, TAO_BAD_VALUE);
+    return TAO_ERROR;
+  }
+  if (cache != NULL && !cache->loaded) {
+    tao_push_error(__func__, TAO_NOT_READY);
+    return TAO_ERROR;
+  }
+  err = ncCamGetSize(cam, &width, &height);
+  if (err) {
+    error_push("ncCamGetSize", err);
+    return TAO_ERROR;
+  }
+  disp = calloc(1, sizeof(nuvu_dispatcher) + nbrWorkers*sizeof(pthread_t));
+  if (disp == NULL) {
+    tao_push_error(__func__, errno);
+    return TAO_ERROR;
+  }
+  disp->cam = cam;
+  disp->handler = handler;
+  disp->handlerData = data;
+  cam_clock_init(&disp->clock);
+  disp->frameSize = (size_t)width*height*sizeof(NcImage);
+  disp->nbrSlots = nbrSlots;
+  disp->slots = calloc(nbrSlots, sizeof(nuvu_frame));
+  disp->freeSlots = calloc(nbrSlots, sizeof(int));
+  disp->ready = calloc(nbrSlots, sizeof(int));
+  if (disp->slots == NULL || disp->freeSlots == NULL || disp->ready == NULL) {
+    tao_push_error(__func__, errno);
+    goto error;
+  }
+  if (tao_common_frame_buffer_alloc(&disp->memory, nbrSlots*disp->frameSize,
+                                    -1) != TAO_OK) {
+    goto error;
+  }
+  for (int i = 0; i < nbrSlots; ++i) {
+    disp->slots[i].width = width;
+    disp->slots[i].height = height;
+    disp->slots[i].data = (NcImage*)((char*)disp->memory.data +
+                                     i*disp->frameSize);
+    disp->freeSlots[i] = nbrSlots - 1 - i;
+  }
+  disp->nbrFree = nbrSlots;
+
+  pthread_mutex_init(&disp->mutex, NULL);
+  pthread_cond_init(&disp->work, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&disp->done, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (cfg == NULL) {
+    tao_common_thread_config_init(&defaultConfig);
+    defaultConfig.name = "nuvu-handler";
+    cfg = &defaultConfig;
+  }
+  for (int i = 0; i < nbrWorkers; ++i) {
+    if (tao_common_thread_create(&disp->workers[i], cfg, dispatcher_worker,
+                                 disp) != TAO_OK) {
+      dispatcher_stop(disp);
+      return TAO_ERROR;
+    }
+    disp->nbrWorkers = i + 1;
+  }
+
+  err = ncCamSetEvent(cam, image_callback, disp);
+  if (err) {
+    error_push("ncCamSetEvent", err);
+    dispatcher_stop(disp);
+    return TAO_ERROR;
+  }
+  disp->eventSet = 1;
+  // the slots are sized for the current ROI
+  if (cache != NULL) {
+    disp->cache = cache;
+    cache->dispatchers += 1;
+  }
+  *disp_ptr = disp;
+  return TAO_OK;
+
+error:
+  free(disp->ready);
+  free(disp->freeSlots);
+  free(disp->slots);
+  free(disp);
+  return TAO_ERROR;
+}
+
+tao_status dispatcher_wait(nuvu_dispatcher* disp, long nbrFrames,
+                           double timeout)
+{
+  struct timespec deadline;
+  int code = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  double sec = (timeout > 0 ? timeout : 0);
+  deadline.tv_sec += (time_t)sec;
+  deadline.tv_nsec += (long)((sec - (time_t)sec)*1e9);
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_mutex_lock(&disp->mutex);
+  while (disp->stats.handled + disp->stats.dropped < nbrFrames &&
+         code != ETIMEDOUT) {
+    code = pthread_cond_timedwait(&disp->done, &disp->mutex, &deadline);
+  }
+  long count = disp->stats.handled + disp->stats.dropped;
+  pthread_mutex_unlock(&disp->mutex);
+  if (count < nbrFrames) {
+    tao_push_error(__func__, TAO_TIMEOUT);
+    return TAO_ERROR;
+  }
+  return TAO_OK;
+}
+
+void dispatcher_get_stats(nuvu_dispatcher* disp, nuvu_dispatcher_stats* stats)
+{
+  pthread_mutex_lock(&disp->mutex);
+  *stats = disp->stats;
+  pthread_mutex_unlock(&disp->mutex);
+}
+
+tao_status dispatcher_stop(nuvu_dispatcher* disp)
+{
+  tao_status st = TAO_OK;
+
+  if (disp == NULL) {
+    return TAO_OK;
+  }
+  // no frame is queued once the callback is cancelled
+  if (disp->eventSet) {
+    int err = ncCamCancelEvent(disp->cam);
+    if (err) {
+      error_push("ncCamCancelEvent", err);
+      st = TAO_ERROR;
+    }
+  }
+  pthread_mutex_lock(&disp->mutex);
+  disp->quit = 1;
+  pthread_cond_broadcast(&disp->work);
+  pthread_mutex_unlock(&disp->mutex);
+  for (int i = 0; i < disp->nbrWorkers; ++i) {
+    pthread_join(disp->workers[i], NULL);
+  }
+  if (disp->cache != NULL) {
+    disp->cache->dispatchers -= 1;
+  }
+  pthread_cond_destroy(&disp->done);
+  pthread_cond_destroy(&disp->work);
+  pthread_mutex_destroy(&disp->mutex);
+  tao_common_frame_buffer_free(&disp->memory);
+  free(disp->ready);
+  free(disp->freeSlots);
+  free(disp->slots);
+  free(disp);
+  return st;
+}
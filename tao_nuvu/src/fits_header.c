@@ -0,0 +1,104 @@
+#include "tao_nuvu.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*---------------------------------------------------------------------------*/
+/* FITS header templates */
+
+tao_status fits_template_create(const nuvu_config_cache* cache, int width,
+                                int height, nuvu_fits_template* tmpl)
+{
+  const nuvu_config* cur = &cache->current;
+  tao_common_fits_header* hdr;
+  tao_status st = TAO_OK;
+
+  memset(tmpl, 0, sizeof(nuvu_fits_template));
+  if (!cache->loaded) {
+    tao_push_error(__func__, TAO_NOT_READY);
+    return TAO_ERROR;
+  }
+  if (tao_common_fits_header_create(TAO_COMMON_UINT16, width, height, 0,
+                                    &hdr) != TAO_OK) {
+    return TAO_ERROR;
+  }
+  // static cards, rendered once for this configuration
+  st |= tao_common_fits_header_add_string(hdr, "INSTRUME", "Nuvu", NULL);
+  st |= tao_common_fits_header_add_int(hdr, "READMODE", cur->readoutMode,
+                                       "readout mode");
+  st |= tao_common_fits_header_add_real(hdr, "EXPTIME", cur->exposureTime*1e-3,
+                                        "exposure time (sec)");
+  st |= tao_common_fits_header_add_real(hdr, "WAITTIME", cur->waitingTime*1e-3,
+                                        "waiting time (sec)");
+  st |= tao_common_fits_header_add_real(hdr, "READTIME", cur->readoutTime*1e-3,
+                                        "readout time (sec)");
+  st |= tao_common_fits_header_add_int(hdr, "ANAGAIN", cur->analogGain,
+                                       "analog gain");
+  st |= tao_common_fits_header_add_int(hdr, "ANAOFFS", cur->analogOffset,
+                                       "analog offset");
+  if (cache->emGainKind != NUVU_EM_GAIN_NONE) {
+    st |= tao_common_fits_header_add_int(hdr, "EMGAIN", cur->emGain,
+                                         (cache->emGainKind == NUVU_EM_GAIN_CALIBRATED
+                                          ? "calibrated EM gain" : "raw EM gain"));
+  }
+  st |= tao_common_fits_header_add_int(hdr, "XBINNING", cur->binX, NULL);
+  st |= tao_common_fits_header_add_int(hdr, "YBINNING", cur->binY, NULL);
+  st |= tao_common_fits_header_add_int(hdr, "ROIWIDTH", cur->roiWidth, NULL);
+  st |= tao_common_fits_header_add_int(hdr, "ROIHEIGH", cur->roiHeight, NULL);
+  st |= tao_common_fits_header_add_real(hdr, "SETTEMP", cur->targetTemp,
+                                        "target detector temperature (C)");
+  // per-frame cards, patched in place
+  tmpl->frameField = tao_common_fits_header_add_field(hdr, "FRAMENUM",
+                                                      TAO_COMMON_FITS_INT, NULL);
+  tmpl->dateField = tao_common_fits_header_add_field(hdr, "DATE-OBS",
+                                                     TAO_COMMON_FITS_DATE,
+                                                     "camera time (UTC)");
+  tmpl->camTimeField = tao_common_fits_header_add_field(hdr, "CAMTIME",
+                                                        TAO_COMMON_FITS_REAL,
+                                                        "camera timer (msec)");
+  tmpl->tempField = tao_common_fits_header_add_field(hdr, "CCD-TEMP",
+                                                     TAO_COMMON_FITS_REAL,
+                                                     "detector temperature (C)");
+  if (st != TAO_OK || tmpl->frameField < 0 || tmpl->dateField < 0 ||
+      tmpl->camTimeField < 0 || tmpl->tempField < 0) {
+    tao_common_fits_header_destroy(hdr);
+    return TAO_ERROR;
+  }
+  pthread_mutex_init(&tmpl->mutex, NULL);
+  tmpl->version = cache->version;
+  tmpl->header = hdr;
+  return TAO_OK;
+}
+
+void fits_template_destroy(nuvu_fits_template* tmpl)
+{
+  if (tmpl->header != NULL) {
+    pthread_mutex_destroy(&tmpl->mutex);
+    tao_common_fits_header_destroy(tmpl->header);
+    tmpl->header = NULL;
+  }
+}
+
+tao_status save_fits_frame(nuvu_fits_template* tmpl, const char* path,
+                           const NcImage* image, long frame,
+                           const nuvu_frame_time* time, double detectorTemp,
+                           void* work)
+{
+  char cards[TAO_COMMON_FITS_MAX_HEADER_SIZE];
+  size_t size;
+
+  // only the patch of the template is serialized, the file is written with
+  // a copy of the header
+  pthread_mutex_lock(&tmpl->mutex);
+  tao_common_fits_header_set_int(tmpl->header, tmpl->frameField, frame);
+  if (time != NULL) {
+    tao_common_fits_header_set_date(tmpl->header, tmpl->dateField,
+                                    time->realtimeTime);
+    tao_common_fits_header_set_real(tmpl->header, tmpl->camTimeField,
+                                    time->cameraTime);
+  }
+  tao_common_fits_header_set_real(tmpl->header, tmpl->tempField, detectorTemp);
+  memcpy(cards, tao_common_fits_header_data(tmpl->header, &size), size);
+  pthread_mutex_unlock(&tmpl->mutex);
+  return tao_common_fits_write_cards(path, tmpl->header, cards, size, image,
+                                     work);
+}
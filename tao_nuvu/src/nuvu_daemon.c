@@ -0,0 +1,624 @@
+// nuvu_daemon.c
+// headless acquisition: frames are published in shared memory for viewers
+// (start_nuvu) which attach read-only and never slow the camera down
+// options
+// 1. -e [exposuretime in msec]
+// 2. -g [analog gain value]
+// 4. -go [analog gain offset]
+// 3. -gem [em gain value]
+// 5. -t [target temperature]
+// 6. -r [degree to rotate]
+// 7. -w [waiting time in msec]
+// 8. -cpu [CPU list of the acquisition thread, e.g. 2,3]
+// 9. -prio [SCHED_FIFO priority of the acquisition thread]
+// 10. -mlock [1 to lock memory]
+// 11. -tp [telemetry polling period in sec]
+// 12. -replay [recorded stream to publish instead of the camera]
+// 13. -fps [replay frame rate, 0 for as fast as possible]
+// 14. -flip [1 to mirror left-right before the rotation]
+// 15. -shm [name of the shared memory, default /tao-nuvu]
+// 16. -slots [number of frames kept in shared memory]
+// 17. -socket [Unix socket serving the frames instead of -shm]
+// 18. -loop [1 to replay the stream again and again]
+
+// -----------------------------------------
+
+#include "tao_nuvu.h"
+#include "tao-common.h"
+#include <math.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WIDTH 128
+#define HEIGHT 128
+
+// global
+NcCam	cam = NULL;
+int degree = 0;
+int flip = 0;
+int orientation = TAO_COMMON_ORIENT_NONE;	// applied to frames when acquired
+tao_common_thread_config acqConfig;		// acquisition thread configuration
+nuvu_telemetry* telemetry = NULL;		// cached camera status
+param_queue* params = NULL;					// settings changed while acquiring
+nuvu_config_cache camCache;					// camera ranges and settings
+double telemetryPeriod = 1.0;
+tao_common_replay* replay = NULL;			// recorded frames instead of the camera
+const char* shmName = "/tao-nuvu";
+int shmSlots = 8;
+tao_common_shm_writer* shm = NULL;		// frames published for the viewers
+const char* socketPath = NULL;
+tao_common_server* server = NULL;			// notifies the clients of -socket
+static volatile sig_atomic_t quit = 0;
+
+// Man page
+void man(){
+	printf(
+"______ nuvu_daemon program ______ \n\
+syntax: -[option] [numeric value] \n\
+1. -e [exposuretime in msec] \n\
+2. -g [analog gain value] \n\
+4. -go [analog gain offset] \n\
+3. -gem [em gain value]\n\
+5. -t [target temperature] \n\
+6. -r [degree to rotate] \n\
+7. -w [waiting time in msec] \n\
+8. -cpu [CPU list of the acquisition thread, e.g. 2,3] \n\
+9. -prio [SCHED_FIFO priority of the acquisition thread] \n\
+10. -mlock [1 to lock memory] \n\
+11. -tp [telemetry polling period in sec] \n\
+12. -replay [recorded stream to publish instead of the camera] \n\
+13. -fps [replay frame rate, 0 for as fast as possible, default is the \n\
+    recorded timing] \n\
+14. -flip [1 to mirror left-right before the rotation] \n\
+15. -shm [name of the shared memory, default /tao-nuvu] \n\
+16. -slots [number of frames kept in shared memory, default 8] \n\
+17. -socket [Unix socket serving the frames instead of -shm, clients get \n\
+    the memory of the frames and a short message per frame] \n\
+18. -loop [1 to replay the stream again and again, by default the daemon \n\
+    stops at its end] \n\
+\n\
+Frames are displayed by start_nuvu, which can be started and stopped at \n\
+any time.  Ctrl-C stops the acquisition. \n\
+\n\
+While running, settings can be changed by typing on the standard input: \n\
+e [msec], w [msec], g [gain], go [offset], gem [em gain], t [temperature] \n\
+\n");
+
+}
+
+// ---Utility funcitonsd---- //
+// Fatal error
+static void fatal_error()
+{
+    fprintf(stderr, "Some fatal error has been encountered...\n");
+    if (tao_any_errors()) {
+        tao_report_errors();
+    }
+    exit(EXIT_FAILURE);
+}
+
+static void stop_handler(int sig)
+{
+	quit = 1;
+}
+
+
+/*------ Camera operations ------- */
+tao_status initialize(NcCam* cam, int argc, char* argv[]){
+   int i;
+	 int array_index = 0;
+	 char* param[argc];
+	 char* val[argc];
+
+	 if (argc > 1){
+		 // read input arguments
+		 for(i = 1; i < argc; i += 2)
+		 {
+			 param[array_index] = argv[i];
+		 	 val[array_index] = argv[i+1];
+			 array_index += 1 ;
+		 }
+	 }
+
+	 // List of parameters
+	 	double readoutTime,
+				   waitingTime,
+					 exposureTime,
+					 temperature;
+		int 	 analogGain,
+					 analogOffset,
+					 emGain = -1;
+		nuvu_config config;
+
+
+	 // do generic initialization
+  tao_status st = TAO_OK;			//We initialize an error flag variable
+
+	// a recorded stream replaces the camera
+	const char* replayPath = NULL;
+	double replayRate = -1;
+	int replayLoop = 0;
+	for(int j =0; j < (argc-1)/2; j++ ){
+		if(strcmp(param[j], "-replay") == 0){
+			replayPath = val[j];
+		}
+		else if (strcmp(param[j], "-fps") == 0){
+			if (sscanf (val[j], "%lf", &replayRate) != 1 || replayRate < 0){
+				printf("replay frame rate should be a non-negative number\n");
+				fatal_error();
+			}
+		}
+		else if (strcmp(param[j], "-loop") == 0){
+			if (sscanf (val[j], "%d", &replayLoop) != 1){
+				printf("loop should be 0 or 1\n");
+				fatal_error();
+			}
+		}
+	}
+	if (replayPath != NULL){
+		tao_common_replay_mode mode = (replayRate < 0 ? TAO_COMMON_REPLAY_ORIGINAL :
+																	 replayRate == 0 ? TAO_COMMON_REPLAY_FAST :
+																	 TAO_COMMON_REPLAY_FIXED);
+		st = tao_common_replay_open(replayPath, mode,
+																(replayRate > 0 ? replayRate : 1.0), replayLoop,
+																&replay);
+		if( st != TAO_OK){
+			 fatal_error();
+		}
+		const tao_common_stream_header* hdr = tao_common_replay_get_header(replay);
+		if (hdr->width != WIDTH || hdr->height != HEIGHT ||
+				tao_common_pixel_size(hdr->pixel_type) != 2){
+			printf("Replayed frames must be %dx%d 16-bit images\n", WIDTH, HEIGHT);
+			fatal_error();
+		}
+		printf("Replaying \"%s\"...\n", replayPath);
+	}
+
+	if (replay == NULL){
+  printf("Open camera...\n" );
+  st = cam_open(NC_AUTO_UNIT, NC_AUTO_CHANNEL, 4, cam);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+
+  // ranges and current settings are queried once
+  st = config_load_cache(*cam, &camCache);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+
+  // geometry first, it gives the readout time used for the defaults
+  config_init(&config);
+  config.mask = NUVU_CONFIG_READOUT_MODE | NUVU_CONFIG_ROI;
+  config.readoutMode = 1;
+  config.roiWidth = WIDTH;
+  config.roiHeight = HEIGHT;
+  st = config_apply(*cam, &camCache, &config, NULL);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  readoutTime = config.readoutTime;
+	printf("Estimated readout time = %lf msec\n", readoutTime);
+
+	/* =====assign defaults values to parameters ======== */
+	exposureTime = readoutTime;
+	waitingTime = 0.1 * exposureTime;
+	temperature = -60.0;
+	if (temperature < camCache.tempMin)
+		temperature = camCache.tempMin;
+	if (temperature > camCache.tempMax)
+		temperature = camCache.tempMax;
+	analogGain = (camCache.analogGainMin + camCache.analogGainMax) / 2;
+	analogOffset = (camCache.analogOffsetMin + camCache.analogOffsetMax) / 2;
+	}
+
+	//#======== iterate over the list of options ================#/
+
+	char* op;
+
+	for(int j =0; j < (argc-1)/2; j++ ){
+		 op = param[j];
+
+		 // exposure time
+		if(strcmp(op, "-e") == 0){
+			if (sscanf (val[j], "%lf", &exposureTime) != 1){
+				printf("exposure time should be a floating point number\n");
+			  fatal_error();
+			}
+		}
+		// analog gain
+		else if (strcmp(op, "-g") == 0){
+			if (sscanf (val[j], "%d", &analogGain) != 1){
+				printf("analog gain should be an integer\n");
+				fatal_error();
+			}
+		}
+		// em gain
+		else if (strcmp(op, "-gem") == 0){
+			if (sscanf (val[j], "%d", &emGain) != 1){
+				printf("EM gain should be an integer\n");
+				fatal_error();
+			}
+		}
+		// analog gain offset
+		else if (strcmp(op, "-go") == 0){
+			if (sscanf (val[j], "%d", &analogOffset) != 1){
+				printf("analog offset should be an integer\n");
+				fatal_error();
+			}
+		}
+		else if (strcmp(op, "-t") == 0){
+			if (sscanf (val[j], "%lf", &temperature) != 1){
+				printf("temperature should be a floating point number\n");
+				fatal_error();
+			}
+
+		}
+		else if (strcmp(op, "-r") == 0){
+			if (sscanf (val[j], "%d", &degree) != 1){
+				printf("degree should be an interger\n");
+				fatal_error();
+			}
+			if(degree%90 != 0){
+				printf("Degree must be 90-degree interger\n");
+				return 0;
+			}
+			else
+			printf("Image will be rotated %d CW\n", degree);
+		}
+		else if (strcmp(op, "-flip") == 0){
+			if (sscanf (val[j], "%d", &flip) != 1){
+				printf("flip should be 0 or 1\n");
+				fatal_error();
+			}
+		}
+		else if (strcmp(op, "-w") == 0){
+			if (sscanf (val[j], "%lf", &waitingTime) != 1){
+				printf("waiting time should be a floating point number\n");
+				fatal_error();
+			}
+		}
+		// acquisition thread configuration
+		else if (strcmp(op, "-cpu") == 0){
+			if (tao_common_thread_config_parse_cpus(&acqConfig, val[j]) != TAO_OK){
+				fatal_error();
+			}
+		}
+		else if (strcmp(op, "-prio") == 0){
+			if (sscanf (val[j], "%d", &acqConfig.priority) != 1){
+				printf("priority should be an integer\n");
+				fatal_error();
+			}
+		}
+		else if (strcmp(op, "-mlock") == 0){
+			if (sscanf (val[j], "%d", &acqConfig.lock_memory) != 1){
+				printf("mlock should be 0 or 1\n");
+				fatal_error();
+			}
+		}
+		else if (strcmp(op, "-tp") == 0){
+			if (sscanf (val[j], "%lf", &telemetryPeriod) != 1 || telemetryPeriod <= 0){
+				printf("telemetry period should be a positive number\n");
+				fatal_error();
+			}
+		}
+		else if (strcmp(op, "-shm") == 0){
+			shmName = val[j];
+		}
+		else if (strcmp(op, "-socket") == 0){
+			socketPath = val[j];
+		}
+		else if (strcmp(op, "-slots") == 0){
+			if (sscanf (val[j], "%d", &shmSlots) != 1 || shmSlots < 2){
+				printf("number of slots should be at least 2\n");
+				fatal_error();
+			}
+		}
+		else if (strcmp(op, "-replay") == 0 || strcmp(op, "-fps") == 0 ||
+						 strcmp(op, "-loop") == 0){
+			// already handled
+		}
+
+
+	} // end option loop
+
+	// frames are oriented once in the acquisition thread, not when drawn
+	orientation = tao_common_orientation_from_degrees(degree, flip);
+
+	// no camera settings to apply when replaying
+	if (replay != NULL){
+		printf("initialization is complete.\n" );
+		return st;
+	}
+
+	// # =============== apply all settings at once ============== #//
+	config.mask = (NUVU_CONFIG_EXPOSURE_TIME | NUVU_CONFIG_WAITING_TIME |
+								 NUVU_CONFIG_ANALOG_GAIN | NUVU_CONFIG_ANALOG_OFFSET |
+								 NUVU_CONFIG_TARGET_TEMP);
+	config.exposureTime = exposureTime;
+	config.waitingTime = waitingTime;
+	config.analogGain = analogGain;
+	config.analogOffset = analogOffset;
+	config.targetTemp = temperature;
+	if (emGain >= 0){
+		config.mask |= NUVU_CONFIG_EM_GAIN;
+		config.emGain = emGain;
+	}
+	st = config_apply(*cam, &camCache, &config, stdout);
+	if( st != TAO_OK){
+		 fatal_error();
+	}
+
+	// the acquisition thread applies later changes between frames
+	st = param_queue_create(&camCache, &params);
+	if( st != TAO_OK){
+		 fatal_error();
+	}
+
+	// poll the camera status in the background
+	st = telemetry_start(*cam, telemetryPeriod, NULL, &telemetry);
+	if( st != TAO_OK){
+		 fatal_error();
+	}
+
+  printf("initialization is complete.\n" );
+
+  return st;
+
+}
+
+// acquisition
+// grab NcImage (unsigned short *), or take the replayed frame `data`
+// the frame is oriented directly in the shared memory slot `dst`
+tao_status acquisition(NcCam cam, const void* data, uint16_t* dst,
+											 tao_common_frame_info* info){
+  tao_status  st = TAO_OK;
+	NcImage* _image_handle; // 1-D array pointer 16 bpp
+
+	// recorded frames come at their own pace, see acquisitionLoop
+	if (data == NULL){
+  // start acquisition
+  st = cam_take_image(cam);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+	// wait image: blocking style Ok for separate thread
+	// FIXME: bad practice
+	int isacquiring = 1;
+	while (isacquiring){
+		ncCamIsAcquiring(cam, &isacquiring);
+	}
+
+	// read image
+	st = read_uint16_image(cam, &_image_handle)  ;
+	if(st != TAO_OK){
+		fatal_error();
+	}
+	data = _image_handle;
+	info->host_time = tao_common_monotonic_time();
+	info->camera_time = 0;
+	}
+	info->orientation = orientation;
+
+	// frames are square, their size does not depend on the orientation
+	st = tao_common_orient(NULL, dst, data, WIDTH, HEIGHT, TAO_COMMON_UINT16,
+												 orientation);
+	if(st != TAO_OK){
+		fatal_error();
+	}
+
+  return st;
+
+}
+
+// camera status (cached values, no driver call)
+void print_status(void){
+
+		nuvu_telemetry_data status;
+		if (server != NULL){
+			printf("Clients = %d \n", tao_common_server_clients(server));
+		}
+		if (replay != NULL){
+			printf("Replay lag = %.3f msec \n", tao_common_replay_max_lag(replay)*1e-6);
+			return;
+		}
+		telemetry_read(telemetry, &status);
+		printf("Temperature = %ld \n", (long)status.detectorTemp );
+		printf("Frame rate = %lf, dropped images = %d \n", status.framerate,
+					 status.droppedImages);
+
+}
+
+// --- worker functions --- //
+// acquisition routine
+void* acquisitionLoop(void* arg)
+{
+  // open shutter
+	tao_status st = TAO_OK;
+  enum ShutterMode mode = OPEN;
+  if (replay == NULL) {
+    st = set_shuttermode(cam, mode);
+    if (st != TAO_OK) {
+      fatal_error();
+    }
+  }
+	long frame = 0;
+	while (!quit){
+		// apply the settings requested since the previous frame, the last
+		// frame read is frame - 1
+		if (params != NULL){
+			param_queue_apply(params, cam, frame - 1, 0);
+		}
+
+		tao_common_frame_info info;
+		info.id = frame;
+		// the replayed frame is fetched before a slot is taken: the end of a
+		// stream which does not loop stops the daemon as Ctrl-C
+		const void* replayed = NULL;
+		if (replay != NULL){
+			st = tao_common_replay_next(replay, &replayed, &info);
+			if (st != TAO_OK){
+				fatal_error();
+			}
+			if (replayed == NULL){
+				printf("End of the replayed stream\n");
+				quit = 1;
+				break;
+			}
+		}
+		uint16_t* slot = tao_common_shm_begin(shm);
+		st = acquisition(cam, replayed, slot, &info);
+		if (st != TAO_OK) {
+	    fatal_error();
+	  }
+		tao_common_shm_end(shm, &info);
+		if (server != NULL){
+			tao_common_server_notify(server);
+		}
+		frame++;
+	}
+
+	printf("Finishing...\n");
+	return NULL;
+}
+
+// --- Finalizer --- //
+// after the acquisition thread, the status is no longer printed
+void finalize(void){
+	tao_status st;
+
+	telemetry_stop(telemetry);
+	telemetry = NULL;
+	if (replay != NULL){
+		return;
+	}
+	// close shutter
+  st = set_shuttermode(cam, CLOSE);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+
+	st = cam_close(cam);
+  if(st != TAO_OK){
+    fatal_error();
+  }
+}
+
+
+// settings typed on the standard input are queued for the acquisition thread
+void* commandReader(void* arg)
+{
+	char line[128], op[8];
+	double value;
+	nuvu_param param;
+
+	while (fgets(line, sizeof(line), stdin) != NULL){
+		if (sscanf(line, "%7s %lf", op, &value) != 2){
+			printf("syntax: [e|w|g|go|gem|t] [value]\n");
+			continue;
+		}
+		if (strcmp(op, "e") == 0)
+			param = NUVU_PARAM_EXPOSURE_TIME;
+		else if (strcmp(op, "w") == 0)
+			param = NUVU_PARAM_WAITING_TIME;
+		else if (strcmp(op, "g") == 0)
+			param = NUVU_PARAM_ANALOG_GAIN;
+		else if (strcmp(op, "go") == 0)
+			param = NUVU_PARAM_ANALOG_OFFSET;
+		else if (strcmp(op, "gem") == 0)
+			param = NUVU_PARAM_EM_GAIN;
+		else if (strcmp(op, "t") == 0)
+			param = NUVU_PARAM_TARGET_TEMP;
+		else {
+			printf("unknown setting %s\n", op);
+			continue;
+		}
+		long frame = -1;
+		long ticket = param_queue_push(params, param, value, 0);
+		if (ticket > 0 && param_queue_wait(params, param, ticket, &frame) == TAO_OK)
+			printf("%s = %g effective from frame %ld\n", op, value, frame);
+		else
+			printf("%s = %g failed\n", op, value);
+	}
+	return NULL;
+}
+
+int main(int argc, char* argv[]) {
+	// check --help
+	if (argc > 1) {
+		if(!strcmp("--help",argv[1]) && (argc == 2)){
+			man();
+			return 0;
+		}
+		else if (!strcmp("--help",argv[1]) || (argc == 2)){
+			printf("Wrong argument. use --help to see the manual\n");
+			return 0;
+		}
+		else {
+			*argv = NULL;
+		}
+	}
+
+	// Ctrl-C and kill stop the acquisition cleanly, only the main thread
+	// gets the signals so that no driver call is interrupted
+	struct sigaction action;
+	sigset_t stopSignals;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stop_handler;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	sigemptyset(&stopSignals);
+	sigaddset(&stopSignals, SIGINT);
+	sigaddset(&stopSignals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stopSignals, NULL);
+
+	tao_common_thread_config_init(&acqConfig);
+	acqConfig.name = "nuvu-acq";
+	acqConfig.stack_prefault = 64*1024;
+ 	initialize(&cam, argc, argv);
+
+	// the ring is faulted in here, before the acquisition starts
+	if (socketPath != NULL){
+		if (tao_common_shm_create_anonymous(WIDTH, HEIGHT, TAO_COMMON_UINT16,
+																				shmSlots, &shm) != TAO_OK ||
+				tao_common_server_create(socketPath, shm, &server) != TAO_OK){
+			fatal_error();
+		}
+		printf("Serving frames on \"%s\"...\n", socketPath);
+	}
+	else {
+		if (tao_common_shm_create(shmName, WIDTH, HEIGHT, TAO_COMMON_UINT16,
+															shmSlots, &shm) != TAO_OK){
+			fatal_error();
+		}
+		printf("Publishing frames in \"%s\"...\n", shmName);
+	}
+
+	pthread_t acqThread;
+	if(tao_common_thread_create(&acqThread, &acqConfig, acquisitionLoop, NULL) != TAO_OK){
+		fatal_error();
+	}
+	pthread_t commandThread;
+	if(params != NULL &&
+		 pthread_create(&commandThread, NULL, commandReader, NULL) == 0){
+		pthread_detach(commandThread);
+	}
+	pthread_sigmask(SIG_UNBLOCK, &stopSignals, NULL);
+
+	// status every 5 seconds
+	int ticks = 0;
+	while (!quit){
+		sleep(1);
+		if (++ticks%5 == 0 && !quit){
+			print_status();
+		}
+	}
+	pthread_join(acqThread, NULL);
+	finalize();
+	tao_common_server_destroy(server);
+	tao_common_shm_close(shm);
+	tao_common_replay_close(replay);
+
+  return EXIT_SUCCESS;
+}
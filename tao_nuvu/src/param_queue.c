@@ -0,0 +1,256 @@
+#include "tao_nuvu.h"
+#include <errno.h>
+
+/*---------------------------------------------------------------------------*/
+/* Queued parameter updates */
+
+// Settings that cannot be changed while the camera is streaming
+static const int needsRestart[NUVU_NBR_PARAMS] = {
+  [NUVU_PARAM_READOUT_MODE] = 1,
+  [NUVU_PARAM_ROI] = 1,
+};
+
+// Field of the batch configuration of each setting
+static const unsigned configBits[NUVU_NBR_PARAMS] = {
+  [NUVU_PARAM_READOUT_MODE] = NUVU_CONFIG_READOUT_MODE,
+  [NUVU_PARAM_EXPOSURE_TIME] = NUVU_CONFIG_EXPOSURE_TIME,
+  [NUVU_PARAM_WAITING_TIME] = NUVU_CONFIG_WAITING_TIME,
+  [NUVU_PARAM_ANALOG_GAIN] = NUVU_CONFIG_ANALOG_GAIN,
+  [NUVU_PARAM_ANALOG_OFFSET] = NUVU_CONFIG_ANALOG_OFFSET,
+  [NUVU_PARAM_EM_GAIN] = NUVU_CONFIG_EM_GAIN,
+  [NUVU_PARAM_TARGET_TEMP] = NUVU_CONFIG_TARGET_TEMP,
+  [NUVU_PARAM_ROI] = NUVU_CONFIG_ROI,
+};
+
+static const char* paramNames[NUVU_NBR_PARAMS] = {
+  [NUVU_PARAM_READOUT_MODE] = "readout mode",
+  [NUVU_PARAM_EXPOSURE_TIME] = "exposure time",
+  [NUVU_PARAM_WAITING_TIME] = "waiting time",
+  [NUVU_PARAM_ANALOG_GAIN] = "analog gain",
+  [NUVU_PARAM_ANALOG_OFFSET] = "analog offset",
+  [NUVU_PARAM_EM_GAIN] = "EM gain",
+  [NUVU_PARAM_TARGET_TEMP] = "target temperature",
+  [NUVU_PARAM_ROI] = "ROI",
+};
+
+typedef struct param_slot {
+  double value[2];       // requested value (ROI uses both)
+  int pending;           // a value has been requested
+  long ticket;           // ticket of the pending request
+  long appliedTicket;    // last ticket that took effect
+  long appliedFrame;     // first frame read after it, see param_queue_wait
+  tao_status appliedStatus;
+} param_slot;
+
+struct param_queue {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  nuvu_config_cache* cache; // settings of the camera
+  int pending;           // any pending request (read without lock)
+  long lastTicket;
+  param_slot slots[NUVU_NBR_PARAMS];
+  long restarts;         // number of stop/restart cycles
+};
+
+tao_status param_queue_create(nuvu_config_cache* cache, param_queue** queue_ptr)
+{
+  *queue_ptr = NULL;
+  if (!cache->loaded) {
+    tao_push_error(__func__, TAO_NOT_READY);
+    return TAO_ERROR;
+  }
+  param_queue* queue = calloc(1, sizeof(param_queue));
+  if (queue == NULL) {
+    tao_push_error(__func__, errno);
+    return TAO_ERROR;
+  }
+  queue->cache = cache;
+  pthread_mutex_init(&queue->mutex, NULL);
+  pthread_cond_init(&queue->cond, NULL);
+  for (int i = 0; i < NUVU_NBR_PARAMS; i++) {
+    queue->slots[i].appliedFrame = -1;
+  }
+  *queue_ptr = queue;
+  return TAO_OK;
+}
+
+void param_queue_destroy(param_queue* queue)
+{
+  if (queue != NULL) {
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+  }
+}
+
+long param_queue_push(param_queue* queue, nuvu_param param,
+                      double value1, double value2)
+{
+  long ticket;
+  if (param < 0 || param >= NUVU_NBR_PARAMS) {
+    tao_push_error(__func__, TAO_BAD_VALUE);
+    return -1;
+  }
+  param_slot* slot = &queue->slots[param];
+  pthread_mutex_lock(&queue->mutex);
+  // a newer request for the same setting replaces the pending one
+  ticket = ++queue->lastTicket;
+  slot->value[0] = value1;
+  slot->value[1] = value2;
+  slot->ticket = ticket;
+  slot->pending = 1;
+  __atomic_store_n(&queue->pending, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&queue->mutex);
+  return ticket;
+}
+
+// Store a requested value in a batch configuration
+static void set_field(nuvu_config* cfg, nuvu_param param, const double* value)
+{
+  cfg->mask |= configBits[param];
+  switch (param) {
+  case NUVU_PARAM_READOUT_MODE:
+    cfg->readoutMode = (int)value[0];
+    break;
+  case NUVU_PARAM_EXPOSURE_TIME:
+    cfg->exposureTime = value[0];
+    break;
+  case NUVU_PARAM_WAITING_TIME:
+    cfg->waitingTime = value[0];
+    break;
+  case NUVU_PARAM_ANALOG_GAIN:
+    cfg->analogGain = (int)value[0];
+    break;
+  case NUVU_PARAM_ANALOG_OFFSET:
+    cfg->analogOffset = (int)value[0];
+    break;
+  case NUVU_PARAM_EM_GAIN:
+    cfg->emGain = (int)value[0];
+    break;
+  case NUVU_PARAM_TARGET_TEMP:
+    cfg->targetTemp = value[0];
+    break;
+  case NUVU_PARAM_ROI:
+    cfg->roiWidth = (int)value[0];
+    cfg->roiHeight = (int)value[1];
+    break;
+  default:
+    break;
+  }
+}
+
+tao_status param_queue_apply(param_queue* queue, NcCam cam, long frame,
+                             int streaming)
+{
+  tao_status status = TAO_OK;
+  int todo[NUVU_NBR_PARAMS];
+  long ticket[NUVU_NBR_PARAMS];
+  nuvu_config cfg;
+  int restart = 0, n = 0;
+
+  // cheap test done once per frame
+  if (!__atomic_load_n(&queue->pending, __ATOMIC_ACQUIRE)) {
+    return TAO_OK;
+  }
+
+  // take the pending requests, dropping those that change nothing; the cache
+  // is only modified by this thread
+  config_init(&cfg);
+  pthread_mutex_lock(&queue->mutex);
+  queue->pending = 0;
+  for (int i = 0; i < NUVU_NBR_PARAMS; i++) {
+    param_slot* slot = &queue->slots[i];
+    if (!slot->pending) {
+      continue;
+    }
+    slot->pending = 0;
+    nuvu_config one;
+    config_init(&one);
+    set_field(&one, i, slot->value);
+    if (config_changes(&one, queue->cache) == 0) {
+      // nothing to do, the next frame has the value as any applied request
+      slot->appliedTicket = slot->ticket;
+      slot->appliedFrame = frame + 1;
+      slot->appliedStatus = TAO_OK;
+      continue;
+    }
+    set_field(&cfg, i, slot->value);
+    todo[n] = i;
+    ticket[n] = slot->ticket;
+    restart |= needsRestart[i];
+    n++;
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  if (n == 0) {
+    pthread_cond_broadcast(&queue->cond);
+    return TAO_OK;
+  }
+
+  // only stop the acquisition when a setting requires it
+  restart &= (streaming != 0);
+  if (restart && cam_abort(cam) != TAO_OK) {
+    status = TAO_ERROR;
+  }
+  // the batch keeps the cache (and the timeout) in step with the camera
+  if (config_apply(cam, queue->cache, &cfg, NULL) != TAO_OK) {
+    status = TAO_ERROR;
+  }
+  for (int k = 0; k < n; k++) {
+    if (!(cfg.applied & configBits[todo[k]])) {
+      fprintf(stderr, "Cannot change %s at frame %ld\n",
+              paramNames[todo[k]], frame);
+    }
+  }
+  if (restart) {
+    queue->restarts++;
+    if (cam_start(cam, 0) != TAO_OK) {
+      status = TAO_ERROR;
+    }
+  }
+
+  // the next frame read is the first one acquired with the new settings when
+  // each frame is requested or the acquisition restarted; while streaming,
+  // the frames buffered by the driver were exposed before, so it is a lower
+  // bound (see param_queue_wait)
+  pthread_mutex_lock(&queue->mutex);
+  for (int k = 0; k < n; k++) {
+    param_slot* slot = &queue->slots[todo[k]];
+    slot->appliedTicket = ticket[k];
+    slot->appliedFrame = frame + 1;
+    slot->appliedStatus = ((cfg.applied & configBits[todo[k]]) ?
+                           TAO_OK : TAO_ERROR);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+  pthread_cond_broadcast(&queue->cond);
+  return status;
+}
+
+tao_status param_queue_wait(param_queue* queue, nuvu_param param, long ticket,
+                            long* frame_ptr)
+{
+  tao_status status;
+  if (param < 0 || param >= NUVU_NBR_PARAMS || ticket <= 0) {
+    tao_push_error(__func__, TAO_BAD_VALUE);
+    return TAO_ERROR;
+  }
+  param_slot* slot = &queue->slots[param];
+  pthread_mutex_lock(&queue->mutex);
+  while (slot->appliedTicket < ticket) {
+    pthread_cond_wait(&queue->cond, &queue->mutex);
+  }
+  if (frame_ptr != NULL) {
+    *frame_ptr = slot->appliedFrame;
+  }
+  status = slot->appliedStatus;
+  pthread_mutex_unlock(&queue->mutex);
+  return status;
+}
+
+long param_queue_restarts(param_queue* queue)
+{
+  long n;
+  pthread_mutex_lock(&queue->mutex);
+  n = queue->restarts;
+  pthread_mutex_unlock(&queue->mutex);
+  return n;
+}
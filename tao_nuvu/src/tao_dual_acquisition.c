@@ -0,0 +1,514 @@
+// tao_dual_acquisition.c
+// Synchronized acquisition of the Nuvu and Grasshopper cameras
+// options
+// 1. -m [duration in minutes]
+// 2. -e [Nuvu exposuretime in msec]
+// 3. -tol [pairing tolerance in msec]
+// 4. -ncpu [CPU list of the Nuvu thread, e.g. 2]
+// 5. -gcpu [CPU list of the Grasshopper thread, e.g. 3]
+// 6. -mcpu [CPU list of the merging thread]
+// 7. -prio [SCHED_FIFO priority of the camera threads]
+// 8. -mlock [1 to lock memory]
+// 9. -rec [prefix of the recorded streams]
+// 10. -o [CSV file of the paired frames]
+// 11. -ge [Grasshopper exposuretime in msec, automatic by default]
+
+// -----------------------------------------
+
+#include "tao_nuvu.h"
+#include "tao-common.h"
+#include "tao-spinnaker.h"
+#include <math.h>
+
+#define NUVU 0
+#define GRASSHOPPER 1
+#define RECORDER_SLOTS 32                 // frames waiting to be written
+
+/* State of a camera thread */
+typedef struct camera_thread {
+  const char* name;
+  tao_common_thread_config config;
+  tao_common_clock_map clock;       // camera time to CLOCK_MONOTONIC
+  tao_common_stream_writer* stream; // recorded frames, NULL if not recording
+  tao_common_recorder* recorder;    // writes them out of the camera thread
+  long frames;
+  long incomplete;
+  volatile int done;
+} camera_thread;
+
+/* Settings and shared state */
+typedef struct dual_acquisition {
+  NcCam cam;
+  spinSystem system;
+  spinCameraList cameraList;
+  spinCamera camera;
+  double minutes;
+  double exposureTime;
+  double ghExposureTime;            // msec, < 0 for automatic
+  double tolerance;                 // msec
+  const char* prefix;
+  const char* output;
+  tao_common_thread_config mergerConfig;
+  int64_t endTime;
+  tao_common_merger* merger;
+  camera_thread thread[2];
+} dual_acquisition;
+
+/* Fatal error */
+static void fatal_error()
+{
+    fprintf(stderr, "Some fatal error has been encountered...\n");
+    if (tao_any_errors()) {
+        tao_report_errors();
+    }
+    exit(EXIT_FAILURE);
+}
+
+// Man page
+static void man(){
+	printf(
+"______ tao_dual_acquisition program ______ \n\
+syntax: -[option] [value] \n\
+1. -m [duration in minutes] \n\
+2. -e [Nuvu exposuretime in msec] \n\
+3. -tol [pairing tolerance in msec] \n\
+4. -ncpu [CPU list of the Nuvu thread, e.g. 2] \n\
+5. -gcpu [CPU list of the Grasshopper thread, e.g. 3] \n\
+6. -mcpu [CPU list of the merging thread] \n\
+7. -prio [SCHED_FIFO priority of the camera threads] \n\
+8. -mlock [1 to lock memory] \n\
+9. -rec [prefix of the recorded streams] \n\
+10. -o [CSV file of the paired frames] \n\
+11. -ge [Grasshopper exposuretime in msec, automatic by default] \n\
+\n");
+}
+
+/*------ Camera operations ------- */
+static void open_nuvu(dual_acquisition* acq)
+{
+  tao_status st = TAO_OK;
+  double readoutTime;
+
+  printf("Open Nuvu camera...\n" );
+  st = cam_open(NC_AUTO_UNIT, NC_AUTO_CHANNEL, 4, &acq->cam);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = set_readout_mode(acq->cam, 1);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = get_readout_time(acq->cam, &readoutTime);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  if (acq->exposureTime < 0) {
+    acq->exposureTime = readoutTime;
+  }
+  st = set_exposure_time(acq->cam, acq->exposureTime);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = set_waiting_time(acq->cam, 0.0);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = set_timeout(acq->cam, (int)(readoutTime + acq->exposureTime) + 1000);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+}
+
+static void open_grasshopper(dual_acquisition* acq)
+{
+  spinNodeMapHandle nodeMap = NULL;
+  tao_spinnaker_node_cache* nodes = NULL;
+
+  printf("Open Grasshopper camera...\n" );
+  if (tao_spinnaker_system_get_instance(&acq->system) != TAO_OK ||
+      tao_spinnaker_camera_list_create_empty(&acq->cameraList) != TAO_OK ||
+      tao_spinnaker_get_cameras_from_system(acq->system, acq->cameraList) != TAO_OK) {
+    fatal_error();
+  }
+  if (tao_spinnaker_camera_list_get_size(acq->cameraList) < 1) {
+    printf("No Spinnaker camera found\n");
+    fatal_error();
+  }
+  if (tao_spinnaker_camera_list_get(acq->cameraList, 0, &acq->camera) != TAO_OK ||
+      tao_spinnaker_camera_init(acq->camera) != TAO_OK ||
+      tao_spinnaker_camera_get_nodemap(acq->camera, &nodeMap) != TAO_OK ||
+      tao_spinnaker_node_cache_create(nodeMap, &nodes) != TAO_OK) {
+    fatal_error();
+  }
+  // continuous acquisition
+  if (tao_spinnaker_set_enum(nodes, "AcquisitionMode", "Continuous") != TAO_OK) {
+    fatal_error();
+  }
+  if (acq->ghExposureTime >= 0) {
+    // the range of ExposureTime is only known once ExposureAuto is off
+    double minTime, maxTime;
+    if (tao_spinnaker_set_enum(nodes, "ExposureAuto", "Off") != TAO_OK ||
+        tao_spinnaker_get_float_range(nodes, "ExposureTime", &minTime,
+                                      &maxTime) != TAO_OK) {
+      fatal_error();
+    }
+    double exposureTime = acq->ghExposureTime*1e3;
+    if (exposureTime < minTime || exposureTime > maxTime) {
+      printf("Grasshopper exposure time should be in [%g,%g] msec\n",
+             minTime*1e-3, maxTime*1e-3);
+      fatal_error();
+    }
+    if (tao_spinnaker_set_float(nodes, "ExposureTime", exposureTime) != TAO_OK) {
+      fatal_error();
+    }
+  }
+  tao_spinnaker_node_cache_destroy(nodes);
+}
+
+static void close_cameras(dual_acquisition* acq)
+{
+  if (acq->cam != NULL) {
+    cam_close(acq->cam);
+  }
+  if (acq->camera != NULL) {
+    tao_spinnaker_camera_deinit(acq->camera);
+    tao_spinnaker_camera_release(acq->camera);
+  }
+  if (acq->cameraList != NULL) {
+    tao_spinnaker_camera_list_destroy(acq->cameraList);
+  }
+  if (acq->system != NULL) {
+    tao_spinnaker_system_release_instance(acq->system);
+  }
+}
+
+// Map the camera time stamp of a frame to the host clock and hand it over
+// to the merger.  The host time is taken right after the frame is received.
+static void publish(dual_acquisition* acq, int source, uint64_t id,
+                    int64_t cameraTime, const void* data)
+{
+  camera_thread* t = &acq->thread[source];
+  tao_common_frame_info info;
+
+  tao_common_clock_map_update(&t->clock, cameraTime, tao_common_monotonic_time());
+  info.id = id;
+  info.host_time = tao_common_clock_map_to_host(&t->clock, cameraTime);
+  info.camera_time = cameraTime;
+  info.orientation = TAO_COMMON_ORIENT_NONE;
+  // the disk is never waited for, a frame is dropped if it cannot keep up
+  if (t->recorder != NULL && tao_common_recorder_push(t->recorder, data, &info) != TAO_OK) {
+    fatal_error();
+  }
+  tao_common_merger_push(acq->merger, source, &info);
+  t->frames++;
+}
+
+// Nuvu acquisition thread
+static void* nuvu_loop(void* arg)
+{
+  dual_acquisition* acq = arg;
+  tao_status st = TAO_OK;
+  NcImage* image;
+  double camTime;
+  uint64_t id = 0;
+
+  st = reset_timer(acq->cam, 0.0);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  st = set_shuttermode(acq->cam, OPEN);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  st = cam_start(acq->cam, 0);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  while (tao_common_monotonic_time() < acq->endTime) {
+    st = read_timed_image(acq->cam, &image, &camTime);
+    if (st != TAO_OK) {
+      fatal_error();
+    }
+    // camera time is in msec
+    publish(acq, NUVU, id++, (int64_t)(camTime*1e6), image);
+  }
+  cam_abort(acq->cam);
+  set_shuttermode(acq->cam, CLOSE);
+  acq->thread[NUVU].done = 1;
+  return NULL;
+}
+
+// Grasshopper acquisition thread
+static void* grasshopper_loop(void* arg)
+{
+  dual_acquisition* acq = arg;
+  camera_thread* t = &acq->thread[GRASSHOPPER];
+  tao_spinnaker_image_info info;
+  spinImage image = NULL;
+  void* rows = NULL;
+
+  if (tao_spinnaker_camera_begin_acquisition(acq->camera) != TAO_OK) {
+    fatal_error();
+  }
+  while (tao_common_monotonic_time() < acq->endTime) {
+    if (tao_spinnaker_camera_get_next_image(acq->camera, 1000, &image) != TAO_OK ||
+        tao_spinnaker_image_get_info(image, &info) != TAO_OK) {
+      fatal_error();
+    }
+    if (info.incomplete) {
+      t->incomplete++;
+      tao_spinnaker_image_release(image);
+      continue;
+    }
+    const void* data = info.data;
+    if (acq->prefix != NULL) {
+      size_t rowSize = info.width*((info.bits_per_pixel + 7)/8);
+      if (t->stream == NULL) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s-grasshopper.tfs", acq->prefix);
+        if (tao_common_stream_create(path, info.width, info.height,
+                                     (info.bits_per_pixel > 8 ?
+                                      TAO_COMMON_UINT16 : TAO_COMMON_UINT8),
+                                     "Grasshopper", "dual acquisition",
+                                     &t->stream) != TAO_OK ||
+            tao_common_recorder_create(t->stream, RECORDER_SLOTS, 1, NULL,
+                                       &t->recorder) != TAO_OK) {
+          fatal_error();
+        }
+        rows = malloc(rowSize*info.height);
+        if (rows == NULL) {
+          fatal_error();
+        }
+      }
+      // streams store contiguous rows
+      if (info.stride != rowSize) {
+        for (size_t y = 0; y < info.height; y++) {
+          memcpy((char*)rows + y*rowSize, (char*)info.data + y*info.stride, rowSize);
+        }
+        data = rows;
+      }
+    }
+    publish(acq, GRASSHOPPER, info.frame_id, (int64_t)info.timestamp, data);
+    tao_spinnaker_image_release(image);
+  }
+  tao_spinnaker_camera_end_acquisition(acq->camera);
+  free(rows);
+  t->done = 1;
+  return NULL;
+}
+
+/*------ Merging ------- */
+static void merge(dual_acquisition* acq)
+{
+  FILE* file = NULL;
+  tao_common_merged out;
+  long pairs = 0, alone[2] = {0, 0};
+  double sumDt = 0, maxDt = 0;
+
+  if (acq->output != NULL) {
+    file = fopen(acq->output, "w");
+    if (file == NULL) {
+      printf("Cannot open \"%s\"\n", acq->output);
+      fatal_error();
+    }
+    fprintf(file, "nuvu_frame,grasshopper_frame,nuvu_ns,grasshopper_ns,dt_us\n");
+  }
+  // until both cameras are done and all frames are merged, waiting longer
+  // than a frame may wait for its partner
+  double timeout = 10*acq->tolerance*1e-3 + 0.1;
+  while (1) {
+    int done = acq->thread[NUVU].done && acq->thread[GRASSHOPPER].done;
+    if (!tao_common_merger_pop(acq->merger, &out, timeout)) {
+      if (done) {
+        break;
+      }
+      continue;
+    }
+    if (out.mask != 3) {
+      alone[out.mask == 1 ? NUVU : GRASSHOPPER]++;
+      continue;
+    }
+    double dt = (out.frame[GRASSHOPPER].host_time - out.frame[NUVU].host_time)/1e3;
+    sumDt += fabs(dt);
+    maxDt = (fabs(dt) > maxDt ? fabs(dt) : maxDt);
+    pairs++;
+    if (file != NULL) {
+      fprintf(file, "%llu,%llu,%lld,%lld,%.3f\n",
+              (unsigned long long)out.frame[NUVU].id,
+              (unsigned long long)out.frame[GRASSHOPPER].id,
+              (long long)out.frame[NUVU].host_time,
+              (long long)out.frame[GRASSHOPPER].host_time, dt);
+    }
+  }
+  if (file != NULL) {
+    fclose(file);
+  }
+
+  printf("\n===== Dual acquisition =====\n");
+  for (int s = 0; s < 2; s++) {
+    const camera_thread* t = &acq->thread[s];
+    printf("%-12s frames = %8ld  unpaired = %8ld  lost = %6llu  "
+           "incomplete = %6ld  clock drift = %+8.3f ppm\n", t->name,
+           t->frames, alone[s],
+           (unsigned long long)tao_common_merger_lost(acq->merger, s),
+           t->incomplete, tao_common_clock_map_drift(&t->clock));
+  }
+  printf("pairs = %ld (tolerance %.3f msec), mean |dt| = %.3f usec, "
+         "max |dt| = %.3f usec\n", pairs, acq->tolerance,
+         (pairs > 0 ? sumDt/pairs : 0), maxDt);
+}
+
+static void parse_cpus(tao_common_thread_config* cfg, const char* val)
+{
+  if (tao_common_thread_config_parse_cpus(cfg, val) != TAO_OK){
+    fatal_error();
+  }
+}
+
+int main(int argc, char* argv[]) {
+  dual_acquisition acq;
+  pthread_t threads[2];
+  int priority = 0, lockMemory = 0;
+
+  memset(&acq, 0, sizeof(acq));
+  acq.minutes = 1.0;
+  acq.exposureTime = -1;
+  acq.ghExposureTime = -1;
+  acq.tolerance = 1.0;
+  for (int s = 0; s < 2; s++) {
+    tao_common_thread_config_init(&acq.thread[s].config);
+    tao_common_clock_map_init(&acq.thread[s].clock);
+    acq.thread[s].config.stack_prefault = 64*1024;
+  }
+  acq.thread[NUVU].name = "nuvu";
+  acq.thread[NUVU].config.name = "dual-nuvu";
+  acq.thread[GRASSHOPPER].name = "grasshopper";
+  acq.thread[GRASSHOPPER].config.name = "dual-gh";
+  tao_common_thread_config_init(&acq.mergerConfig);
+
+  if (argc > 1 && !strcmp("--help", argv[1])) {
+    man();
+    return 0;
+  }
+  if (argc%2 != 1) {
+    printf("Wrong argument. use --help to see the manual\n");
+    return 0;
+  }
+  // iterate over the list of options
+  for (int i = 1; i < argc; i += 2) {
+    const char* op = argv[i];
+    const char* val = argv[i + 1];
+    if (strcmp(op, "-m") == 0){
+      if (sscanf(val, "%lf", &acq.minutes) != 1 || acq.minutes <= 0){
+        printf("duration should be a positive number of minutes\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-e") == 0){
+      if (sscanf(val, "%lf", &acq.exposureTime) != 1){
+        printf("exposure time should be a floating point number\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-ge") == 0){
+      if (sscanf(val, "%lf", &acq.ghExposureTime) != 1 || acq.ghExposureTime < 0){
+        printf("Grasshopper exposure time should be a non-negative number\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-tol") == 0){
+      if (sscanf(val, "%lf", &acq.tolerance) != 1 || acq.tolerance < 0){
+        printf("tolerance should be a non-negative number\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-ncpu") == 0){
+      parse_cpus(&acq.thread[NUVU].config, val);
+    }
+    else if (strcmp(op, "-gcpu") == 0){
+      parse_cpus(&acq.thread[GRASSHOPPER].config, val);
+    }
+    else if (strcmp(op, "-mcpu") == 0){
+      parse_cpus(&acq.mergerConfig, val);
+    }
+    else if (strcmp(op, "-prio") == 0){
+      if (sscanf(val, "%d", &priority) != 1){
+        printf("priority should be an integer\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-mlock") == 0){
+      if (sscanf(val, "%d", &lockMemory) != 1){
+        printf("mlock should be 0 or 1\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-rec") == 0){
+      acq.prefix = val;
+    }
+    else if (strcmp(op, "-o") == 0){
+      acq.output = val;
+    }
+    else {
+      printf("Unknown option %s. use --help to see the manual\n", op);
+      return 0;
+    }
+  }
+  for (int s = 0; s < 2; s++) {
+    acq.thread[s].config.priority = priority;
+  }
+  acq.thread[NUVU].config.lock_memory = lockMemory;
+
+  open_nuvu(&acq);
+  open_grasshopper(&acq);
+  if (acq.prefix != NULL) {
+    char path[512];
+    int width, height;
+    if (ncCamGetSize(acq.cam, &width, &height) != NC_SUCCESS) {
+      fatal_error();
+    }
+    snprintf(path, sizeof(path), "%s-nuvu.tfs", acq.prefix);
+    if (tao_common_stream_create(path, width, height, TAO_COMMON_UINT16, "Nuvu",
+                                 "dual acquisition",
+                                 &acq.thread[NUVU].stream) != TAO_OK ||
+        tao_common_recorder_create(acq.thread[NUVU].stream, RECORDER_SLOTS,
+                                   1, NULL, &acq.thread[NUVU].recorder) != TAO_OK) {
+      fatal_error();
+    }
+  }
+  // frames waiting more than 10 tolerances for a partner are given alone
+  if (tao_common_merger_create(4096, (int64_t)(acq.tolerance*1e6),
+                               (int64_t)(10*acq.tolerance*1e6) + 1000000,
+                               &acq.merger) != TAO_OK) {
+    fatal_error();
+  }
+
+  // each camera has its own thread, they never wait for each other
+  printf("Acquiring for %g minute(s)...\n", acq.minutes);
+  acq.endTime = tao_common_monotonic_time() + (int64_t)(acq.minutes*60e9);
+  if (tao_common_thread_create(&threads[NUVU], &acq.thread[NUVU].config,
+                               nuvu_loop, &acq) != TAO_OK ||
+      tao_common_thread_create(&threads[GRASSHOPPER], &acq.thread[GRASSHOPPER].config,
+                               grasshopper_loop, &acq) != TAO_OK) {
+    fatal_error();
+  }
+  if (tao_common_thread_apply(&acq.mergerConfig) != TAO_OK) {
+    tao_common_thread_report(stderr, "dual-merge");
+  }
+  merge(&acq);
+  for (int s = 0; s < 2; s++) {
+    pthread_join(threads[s], NULL);
+    if (acq.thread[s].recorder != NULL) {
+      printf("%-12s recorded = %8llu  dropped = %6llu\n", acq.thread[s].name,
+             (unsigned long long)tao_common_stream_written(acq.thread[s].stream),
+             (unsigned long long)tao_common_recorder_dropped(acq.thread[s].recorder));
+    }
+    if (tao_common_recorder_close(acq.thread[s].recorder) != TAO_OK ||
+        tao_common_stream_close(acq.thread[s].stream) != TAO_OK) {
+      fatal_error();
+    }
+  }
+  tao_common_merger_destroy(acq.merger);
+  close_cameras(&acq);
+  return EXIT_SUCCESS;
+}
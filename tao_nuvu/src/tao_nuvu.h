@@ -3,6 +3,8 @@
 
 #include <tao.h>
 #include "nc_driver.h"
+#include "tao-common.h"
+#include <time.h>
 
 extern void error_push(const char* func, int err);
 
@@ -34,8 +36,9 @@ extern tao_status set_timeout(NcCam cam,int timeTimeout);
 // change EM gain
 /*
 *   function pointer to opeartion on the emMax and emMin
+*   (NULL to use emGainInput clamped to the allowed range)
 */
-extern tao_status change_em_gain(NcCam camera,
+extern tao_status set_em_gain(NcCam camera,
                           int (*emGainOp)(int* num),
                           int emGainInput);
 
@@ -83,6 +86,359 @@ extern tao_status set_temperature(NcCam camera, double	ccdTargetTemp);
 /*---------------------------------------------------------------------------*/
 /* Status*/
 extern tao_status get_framerate(NcCam cam, double* fps);
+extern tao_status get_nbr_dropped_images(NcCam cam, int* nbrDropped);
+
+/*---------------------------------------------------------------------------*/
+/* Telemetry */
+/*
+*   A low priority thread polls the camera status at a fixed rate and publishes
+*   it under a sequence lock, readers never call the driver nor block.
+*/
+typedef struct nuvu_telemetry nuvu_telemetry;
+
+typedef struct nuvu_telemetry_data {
+  double detectorTemp;   // detector temperature (Celsius)
+  double framerate;      // frame rate (Hz)
+  int emGain;            // EM gain (calibrated if available, raw otherwise)
+  int droppedImages;     // number of dropped images
+  int64_t updateTime;    // CLOCK_MONOTONIC of the last update (nsec)
+  long updates;          // number of updates
+  long errors;           // number of failed driver queries
+} nuvu_telemetry_data;
+
+// Start polling every period seconds, cfg may be NULL for a low priority thread
+extern tao_status telemetry_start(NcCam cam, double period,
+                                  const tao_common_thread_config* cfg,
+                                  nuvu_telemetry** tlm_ptr);
+
+// Get the latest values, never calls the driver
+extern void telemetry_read(const nuvu_telemetry* tlm, nuvu_telemetry_data* data);
+
+extern tao_status telemetry_stop(nuvu_telemetry* tlm);
+
+/*---------------------------------------------------------------------------*/
+/* Batch configuration */
+/*
+*   The caller fills a nuvu_config and sets in its mask the fields to apply.
+*   config_apply() checks them all against ranges cached once per camera (and
+*   readout mode) before changing anything, then applies only the changed
+*   settings in dependency order (readout mode, binning and ROI, timing with a
+*   consistent timeout, gains, offset and temperature) and prints one report.
+*/
+enum {
+  NUVU_CONFIG_READOUT_MODE  = 1 << 0,
+  NUVU_CONFIG_EXPOSURE_TIME = 1 << 1,
+  NUVU_CONFIG_WAITING_TIME  = 1 << 2,
+  NUVU_CONFIG_ANALOG_GAIN   = 1 << 3,
+  NUVU_CONFIG_ANALOG_OFFSET = 1 << 4,
+  NUVU_CONFIG_EM_GAIN       = 1 << 5,
+  NUVU_CONFIG_TARGET_TEMP   = 1 << 6,
+  NUVU_CONFIG_ROI           = 1 << 7,
+  NUVU_CONFIG_BINNING       = 1 << 8,
+  NUVU_CONFIG_ALL           = (1 << 9) - 1
+};
+
+enum { NUVU_EM_GAIN_NONE = 0, NUVU_EM_GAIN_CALIBRATED, NUVU_EM_GAIN_RAW };
+
+typedef struct nuvu_config {
+  unsigned mask;          // NUVU_CONFIG_* bits of the fields to apply
+  int readoutMode;
+  double exposureTime;    // msec
+  double waitingTime;     // msec
+  int analogGain;
+  int analogOffset;
+  int emGain;
+  double targetTemp;      // Celsius
+  int roiWidth;           // centered ROI
+  int roiHeight;
+  int binX;
+  int binY;
+  int timeout;            // (output) msec
+  double readoutTime;     // (output) msec
+  unsigned applied;       // (output) bits of the requested fields in effect
+} nuvu_config;
+
+typedef struct nuvu_config_cache {
+  int loaded;
+  int nbrReadoutModes;
+  int maxWidth, maxHeight;
+  double tempMin, tempMax;
+  double emTempMin, emTempMax;      // calibrated EM gain temperatures
+  unsigned binXMask, binYMask;      // bit i set if binning i is supported
+  // depend on the readout mode
+  int analogGainMin, analogGainMax;
+  int analogOffsetMin, analogOffsetMax;
+  int emGainKind;
+  int emGainMin, emGainMax;
+  double readoutTime;
+  nuvu_config current;              // settings of the camera
+  long version;                     // incremented when a setting changes
+  int dispatchers;                  // running dispatchers, see dispatcher_start
+} nuvu_config_cache;
+
+// Empty configuration (nothing to apply)
+extern void config_init(nuvu_config* cfg);
+
+// Query the ranges and the current settings of the camera
+extern tao_status config_load_cache(NcCam cam, nuvu_config_cache* cache);
+
+// Validate and apply a configuration, report may be NULL.  Nothing is changed
+// if a field is invalid or if the ROI or the binning would change while a
+// dispatcher is attached to the cache (TAO_ALREADY_IN_USE).  If the camera refuses a setting, the following ones
+// are not applied and TAO_ERROR is returned: cfg->applied tells which of the
+// requested fields are in effect and the cache still follows the camera.
+extern tao_status config_apply(NcCam cam, nuvu_config_cache* cache,
+                               nuvu_config* cfg, FILE* report);
+
+// Bits of the requested fields of cfg that differ from the camera settings
+extern unsigned config_changes(const nuvu_config* cfg,
+                               const nuvu_config_cache* cache);
+
+// Size in bytes of an image of the cached ROI and binning with pixels of
+// type, 0 if they are not known (no driver call)
+extern size_t config_image_size(const nuvu_config_cache* cache,
+                                tao_common_pixel_type type);
+
+/*---------------------------------------------------------------------------*/
+/* Queued parameter updates */
+/*
+*   Settings requested by any thread are queued and applied by the streaming
+*   thread between two frames.  Only the settings that changed are applied and
+*   the acquisition is only stopped and restarted for settings that need it
+*   (readout mode, ROI).
+*/
+typedef enum nuvu_param {
+  NUVU_PARAM_READOUT_MODE = 0,
+  NUVU_PARAM_EXPOSURE_TIME,     // msec
+  NUVU_PARAM_WAITING_TIME,      // msec
+  NUVU_PARAM_ANALOG_GAIN,
+  NUVU_PARAM_ANALOG_OFFSET,
+  NUVU_PARAM_EM_GAIN,
+  NUVU_PARAM_TARGET_TEMP,       // Celsius
+  NUVU_PARAM_ROI,               // width, height
+  NUVU_NBR_PARAMS
+} nuvu_param;
+
+typedef struct param_queue param_queue;
+
+// Create a queue applying the requests with config_apply() on a loaded cache,
+// requests of the settings the camera already uses are not sent to the
+// driver.  The cache is then only modified by the thread applying requests.
+extern tao_status param_queue_create(nuvu_config_cache* cache,
+                                     param_queue** queue_ptr);
+extern void param_queue_destroy(param_queue* queue);
+
+// Request a new value, yield a ticket (> 0) or -1 on error.  A pending request
+// of the same setting is replaced.
+extern long param_queue_push(param_queue* queue, nuvu_param param,
+                             double value1, double value2);
+
+// Apply the pending requests, to be called by the streaming thread between
+// frames.  frame is the number of the last frame read (-1 if none), streaming
+// is non-zero for a continuous acquisition started by cam_start(cam, 0).
+extern tao_status param_queue_apply(param_queue* queue, NcCam cam, long frame,
+                                    int streaming);
+
+// Wait until the request of a ticket has been handled and get the frame read
+// right after the param_queue_apply() call that took the request, i.e. its
+// frame argument + 1.  In single-shot mode (streaming == 0, as nuvu_daemon)
+// and after a restart, it is the first frame acquired with the requested
+// value.  In continuous streaming without a restart it is only a lower bound:
+// the frames already buffered by the driver, or being exposed, still have the
+// old exposure, gain or waiting time.  A value already in effect gives the
+// same frame (earlier frames then have it too).
+extern tao_status param_queue_wait(param_queue* queue, nuvu_param param,
+                                   long ticket, long* frame_ptr);
+
+// Number of stop/restart cycles done to apply requests
+extern long param_queue_restarts(param_queue* queue);
+
+/*---------------------------------------------------------------------------*/
+/* Clock correlation */
+/*
+*   The camera timer of read_timed_image is fitted to the host CLOCK_MONOTONIC
+*   clock on every frame (robust fit of tao_common_clock_map, see tao-common),
+*   frames then get host comparable time stamps in nanoseconds.
+*/
+typedef struct nuvu_clock {
+  tao_common_clock_map map;   // camera timer (nsec) to CLOCK_MONOTONIC
+  int64_t realtimeOffset;     // CLOCK_REALTIME - CLOCK_MONOTONIC (nsec)
+  int64_t realtimeUpdate;     // CLOCK_MONOTONIC when realtimeOffset was sampled
+} nuvu_clock;
+
+typedef struct nuvu_frame_time {
+  double cameraTime;          // camera timer (msec since reset_timer)
+  int64_t receiveTime;        // CLOCK_MONOTONIC when the frame was read (nsec)
+  int64_t monotonicTime;      // camera time mapped to CLOCK_MONOTONIC (nsec)
+  int64_t realtimeTime;       // camera time mapped to CLOCK_REALTIME (nsec)
+} nuvu_frame_time;
+
+extern void cam_clock_init(nuvu_clock* clk);
+
+// Add a frame read at receiveTime (CLOCK_MONOTONIC, nsec) to the fit and get
+// its time stamps (time may be NULL)
+extern void cam_clock_update(nuvu_clock* clk, double cameraTime,
+                             int64_t receiveTime, nuvu_frame_time* time);
+
+// read_timed_image followed by cam_clock_update
+extern tao_status read_synced_image(NcCam cam, nuvu_clock* clk,
+                                    NcImage** image_ptrptr,
+                                    nuvu_frame_time* time);
+
+/*---------------------------------------------------------------------------*/
+/* Controller time stamps */
+/*
+*   ncCamGetCtrlTimestamp gives a struct tm and a fraction of second.  They are
+*   decoded into nanoseconds since the Epoch (the controller time is taken as
+*   UTC) without calling mktime: the start of the day is only recomputed when
+*   the date changes.  Time stamps without a date (tm_mday = 0) are counted
+*   from the current host day and follow midnight wraps.
+*/
+typedef struct nuvu_ctrl_clock {
+  int year, month, day;   // date of dayStart (struct tm fields)
+  int64_t dayStart;       // nsec since the Epoch at 00:00 of the current day
+  int64_t lastTimeOfDay;  // nsec since midnight of the last time stamp
+} nuvu_ctrl_clock;
+
+extern void ctrl_clock_init(nuvu_ctrl_clock* clk);
+
+// Decode a controller time stamp into nsec since the Epoch
+extern int64_t ctrl_clock_decode(nuvu_ctrl_clock* clk, const struct tm* time,
+                                 double fraction);
+
+// ncCamGetCtrlTimestamp followed by ctrl_clock_decode
+extern tao_status get_ctrl_timestamp(NcCam cam, NcImage* image,
+                                     nuvu_ctrl_clock* clk, int64_t* time_ptr);
+
+/*---------------------------------------------------------------------------*/
+/* Callback dispatcher */
+/*
+*   The driver callback registered with ncCamSetEvent only reads the frame,
+*   copies it in a free slot and queues it.  A pool of workers runs the user
+*   handler on the queued frames, so slow handlers (saving, processing) never
+*   delay the driver.  Frames arriving while all slots are busy are dropped and
+*   counted.  The frame size is taken when the dispatcher starts, it must be
+*   restarted after changing the ROI or the binning: config_apply refuses to
+*   change them while a dispatcher is attached to the configuration cache.
+*/
+typedef struct nuvu_dispatcher nuvu_dispatcher;
+
+typedef struct nuvu_frame {
+  long number;            // frame number since the dispatcher started
+  int worker;             // index of the worker handling the frame
+  nuvu_frame_time time;   // camera and host time stamps
+  int width, height;
+  NcImage* data;          // valid until the handler returns
+} nuvu_frame;
+
+typedef struct nuvu_dispatcher_stats {
+  long received;          // frames signalled by the driver
+  long handled;           // frames given to the handler
+  long failed;            // handled frames for which the handler failed
+  long dropped;           // frames lost because no slot was free
+  long readErrors;        // failed ncCamReadTimed
+} nuvu_dispatcher_stats;
+
+// Handler run by the workers, several frames may be handled concurrently
+typedef tao_status nuvu_frame_handler(NcCam cam, const nuvu_frame* frame,
+                                      void* data);
+
+// Register the callback and start nbrWorkers workers with configuration cfg
+// (NULL for default threads), nbrSlots frames can be waiting or handled.  The
+// dispatcher is attached to cache (NULL or loaded) until it is stopped.
+extern tao_status dispatcher_start(NcCam cam, nuvu_config_cache* cache,
+                                   int nbrSlots, int nbrWorkers,
+                                   const tao_common_thread_config* cfg,
+                                   nuvu_frame_handler* handler, void* data,
+                                   nuvu_dispatcher** disp_ptr);
+
+// Wait until nbrFrames frames have been handled or dropped (timeout in sec)
+extern tao_status dispatcher_wait(nuvu_dispatcher* disp, long nbrFrames,
+                                  double timeout);
+
+extern void dispatcher_get_stats(nuvu_dispatcher* disp,
+                                 nuvu_dispatcher_stats* stats);
+
+// Cancel the callback, handle the queued frames and stop the workers
+extern tao_status dispatcher_stop(nuvu_dispatcher* disp);
+
+/*---------------------------------------------------------------------------*/
+/* FITS header templates */
+/*
+*   The header of saved frames is rendered once per configuration with the
+*   settings of the camera (from a cache loaded by config_load_cache).  Only the
+*   per-frame cards (frame number, date, camera time, detector temperature)
+*   are patched for each frame, instead of building a header through
+*   ncCamSaveImage and header callbacks querying the camera.  The template has
+*   to be created again after the configuration changes, i.e. when the version
+*   of the cache differs from the one the template was rendered with.
+*/
+typedef struct nuvu_fits_template {
+  tao_common_fits_header* header;
+  int frameField, dateField, camTimeField, tempField;
+  long version;             // of the cache the cards come from
+  pthread_mutex_t mutex;    // serializes the patches of the header
+} nuvu_fits_template;
+
+extern tao_status fits_template_create(const nuvu_config_cache* cache,
+                                       int width, int height,
+                                       nuvu_fits_template* tmpl);
+extern void fits_template_destroy(nuvu_fits_template* tmpl);
+
+// Save a 16-bit frame, time may be NULL and detectorTemp is typically taken
+// from the telemetry.  work is a buffer of a frame owned by the calling
+// thread for the big-endian pixels (NULL to allocate one for the call).
+// Several threads can save frames at the same time, only the patch of the
+// header cards is serialized.
+extern tao_status save_fits_frame(nuvu_fits_template* tmpl, const char* path,
+                                  const NcImage* image, long frame,
+                                  const nuvu_frame_time* time,
+                                  double detectorTemp, void* work);
+
+/*---------------------------------------------------------------------------*/
+/* Bias refresh */
+/*
+*   A running bias estimate is kept during streaming.  Every burstPeriod
+*   seconds the streaming thread closes the shutter, keeps burstFrames dark
+*   frames (after settleFrames frames exposed while the shutter moves) and
+*   opens it again: the stream is never stopped, only the frames of the burst
+*   are not data.  A low-priority thread averages the burst, blends it into
+*   the estimate and publishes the new estimate, readers keep the one they
+*   started with.  The drift of the bias between bursts is followed with the
+*   overscan rows (overscanLines rows after the image rows of a raw frame).
+*/
+typedef struct nuvu_bias nuvu_bias;
+
+typedef struct nuvu_bias_config {
+  int burstFrames;          // dark frames per burst
+  double burstPeriod;       // sec between bursts, 0 for a single burst
+  float weight;             // weight of a new burst in the estimate
+  int settleFrames;         // frames skipped after moving the shutter
+  int overscanLines;        // see ncCamGetOverscanLines
+} nuvu_bias_config;
+
+extern void bias_config_init(nuvu_bias_config* cfg);
+extern tao_status bias_create(int width, int height,
+                              const nuvu_bias_config* cfg,
+                              nuvu_bias** bias_ptr);
+extern void bias_destroy(nuvu_bias* bias);
+
+// Give each raw frame to the estimator, from the streaming thread, isData is
+// set to 0 for the dark and settling frames of a burst
+extern tao_status bias_feed(nuvu_bias* bias, NcCam cam, const NcImage* image,
+                            int* isData);
+
+// Number of estimates published so far
+extern long bias_generation(nuvu_bias* bias);
+
+// Linear mode: out = raw - bias (width*height pixels), TAO_NOT_READY before
+// the first estimate
+extern tao_status bias_correct(nuvu_bias* bias, const NcImage* raw,
+                               float* out);
+
+// Photon counting: increment counts where raw - bias is above threshold
+extern tao_status bias_count_photons(nuvu_bias* bias, const NcImage* raw,
+                                     float threshold, uint16_t* counts);
 
 /*-------------------------- Helper Function -------------------------------*/
 // Param availability
@@ -111,8 +467,33 @@ extern tao_status read_image(NcCam cam, NcImage** image_ptrptr);
 
 extern tao_status read_uint16_image(NcCam cam, NcImage** image_ptrptr);
 
-// Don't USE
-extern tao_status read_uint32_image (NcCam cam, uint32_t* image);
+// Read with the camera time stamp (msec since reset_timer)
+extern tao_status read_timed_image(NcCam cam, NcImage** image_ptrptr,
+                                   double* imageTime);
+extern tao_status reset_timer(NcCam cam, double timeOffset);
+
+// Size in bytes of an image of the current ROI with pixels of type, 0 on error
+extern size_t image_size(NcCam cam, tao_common_pixel_type type);
+
+// Read the next image converted to type (TAO_COMMON_UINT16, TAO_COMMON_UINT32
+// or TAO_COMMON_FLOAT32) into image.  size is the size of image in bytes, it
+// must be config_image_size(cache, type): the cache (updated by config_apply)
+// gives the ROI and the binning without querying the driver for every frame
+extern tao_status read_converted_image(NcCam cam,
+                                       const nuvu_config_cache* cache,
+                                       tao_common_pixel_type type,
+                                       void* image, size_t size);
+extern tao_status read_uint32_image(NcCam cam, const nuvu_config_cache* cache,
+                                    uint32_t* image, size_t size);
+extern tao_status read_float_image(NcCam cam, const nuvu_config_cache* cache,
+                                   float* image, size_t size);
+
+// Same in a frame buffer allocated (on buf->node, -1 for any node) at the
+// first call and again when the size of the images changes, buf->data must
+// be NULL before the first call
+extern tao_status read_image_buffer(NcCam cam, const nuvu_config_cache* cache,
+                                    tao_common_pixel_type type,
+                                    tao_common_frame_buffer* buf);
 
 // SaveImage
 extern tao_status save_image(NcCam cam,
@@ -0,0 +1,506 @@
+// tao_nuvu_jitter.c
+// Frame timing jitter benchmark
+// options
+// 1. -m [duration in minutes]
+// 2. -sim [frame rate in Hz] (simulated camera, no hardware needed)
+// 3. -e [exposuretime in msec]
+// 4. -cpu [CPU list of the acquisition thread, e.g. 2,3]
+// 5. -prio [SCHED_FIFO priority of the acquisition thread]
+// 6. -mlock [1 to lock memory]
+// 7. -o [CSV file to dump the per-frame samples]
+// 8. -ctrl [1 to use the controller time stamps instead of the camera timer]
+
+// -----------------------------------------
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE   // RUSAGE_THREAD
+#endif
+#include "tao_nuvu.h"
+#include "tao-common.h"
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define NBR_WORST 10
+
+/* Per-frame sample */
+typedef struct frame_sample {
+  int64_t hostTime;     // CLOCK_MONOTONIC when the frame was read (nsec)
+  double camTime;       // camera time stamp (msec)
+  long minFaults;       // minor page faults since the previous frame
+  long majFaults;       // major page faults since the previous frame
+  long volSwitches;     // voluntary context switches since the previous frame
+  long invSwitches;     // involuntary context switches since the previous frame
+} frame_sample;
+
+/* Benchmark settings and results */
+typedef struct jitter_bench {
+  NcCam cam;
+  double minutes;
+  double simRate;       // > 0 for the simulated camera
+  double exposureTime;
+  int ctrlTime;         // controller time stamps instead of the camera timer
+  const char* output;
+  tao_common_thread_config thread;
+  frame_sample* samples;
+  long capacity;
+  long count;
+  int dropped;
+} jitter_bench;
+
+/* Fatal error */
+static void fatal_error()
+{
+    fprintf(stderr, "Some fatal error has been encountered...\n");
+    if (tao_any_errors()) {
+        tao_report_errors();
+    }
+    exit(EXIT_FAILURE);
+}
+
+// Man page
+static void man(){
+	printf(
+"______ tao_nuvu_jitter program ______ \n\
+syntax: -[option] [numeric value] \n\
+1. -m [duration in minutes] \n\
+2. -sim [frame rate in Hz] (simulated camera) \n\
+3. -e [exposuretime in msec] \n\
+4. -cpu [CPU list of the acquisition thread, e.g. 2,3] \n\
+5. -prio [SCHED_FIFO priority of the acquisition thread] \n\
+6. -mlock [1 to lock memory] \n\
+7. -o [CSV file to dump the per-frame samples] \n\
+8. -ctrl [1 to use the controller time stamps instead of the camera timer] \n\
+\n");
+}
+
+static int64_t monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+/*------ Camera operations ------- */
+static tao_status initialize(jitter_bench* bench)
+{
+  tao_status st = TAO_OK;
+  double readoutTime, fps;
+
+  if (bench->simRate > 0) {
+    bench->capacity = (long)(bench->minutes*60*bench->simRate*1.25) + 16;
+    return TAO_OK;
+  }
+
+  printf("Open camera...\n" );
+  st = cam_open(NC_AUTO_UNIT, NC_AUTO_CHANNEL, 4, &bench->cam);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = set_readout_mode(bench->cam, 1);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = get_readout_time(bench->cam, &readoutTime);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  if (bench->exposureTime < 0) {
+    bench->exposureTime = readoutTime;
+  }
+  st = set_exposure_time(bench->cam, bench->exposureTime);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = set_waiting_time(bench->cam, 0.0);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = set_timeout(bench->cam, (int)(readoutTime + bench->exposureTime) + 1000);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  st = get_framerate(bench->cam, &fps);
+  if( st != TAO_OK){
+     fatal_error();
+  }
+  printf("Expected frame rate = %f Hz\n", fps);
+  bench->capacity = (long)(bench->minutes*60*fps*1.25) + 16;
+  return st;
+}
+
+// Record the time stamps and the system events since the previous frame
+static void record_sample(jitter_bench* bench, double camTime,
+                          struct rusage* prev)
+{
+  struct rusage usage;
+  frame_sample* s = &bench->samples[bench->count++];
+
+  s->hostTime = monotonic_ns();
+  s->camTime = camTime;
+  getrusage(RUSAGE_THREAD, &usage);
+  s->minFaults = usage.ru_minflt - prev->ru_minflt;
+  s->majFaults = usage.ru_majflt - prev->ru_majflt;
+  s->volSwitches = usage.ru_nvcsw - prev->ru_nvcsw;
+  s->invSwitches = usage.ru_nivcsw - prev->ru_nivcsw;
+  *prev = usage;
+}
+
+// Simulated camera: frames are produced on a fixed schedule of the host
+// clock so that the measured jitter is the wake-up latency of the thread.
+static void simulated_loop(jitter_bench* bench, int64_t endTime)
+{
+  struct rusage prev;
+  struct timespec deadline;
+  int64_t period = (int64_t)(1e9/bench->simRate);
+  int64_t t0 = monotonic_ns();
+  int64_t next = t0;
+
+  getrusage(RUSAGE_THREAD, &prev);
+  while (bench->count < bench->capacity) {
+    next += period;
+    if (next > endTime) {
+      break;
+    }
+    deadline.tv_sec = next/1000000000;
+    deadline.tv_nsec = next%1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0)
+      ;
+    record_sample(bench, (next - t0)/1e6, &prev);
+  }
+}
+
+static void camera_loop(jitter_bench* bench, int64_t endTime)
+{
+  tao_status st = TAO_OK;
+  struct rusage prev;
+  NcImage* image;
+  double camTime;
+  nuvu_ctrl_clock ctrlClock;
+  int64_t ctrlTime, ctrlStart = 0;
+
+  st = reset_timer(bench->cam, 0.0);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  st = set_shuttermode(bench->cam, OPEN);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  // continuous acquisition
+  st = cam_start(bench->cam, 0);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  ctrl_clock_init(&ctrlClock);
+  getrusage(RUSAGE_THREAD, &prev);
+  while (bench->count < bench->capacity && monotonic_ns() < endTime) {
+    if (bench->ctrlTime) {
+      st = read_image(bench->cam, &image);
+      if (st == TAO_OK) {
+        st = get_ctrl_timestamp(bench->cam, image, &ctrlClock, &ctrlTime);
+      }
+      if (bench->count == 0) {
+        ctrlStart = ctrlTime;
+      }
+      camTime = (ctrlTime - ctrlStart)*1e-6;
+    } else {
+      st = read_timed_image(bench->cam, &image, &camTime);
+    }
+    if (st != TAO_OK) {
+      fatal_error();
+    }
+    record_sample(bench, camTime, &prev);
+  }
+  cam_abort(bench->cam);
+  get_nbr_dropped_images(bench->cam, &bench->dropped);
+  set_shuttermode(bench->cam, CLOSE);
+}
+
+// acquisition thread
+static void* acquisition(void* arg)
+{
+  jitter_bench* bench = arg;
+  int64_t endTime = monotonic_ns() + (int64_t)(bench->minutes*60e9);
+
+  if (bench->simRate > 0) {
+    simulated_loop(bench, endTime);
+  } else {
+    camera_loop(bench, endTime);
+  }
+  return NULL;
+}
+
+/*------ Analysis ------- */
+static int compare_double(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+// Percentile of sorted values
+static double percentile(const double* sorted, long n, double p)
+{
+  long i = (long)floor(p/100.0*(n - 1) + 0.5);
+  return sorted[i < 0 ? 0 : (i >= n ? n - 1 : i)];
+}
+
+// Print the distribution of the intervals (nsec) in usec, yield the median
+static double print_distribution(const char* title, const double* dt, long n)
+{
+  double* sorted = malloc(n*sizeof(double));
+  double mean = 0, var = 0, median;
+
+  memcpy(sorted, dt, n*sizeof(double));
+  qsort(sorted, n, sizeof(double), compare_double);
+  for (long i = 0; i < n; i++) {
+    mean += dt[i];
+  }
+  mean /= n;
+  for (long i = 0; i < n; i++) {
+    var += (dt[i] - mean)*(dt[i] - mean);
+  }
+  median = percentile(sorted, n, 50);
+  printf("%-8s mean = %10.3f  std = %8.3f  min = %10.3f  p1 = %10.3f  "
+         "p50 = %10.3f  p99 = %10.3f  p99.9 = %10.3f  max = %10.3f (usec)\n",
+         title, mean/1e3, sqrt(var/n)/1e3, sorted[0]/1e3,
+         percentile(sorted, n, 1)/1e3, median/1e3,
+         percentile(sorted, n, 99)/1e3, percentile(sorted, n, 99.9)/1e3,
+         sorted[n - 1]/1e3);
+  free(sorted);
+  return median;
+}
+
+// Mean interval of the frames with and without an event
+static void print_conditional(const char* event, const frame_sample* s,
+                              const double* dt, long n, int (*has)(const frame_sample*))
+{
+  double sumWith = 0, sumWithout = 0, maxWith = 0;
+  long nWith = 0;
+
+  for (long i = 0; i < n; i++) {
+    if (has(&s[i + 1])) {
+      sumWith += dt[i];
+      maxWith = (dt[i] > maxWith ? dt[i] : maxWith);
+      nWith++;
+    } else {
+      sumWithout += dt[i];
+    }
+  }
+  printf("%-22s %8ld frames (%6.3f%%), mean interval %10.3f usec "
+         "(max %10.3f) vs %10.3f usec without\n", event, nWith,
+         100.0*nWith/n, (nWith > 0 ? sumWith/nWith/1e3 : 0), maxWith/1e3,
+         (n > nWith ? sumWithout/(n - nWith)/1e3 : 0));
+}
+
+static int has_fault(const frame_sample* s)
+{
+  return s->minFaults + s->majFaults > 0;
+}
+
+static int has_involuntary_switch(const frame_sample* s)
+{
+  return s->invSwitches > 0;
+}
+
+static int has_voluntary_switch(const frame_sample* s)
+{
+  return s->volSwitches > 0;
+}
+
+static void report(const jitter_bench* bench)
+{
+  long n = bench->count - 1;
+  const frame_sample* s = bench->samples;
+
+  if (n < 2) {
+    printf("Not enough frames (%ld) to compute statistics\n", bench->count);
+    return;
+  }
+  double* dtHost = malloc(n*sizeof(double));
+  double* dtCam = malloc(n*sizeof(double));
+  for (long i = 0; i < n; i++) {
+    dtHost[i] = (double)(s[i + 1].hostTime - s[i].hostTime);
+    dtCam[i] = (s[i + 1].camTime - s[i].camTime)*1e6;
+  }
+
+  printf("\n===== Inter-frame intervals (%ld frames, %s) =====\n",
+         bench->count, (bench->simRate > 0 ? "simulated" : "camera"));
+  print_distribution("host", dtHost, n);
+  double camMedian = print_distribution("camera", dtCam, n);
+
+  // jitter of the host interval with respect to the nominal period
+  double* jitter = malloc(n*sizeof(double));
+  for (long i = 0; i < n; i++) {
+    jitter[i] = fabs(dtHost[i] - camMedian);
+  }
+  print_distribution("|jitter|", jitter, n);
+
+  // worst gaps
+  long worst[NBR_WORST];
+  int nworst = 0;
+  for (long i = 0; i < n; i++) {
+    int k = nworst;
+    if (k == NBR_WORST) {
+      if (dtHost[i] <= dtHost[worst[k - 1]]) {
+        continue;
+      }
+      k--;
+    } else {
+      nworst++;
+    }
+    while (k > 0 && dtHost[worst[k - 1]] < dtHost[i]) {
+      worst[k] = worst[k - 1];
+      k--;
+    }
+    worst[k] = i;
+  }
+  printf("\n===== Worst host gaps =====\n");
+  printf("   frame  host (usec)  camera (usec)  minflt  majflt  nvcsw  nivcsw\n");
+  for (int k = 0; k < nworst; k++) {
+    const frame_sample* w = &s[worst[k] + 1];
+    printf("%8ld %12.3f %14.3f %7ld %7ld %6ld %7ld\n", worst[k] + 1,
+           dtHost[worst[k]]/1e3, dtCam[worst[k]]/1e3, w->minFaults,
+           w->majFaults, w->volSwitches, w->invSwitches);
+  }
+
+  // correlation with system events
+  printf("\n===== Correlation with system events =====\n");
+  print_conditional("page faults", s, dtHost, n, has_fault);
+  print_conditional("involuntary switches", s, dtHost, n, has_involuntary_switch);
+  print_conditional("voluntary switches", s, dtHost, n, has_voluntary_switch);
+
+  // frames lost by the camera (gaps in the camera time stamps)
+  long gaps = 0;
+  for (long i = 0; i < n; i++) {
+    if (dtCam[i] > 1.5*camMedian) {
+      gaps++;
+    }
+  }
+  printf("\nCamera time stamp gaps > 1.5 period = %ld, dropped images = %d\n",
+         gaps, bench->dropped);
+  if (bench->count == bench->capacity) {
+    printf("WARNING: sample buffer full, the run was shortened\n");
+  }
+  free(jitter);
+  free(dtCam);
+  free(dtHost);
+}
+
+static void dump(const jitter_bench* bench)
+{
+  FILE* file = fopen(bench->output, "w");
+  if (file == NULL) {
+    printf("Cannot open \"%s\"\n", bench->output);
+    return;
+  }
+  fprintf(file, "frame,host_ns,camera_ms,minflt,majflt,nvcsw,nivcsw\n");
+  for (long i = 0; i < bench->count; i++) {
+    const frame_sample* s = &bench->samples[i];
+    fprintf(file, "%ld,%lld,%.6f,%ld,%ld,%ld,%ld\n", i, (long long)s->hostTime,
+            s->camTime, s->minFaults, s->majFaults, s->volSwitches,
+            s->invSwitches);
+  }
+  fclose(file);
+}
+
+int main(int argc, char* argv[]) {
+  jitter_bench bench;
+  pthread_t thread;
+
+  memset(&bench, 0, sizeof(bench));
+  bench.minutes = 1.0;
+  bench.exposureTime = -1;
+  tao_common_thread_config_init(&bench.thread);
+  bench.thread.name = "jitter-acq";
+  bench.thread.stack_prefault = 64*1024;
+
+  if (argc > 1 && !strcmp("--help", argv[1])) {
+    man();
+    return 0;
+  }
+  if (argc%2 != 1) {
+    printf("Wrong argument. use --help to see the manual\n");
+    return 0;
+  }
+  // iterate over the list of options
+  for (int i = 1; i < argc; i += 2) {
+    const char* op = argv[i];
+    const char* val = argv[i + 1];
+    if (strcmp(op, "-m") == 0){
+      if (sscanf(val, "%lf", &bench.minutes) != 1 || bench.minutes <= 0){
+        printf("duration should be a positive number of minutes\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-sim") == 0){
+      if (sscanf(val, "%lf", &bench.simRate) != 1 || bench.simRate <= 0){
+        printf("simulated frame rate should be a positive number\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-e") == 0){
+      if (sscanf(val, "%lf", &bench.exposureTime) != 1){
+        printf("exposure time should be a floating point number\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-cpu") == 0){
+      if (tao_common_thread_config_parse_cpus(&bench.thread, val) != TAO_OK){
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-prio") == 0){
+      if (sscanf(val, "%d", &bench.thread.priority) != 1){
+        printf("priority should be an integer\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-mlock") == 0){
+      if (sscanf(val, "%d", &bench.thread.lock_memory) != 1){
+        printf("mlock should be 0 or 1\n");
+        fatal_error();
+      }
+    }
+    else if (strcmp(op, "-o") == 0){
+      bench.output = val;
+    }
+    else if (strcmp(op, "-ctrl") == 0){
+      if (sscanf(val, "%d", &bench.ctrlTime) != 1){
+        printf("ctrl should be 0 or 1\n");
+        fatal_error();
+      }
+    }
+    else {
+      printf("Unknown option %s. use --help to see the manual\n", op);
+      return 0;
+    }
+  }
+
+  if (initialize(&bench) != TAO_OK) {
+    fatal_error();
+  }
+  bench.samples = malloc(bench.capacity*sizeof(frame_sample));
+  if (bench.samples == NULL) {
+    printf("Cannot allocate %ld samples\n", bench.capacity);
+    fatal_error();
+  }
+  // fault the sample buffer in before measuring
+  tao_common_memory_prefault(bench.samples, bench.capacity*sizeof(frame_sample));
+
+  printf("Streaming for %g minute(s)...\n", bench.minutes);
+  if (tao_common_thread_create(&thread, &bench.thread, acquisition, &bench) != TAO_OK) {
+    fatal_error();
+  }
+  pthread_join(thread, NULL);
+
+  report(&bench);
+  if (bench.output != NULL) {
+    dump(&bench);
+  }
+  if (bench.cam != NULL && cam_close(bench.cam) != TAO_OK) {
+    fatal_error();
+  }
+  free(bench.samples);
+  return EXIT_SUCCESS;
+}
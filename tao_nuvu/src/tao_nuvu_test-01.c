@@ -74,11 +74,26 @@ tao_status initialize(NcCam* cam){
 /*Acquisition*/
 tao_status continuousAcquisition(NcCam cam, int nbrImagesToSave){
   tao_status  st = TAO_OK;
-  int		i;
-  char	imageName[31];
+  int		i, width, height;
+  const char* streamName = "Images.tfs";
+  tao_common_stream_writer* stream = NULL;
+  tao_common_frame_info info;
+  nuvu_clock clock;
+  nuvu_frame_time time;
 
   NcImage	*ncImage;
 
+  // all images go to a single indexed stream
+  if (ncCamGetSize(cam, &width, &height) != NC_SUCCESS) {
+    fatal_error();
+  }
+  st = tao_common_stream_create(streamName, width, height, TAO_COMMON_UINT16,
+                                "Nuvu", "Image acquired in continuous acquisition",
+                                &stream);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+
   // open shutter
   enum ShutterMode mode = OPEN;
   st = set_shuttermode(cam, mode);
@@ -87,6 +102,7 @@ tao_status continuousAcquisition(NcCam cam, int nbrImagesToSave){
   }
   printf("Acquiring images...\n" );
   // start acquisition
+  cam_clock_init(&clock);
   st = cam_start(cam, nbrImagesToSave);
   if (st != TAO_OK) {
     fatal_error();
@@ -94,22 +110,28 @@ tao_status continuousAcquisition(NcCam cam, int nbrImagesToSave){
 
   // Loop to read images
   for(i = 0; i< nbrImagesToSave; i++){
-    // create image name
-  	sprintf(imageName, "Image_%d", i);
     printf("Reading image %d \n", i );
-    st = read_uint16_image(cam,&ncImage)  ;
+    st = read_synced_image(cam, &clock, &ncImage, &time);
     if(st != TAO_OK){
       fatal_error();
     }
 
-    printf("Saving image \"%s\"\n", imageName);
-    st = save_image(cam, ncImage, imageName, FITS, "Image acquired in continuous acquisition", 1);
-
+    info.id = i;
+    info.host_time = time.monotonicTime;
+    info.camera_time = (int64_t)(time.cameraTime*1e6);
+    info.orientation = TAO_COMMON_ORIENT_NONE;
+    st = tao_common_stream_append(stream, ncImage, &info);
     if(st != TAO_OK){
       fatal_error();
     }
 
   }
+  printf("Images saved in \"%s\" (tao_stream_to_fits converts them to FITS)\n",
+         streamName);
+  st = tao_common_stream_close(stream);
+  if(st != TAO_OK){
+    fatal_error();
+  }
 
   // abort acquisition
   st = cam_abort(cam);
@@ -128,6 +150,236 @@ tao_status continuousAcquisition(NcCam cam, int nbrImagesToSave){
 }
 
 
+/*Callback acquisition*/
+#define SAVE_WORKERS 2
+
+typedef struct saveContext {
+  nuvu_fits_template tmpl;
+  double detectorTemp;      // read once, not for every frame
+  void* work[SAVE_WORKERS]; // big-endian pixels of each worker
+} saveContext;
+
+// Run by the dispatcher workers: saving is slow but does not delay the driver
+static tao_status saveFrame(NcCam cam, const nuvu_frame* frame, void* data){
+  saveContext* ctx = data;
+  char name[64];
+  snprintf(name, sizeof(name), "callbackImage-%ld.fits", frame->number);
+  printf("Saving image %ld (camera time %.3f msec, latency %.3f msec)\n",
+         frame->number, frame->time.cameraTime,
+         (frame->time.receiveTime - frame->time.monotonicTime)*1e-6);
+  return save_fits_frame(&ctx->tmpl, name, frame->data, frame->number,
+                         &frame->time, ctx->detectorTemp,
+                         ctx->work[frame->worker]);
+}
+
+tao_status callbackAcquisition(NcCam cam, int nbrImages){
+  tao_status st = TAO_OK;
+  nuvu_dispatcher* disp = NULL;
+  nuvu_dispatcher_stats stats;
+  nuvu_config_cache cache;
+  saveContext ctx;
+  int width, height;
+
+  // the header of the saved frames is rendered once
+  if (config_load_cache(cam, &cache) != TAO_OK ||
+      detector_temperature(cam, &ctx.detectorTemp) != TAO_OK) {
+    fatal_error();
+  }
+  if (ncCamGetSize(cam, &width, &height) != NC_SUCCESS) {
+    fatal_error();
+  }
+  if (fits_template_create(&cache, width, height, &ctx.tmpl) != TAO_OK) {
+    fatal_error();
+  }
+  for (int i = 0; i < SAVE_WORKERS; i++) {
+    ctx.work[i] = malloc((size_t)width*height*sizeof(NcImage));
+    if (ctx.work[i] == NULL) {
+      fatal_error();
+    }
+  }
+
+  // 4 slots, the workers save frames concurrently
+  st = dispatcher_start(cam, &cache, 4, SAVE_WORKERS, NULL, saveFrame, &ctx,
+                        &disp);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  st = set_shuttermode(cam, OPEN);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  st = cam_start(cam, nbrImages);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+
+  // wait for the handlers instead of polling a flag
+  st = dispatcher_wait(disp, nbrImages, 10.0);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  dispatcher_get_stats(disp, &stats);
+  printf("Callback acquisition: %ld received, %ld saved, %ld dropped\n",
+         stats.received, stats.handled - stats.failed, stats.dropped);
+  st = dispatcher_stop(disp);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  fits_template_destroy(&ctx.tmpl);
+  for (int i = 0; i < SAVE_WORKERS; i++) {
+    free(ctx.work[i]);
+  }
+
+  st = set_shuttermode(cam, CLOSE);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  return st;
+}
+
+
+/*Streaming with bias refresh*/
+tao_status biasRefreshAcquisition(NcCam cam, int nbrImages){
+  tao_status st = TAO_OK;
+  nuvu_bias_config cfg;
+  nuvu_bias* bias = NULL;
+  NcImage* ncImage;
+  float* corrected;
+  int width, height, isData;
+  long nbrData = 0, nbrCorrected = 0;
+  double level = 0;
+
+  if (ncCamGetSize(cam, &width, &height) != NC_SUCCESS) {
+    fatal_error();
+  }
+  // a burst every second, the first one right away
+  bias_config_init(&cfg);
+  cfg.burstPeriod = 1.0;
+  if (ncCamGetOverscanLines(cam, &cfg.overscanLines) != NC_SUCCESS) {
+    fatal_error();
+  }
+  st = bias_create(width, height, &cfg, &bias);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  corrected = malloc(width*height*sizeof(float));
+  if (corrected == NULL) {
+    fatal_error();
+  }
+  st = set_shuttermode(cam, OPEN);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  st = cam_start(cam, 0);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  for (int i = 0; i < nbrImages; i++) {
+    st = read_image(cam, &ncImage);
+    if (st != TAO_OK || bias_feed(bias, cam, ncImage, &isData) != TAO_OK) {
+      fatal_error();
+    }
+    if (!isData) {
+      continue;
+    }
+    nbrData += 1;
+    // the frames before the first estimate are not corrected
+    if (bias_generation(bias) > 0 &&
+        bias_correct(bias, ncImage, corrected) == TAO_OK) {
+      nbrCorrected += 1;
+      level += corrected[(height/2)*width + width/2];
+    }
+  }
+  st = cam_abort(cam);
+  if (st != TAO_OK) {
+    printf("Cannot abort acquisition \n" );
+  }
+  printf("Bias refresh: %ld estimates, %ld/%d data frames, mean level %.1f\n",
+         bias_generation(bias), nbrData, nbrImages,
+         (nbrCorrected > 0 ? level/nbrCorrected : 0.0));
+  bias_destroy(bias);
+  free(corrected);
+
+  st = set_shuttermode(cam, CLOSE);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  return st;
+}
+
+
+/*Co-added acquisition*/
+tao_status coaddAcquisition(NcCam cam, int nbrImages, int window){
+  tao_status st = TAO_OK;
+  const char* streamName = "Stacked.tfs";
+  tao_common_stream_writer* stream = NULL;
+  tao_common_coadd* coadd = NULL;
+  tao_common_pool* pool = NULL;
+  tao_common_frame_info info;
+  nuvu_clock clock;
+  nuvu_frame_time time;
+  NcImage* ncImage;
+  int width, height;
+
+  if (ncCamGetSize(cam, &width, &height) != NC_SUCCESS) {
+    fatal_error();
+  }
+  // 32-bit sums of the windows are recorded, rows are added by 2 threads
+  // and the reading thread
+  if (tao_common_pool_create(2, NULL, &pool) != TAO_OK ||
+      tao_common_stream_create(streamName, width, height, TAO_COMMON_UINT32,
+                               "Nuvu", "Co-added frames", &stream) != TAO_OK ||
+      tao_common_coadd_create(width, height, TAO_COMMON_UINT32, window, pool,
+                              stream, &coadd) != TAO_OK) {
+    fatal_error();
+  }
+  st = set_shuttermode(cam, OPEN);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  cam_clock_init(&clock);
+  st = cam_start(cam, nbrImages);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  for (int i = 0; i < nbrImages; i++) {
+    st = read_synced_image(cam, &clock, &ncImage, &time);
+    if (st != TAO_OK) {
+      fatal_error();
+    }
+    info.id = i;
+    info.host_time = time.monotonicTime;
+    info.camera_time = (int64_t)(time.cameraTime*1e6);
+    info.orientation = TAO_COMMON_ORIENT_NONE;
+    st = tao_common_coadd_add(coadd, ncImage, &info, NULL);
+    if (st != TAO_OK) {
+      fatal_error();
+    }
+  }
+  // the last window may be incomplete
+  if (tao_common_coadd_flush(coadd, NULL, NULL) != TAO_OK) {
+    fatal_error();
+  }
+  printf("%ld stacks of %d frames saved in \"%s\"\n",
+         (long)tao_common_coadd_stacks(coadd), window, streamName);
+  tao_common_coadd_destroy(coadd);
+  if (tao_common_stream_close(stream) != TAO_OK) {
+    fatal_error();
+  }
+  tao_common_pool_destroy(pool);
+
+  st = cam_abort(cam);
+  if (st != TAO_OK) {
+    printf("Cannot abort acquisition \n" );
+  }
+  st = set_shuttermode(cam, CLOSE);
+  if (st != TAO_OK) {
+    fatal_error();
+  }
+  return st;
+}
+
+
 int main(int argc, char const *argv[]) {
   NcCam	cam = NULL;
   tao_status status = TAO_OK;
@@ -144,6 +396,15 @@ int main(int argc, char const *argv[]) {
 	status = continuousAcquisition(cam, nbrImagesToSave);
 
 	}
+  if (status == TAO_OK) {
+    status = callbackAcquisition(cam, nbrImagesToSave);
+  }
+  if (status == TAO_OK) {
+    status = biasRefreshAcquisition(cam, 100);
+  }
+  if (status == TAO_OK) {
+    status = coaddAcquisition(cam, 100, 10);
+  }
 
   if (status != TAO_OK) {
     fatal_error();
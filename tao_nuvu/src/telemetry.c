@@ -0,0 +1,166 @@
+#include "tao_nuvu.h"
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+/* Telemetry */
+
+// EM gain query available on the camera
+enum { EM_GAIN_NONE = 0, EM_GAIN_CALIBRATED, EM_GAIN_RAW };
+
+struct nuvu_telemetry {
+  NcCam cam;
+  double period;                  // polling period (sec)
+  int emGainKind;
+  volatile int running;
+  pthread_t thread;
+  pthread_mutex_t mutex;          // to wake up the thread when stopping
+  pthread_cond_t cond;
+  tao_common_seqlock lock;
+  nuvu_telemetry_data data;
+};
+
+static int64_t monotonic_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+// Query the driver and publish the values.  Values that cannot be read keep
+// their previous value and the error is counted.
+static void telemetry_poll(nuvu_telemetry* tlm)
+{
+  nuvu_telemetry_data data = tlm->data;   // only this thread writes it
+  int err;
+
+  err = ncCamGetDetectorTemp(tlm->cam, &data.detectorTemp);
+  data.errors += (err != NC_SUCCESS);
+  err = ncCamGetFramerate(tlm->cam, &data.framerate);
+  data.errors += (err != NC_SUCCESS);
+  if (tlm->emGainKind == EM_GAIN_CALIBRATED) {
+    err = ncCamGetCalibratedEmGain(tlm->cam, 1, &data.emGain);
+    data.errors += (err != NC_SUCCESS);
+  } else if (tlm->emGainKind == EM_GAIN_RAW) {
+    err = ncCamGetRawEmGain(tlm->cam, 1, &data.emGain);
+    data.errors += (err != NC_SUCCESS);
+  }
+  err = ncCamGetNbrDroppedImages(tlm->cam, &data.droppedImages);
+  data.errors += (err != NC_SUCCESS);
+  data.updateTime = monotonic_ns();
+  data.updates += 1;
+
+  tao_common_seqlock_write_begin(&tlm->lock);
+  tlm->data = data;
+  tao_common_seqlock_write_end(&tlm->lock);
+}
+
+static void* telemetry_loop(void* arg)
+{
+  nuvu_telemetry* tlm = arg;
+  struct timespec deadline;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  pthread_mutex_lock(&tlm->mutex);
+  while (tlm->running) {
+    pthread_mutex_unlock(&tlm->mutex);
+    telemetry_poll(tlm);
+    pthread_mutex_lock(&tlm->mutex);
+
+    double sec = floor(tlm->period);
+    deadline.tv_sec += (time_t)sec;
+    deadline.tv_nsec += (long)((tlm->period - sec)*1e9);
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+    while (tlm->running &&
+           pthread_cond_timedwait(&tlm->cond, &tlm->mutex, &deadline) != ETIMEDOUT)
+      ;
+  }
+  pthread_mutex_unlock(&tlm->mutex);
+  return NULL;
+}
+
+tao_status telemetry_start(NcCam cam, double period,
+                           const tao_common_thread_config* cfg,
+                           nuvu_telemetry** tlm_ptr)
+{
+  tao_common_thread_config defaultConfig;
+  pthread_condattr_t attr;
+  nuvu_telemetry* tlm;
+  enum Ampli ampliType;
+  int readoutMode, err;
+
+  *tlm_ptr = NULL;
+  if (!(period > 0)) {
+    tao_push_error(__func__, TAO_BAD_VALUE);
+    return TAO_ERROR;
+  }
+  tlm = calloc(1, sizeof(nuvu_telemetry));
+  if (tlm == NULL) {
+    tao_push_error(__func__, errno);
+    return TAO_ERROR;
+  }
+  tlm->cam = cam;
+  tlm->period = period;
+  tlm->running = 1;
+
+  // Find out once which EM gain can be queried
+  tlm->emGainKind = EM_GAIN_NONE;
+  err = ncCamGetCurrentReadoutMode(cam, &readoutMode, &ampliType, 0, 0, 0);
+  if (err == NC_SUCCESS && ampliType == EM) {
+    if (ncCamParamAvailable(cam, CALIBRATED_EM_GAIN, 0) == NC_SUCCESS) {
+      tlm->emGainKind = EM_GAIN_CALIBRATED;
+    } else if (ncCamParamAvailable(cam, RAW_EM_GAIN, 0) == NC_SUCCESS) {
+      tlm->emGainKind = EM_GAIN_RAW;
+    }
+  }
+
+  pthread_mutex_init(&tlm->mutex, NULL);
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&tlm->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  // publish a first sample before returning so that readers get valid values
+  telemetry_poll(tlm);
+
+  if (cfg == NULL) {
+    // low priority by default, telemetry must never delay acquisition
+    tao_common_thread_config_init(&defaultConfig);
+    defaultConfig.name = "nuvu-telemetry";
+    defaultConfig.nice = 10;
+    cfg = &defaultConfig;
+  }
+  if (tao_common_thread_create(&tlm->thread, cfg, telemetry_loop, tlm) != TAO_OK) {
+    pthread_cond_destroy(&tlm->cond);
+    pthread_mutex_destroy(&tlm->mutex);
+    free(tlm);
+    return TAO_ERROR;
+  }
+  *tlm_ptr = tlm;
+  return TAO_OK;
+}
+
+void telemetry_read(const nuvu_telemetry* tlm, nuvu_telemetry_data* data)
+{
+  tao_common_seqlock_read(&tlm->lock, data, &tlm->data, sizeof(*data));
+}
+
+tao_status telemetry_stop(nuvu_telemetry* tlm)
+{
+  if (tlm == NULL) {
+    return TAO_OK;
+  }
+  pthread_mutex_lock(&tlm->mutex);
+  tlm->running = 0;
+  pthread_cond_signal(&tlm->cond);
+  pthread_mutex_unlock(&tlm->mutex);
+  pthread_join(tlm->thread, NULL);
+  pthread_cond_destroy(&tlm->cond);
+  pthread_mutex_destroy(&tlm->mutex);
+  free(tlm);
+  return TAO_OK;
+}
@@ -0,0 +1,127 @@
+#include "tao_nuvu.h"
+#include <time.h>
+
+/*---------------------------------------------------------------------------*/
+/* Clock correlation */
+
+// Period of the sampling of the realtime clock offset (nsec)
+#define REALTIME_PERIOD 1000000000
+
+void cam_clock_init(nuvu_clock* clk)
+{
+  tao_common_clock_map_init(&clk->map);
+  clk->realtimeOffset = tao_common_realtime_offset();
+  clk->realtimeUpdate = tao_common_monotonic_time();
+}
+
+void cam_clock_update(nuvu_clock* clk, double cameraTime, int64_t receiveTime,
+                      nuvu_frame_time* time)
+{
+  int64_t camera = (int64_t)(cameraTime*1e6);
+
+  tao_common_clock_map_update(&clk->map, camera, receiveTime);
+  // follow the adjustments of the system clock
+  if (receiveTime - clk->realtimeUpdate >= REALTIME_PERIOD) {
+    clk->realtimeOffset = tao_common_realtime_offset();
+    clk->realtimeUpdate = receiveTime;
+  }
+  if (time != NULL) {
+    time->cameraTime = cameraTime;
+    time->receiveTime = receiveTime;
+    time->monotonicTime = tao_common_clock_map_to_host(&clk->map, camera);
+    time->realtimeTime = time->monotonicTime + clk->realtimeOffset;
+  }
+}
+
+tao_status read_synced_image(NcCam cam, nuvu_clock* clk,
+                             NcImage** image_ptrptr, nuvu_frame_time* time)
+{
+  double cameraTime;
+
+  if (read_timed_image(cam, image_ptrptr, &cameraTime) != TAO_OK) {
+    return TAO_ERROR;
+  }
+  cam_clock_update(clk, cameraTime, tao_common_monotonic_time(), time);
+  return TAO_OK;
+}
+
+/*---------------------------------------------------------------------------*/
+/* Controller time stamps */
+
+#define NSEC_PER_DAY ((int64_t)86400*1000000000)
+#define NSEC_HALF_DAY (NSEC_PER_DAY/2)
+
+// Days since 1970-01-01 of a date of the proleptic Gregorian calendar
+// (month = 1..12), no time zone involved unlike mktime
+static int64_t days_from_civil(int64_t year, int month, int day)
+{
+  year -= (month <= 2);
+  int64_t era = (year >= 0 ? year : year - 399)/400;
+  int64_t yoe = year - era*400;
+  int64_t doy = (153*(month + (month > 2 ? -3 : 9)) + 2)/5 + day - 1;
+  int64_t doe = yoe*365 + yoe/4 - yoe/100 + doy;
+  return era*146097 + doe - 719468;
+}
+
+void ctrl_clock_init(nuvu_ctrl_clock* clk)
+{
+  clk->year = -1;
+  clk->month = -1;
+  clk->day = -1;
+  clk->dayStart = -1;
+  clk->lastTimeOfDay = 0;
+}
+
+int64_t ctrl_clock_decode(nuvu_ctrl_clock* clk, const struct tm* time,
+                          double fraction)
+{
+  int64_t timeOfDay = ((int64_t)((time->tm_hour*60 + time->tm_min)*60 +
+                                 time->tm_sec))*1000000000 +
+    (int64_t)(fraction*1e9 + 0.5);
+
+  if (time->tm_mday >= 1) {
+    // dated time stamp, the day is only converted when it changes
+    if (time->tm_mday != clk->day || time->tm_mon != clk->month ||
+        time->tm_year != clk->year) {
+      clk->year = time->tm_year;
+      clk->month = time->tm_mon;
+      clk->day = time->tm_mday;
+      clk->dayStart = days_from_civil(1900 + (int64_t)time->tm_year,
+                                      time->tm_mon + 1, time->tm_mday)*NSEC_PER_DAY;
+    }
+  } else if (clk->dayStart < 0) {
+    // time of day only: start from the host day, the controller and the host
+    // may be on each side of midnight
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t now = (int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+    clk->dayStart = now - now%NSEC_PER_DAY;
+    int64_t diff = timeOfDay - now%NSEC_PER_DAY;
+    if (diff > NSEC_HALF_DAY) {
+      clk->dayStart -= NSEC_PER_DAY;
+    } else if (diff < -NSEC_HALF_DAY) {
+      clk->dayStart += NSEC_PER_DAY;
+    }
+  } else if (timeOfDay < clk->lastTimeOfDay - NSEC_HALF_DAY) {
+    // time of day only: wrapped at midnight
+    clk->dayStart += NSEC_PER_DAY;
+  }
+  clk->lastTimeOfDay = timeOfDay;
+  return clk->dayStart + timeOfDay;
+}
+
+tao_status get_ctrl_timestamp(NcCam cam, NcImage* image, nuvu_ctrl_clock* clk,
+                              int64_t* time_ptr)
+{
+  struct tm dateTime;
+  double fraction;
+  int status;
+
+  int err = ncCamGetCtrlTimestamp(cam, image, &dateTime, &fraction, &status);
+  if (err) {
+    error_push(__func__, err);
+    return TAO_ERROR;
+  }
+  *time_ptr = ctrl_clock_decode(clk, &dateTime, fraction);
+  return TAO_OK;
+}